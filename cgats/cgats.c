@@ -73,6 +73,7 @@ extern void error(const char *fmt, ...), warning(const char *fmt, ...);
 
 #undef  EMIT_KEYWORDS		/* [und] Emit unknown keywords by default */
 #define REAL_SIGDIG 6		/* [6] Number of significant digits in real representation */
+#define WBUF_SIZE 65536		/* [65536] Size of buffer data sets are formatted into */
 
 static int cgats_read(cgats *p, cgatsFile *fp);
 static int find_kword(cgats *p, int table, const char *ksym);
@@ -87,6 +88,7 @@ static int add_kword(cgats *p, int table, const char *ksym, const char *kdata, c
 static int add_field(cgats *p, int table, const char *fsym, data_type ftype);
 static int add_set(cgats *p, int table, ...);
 static int add_setarr(cgats *p, int table, cgats_set_elem *args);
+static int add_sets(cgats *p, int table, int nsets, cgats_col *cols);
 static int get_setarr(cgats *p, int table, int set_index, cgats_set_elem *args);
 static int cgats_write(cgats *p, cgatsFile *fp);
 static int cgats_error(cgats *p, char **mes);
@@ -105,6 +107,7 @@ static int add_data_item(cgats *p, int table, void *data);
 static void unquote_cs(char *cs);
 static data_type guess_type(const char *cs);
 static void real_format(double value, int nsd, char *fmt);
+static int real_sprintf(char *buf, double value, int nsd);
 
 #ifdef COMBINED_STD
 static int cgats_read_name(cgats *p, const char *filename);
@@ -141,6 +144,7 @@ cgatsAlloc *al			/* memory allocator */
 	p->add_field  = add_field;
 	p->add_set    = add_set;
 	p->add_setarr = add_setarr;
+	p->add_sets   = add_sets;
 	p->get_setarr = get_setarr;
 	p->write      = cgats_write;
 	p->error      = cgats_error;
@@ -1217,6 +1221,69 @@ add_setarr(cgats *p, int table, cgats_set_elem *args) {
 	return 0;
 }
 
+/* Add nsets of data from an array of nfields column value arrays. */
+/* cols[field] points to nsets values of the field type. */
+/* return 0 normally. */
+/* return -2, -1, errc & err on error */
+static int
+add_sets(cgats *p, int table, int nsets, cgats_col *cols) {
+	cgatsAlloc *al = p->al;
+	int i, j;
+	cgats_table *t;
+
+	p->e.c = 0;
+	p->e.m[0] = '\000';
+	if (table < 0 || table >= p->ntables)
+		return err(p,-1,"cgats.add_sets(), table parameter out of range");
+	t = &p->t[table];
+
+	if (t->nfields == 0)
+		return err(p,-1,"cgats.add_sets(), attempt to add set when no fields are defined");
+
+	if (nsets <= 0)
+		return 0;
+
+	for (i = 0; i < t->nfields; i++) {
+		if (t->ftype[i] != r_t && t->ftype[i] != i_t
+		 && t->ftype[i] != cs_t && t->ftype[i] != nqcs_t)
+			return err(p,-1,"cgats.add_sets(), field has unknown data type");
+	}
+
+	/* Allocate all the set pointers at once, rounded up to a group of 100 */
+	if ((t->nsets + nsets) > t->nsetsa) {
+		int nsetsa = ((t->nsets + nsets + 99)/100) * 100;
+		void ***fdata;
+		if ((fdata = (void ***)al->realloc(al, t->fdata, nsetsa * sizeof(void **))) == NULL)
+			return err(p,-2,"cgats.add_sets(), realloc failed!");
+		t->fdata = fdata;
+		t->nsetsa = nsetsa;
+	}
+
+	/* Allocate and copy data to each new set */
+	for (j = 0; j < nsets; j++) {
+		void **sdata;
+
+		if ((sdata = (void **)al->calloc(al, t->nfields, sizeof(void *))) == NULL)
+			return err(p,-2,"cgats.add_sets(), malloc failed!");
+		t->fdata[t->nsets++] = sdata;
+
+		for (i = 0; i < t->nfields; i++) {
+			void *dp;
+
+			if (t->ftype[i] == r_t)
+				dp = (void *)&cols[i].d[j];
+			else if (t->ftype[i] == i_t)
+				dp = (void *)&cols[i].i[j];
+			else
+				dp = (void *)cols[i].c[j];
+
+			if ((sdata[i] = alloc_copy_data_type(al, t->ftype[i], dp)) == NULL)
+				return err(p,-2,"cgats.alloc_copy_data_type() malloc fail");
+		}
+	}
+	return 0;
+}
+
 /* Fill a suitable set_element with a set of data. */
 /* Note a returned char pointer is to a string in *p */
 /* return 0 normally. */
@@ -1300,6 +1367,51 @@ add_data_item(cgats *p, int table, void *data) {
 	return 0;
 }
 
+/* Add a string and a trailing space to the data set output buffer, */
+/* writing the buffer out if it is full. */
+/* Return NZ on write error */
+static int wbuf_str(cgatsFile *fp, char *wbuf, int *pwbix, char *str) {
+	size_t len = strlen(str);
+
+	if ((*pwbix + len + 1) > WBUF_SIZE) {
+		if (*pwbix > 0 && fp->write(fp, wbuf, 1, *pwbix) != (size_t)*pwbix)
+			return 1;
+		*pwbix = 0;
+		if ((len + 1) > WBUF_SIZE) {		/* Won't fit in buffer */
+			if (fp->write(fp, str, 1, len) != len
+			 || fp->write(fp, " ", 1, 1) != 1)
+				return 1;
+			return 0;
+		}
+	}
+	memcpy(wbuf + *pwbix, str, len);
+	*pwbix += len;
+	wbuf[(*pwbix)++] = ' ';
+	return 0;
+}
+
+/* Format an integer the same as sprintf("%d"). */
+/* Return the number of characters */
+static int int_sprintf(char *buf, int value) {
+	char tb[12];
+	unsigned int uv;
+	int i = 0, len = 0;
+
+	if (value < 0) {
+		buf[len++] = '-';
+		uv = -(unsigned int)value;
+	} else
+		uv = value;
+	do {
+		tb[i++] = '0' + uv % 10;
+		uv /= 10;
+	} while (uv != 0);
+	while (i > 0)
+		buf[len++] = tb[--i];
+
+	return len;
+}
+
 /* Write structure into cgats file */
 /* Return -ve, errc & err if there was an error */
 static int
@@ -1308,6 +1420,8 @@ cgats_write(cgats *p, cgatsFile *fp) {
 	int i;
 	int table,set,field;
 	int *sfield = NULL;	/* Standard field flag */
+	char *wbuf = NULL;	/* Data set output buffer */
+	int wbix;			/* Number of characters in wbuf */
 	p->e.c = 0;
 	p->e.m[0] = '\000';
 
@@ -1556,20 +1670,34 @@ cgats_write(cgats *p, cgatsFile *fp) {
 			goto write_error;
 		if (fp->gprintf(fp,"BEGIN_DATA\n") < 0)
 			goto write_error;
+
+		/* The data values are formatted into wbuf, and written */
+		/* out a buffer full at a time. */
+		if ((wbuf = (char *)al->malloc(al, WBUF_SIZE)) == NULL) {
+			al->free(al, sfield);
+			return err(p,-2,"cgats_write(), malloc of write buffer failed!");
+		}
+		wbix = 0;
+
 		for (set = 0; set < t->nsets; set++) {
 			DBGF((DBGA,"CGATS writing set %d\n",set));
 			for (field = 0; field < t->nfields; field++) {
 				data_type tt;
+
+				/* Make sure there is room for a number */
+				if ((wbix + 100) > WBUF_SIZE) {
+					if (fp->write(fp, wbuf, 1, wbix) != (size_t)wbix)
+						goto write_error;
+					wbix = 0;
+				}
+
 				if (t->ftype[field] == r_t) {
-					char fmt[30];
 					double val = *((double *)t->fdata[set][field]);
-					real_format(val, REAL_SIGDIG, fmt);
- 					strcat(fmt," ");
-					if (fp->gprintf(fp,fmt,val) < 0)
-						goto write_error;
+					wbix += real_sprintf(wbuf + wbix, val, REAL_SIGDIG);
+					wbuf[wbix++] = ' ';
 				} else if (t->ftype[field] == i_t) {
-					if (fp->gprintf(fp,"%d ",*((int *)t->fdata[set][field])) < 0)
-						goto write_error;
+					wbix += int_sprintf(wbuf + wbix, *((int *)t->fdata[set][field]));
+					wbuf[wbix++] = ' ';
 				} else if (t->ftype[field] == nqcs_t
 				      && !cs_has_ws((char *)t->fdata[set][field])
 				      && (sfield[field] || (tt = guess_type((char *)t->fdata[set][field]),
@@ -1577,28 +1705,39 @@ cgats_write(cgats *p, cgatsFile *fp) {
 					/* We can only print a non-quote string if it doesn't contain white space, */
 					/* quote or comment characters, and if it is a standard field or */
 					/* can't be mistaken for a number. */
-					if (fp->gprintf(fp,"%s ",(char *)t->fdata[set][field]) < 0)
+					if (wbuf_str(fp, wbuf, &wbix, (char *)t->fdata[set][field]))
 						goto write_error;
 				} else if (t->ftype[field] == nqcs_t
 				      || t->ftype[field] == cs_t) {
 					char *qs;
 					if ((qs = quote_cs(al, (char *)t->fdata[set][field])) == NULL) {
 						al->free(al, sfield);
+						al->free(al, wbuf);
 						return err(p,-2,"quote_cs() malloc failed!");
 					}
-					if (fp->gprintf(fp,"%s ",qs) < 0) {
+					if (wbuf_str(fp, wbuf, &wbix, qs)) {
 						al->free(al, qs);
 						goto write_error;
 					}
 					al->free(al, qs);
 				} else {
 					al->free(al, sfield);
+					al->free(al, wbuf);
 					return err(p,-1,"cgats_write(), illegal data type found");
 				}
 			}
-			if (fp->gprintf(fp,"\n") < 0)
-				goto write_error;
+			if ((wbix + 1) > WBUF_SIZE) {
+				if (fp->write(fp, wbuf, 1, wbix) != (size_t)wbix)
+					goto write_error;
+				wbix = 0;
+			}
+			wbuf[wbix++] = '\n';
 		}
+		if (wbix > 0 && fp->write(fp, wbuf, 1, wbix) != (size_t)wbix)
+			goto write_error;
+		al->free(al, wbuf);
+		wbuf = NULL;
+
 		if (fp->gprintf(fp,"END_DATA\n") < 0)
 			goto write_error;
 
@@ -1612,6 +1751,8 @@ write_error:
 	err(p,-1,"Write error to file '%s'",fp->fname(fp));
 	if (sfield != NULL)
 		al->free(al, sfield);
+	if (wbuf != NULL)
+		al->free(al, wbuf);
 	return p->e.c;
 }
 
@@ -1932,22 +2073,24 @@ guess_type(const char *cs)
 	return i_t;
 	}
 
-/* Set the character format to the appropriate printf() */
-/* format given the real value and the desired number of significant digits. */
+/* Determine the printf() conversion, width and precision to use */
+/* given the real value and the desired number of significant digits. */
 /* We try to do this while not using the %e format for normal values. */
-/* The fmt string space is assumed to be big enough to contain the format */
-static void
-real_format(double value, int nsd, char *fmt) {
+/* Return the conversion character 'f', 'e' or 'g', with *wid < 0 if */
+/* the width and precision shouldn't be specified. */
+static int
+real_fmtspec(double value, int nsd, int *wid, int *prec) {
 	int ndigs;
 	int tot = nsd + 1;
 	int xtot = tot;
 	if (value == 0.0) {
-		sprintf(fmt,"%%%d.%df",tot,tot-2);
-		return;
+		*wid = tot;
+		*prec = tot-2;
+		return 'f';
 	}
+	*wid = *prec = -1;
 	if (value != value) {		/* Hmm. A nan */
-		sprintf(fmt,"%%f");
-		return;
+		return 'f';
 	}
 	if (value < 0.0) {
 		value = -value;
@@ -1957,28 +2100,120 @@ real_format(double value, int nsd, char *fmt) {
 		int thr = -5;
 		ndigs = (int)(log10(value));
 		if (ndigs > 310 || ndigs < -310) {   /* Protect against silliness.. */
-			strcpy(fmt,"%g");
-			return;
+			return 'g';
 		}
 		if (ndigs <= thr) {
-			sprintf(fmt,"%%%d.%de",xtot,tot-2);
-			return;
+			*wid = xtot;
+			*prec = tot-2;
+			return 'e';
 		}
-		sprintf(fmt,"%%%d.%df",xtot-ndigs,nsd-ndigs);
-		return;
+		*wid = xtot-ndigs;
+		*prec = nsd-ndigs;
+		return 'f';
 	} else {
 		int thr = -0;
 		ndigs = (int)(log10(value));
 		if (ndigs > 310 || ndigs < -310) {   /* Protect against silliness.. */
-			strcpy(fmt,"%g");
-			return;
+			return 'g';
 		}
 		if (ndigs >= (nsd + thr)) {
-			sprintf(fmt,"%%%d.%de",xtot,tot-2);
-			return;
+			*wid = xtot;
+			*prec = tot-2;
+			return 'e';
+		}
+		*wid = xtot;
+		*prec = (nsd + thr)-ndigs;
+		return 'f';
+	}
+}
+
+/* Set the character format to the appropriate printf() */
+/* format given the real value and the desired number of significant digits. */
+/* The fmt string space is assumed to be big enough to contain the format */
+static void
+real_format(double value, int nsd, char *fmt) {
+	int wid, prec, conv;
+
+	conv = real_fmtspec(value, nsd, &wid, &prec);
+	if (wid < 0)
+		sprintf(fmt,"%%%c",conv);
+	else
+		sprintf(fmt,"%%%d.%d%c",wid,prec,conv);
+}
+
+/* Format a real value into buf the same as sprintf() using the */
+/* real_format() format. The usual fixed point cases are formatted */
+/* directly, anything else uses sprintf(). */
+/* Return the number of characters */
+static int
+real_sprintf(char *buf, double value, int nsd) {
+	static double p10[10] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+	int wid, prec, conv;
+
+	conv = real_fmtspec(value, nsd, &wid, &prec);
+
+	if (conv == 'f' && wid >= 0 && prec >= 0 && prec <= 9
+	 && !(value == 0.0 && (1.0/value) < 0.0)) {		/* Not -0.0 */
+		char tb[30];
+		double av, m, im, fr;
+		unsigned int iv, sc, ip, fp;
+		int i, len = 0;
+
+		av = value < 0.0 ? -value : value;
+		m = av * p10[prec];
+
+		if (m < 4e9) {
+			im = floor(m);
+			fr = m - im;
+
+			/* Let sprintf() resolve values that are too close to */
+			/* a rounding tie for the scaled value to be trusted. */
+			if (fr < 0.4999 || fr > 0.5001) {
+				if (fr > 0.5)
+					im += 1.0;
+				iv = (unsigned int)im;
+				sc = (unsigned int)p10[prec];
+				ip = iv / sc;
+				fp = iv % sc;
+
+				/* Fraction digits */
+				for (i = 0; i < prec; i++) {
+					tb[len++] = '0' + fp % 10;
+					fp /= 10;
+				}
+				if (prec > 0)
+					tb[len++] = '.';
+
+				/* Integer digits */
+				do {
+					tb[len++] = '0' + ip % 10;
+					ip /= 10;
+				} while (ip != 0);
+
+				if (value < 0.0)
+					tb[len++] = '-';
+
+				/* Pad to width, and reverse into buf */
+				for (i = 0; (len + i) < wid; i++)
+					buf[i] = ' ';
+				while (len > 0)
+					buf[i++] = tb[--len];
+
+				return i;
+			}
 		}
-		sprintf(fmt,"%%%d.%df",xtot,(nsd + thr)-ndigs);
-		return;
+	}
+
+	/* Use sprintf() */
+	{
+		char fmt[30];
+
+		if (wid < 0)
+			sprintf(fmt,"%%%c",conv);
+		else
+			sprintf(fmt,"%%%d.%d%c",wid,prec,conv);
+
+		return sprintf(buf, fmt, value);
 	}
 }
 
@@ -2175,6 +2410,19 @@ main(int argc, char *argv[]) {
 		 || pp->add_set(pp, 1, "19", "A5", -12345678000.0) < 0
 		 || pp->add_set(pp, 1, "20", "A5", -123456780000.0) < 0)
 			error("Adding set 2 error '%s'",pp->e.m);
+
+		{	/* Add some sets in bulk */
+			char *ids[3] = { "21", "22", "23" };
+			char *locs[3] = { "B1", "B2", "B3" };
+			double xyzx[3] = { 0.5, -2.25, 0.0000001 };
+			cgats_col cols[3];
+
+			cols[0].c = ids;
+			cols[1].c = locs;
+			cols[2].d = xyzx;
+			if (pp->add_sets(pp, 1, 3, cols) < 0)
+				error("Adding sets error '%s'",pp->e.m);
+		}
 	
 		if ((fp = new_cgatsFileStd_name("fred.it8", "w")) == NULL)
 			error("Error opening '%s' for writing","fred.it8");
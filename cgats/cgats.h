@@ -40,6 +40,13 @@ union _cgats_set_elem {
 	char *c;
 }; typedef union _cgats_set_elem cgats_set_elem;
 
+/* A column of values for add_sets() */
+union _cgats_col {
+	int *i;				/* Array of values for an i_t field */
+	double *d;			/* Array of values for an r_t field */
+	char **c;			/* Array of values for a cs_t or nqcs_t field */
+}; typedef union _cgats_col cgats_col;
+
 struct _cgats_table {
 	cgatsAlloc *al;		/* Copy of parent memory allocator */
 	table_type tt;		/* Table type */
@@ -142,6 +149,9 @@ struct _cgats {
 						/* Return 0 normally, -1, -2, e.c & e.m if error */
 	int (*add_setarr)(struct _cgats *p, int table, cgats_set_elem *ary); /* Add data from array */
 						/* Return 0 normally, -1, -2, e.c & e.m if error */
+	int (*add_sets)(struct _cgats *p, int table, int nsets, cgats_col *cols);
+						/* Add nsets of data from an array of nfields column value arrays */
+						/* Return 0 normally, -1, -2, e.c & e.m if error */
 	int (*write)(struct _cgats *p, cgatsFile *fp);	/* Write structure into cgats file */
 										/* return -ve and e.c & e.m set on error */
 
@@ -238,12 +238,12 @@ size_t count
 	size_t len;
 
 	len = ssat_mul(size, count);
-	if (len > (size_t)(p->end - p->cur))  /* Try and expand buffer */
-		cgatsFileMem_filemem_resize(p, p->start + len);
+	if (len > (size_t)(p->aend - p->cur))  /* Try and expand buffer */
+		cgatsFileMem_filemem_resize(p, p->cur + len);
 
-	if (len > (size_t)(p->end - p->cur)) {
+	if (len > (size_t)(p->aend - p->cur)) {
 		if (size > 0)
-			count = (p->end - p->cur)/size;
+			count = (p->aend - p->cur)/size;
 		else
 			count = 0;
 	}
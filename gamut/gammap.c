@@ -1546,10 +1546,12 @@ typedef struct {
 
 		/* Create the near point mapping, which is our fundamental gamut */
 		/* hull to gamut hull mapping. */
+		ATIMER_BEGIN("gamut map nearsmth")
 		nsm = near_smooth(verb, &nnsm, scl_gam, sil_gam, d_gam, src_kbp, dst_kbp,
 		                  dr_cs_bp, xwh, gmi->gamcknf, gmi->gamxknf,
 		                  gmi->gamcpf > 1e-6, gmi->gamexf > 1e-6,
 		                  xvra, mapres, smooth, 1.10, surfpnts, il, ih, ol, oh);
+		ATIMER_END
 		if (nsm == NULL) {
 			fprintf(stderr,"Creating smoothed near points failed\n");
 			s->grey->del(s->grey);
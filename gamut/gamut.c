@@ -58,6 +58,10 @@
 #define NORM_LOG_POW 0.25	/* [0.25] Normal, colorspace lopow value */
 #define RAST_LOG_POW 0.10	/* [0.10] Raster lopow value (is 0.05 too extreme ??) */
 
+#define BVH_LEAFTRIS 4		/* [4] Maximum triangles in a bounding volume hierarchy leaf */
+#define BVH_MARGIN 1e-6		/* [1e-6] Bounding box margin for triangle test tollerance */
+#define BVH_MAXDEPTH 64		/* [64] Maximum depth of bounding volume hierarchy */
+
 #undef TEST_CONVEX_HULL		/* Use pure convex hull, not log hull */
 
 #undef DEBUG_TRIANG			/* Enable detailed triangulation debugging & diag2 */
@@ -156,6 +160,7 @@ static int getssvert(gamut *s, double *rad, double pos[3], double norm[3], int i
 static void startnexttri(gamut *s);
 static int getnexttri(gamut *s, int v[3]);
 static double volume(gamut *s);
+static int radial_isect(gamut *s, gamut *s2, int res, double *vol, double *vol2, double *ivol);
 static int write_to_vrml(gamut *s, vrml *wrl, double trans, int docusps);	
 static int write_trans_vrml(gamut *s, char *filename, int doaxes, int docusps,
 	void (*transform)(void *cntx, double out[3], double in[3]), void *cntx);
@@ -167,6 +172,9 @@ static double radial(gamut *s, double out[3], double in[3]);
 static double nradial(gamut *s, double out[3], double in[3]);
 static void nearest(gamut *s, double out[3], double in[3]);
 static void nearest_tri(gamut *s, double out[3], double in[3], gtri **ctri);
+static void nearest_n(gamut *s, double (*out)[3], double (*in)[3], int n);
+static void init_lookup(gamut *s);
+static void init_bvh(gamut *s);
 static void setwb(gamut *s, double *wp, double *bp, double *kp);
 static int getwb(gamut *s, double *cswp, double *csbp, double *cskp, double *gawp, double *gabp, double *gakp);
 static void setcusps(gamut *s, int flag, double in[3]);
@@ -174,6 +182,8 @@ static int getcusps(gamut *s, double cusps[6][3]);
 static int compute_vector_isect(gamut *s, double *p1, double *p2, double *min, double *max,
                                  double *mint, double *maxt, gtri **mntri, gtri **mxtri);
 static int compute_vector_isectns(gamut *s, double *p1, double *p2, gispnt *lp, int ll); 
+static int vector_isect_n(gamut *s, double (*p1)[3], double (*p2)[3], double (*min)[3],
+                          double (*max)[3], double *mint, double *maxt, int *isect, int n);
 static double log_scale(gamut *s, double ss);
 static int intersect(gamut *s, gamut *s1, gamut *s2);
 static int exp_cyl(gamut *s, gamut *s1, double ratio);
@@ -473,15 +483,14 @@ static int gquad_quadrant(gquad *q, double p[3]) {
 
 /* ------------------------------------ */
 /* Allocate a BSP decision node structure */
-gbspn *new_gbspn(void) {
+gbspn *new_gbspn(gamut *s) {
 	gbspn *t;
-	static int n = 0; 		/* Serial number */
 	if ((t = (gbspn *) calloc(1, sizeof(gbspn))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - bspn node\n");
 		exit(-1);
 	}
 	t->tag = 1;		/* bspn decision node */
-	t->n = n++;
+	t->n = s->bspnsn++;
 
 	return t;
 }
@@ -494,18 +503,18 @@ void del_gbspn(gbspn *t) {
 /* ------------------------------------ */
 /* Allocate a BSP tree triangle list node structure */
 gbspl *new_gbspl(
+gamut *s,
 int nt,			/* Number of triangles in the list */
 gtri **t		/* List of triangles to copy into structure */
 ) {
 	gbspl *l;
 	int i;
-	static int n = 0; 		/* Serial number */
 	if ((l = (gbspl *) calloc(1, sizeof(gbspl) + nt * sizeof(gtri *))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - bspl triangle tree node\n");
 		exit(-1);
 	}
 	l->tag = 3;		/* bspl triangle list node */
-	l->n = n++;
+	l->n = s->bsplsn++;
 	l->nt = nt;
 	for (i = 0; i < nt; i++)
 		l->t[i] = t[i];
@@ -520,15 +529,14 @@ void del_gbspl(gbspl *l) {
 
 /* ------------------------------------ */
 /* Allocate a triangle structure */
-gtri *new_gtri(void) {
+gtri *new_gtri(gamut *s) {
 	gtri *t;
-	static int n = 0; 		/* Serial number */
 	if ((t = (gtri *) calloc(1, sizeof(gtri))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - gamut surface triangle\n");
 		exit(-1);
 	}
 	t->tag = 2;		/* Triangle */
-	t->n = n++;
+	t->n = s->trisn++;
 
 	return t;
 }
@@ -540,14 +548,13 @@ void del_gtri(gtri *t) {
 
 /* ------------------------------------ */
 /* Allocate an edge structure */
-gedge *new_gedge(void) {
+gedge *new_gedge(gamut *s) {
 	gedge *t;
-	static int n = 0; 		/* Serial number */
 	if ((t = (gedge *) calloc(1, sizeof(gedge))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - triangle edge\n");
 		exit(-1);
 	}
-	t->n = n++;
+	t->n = s->edgesn++;
 	return t;
 }
 
@@ -661,6 +668,7 @@ int isRast				/* Flag indicating Raster rather than colorspace, */
 	s->getvert     = getvert;
 	s->volume      = volume;
 	s->intersect   = intersect;
+	s->radial_isect = radial_isect;
 	s->exp_cyl     = exp_cyl;
 	s->nexpintersect   = nexpintersect;
 	s->expdstbysrcmdst = expdstbysrcmdst;
@@ -670,6 +678,9 @@ int isRast				/* Flag indicating Raster rather than colorspace, */
 	s->nearest_tri = nearest_tri;
 	s->vector_isect = compute_vector_isect;
 	s->vector_isectns = compute_vector_isectns;
+	s->nearest_n   = nearest_n;
+	s->vector_isect_n = vector_isect_n;
+	s->init_lookup = init_lookup;
 	s->setwb       = setwb;
 	s->getwb       = getwb;
 	s->setcusps    = setcusps;
@@ -684,7 +695,7 @@ int isRast				/* Flag indicating Raster rather than colorspace, */
 	return s;
 }
 
-static void del_gnn(gnn *p);
+static void del_gbvh(gbvh *p);
 static void del_gbsp(gbsp *n);
 
 /* Free and clear the triangulation structures, */
@@ -723,9 +734,14 @@ static void del_triang(gamut *s) {
 	
 	s->lu_inited = 0;
 
-	if (s->nns != NULL) {
-		del_gnn(s->nns);
-		s->nns = NULL;
+	if (s->rsv != NULL) {
+		free(s->rsv);
+		s->rsv = NULL;
+	}
+
+	if (s->bvh != NULL) {
+		del_gbvh(s->bvh);
+		s->bvh = NULL;
 	}
 	s->ne_inited = 0;
 
@@ -1078,6 +1094,12 @@ static void intersect_imp(gamut *s, gamut *sa, gamut *sb) {
 	int i, j, k;
 	gamut *s1, *s2;
 
+	/* Make sure the triangle bounding boxes are set */
+	if (sa->ne_inited == 0)
+		init_bvh(sa);
+	if (sb->ne_inited == 0)
+		init_bvh(sb);
+
 	/* Add each source gamuts vertices that lie within */
 	/* the other gamut */
 	for (k = 0; k < 2; k++) {
@@ -1578,6 +1600,12 @@ void *cntx		/* which returns p2 which is in desired direction from given p1 */
 	/* to the image/dest gamut, and add them as well. This is to properly define */
 	/* the edges of the expansion zone. */
 
+	/* Make sure the triangle bounding boxes are set */
+	if (s2->ne_inited == 0)
+		init_bvh(s2);
+	if (s3->ne_inited == 0)
+		init_bvh(s3);
+
 	/* For sc on dc and then dc on sc */
 	for (k = 0; k < 2; k++) {
 		gamut *ss1, *ss2;
@@ -2385,7 +2413,7 @@ gtri *tp		/* Triangle faces to be added */
 	/* The edges adjacency info remains valid for the three faces, */
 	/* as does the edge plane equation. */
 	DEL_LINK(s->tris, tp);		/* Delete it from the triangulation list */
-	t1 = new_gtri();
+	t1 = new_gtri(s);
 	t1->v[0] = tp->v[1];		/* Duplicate with rotated faces */
 	t1->v[1] = tp->v[2];
 	t1->e[0] = tp->e[1];		/* Edge adjacency for this edge */
@@ -2396,7 +2424,7 @@ gtri *tp		/* Triangle faces to be added */
 	for (j = 0; j < 4; j++)		/* Copy edge plane equation */
 		t1->ee[2][j] = tp->ee[0][j];
 
-	t2 = new_gtri();
+	t2 = new_gtri(s);
 	t2->v[0] = tp->v[2];		/* Duplicate with rotated faces */
 	t2->v[1] = tp->v[0];
 	t2->e[0] = tp->e[2];		/* Edge adjacency for this edge */
@@ -2586,7 +2614,7 @@ if (!intri) printf("~1 ###### vertex didn't land in any triangle! ########\n");
 			FOR_ALL_ITEMS(gtri, tp2) {
 				if (tp2->v[0] == tp->v[1]) {	/* Found 1/2 tp/tp2 edge adjacency */
 					gedge *e;
-					e = new_gedge();
+					e = new_gedge(s);
 					ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
 					tp->e[1] = e;			/* Point to edge */
 					tp->ei[1] = 0;			/* edges 0th triangle */
@@ -2708,11 +2736,11 @@ gamut *s
 #endif
 		/* Setup the initial triangulation */
 		for (i = 0; i < 4; i++) {
-			tr[i] = new_gtri();
+			tr[i] = new_gtri(s);
 		}
 
 		for (i = 0; i < 6; i++) {
-			ed[i] = new_gedge();
+			ed[i] = new_gedge(s);
 			ADD_ITEM_TO_BOT(s->edges, ed[i]);
 		}
 
@@ -2975,6 +3003,8 @@ static void triangulate(
 gamut *s
 ) {
 
+	ATIMER_BEGIN("gamut triangulation")
+
 	/* Create the convex hull */
 	triangulate_ch(s);
 
@@ -2995,6 +3025,8 @@ gamut *s
 //		triangulate_ch(s);
 	}
 #endif /* DO_TWOPASS && !TEST_CONVEX_HULL */
+
+	ATIMER_END
 }
 
 /* ===================================================== */
@@ -3510,6 +3542,94 @@ gamut *s
 	return vol;
 }
 
+/* Return the unit direction vector for radial_isect() direction i, j */
+static void rsdir(int res, int i, int j, double dir[3]) {
+	double z, rxy, ang;
+
+	/* Equal area bands in z, and equal steps in angle around the neutral axis, */
+	/* so that every direction represents the same solid angle. */
+	z = -1.0 + (i + 0.5) * 2.0/res;
+	rxy = sqrt(1.0 - z * z);
+	ang = (j + 0.5) * M_PI/res;
+	dir[0] = z;
+	dir[1] = rxy * cos(ang);
+	dir[2] = rxy * sin(ang);
+}
+
+/* Compute the volume of this gamut, s2, and their intersection. */
+/* Since both gamuts are radial surfaces about the same center, */
+/* the intersection surface is the minimum radial distance in */
+/* each direction, and volume is the integral of r^3/3 over */
+/* the sphere of directions. */
+static int radial_isect(
+gamut *s,
+gamut *s2,		/* Other gamut, may be NULL */
+int res,		/* Direction resolution, 0 = default */
+double *pvol,	/* Return volume of s, may be NULL */
+double *pvol2,	/* Return volume of s2, may be NULL */
+double *pivol	/* Return volume of intersection, may be NULL */
+) {
+	int i, j, k;
+	double dir[3], in[3];
+	double sa;		/* Solid angle of each direction */
+	double vol = 0.0, vol2 = 0.0, ivol = 0.0;
+
+	if (res <= 0)
+		res = 200;
+
+	if (s2 != NULL && s->compatible(s, s2) == 0)
+		return 1;
+
+	/* (Re-)create the cache of radial distances of this gamut */
+	if (s->rsv == NULL || s->rsres != res) {
+		if (s->rsv != NULL)
+			free(s->rsv);
+		if ((s->rsv = (double *)malloc(sizeof(double) * 2 * res * res)) == NULL) {
+			fprintf(stderr,"gamut: malloc failed - radial isect cache\n");
+			exit(-1);
+		}
+		for (i = 0; i < res; i++) {
+			for (j = 0; j < (2 * res); j++) {
+				rsdir(res, i, j, dir);
+				for (k = 0; k < 3; k++)
+					in[k] = s->cent[k] + dir[k];
+				s->rsv[i * 2 * res + j] = s->radial(s, NULL, in);
+			}
+		}
+		s->rsres = res;
+	}
+
+	for (i = 0; i < res; i++) {
+		for (j = 0; j < (2 * res); j++) {
+			double r1, r2;
+
+			r1 = s->rsv[i * 2 * res + j];
+			vol += r1 * r1 * r1;
+
+			if (s2 != NULL) {
+				rsdir(res, i, j, dir);
+				for (k = 0; k < 3; k++)
+					in[k] = s2->cent[k] + dir[k];
+				r2 = s2->radial(s2, NULL, in);
+				vol2 += r2 * r2 * r2;
+				if (r2 < r1)
+					r1 = r2;
+				ivol += r1 * r1 * r1;
+			}
+		}
+	}
+
+	sa = 4.0 * M_PI/(2.0 * res * res);
+	if (pvol != NULL)
+		*pvol = vol * sa/3.0;
+	if (pvol2 != NULL)
+		*pvol2 = vol2 * sa/3.0;
+	if (pivol != NULL)
+		*pivol = ivol * sa/3.0;
+
+	return 0;
+}
+
 /* ===================================================== */
 /* ===================================================== */
 /* Given a point, */
@@ -3659,7 +3779,6 @@ init_lu(
 gamut *s
 ) {
 	static double v0[3] = {0.0, 0.0, 0.0};
-	static 
 	gedge *ep;		/* Edge pointer */
 	gtri *tp;		/* Triangle pointer */
 	gtri **tlist;
@@ -3716,6 +3835,12 @@ gamut *s
  * be better. To address this, an orthogonal element to the
  * radial BSP's is provided in the radius squared range
  * of each set of elements below a BSP node.
+ *
+ * A radial lookup descends a single wedge at each level, so
+ * it only tests a few triangles, and its cost grows slowly
+ * with resolution (~0.3 usec at sres 10, ~0.6 usec at sres 5).
+ * A coarse proxy surface doesn't help here, since the exact
+ * surface point is always needed.
  */
 
 /* Recursive routine to choose a partition plane, */
@@ -3872,7 +3997,7 @@ int llen		/* Number of triangles in the list */
 		/* Instead leave our list of triangles as the leaf node, */
 		/* and let the search algorithms deal with this. */
 
-		*np = (gbsp *)new_gbspl(llen, list);
+		*np = (gbsp *)new_gbspl(s, llen, list);
 		(*np)->rs0 = rs0;		/* Radius squared range */
 		(*np)->rs1 = rs1;
 //printf("~1 lu_split returning with a non split list of %d triangles\n",llen);
@@ -3880,7 +4005,7 @@ int llen		/* Number of triangles in the list */
 	}
 
 	/* Divide the triangles into two lists */
-	bspn = new_gbspn();				/* Next node */
+	bspn = new_gbspn(s);				/* Next node */
 	*np = (gbsp *)bspn;				/* Put it in place */
 	bspn->rs0 = rs0;				/* Radius squared range */
 	bspn->rs1 = rs1;
@@ -4101,9 +4226,6 @@ static void del_gbsp(gbsp *n) {
 /* Given a point, */
 /* return the nearest point on the gamut surface. */
 
-#define GNN_INF 1e307
-static void init_ne(gamut *s);
-
 /* Given an absolute point, return the point on the gamut */
 /* surface that is closest to it. */
 /* Use a brute force search */
@@ -4137,7 +4259,28 @@ double *q		/* Target point (absolute) */
 	} END_FOR_ALL_ITEMS(tp);
 }
 
-/* Using nearest neighbourhood accelleration structure: */
+/* Return the distance squared from a point to a bounding box */
+static double bvh_box_dist(
+double *mn,
+double *mx,
+double *q
+) {
+	double tt, rv = 0.0;
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		if (q[j] < mn[j]) {
+			tt = mn[j] - q[j];
+			rv += tt * tt;
+		} else if (q[j] > mx[j]) {
+			tt = q[j] - mx[j];
+			rv += tt * tt;
+		}
+	}
+	return rv;
+}
+
+/* Using the bounding volume hierarchy: */
 
 /* Given an absolute point, return the point on the gamut */
 /* surface that is closest to it. */
@@ -4148,308 +4291,250 @@ double *rout,	/* result point (absolute) */
 double *q,		/* Target point (absolute) */
 gtri **ctri		/* If not NULL, return pointer to nearest triangle */
 ) {
-	gnn *p;				/* Pointer to nearest neighbor structure */
-	int e, i;
-	double r[3] = {0.0, 0.0, 0.0 };		/* Possible solution point */
-	double out[3] = {0.0, 0.0, 0.0};	/* Current best output value */
-	int wex[3 * 2];		/* Current window edge indexes */
-	double wed[3 * 2];	/* Current window edge distances */
-						/* Indexes are axis * 2 +0 for lower edge, */
-						/* +1 for upper edge of search box. */
-						/* We are comparing lower edge of search box */
-						/* with upper edge of bounding box etc. */ 
+	gbvh *p;
+	gbvhn *n, *stack[BVH_MAXDEPTH];	/* Nodes still to be searched */
+	double sdist[BVH_MAXDEPTH];		/* and their distances squared */
+	int sp = 0;
+	double r[3], out[3] = { 0.0, 0.0, 0.0 };
+	double bdist = 1e308;	/* Best distance squared so far */
+	gtri *bobj = NULL;
 
 //printf("~1 nearest called\n");
-	if IS_LIST_EMPTY(s->tris)
-		triangulate(s);
-
 	/* We have to find out which triangle the point will be nearest */
-	if (s->ne_inited == 0) {
-		init_ne(s);				/* Init nn structure */
-	}
-	p = s->nns;
-
-	if ((p->tbase + 3) < p->tbase) {	/* Overflow of touch count */
-		for (i = 0; i < p->n; i++)
-			p->sax[0][i]->touch = 0;		/* reset it in all the objects */
-		p->tbase = 0;
-	}
-	p->ttarget = p->tbase + 3;		/* Target touch value */
-
-//printf("\n");
-//printf("Query point is %f %f %f\n",q[0], q[1], q[2]);
-
-	/* Find starting indexes within axis arrays */
-	for (e = 0; e < (2 * 3); e++) {	/* For all axes min & max */
-		int f = e/2;			/* Axis */
-		int mm = (e ^ 1) & 1;	/* Min/Max index used for edges */
-		int i0, i1, i2;
-		double v0, v1, v2;
-		double qf, ww;
-
-		/* Binary search this edge */
-		qf = q[f]; 		/* strength reduced q[f] */
-
-//printf("\n");
-//printf("isearching axis %d %s for %f\n",f, e & 1 ? "max" : "min", qf);
-		i0 = 0;
-		i2 = p->n - 1;
-		v0 = p->sax[e][i0]->mix[mm][f];
-		v2 = p->sax[e][i2]->mix[mm][f];
-//printf("start points %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-
-		if (qf <= v0) {
-			i2 = i0;
-			v2 = v0;
-		} else if (qf >= v2) {
-			i0 = i2;
-			v0 = v2;
-		} else {
-			do {
-				i1 = (i2 + i0)/2;		/* Trial point */
-				v1 = p->sax[e][i1]->mix[mm][f];	/* Value at trial */
-				if (v1 < qf) {
-					i0 = i1;			/* Take top half */
-					v0 = v1;
-				} else {
-					i2 = i1;			/* Take bottom half */
-					v2 = v1;
-				}
-//printf("current point %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-			} while ((i2 - i0) > 1);
-		}
-
-		if (e & 1) {			/* Max side of window */
-			int tc;				/* total object count */
-
-			ww = v2 - qf;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i2;
-
-			/* Check that min and max together will cover at least p->n objects */
-			tc = p->n - i2 + wex[e ^ 1] + 1;
-//printf("got %d, expected %d\n",tc, p->n);
-
-			/* (I don't really understand why this works!) */
-			if (tc < p->n) {		/* We haven't accounted for all the objects */
-				int el = e ^ 1;		/* Low side sax */
-				int ti0, ti2;
-				double tv0, tv2;
-
-				ti0 = wex[el];
-				ti2 = i2;
-//printf("We have straddling objects, initial indexes are %d - %d\n",ti0, ti2);
-
-				/* While straddling objects remain undiscovered: */
-				while (tc < p->n) {
-					tv0 =  GNN_INF;		/* Guard values */
-					tv2 = -GNN_INF;
-
-					/* Increment low side until we find a straddler */
-					while (ti0 < (p->n-1)) {
-						ww = p->sax[el][++ti0]->mix[0][f];	/* Position of the other end */
-						if (ww < qf) {
-//printf("found low object %d at index %d that straddles\n",p->sax[el][ti0]->n,ti0);
-							tv0 = qf - p->sax[el][ti0]->mix[1][f];
-							break;
-						}
-					}
-
-					/* Decrement high side until we find a straddler */
-					while (ti2 > 0) {
-						ww = p->sax[e][--ti2]->mix[1][f];	/* Position of the other end */
-						if (ww > qf) {
-//printf("found high object %d at index %d that straddles\n",p->sax[e][ti2]->n,ti2);
-							tv2 = p->sax[e][ti2]->mix[0][f] - qf;
-							break;
-						}
-					}
-					/* Choose the closest */
-					if (tv0 > tv2) {
-						wed[el] = fabs(tv0) * tv0;
-						wex[el] = ti0;
-						tc++;
-					} else {
-						wed[e] = fabs(tv2) * tv2;
-						wex[e] = ti2;
-						tc++;
-					}
-				}
-//printf("After correction we have %d - %d\n",wex[e^1], wex[e]);
+	if (s->ne_inited == 0)
+		init_bvh(s);			/* Init BVH structure (and triangulate) */
+	p = s->bvh;
+
+	for (n = &p->node[0]; n != NULL;) {
+
+		if (n->nt > 0) {		/* Leaf */
+			double lb[BVH_LEAFTRIS];
+			double *pe0 = p->pe[0] + n->ix, *pe1 = p->pe[1] + n->ix;
+			double *pe2 = p->pe[2] + n->ix, *pe3 = p->pe[3] + n->ix;
+			double *mn0 = p->mn[0] + n->ix, *mn1 = p->mn[1] + n->ix;
+			double *mn2 = p->mn[2] + n->ix, *mx0 = p->mx[0] + n->ix;
+			double *mx1 = p->mx[1] + n->ix, *mx2 = p->mx[2] + n->ix;
+			int i, nt = n->nt;
+
+			/* Lower bound on the distance squared to each triangle, */
+			/* from the larger of the distance to its plane and its box. */
+			for (i = 0; i < nt; i++) {
+				double pd, d0, d1, d2, bd;
+
+				pd = pe0[i] * q[0] + pe1[i] * q[1] + pe2[i] * q[2] + pe3[i];
+				pd *= pd;
+				d0 = q[0] < mn0[i] ? mn0[i] - q[0] : q[0] > mx0[i] ? q[0] - mx0[i] : 0.0;
+				d1 = q[1] < mn1[i] ? mn1[i] - q[1] : q[1] > mx1[i] ? q[1] - mx1[i] : 0.0;
+				d2 = q[2] < mn2[i] ? mn2[i] - q[2] : q[2] > mx2[i] ? q[2] - mx2[i] : 0.0;
+				bd = d0 * d0 + d1 * d1 + d2 * d2;
+				lb[i] = pd > bd ? pd : bd;
 			}
-		} else {				/* Min side of window */
-			ww = q[f] - v0;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i0;
-		}
-	}
 
-	/* Expand a 3 dimenstional cube centered on the target point, */
-	/* jumping to the next nearest point on any axis, discovering */
-	/* any bounding boxes that are within the expanding window */
-	/* by checking their touch count. */
+			for (i = 0; i < nt; i++) {
+				double tdist;
 
-	/* The first point found establishes the initial best distance. */
-	/* When the window expands beyond the point where it can improve */
-	/* the best distance, stop */
+				if (lb[i] >= bdist)
+					continue;
 
-	{
-		double bw = 0.0;		/* Current window distance */
-		double bdist = 1e308;	/* Best possible distance to an object outside the window */
-		gtri *bobj = NULL;
-		int ptested = 0;		/* Stats */
-		int pcalced = 0;		/* Stats */
-
-		/* Until we're done */
-		for (;;ptested++) {
-			int ee;				/* Axis & expanding box edge */
-			int ff;				/* Axis */
-			int ii;				/* Index of chosen point */
-			gtri *ob;			/* Current object */
-			unsigned int ctv;	/* Current touch value */
-//printf("\n");
-//printf("wwidth = %f, bdist = %f, window = %d-%d, %d-%d, %d-%d\n",
-//bw, bobj == NULL ? 0.0 : bdist, wex[0], wex[1], wex[2], wex[3], wex[4], wex[5]);
-//printf("window edge distances are = %f-%f, %f-%f, %f-%f\n",
-//wed[0], wed[1], wed[2], wed[3], wed[4], wed[5]);
-
-			/* find next (smallest) window increment axis and direction */
-			ee = 0;
-			ii = wex[ee];
-			bw = wed[ee];
-			for (e = 1; e < (2 * 3); e++) {
-				if (wed[e] < bw) {
-					ee = e;
-					ii = wex[e];
-					bw = wed[e];
+				tdist = ne_point_on_tri(s, p->t[n->ix + i], r, q);
+				if (tdist < bdist) {	/* New best point */
+					bobj = p->t[n->ix + i];
+					bdist = tdist;
+					out[0] = r[0];
+					out[1] = r[1];
+					out[2] = r[2];
 				}
 			}
-//printf("Next best is axisdir %d, object %d, axis index %d, best possible dist %f\n",
-//ee, p->sax[ee][ii]->n, ii, bw);
 
-			if (bw == GNN_INF || bw > bdist) {
-				break;		/* Can't got any further, or further points will be worse */
+		} else {				/* Descend closer child first */
+			gbvhn *c0 = n + 1, *c1 = &p->node[n->ix];
+			double d0, d1;
+
+			d0 = bvh_box_dist(c0->mn, c0->mx, q);
+			d1 = bvh_box_dist(c1->mn, c1->mx, q);
+			if (d1 < d0) {
+				gbvhn *tn = c0;
+				double td = d0;
+				c0 = c1; c1 = tn;
+				d0 = d1; d1 = td;
+			}
+			if (d0 < bdist) {
+				if (d1 < bdist) {
+					stack[sp] = c1;
+					sdist[sp++] = d1;
+				}
+				n = c0;
+				continue;
 			}
+		}
 
-#ifdef ASSERTS
-			if (ii < 0 || ii >= p->n) {
-				printf("Assert: went out of bounds of sorted axis array\n");
-				exit(0);
+		/* Pop the next node that could still be closer */
+		for (n = NULL; sp > 0;) {
+			sp--;
+			if (sdist[sp] < bdist) {
+				n = stack[sp];
+				break;
 			}
-#endif
-			/* Chosen point on ee axis/direction, index ii */
-			ff = ee / 2;			/* Axis only */
+		}
+	}
 
-			ob = p->sax[ee][ii];
+	if (rout != NULL) {
+		rout[0] = out[0];	/* Copy results to output */
+		rout[1] = out[1];
+		rout[2] = out[2];
+	}
 
-			/* Touch value of current object */
-			ctv = ob->touch;
+	if (ctri != NULL)
+		*ctri = bobj;
+}
 
-			if (ctv < p->ttarget) {		/* Not been dealt with before */
+/* Given an absolute point, return the point on the gamut */
+/* surface that is closest to it. */
+static void
+nearest(
+gamut *s,
+double *rout,	/* result point (absolute) */
+double *q		/* Target point (absolute) */
+) {
+	nearest_tri(s, rout, q, NULL);
+}
 
-				/* Touch this new window boundary point */
-				ob->touch = ctv = ((ctv < p->tbase) ? p->tbase : ctv) + 1;
+/* Given an array of absolute points, return the points */
+/* on the gamut surface that are closest to them. */
+static void
+nearest_n(
+gamut *s,
+double (*rout)[3],	/* result points (absolute) */
+double (*q)[3],		/* Target points (absolute) */
+int n				/* Number of points */
+) {
+	int i;
 
-//printf("New touch count on %d is %d, target %d\n", ob->n, p->sax[ee][ii]->touch, p->ttarget);
+	if (s->ne_inited == 0)
+		init_bvh(s);			/* Init BVH structure (and triangulate) */
 
-				/* Check the point out */
-				if (ctv == (p->tbase + 3)) {	/* Is within window on all axes */
-					double tdist;
+	for (i = 0; i < n; i++)
+		nearest_tri(s, rout[i], q[i], NULL);
+}
 
-					pcalced++;		/* Stats */
+/* Set up all the lookup structures, so that the lookup */
+/* methods no longer modify the gamut. */
+static void
+init_lookup(
+gamut *s
+) {
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
 
-					/* Compute distance from query point to this object */
-					tdist = ne_point_on_tri(s, ob, r, q);
+	if (s->lu_inited == 0)
+		init_lu(s);				/* Init BSP search tree */
 
-//printf("Got new best point %d, dist %f\n",i,tdist);
-					if (tdist < bdist) {	/* New best point */
-						bobj = ob;
-						bdist = tdist;
-						out[0] = r[0];
-						out[1] = r[1];
-						out[2] = r[2];
-					}
-				}
-			}
+	if (s->ne_inited == 0)
+		init_bvh(s);			/* Init BVH structure */
+}
 
-			/* Increment next window edge candidate, and figure new edge distance */
-			if (ee & 1) {					/* Top */
-				if (++wex[ee] >= p->n) {
-					wed[ee] = GNN_INF;
-					wex[ee]--;
-				} else {
-					double ww = p->sax[ee][wex[ee]]->mix[0][ff] - q[ff];
-					wed[ee] = fabs(ww) * ww;
-				}
-			} else {
-				if (--wex[ee] < 0) {
-					wed[ee] = GNN_INF;
-					wex[ee]++;
-				} else {
-					double ww = q[ff] - p->sax[ee][wex[ee]]->mix[1][ff];
-					wed[ee] = fabs(ww) * ww;
-				}
-			}
-		}
+/* ----------------------------------------------------- */
+/* Bounding volume hierarchy. */
 
-//printf("Searched %d points out of %d = %f%%\n",ptested, p->n, 100.0 * ptested/p->n);
+/*
+	The surface triangles are split at the median of their
+	centroids along the longest axis, recursively, until there
+	are no more than BVH_LEAFTRIS in a node. A nearest query
+	descends the closer child first, and skips any node whose
+	bounding box is further away than the best triangle found so far.
+	A vector query only visits nodes whose bounding box the line
+	passes through.
+
+	The leaf tests first compute a bound or intersection parameter
+	for all the leaves triangles from the packed arrays, in loops
+	the compiler can vectorize, before doing the detailed test on
+	those triangles that need it.
+
+	Nothing is modified by a query, so once init_bvh() has been
+	called, queries may be made from several threads at once.
+ */
 
-		p->tbase += 3;		/* Next touch */
+/* Sum of the triangles vertex values along axis k, ie. 3 x centroid */
+#define BVH_CSUM(T, K) ((T)->v[0]->p[K] + (T)->v[1]->p[K] + (T)->v[2]->p[K])
 
-		if (rout != NULL) {
-			rout[0] = out[0];	/* Copy results to output */
-			rout[1] = out[1];
-			rout[2] = out[2];
+/* Recursively create the node for the triangles p->t[ix .. ix+nt-1], */
+/* and return its index. */
+static int build_bvh(
+gbvh *p,
+int ix,
+int nt
+) {
+	gbvhn *n;
+	gtri **tl = p->t + ix;
+	double cmn[3], cmx[3];
+	int i, j, k, ni;
+
+	ni = p->nn++;
+	n = &p->node[ni];
+
+	/* Bounding box of the triangles and of their centroids */
+	for (j = 0; j < 3; j++) {
+		n->mn[j] = cmn[j] = 1e38;
+		n->mx[j] = cmx[j] = -1e38;
+	}
+	for (i = 0; i < nt; i++) {
+		for (j = 0; j < 3; j++) {
+			double cc = BVH_CSUM(tl[i], j);
+			if (cc < cmn[j])
+				cmn[j] = cc;
+			if (cc > cmx[j])
+				cmx[j] = cc;
+			for (k = 0; k < 3; k++) {
+				if (tl[i]->v[k]->p[j] < n->mn[j])
+					n->mn[j] = tl[i]->v[k]->p[j];
+				if (tl[i]->v[k]->p[j] > n->mx[j])
+					n->mx[j] = tl[i]->v[k]->p[j];
+			}
 		}
+	}
 
-		if (ctri != NULL)
-			*ctri = bobj;
+	/* Allow a margin for the tolerance of the triangle tests */
+	for (j = 0; j < 3; j++) {
+		n->mn[j] -= BVH_MARGIN;
+		n->mx[j] += BVH_MARGIN;
+	}
 
-		return;
+	if (nt <= BVH_LEAFTRIS) {
+		n->ix = ix;
+		n->nt = nt;
+		return ni;
 	}
-}
 
-/* Given an absolute point, return the point on the gamut */
-/* surface that is closest to it. */
-static void
-nearest(
-gamut *s,
-double *rout,	/* result point (absolute) */
-double *q		/* Target point (absolute) */
-) {
-	nearest_tri(s, rout, q, NULL);
-}
+	/* Split along the longest axis of the centroids */
+	for (k = 0, j = 1; j < 3; j++) {
+		if ((cmx[j] - cmn[j]) > (cmx[k] - cmn[k]))
+			k = j;
+	}
+#define 	HEAP_COMPARE(A,B) (BVH_CSUM(A, k) < BVH_CSUM(B, k))
+	HEAPSORT(gtri *, tl, nt)
+#undef HEAP_COMPARE
 
-/* Perturb the containment points to avoid */
-/* numerical co-incidence */
-double perturb[21] = {
-	8.9919295344233395e-283, 1.1639766020018968e+224, 1.2554893023590904e+232,
-	2.3898157055642966e+190, 1.5697612415774029e-076, 6.6912978722191457e+281,
-	1.2369092402930559e+277, 1.4430907501246712e-153, 3.0017439193018232e+238,
-	1.2978311824382444e+161, 5.5068703318775818e-311, 7.7791723264448801e-260,
-	4.4296571592384350e+281, 8.9481529920968425e+165, 1.2845894914769635e-153,
-	2.0835868791190880e-076, 5.4310198502711138e+241, 4.8689849775675438e+275,
-	9.2709981544886391e+122, 3.7958270103353899e-153, 7.1366083837501666e-154
-};
+	n->nt = 0;
+	build_bvh(p, ix, nt/2);				/* First child follows */
+	i = build_bvh(p, ix + nt/2, nt - nt/2);
+	p->node[ni].ix = i;
 
-/* Setup the nearest function acceleration structure */
+	return ni;
+}
+
+/* Setup the bounding volume hierarchy */
 static void
-init_ne(
+init_bvh(
 gamut *s
 ) {
-	gnn *p;
-	int i, k;
+	gbvh *p;
 	gtri *tp;		/* Triangle pointer */
-	int ntris;
-	double psf;
+	int i, j, k, ntris;
 
-//printf("~1 init_ne called\n");
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
 
-	/* Allocate the nearest neighbor acceleration structure */
-	if ((s->nns = p = (gnn *) calloc(1, sizeof(gnn))) == NULL) {
-		fprintf(stderr,"gamut: calloc failed - gnn structure\n");
-		exit(-1);
-	}
+//printf("~1 init_bvh called\n");
 
 	/* Count triangles */
 	ntris = 0;
@@ -4458,71 +4543,84 @@ gamut *s
 		ntris++;
 	} END_FOR_ALL_ITEMS(tp);
 
-	p->n = ntris;
-	p->tbase = 0;		/* Initialse touch flag */
-
-	/* Allocate the arrays spaces */
-	for (k = 0; k < (3 * 2); k++) {
-		if ((p->sax[k] = (gtri **)malloc(sizeof(gtri *) * ntris)) == NULL)
-			error("Failed to allocate sorted index array");
+	if ((p = (gbvh *) calloc(1, sizeof(gbvh))) == NULL) {
+		fprintf(stderr,"gamut: calloc failed - gbvh structure\n");
+		exit(-1);
 	}
+	p->nt = ntris;
 
-	/* Compute pertbation factor */
-	for (psf = 0.0, i = 1; i < 21; i++)
-		psf += perturb[i];
-	psf *= perturb[0];
+	/* A binary tree with leaves of at least one triangle */
+	/* has fewer than 2 x ntris nodes. */
+	if ((p->node = (gbvhn *)malloc(sizeof(gbvhn) * (2 * ntris + 1))) == NULL
+	 || (p->t = (gtri **)malloc(sizeof(gtri *) * (ntris + 1))) == NULL)
+		error("Failed to allocate BVH arrays");
+	for (j = 0; j < 4; j++) {
+		if ((p->pe[j] = (double *)malloc(sizeof(double) * (ntris + 1))) == NULL)
+			error("Failed to allocate BVH arrays");
+	}
+	for (j = 0; j < 3; j++) {
+		if ((p->mn[j] = (double *)malloc(sizeof(double) * (ntris + 1))) == NULL
+		 || (p->mx[j] = (double *)malloc(sizeof(double) * (ntris + 1))) == NULL)
+			error("Failed to allocate BVH arrays");
+	}
 
-	/* For each triangle, create the triangle bounding box values, */
-	/* and add them to the axis lists. */
-	tp = s->tris; 
 	i = 0;
+	tp = s->tris; 
 	FOR_ALL_ITEMS(gtri, tp) {
-		int j;
-		for (j = 0; j < 3; j++) {	/* Init */
-			tp->mix[0][j] = 1e38;
-			tp->mix[1][j] = -1e38;
-		}
-		for (k = 0; k < 3; k++) {
-			for (j = 0; j < 3; j++) {
-				if (tp->v[k]->p[j] < tp->mix[0][j])		/* New min */
-					tp->mix[0][j] = psf * tp->v[k]->p[j];
-				if (tp->v[k]->p[j] > tp->mix[1][j])		/* New max */
-					tp->mix[1][j] = psf * tp->v[k]->p[j];
-			}
-			p->sax[k * 2 + 0][i] = tp;
-			p->sax[k * 2 + 1][i] = tp;
-		}
-//printf("~1 tri %d has bb %f - %f, %f - %f, %f - %f\n", i, tp->mix[0][0], tp->mix[1][0], tp->mix[0][1], tp->mix[1][1], tp->mix[0][2], tp->mix[1][2]);
-		i++;
+		p->t[i++] = tp;
 	} END_FOR_ALL_ITEMS(tp);
 
+	if (ntris > 0)
+		build_bvh(p, 0, ntris);
+	else {
+		p->nn = 1;
+		for (j = 0; j < 3; j++) {
+			p->node[0].mn[j] = 1e38;
+			p->node[0].mx[j] = -1e38;
+		}
+		p->node[0].ix = 0;
+		p->node[0].nt = 0;
+	}
 
-	/* Sort the axis arrays */
-	for (k = 0; k < 3; k++) {
-
-			/* Sort upper edges of bounding box */
-#define 	HEAP_COMPARE(A,B) (A->mix[1][k] < B->mix[1][k])
-			HEAPSORT(gtri *, &p->sax[k * 2 + 0][0], ntris)
-#undef HEAP_COMPARE
+	/* Set the triangle bounding boxes, and pack */
+	/* the triangle values in leaf order. */
+	for (i = 0; i < ntris; i++) {
+		gtri *t = p->t[i];
 
-			/* Sort lower edges of bounding box */
-#define 	HEAP_COMPARE(A,B) (A->mix[0][k] < B->mix[0][k])
-			HEAPSORT(gtri *, &p->sax[k * 2 + 1][0], ntris)
-#undef HEAP_COMPARE
+		for (j = 0; j < 3; j++) {
+			t->mix[0][j] = 1e38;
+			t->mix[1][j] = -1e38;
+			for (k = 0; k < 3; k++) {
+				if (t->v[k]->p[j] < t->mix[0][j])
+					t->mix[0][j] = t->v[k]->p[j];
+				if (t->v[k]->p[j] > t->mix[1][j])
+					t->mix[1][j] = t->v[k]->p[j];
+			}
+			p->mn[j][i] = t->mix[0][j];
+			p->mx[j][i] = t->mix[1][j];
+		}
+		for (j = 0; j < 4; j++)
+			p->pe[j][i] = t->pe[j];
 	}
+
+	s->bvh = p;
 	s->ne_inited = 1;
 
-//printf("~1 init_ne done\n");
+//printf("~1 init_bvh done, %d tris, %d nodes\n",ntris,p->nn);
 }
 
 /* Free everything */
-static void del_gnn(gnn *p) {
-	int k;
+static void del_gbvh(gbvh *p) {
+	int j;
 
-	for (k = 0; k < (3 * 2); k++) {
-		free (p->sax[k]);
+	free(p->node);
+	free(p->t);
+	for (j = 0; j < 4; j++)
+		free(p->pe[j]);
+	for (j = 0; j < 3; j++) {
+		free(p->mn[j]);
+		free(p->mx[j]);
 	}
-
 	free(p);
 }
 
@@ -4919,387 +5017,151 @@ gtri **omxtri
 
 int deb_insect = 1;		/* Do vrml plot */
 
-/* Debug - given a BSP node, add all the triangles vertexes indexes */
-/* below this node to the diagnosti wrl */
-static void debug_bsp_triangl_wrl(
-gamut *s,
-gbsp *np,		/* BSP node pointer we're at */
-vrml *wrl		/* Diagnostic plot */
-) {
-	if (np->tag == 1) {		/* It's a BSP node */
-		gbspn *n = (gbspn *)np;
-
-		debug_bsp_triangl_wrl(s, n->po, wrl);
-		debug_bsp_triangl_wrl(s, n->ne, wrl);
-
-	} else {
-		int nt;			/* Number of triangles in list */
-		gtri **tpp;		/* Pointer to list of triangles */
-		int i, j;
-
-		if (np->tag == 2) {			/* It's a triangle */
-			tpp = &((gtri *)np);
-			nt = 1;
-		} else if (np->tag == 3) {	/* It's a triangle list */
-			gbspl *n = (gbspl *)np;
-			tpp = n->t;
-			nt = n->nt;
-		}
-		/* Go through the list of triangles and intersect with vector */
-		for (i = 0; i < nt; i++, tpp++) {
-			gtri *t = *tpp;
-			int ix[3];
-
-			ix[0] = t->v[0]->tn;
-			ix[1] = t->v[1]->tn;
-			ix[2] = t->v[2]->tn;
-
-			wrl->add_triangle(wrl, 0, ix);
-		}
-	}
-}
 #else	/* !INTERSECT_DEBUG */
 # define ISDBG(xxx)
 #endif	/* !INTERSECT_DEBUG */
 
-/* Recursive vector intersect using BSP accelleration. */
-static void vector_isect_rec(
+/* Locate the intersections of the line vb + t * vv, t0 <= t <= t1 */
+/* with the gamut surface using the bounding volume hierarchy. */
+static void vector_isect_bvh(
 gamut *s,
-gbsp  *np,		/* BSP node pointer we're at */
 double *vb,		/* Center relative base point of vector */
 double *vv,		/* Vector direction from base */
-double t0,		/* Start parameter value of line */
-double rs0,		/* line start point radius squared */ 
-double t1,		/* End parameter value of line */
-double rs1,		/* line end point radius squared */ 
-double tc,		/* Parameter value of closest point on line to center */
-double rsc,		/* Radius squared of closest point on line to center */
-double rse0,	/* Effective radius squared minimum */
-double rse1,	/* Effective radius squared maximum */
-gispnt *lp,		/* List to set intersections in. */
-int    ll,		/* Size of list. 0 == 2, min and max only */
-int   *lu		/* Number used in list */
+double t0,		/* Parameter range to search */
+double t1,
+gispnt *lp,		/* List to return intersections in */
+int ll,			/* Size of list. 0 == 2, min & max */
+int *lu			/* Used in list */
 ) {
-	double den;			/* Intersection denominator */
-	double ti;			/* Intersection parameter value */
-	double rsi;			/* Radius squared of intersection point */
-	double ip[3];		/* Intersection point */
-
-#ifdef INTERSECT_DEBUG
-	if (ll == 0)
-		printf("\nvector_isect_rec got seg %f - %f (%e), best %f, %f\n",t0,t1,t1-t0,lp[0].pv,lp[1].pv);
-	else
-		printf("\nvector_isect_rec got seg %f - %f (%e), no isects %d\n",t0,t1,t1-t0,*lu);
-	printf("     rs %f, %f, tc %f, rsc %f, rse0 %f, rse1 %f, BSP rs %f - %f\n",rs0, rs1, tc, rsc, rse0, rse1, np->rs0, np->rs1);
-#endif
-#ifdef INTERSECT_DEBUG
-	if (deb_insect) {
-		char isect[20] = "isect";
-		char isect2[20] = "isect2";
-		vrml *wrl = NULL;
-		double cc[3] = { 1.0, 1.0, 0.0 };
-		double red[3] = { 1.0, 0.0, 0.0 };
-		double green[3] = { 0.0, 1.0, 0.0 };
-		double blue[3] = { 0.0, 0.0, 1.0 };
-		double p1[3], p2[3];
-		int i;
+	gbvh *p = s->bvh;
+	gbvhn *n, *stack[BVH_MAXDEPTH];	/* Nodes still to be searched */
+	int sp = 0;
+	double ab[3];			/* Absolute base point */
+	double iv[3];			/* Inverse of vv, 0 if too small */
+	int j;
 
-		strcat(isect2, vrml_ext());
-		strcat(isect, vrml_ext());
+	for (j = 0; j < 3; j++) {
+		ab[j] = vb[j] + s->cent[j];
+		iv[j] = fabs(vv[j]) > 1e-12 ? 1.0/vv[j] : 0.0;
+	}
 
-	    unlink(isect2);
-    	rename(isect, isect2);
+	for (n = &p->node[0]; n != NULL;) {
+		double tn = t0, tf = t1;	/* Parameter range within box */
 
-		if ((wrl = new_vrml("isect", 0, vrml_lab)) == NULL)
-			error("New vrml failed");
+		/* Find the range of the line within the box */
+		for (j = 0; j < 3; j++) {
+			double ta, tb;
 
-		/* The triangles below the BSP */
-		for (i = 0; i < s->nv; i++) {
-			if (!(s->verts[i]->f & GVERT_TRI))
+			if (iv[j] == 0.0) {
+				if (ab[j] < n->mn[j] || ab[j] > n->mx[j])
+					break;
 				continue;
-			wrl->add_vertex(wrl, 0, s->verts[i]->p);
-		}
-		debug_bsp_triangl_wrl(s, np, wrl);
-		wrl->make_triangles(wrl, 0, 0.0, cc);
-
-		/* The segment. The vrml browser can go crazy if the line */
-		/* is too long, so limit it to +/- 100 */
-		{
-			double vbl = icmNorm3(vb);
-			double tt0 = t0, tt1 = t1;
-			if (tt0 > 0.0) {
-				if ((tt0 * vbl) > 100.0)
-					tt0 = 100.0/vbl;
-			} else {
-				if ((tt0 * vbl) < -100.0)
-					tt0 = -100.0/vbl;
-			}
-			if (tt1 > 0.0) {
-				if ((tt1 * vbl) > 100.0)
-					tt1 = 100.0/vbl;
-			} else {
-				if ((tt1 * vbl) < -100.0)
-					tt1 = -100.0/vbl;
 			}
-			for (i = 0; i < 3; i++) {
-				p1[i] = s->cent[i] + vb[i] + tt0 * vv[i];
-				p2[i] = s->cent[i] + vb[i] + tt1 * vv[i];
-			}
-		}
-		wrl->add_col_vertex(wrl, 1, p1, red);
-		wrl->add_col_vertex(wrl, 1, p2, red);
-		wrl->make_lines(wrl, 1, 2);
-
-		/* Add two initial points */
-		for (i = 0; i < 3; i++) {
-			p1[i] = s->cent[i] + vb[i] + 0.0 * vv[i];
-			p2[i] = s->cent[i] + vb[i] + 1.0 * vv[i];
-		}
-		wrl->add_marker(wrl, p1, green, 0.5);
-		wrl->add_marker(wrl, p2, blue, 0.5);
-
-		wrl->del(wrl);
-		printf("Waiting for input after writing '%s':\n", isect);
-		getchar();
-	}
-#endif
-
-	if (np->tag == 1) {		/* It's a BSP node */
-		int j;
-		gbspn *n = (gbspn *)np;
-		double ds;
-		gbsp *n1, *n2;		/* next bsp to recurse to */
-		double ti1, ti2;	/* Intersection parameters for recursion */
-		double rse1_0, rse1_1, rse2_0, rse2_1;
-
-		ISDBG(("vector_isect_rec at bsp node %d\n"));
-
-		/* Try and compute intersection with BSP */
-
-		den = n->pe[0] * vv[0] + n->pe[1] * vv[1] + n->pe[2] * vv[2];
-		if (fabs(den) > 1e-12) {
-			/* Compute the intersection point */
-			ti = -(n->pe[0] * vb[0] + n->pe[1] * vb[1] + n->pe[2] * vb[2] + n->pe[3])/den;
-			ISDBG(("intersects BSP plane at ti %f\n",ti));
-		} 
-		if (fabs(den) < 1e-12 || ti < (t0 - 1e-6) || ti > (t1 + 1e-6)) {	/* Doesn't intersect */
-			double ds;									/* or intersects outside segment */
-
-			ISDBG(("doesn't intersect BSP plane within segment\n"));
-			/* Figure which side of the BSP segment is on */
-			ds = n->pe[0] * (vb[0] + 0.5 * (t0 + t1) * vv[0])
-			   + n->pe[1] * (vb[1] + 0.5 * (t0 + t1) * vv[1])
-		       + n->pe[2] * (vb[2] + 0.5 * (t0 + t1) * vv[2])
-			   + n->pe[3];
-
-			ISDBG(("recursing down side that segment is on\n"));
-			/* And recurse approproately if it can be improved */
-			/* ???? Shouldn't we recurse down both if ds ~= 0.0 ? */
-			if (ds >= 0.0) {
-				if (rse0 <= n->po->rs1
-			     && rse1 >= n->po->rs0
-			     && (ll > 0 || t0 < lp[0].pv || t1 > lp[1].pv))
-					vector_isect_rec(s, n->po, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-					lp, ll, lu);
-			} else {
-				if (rse0 <= n->ne->rs1
-			     && rse1 >= n->ne->rs0
-			     && (ll > 0 || t0 < lp[0].pv || t1 > lp[1].pv))
-					vector_isect_rec(s, n->ne, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-					lp, ll, lu);
+			ta = (n->mn[j] - ab[j]) * iv[j];
+			tb = (n->mx[j] - ab[j]) * iv[j];
+			if (ta > tb) {
+				double tt = ta;
+				ta = tb;
+				tb = tt;
 			}
-			ISDBG(("vector_isect_rec returning\n"));
-			return;
-		}
-
-		/* Compute radius squared to center point at split point */
-		for (rsi = 0.0, j = 0; j < 3; j++) {
-			den = vb[j] + ti * vv[j];
-			rsi += den * den;
-		}
-
-		/* Compute the effective radius squared range for each segment */
-		rse1_0 = rs0;
-		rse1_1 = rs0;
-		if (rsi < rse1_0)
-			rse1_0 = rsi;
-		if (rsi > rse1_1)
-			rse1_1 = rsi;
-		if (tc >= t0 && tc <= ti) {	/* Closest point is within segment */
-			if (rsc < rse1_0)
-				rse1_0 = rsc;
-			if (rsc > rse1_1)
-				rse1_1 = rsc;
-		}
-	
-		rse2_0 = rsi;
-		rse2_1 = rsi;
-		if (rs1 < rse2_0)
-			rse2_0 = rs1;
-		if (rs1 > rse2_1)
-			rse2_1 = rs1;
-		if (tc >= ti && tc <= t1) {	/* Closest point is within segment */
-			if (rsc < rse2_0)
-				rse2_0 = rsc;
-			if (rsc > rse2_1)
-				rse2_1 = rsc;
+			if (ta > tn)
+				tn = ta;
+			if (tb < tf)
+				tf = tb;
 		}
 
-		/* Test t0-1.0 to see what side of the BSP t0..ti is. */
-		ip[0] = vb[0] + (t0-1.0) * vv[0];
-		ip[1] = vb[1] + (t0-1.0) * vv[1];
-		ip[2] = vb[2] + (t0-1.0) * vv[2];
-
-		ds = n->pe[0] * ip[0]
-		   + n->pe[1] * ip[1]
-	       + n->pe[2] * ip[2]
-		   + n->pe[3];
-		
-		/* Because we're intersecting a line segment, we don't */
-		/* have to recurse down both sides of the BSP tree ? */
-		if (ds >= 0.0) {
-			n1 = n->po;
-			n2 = n->ne;
-		} else {
-			n1 = n->ne;
-			n2 = n->po;
-		}
-
-		/* Make sure that touching segments get properly tested */
-		ti1 = ti + 1e-7;
-		ti2 = ti - 1e-7;
-
-		/* Split the line into two segments and recurse for each. */
-		/* Don't recurse if the line can't improve either min or max. */
-		if (rse1_0 <= n1->rs1
-		 && rse1_1 >= n1->rs0
-		 && (ll > 0 || t0 < lp[0].pv || ti1 > lp[1].pv)) {
-			ISDBG(("recursing segment 1/2 %f .. %f\n",t0,ti1));
-			vector_isect_rec(s, n1, vb, vv, t0, rs0, ti1, rsi, tc, rsc, rse1_0, rse1_1,
-			                                                    lp, ll, lu);
-		}
-#ifdef INTERSECT_DEBUG
-		else if (deb_insect) {
-			printf("Skipped seg 1/2 because rse1_0 %f > n1->rs1 %f ? || rse1_1 %f < n1->rs0 %f\n",rse1_0,n1->rs1,rse1_1, n1->rs0);
-			if (ll == 0)
-				printf("|| ti1 %f <= t0 %f ? || ti1 %f <= omxt %f && t0 %f <= omnt %f ?\n",ti1,t0,ti1,lp[1].pv,t0,lp[0].pv);
-			else
-				printf("|| ti1 %f <= t0 %f ?\n",ti1,t0);
-		}
-#endif
-		if (rse2_0 <= n2->rs1
-		 && rse2_1 >= n2->rs0
-		 && (ll > 0 || ti2 < lp[0].pv || t1 > lp[1].pv)) {
-			ISDBG(("recursing segment 2/2 %f .. %f\n",ti2,t1));
-			vector_isect_rec(s, n2, vb, vv, ti2, rsi, t1, rs1, tc, rsc, rse2_0, rse2_1,
-			                                                    lp, ll, lu);
-		}
-#ifdef INTERSECT_DEBUG
-		else if (deb_insect) {
-			printf("Skipped seg 2/2 because rse2_0 %f > n2->rs1 %f ? || rse2_1 %f < n2->rs0 %f\n",rse2_0,n2->rs1,rse2_1, n2->rs0);
-			if (ll == 0)
-				printf("|| t1 %f <= ti2 %f ? || t1 %f <= omxt %f && ti2 %f <= omnt %f ?\n",t1,ti2,t1,lp[1].pv,ti2,lp[0].pv);
-			else
-				printf("|| t1 %f <= ti2 %f ?\n",t1,ti2);
+		/* Misses the box, or can't improve either min or max */
+		if (j < 3 || tn > tf
+		 || (ll <= 0 && tn >= lp[0].pv && tf <= lp[1].pv)) {
+			n = sp > 0 ? stack[--sp] : NULL;
+			continue;
 		}
-#endif
 
-		ISDBG(("vector_isect_rec returning\n"));
-		return;
-
-	/* It's a list of triangles */
-	} else {
-		int nt;			/* Number of triangles in list */
-		gtri **tpp;		/* Pointer to list of triangles */
-		int i, j;
-
-		if (np->tag == 2) {			/* It's a triangle */
-			tpp = (gtri **)&np;
-			nt = 1;
-		} else if (np->tag == 3) {	/* It's a triangle list */
-			gbspl *n = (gbspl *)np;
-			tpp = n->t;
-			nt = n->nt;
+		if (n->nt == 0) {		/* Node - search both children */
+			stack[sp++] = &p->node[n->ix];
+			n = n + 1;
+			continue;
 		}
-		ISDBG(("vector_isect_rec at triangle(s) %d\n",nt));
-		/* Go through the list of triangles and intersect with vector */
-		for (i = 0; i < nt; i++, tpp++) {
-			double bds;
-			gtri *t = *tpp;
-
-			ISDBG(("triangle no %d\n",t->n));
-
-			den = t->pe[0] * vv[0] + t->pe[1] * vv[1] + t->pe[2] * vv[2];
-			if (fabs(den) < 1e-12) {
-				ISDBG(("segment is tangent to triangle\n"));
-				continue;
-			}
 
-			/* Compute the intersection of vector with the BSP plane */
-			ti = -(t->pe[0] * (vb[0] + s->cent[0]) 
-			     + t->pe[1] * (vb[1] + s->cent[1])
-			     + t->pe[2] * (vb[2] + s->cent[2])
-			     + t->pe[3])/den;
-			ISDBG(("segment intersects at %f\n",ti));
-
-			/* Compute the actual (center relative) intersection point */
-			ip[0] = vb[0] + ti * vv[0];
-			ip[1] = vb[1] + ti * vv[1];
-			ip[2] = vb[2] + ti * vv[2];
-			ISDBG(("triangle intersection point %f %f %f\n",ip[0]+s->cent[0],ip[1]+s->cent[1],ip[2]+s->cent[2]));
-
-			/* Check if the intersection point is within the triangle */
-			bds = -1e6;
-			for (j = 0; j < 3; j++) {
-				double ds;
-				ds = t->ee[j][0] * ip[0]
-				   + t->ee[j][1] * ip[1]
-			       + t->ee[j][2] * ip[2]
-				   + t->ee[j][3];
-				if (ds > 1e-8)
-					break;			/* Not within triangle */
-				if (ds > bds)
-					bds = ds;
-			}
-			if (j < 3) {
-				ISDBG(("intersection not within triangle\n"));
-				continue;			/* Not within triangle, so ignore */
+		/* Leaf */
+		{
+			double den[BVH_LEAFTRIS], ti[BVH_LEAFTRIS];
+			double *pe0 = p->pe[0] + n->ix, *pe1 = p->pe[1] + n->ix;
+			double *pe2 = p->pe[2] + n->ix, *pe3 = p->pe[3] + n->ix;
+			int i, nt = n->nt;
+
+			/* Intersection parameter with each triangles plane */
+			for (i = 0; i < nt; i++) {
+				den[i] = pe0[i] * vv[0] + pe1[i] * vv[1] + pe2[i] * vv[2];
+				ti[i] = -(pe0[i] * ab[0] + pe1[i] * ab[1] + pe2[i] * ab[2] + pe3[i]);
 			}
 
-			/* Add intersection to list */
-			if (ll > 0) {		/* List of all */
-				if (*lu < ll) {
-					lp[*lu].pv = ti;
-					icmAdd3(lp[*lu].ip,ip,s->cent);		/* Abs. intersection point */
-					lp[*lu].dir = den > 0.0 ? 1 : 0;
-					lp[*lu].edge = bds > 0.0 ? 1 : 0;
-					lp[*lu].tri = t;
-					ISDBG(("new isect %d: pv %f, dir %d, edge %d\n",*lu,ti,lp[*lu].dir,lp[*lu].edge));
-					(*lu)++;
-				} else {
-					ISDBG(("new isect %d: List Too Short %d!!!\n",*lu,ll));
-				}
-			} else {			/* Bigest/smallest list of 2 */
-				if (ti < lp[0].pv) {
-					ISDBG(("new min %f\n",ti));
-					lp[0].pv = ti;
-					icmAdd3(lp[0].ip,ip,s->cent);		/* Abs. intersection point */
-					lp[0].dir = den > 0.0 ? 1 : 0;
-					lp[0].edge = bds > 0.0 ? 1 : 0;
-					lp[0].tri = t;
+			for (i = 0; i < nt; i++) {
+				gtri *t = p->t[n->ix + i];
+				double ip[3], bds;
+
+				if (fabs(den[i]) < 1e-12)
+					continue;			/* Tangent to triangle */
+				ti[i] /= den[i];
+
+				if (ll <= 0 && ti[i] >= lp[0].pv && ti[i] <= lp[1].pv)
+					continue;			/* Can't improve min or max */
+
+				/* Compute the actual (center relative) intersection point */
+				ip[0] = vb[0] + ti[i] * vv[0];
+				ip[1] = vb[1] + ti[i] * vv[1];
+				ip[2] = vb[2] + ti[i] * vv[2];
+
+				/* Check if the intersection point is within the triangle */
+				bds = -1e6;
+				for (j = 0; j < 3; j++) {
+					double ds;
+					ds = t->ee[j][0] * ip[0]
+					   + t->ee[j][1] * ip[1]
+				       + t->ee[j][2] * ip[2]
+					   + t->ee[j][3];
+					if (ds > 1e-8)
+						break;			/* Not within triangle */
+					if (ds > bds)
+						bds = ds;
 				}
-				if (ti > lp[1].pv) {
-					ISDBG(("new max %f\n",ti));
-					lp[1].pv = ti;
-					icmAdd3(lp[1].ip,ip,s->cent);		/* Abs. intersection point */
-					lp[1].dir = den > 0.0 ? 1 : 0;
-					lp[1].edge = bds > 0.0 ? 1 : 0;
-					lp[1].tri = t;
+				if (j < 3)
+					continue;			/* Not within triangle, so ignore */
+
+				/* Add intersection to list */
+				if (ll > 0) {		/* List of all */
+					if (*lu < ll) {
+						lp[*lu].pv = ti[i];
+						icmAdd3(lp[*lu].ip,ip,s->cent);		/* Abs. intersection point */
+						lp[*lu].dir = den[i] > 0.0 ? 1 : 0;
+						lp[*lu].edge = bds > 0.0 ? 1 : 0;
+						lp[*lu].tri = t;
+						ISDBG(("new isect %d: pv %f, dir %d, edge %d\n",*lu,ti[i],lp[*lu].dir,lp[*lu].edge));
+						(*lu)++;
+					} else {
+						ISDBG(("new isect %d: List Too Short %d!!!\n",*lu,ll));
+					}
+				} else {			/* Bigest/smallest list of 2 */
+					if (ti[i] < lp[0].pv) {
+						ISDBG(("new min %f\n",ti[i]));
+						lp[0].pv = ti[i];
+						icmAdd3(lp[0].ip,ip,s->cent);		/* Abs. intersection point */
+						lp[0].dir = den[i] > 0.0 ? 1 : 0;
+						lp[0].edge = bds > 0.0 ? 1 : 0;
+						lp[0].tri = t;
+					}
+					if (ti[i] > lp[1].pv) {
+						ISDBG(("new max %f\n",ti[i]));
+						lp[1].pv = ti[i];
+						icmAdd3(lp[1].ip,ip,s->cent);		/* Abs. intersection point */
+						lp[1].dir = den[i] > 0.0 ? 1 : 0;
+						lp[1].edge = bds > 0.0 ? 1 : 0;
+						lp[1].tri = t;
+					}
 				}
 			}
 		}
-		ISDBG(("vector_isect_rec returning\n"));
-		return;
+		n = sp > 0 ? stack[--sp] : NULL;
 	}
 }
 
@@ -5386,7 +5248,7 @@ double *vv		/* Vector direction from base */
 
 /* Given a vector, find the two extreme intersection with */
 /* the gamut surface. */
-/* BSP accellerated version */
+/* BVH accellerated version */
 /* Return 0 if there is no intersection */
 static int compute_vector_isect(
 gamut *s,
@@ -5399,19 +5261,14 @@ double *omxt,	/* and 1 being at p2 */
 gtri **omntri,	/* Return the intersection triangles */
 gtri **omxtri
 ) {
-	gtri *tp;
 	double vb[3], vv[3];	/* Center relative base of vector, vector of vector */
-	double tt, t0, rs0, t1, rs1, tc, rsc;	
-	double rse0, rse1;		/* Effective radius squared min & max */
+	double tt;
 	gispnt islist[2];		/* min and max result */
 	int lu = 0, j;
 	int rv = 0;
 
-	if IS_LIST_EMPTY(s->tris)
-		triangulate(s);
-
-	if (s->lu_inited == 0)
-		init_lu(s);				/* Init BSP search tree */
+	if (s->ne_inited == 0)
+		init_bvh(s);			/* Init BVH structure (and triangulate) */
 
 	/* Convert twp points to center relative base + vector direction */
 	for (tt = 0.0, j = 0; j < 3; j++) {
@@ -5426,53 +5283,8 @@ gtri **omxtri
 
 	islist[0].pv =  1e68;
 	islist[1].pv = -1e68;	/* Setup to find min/max */
-	t0 = -1e6;
-	t1 =  1e6;
 
-	/* Compute radius range of segment */
-	for (rs0 = rs1 = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + t0 * vv[j];
-		rs0 += tt * tt;
-		tt = vb[j] + t1 * vv[j];
-		rs1 += tt * tt;
-	}
-
-	/* Compute the point closest to the center */
-	tc = -(vv[0] * vb[0] + vv[1] * vb[1] + vv[2] * vb[2])
-	    / (vv[0] * vv[0] + vv[1] * vv[1] + vv[2] * vv[2]);
-
-#ifdef INTERSECT_VERIFY
-	/* Check that this is correct */
-	for (tt = 0.0, j = 0; j < 3; j++) {
-		double pp;
-		pp = vb[j] + tc * vv[j];
-		tt += pp * vv[j];
-	}
-	if (fabs(tt) > 1e-5)
-		error("Failed to locate closest point on vector");
-#endif	/* INTERSECT_VERIFY */
-
-	for (rsc = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + tc * vv[j];
-		rsc += tt * tt;
-	}
-
-	/* Compute the effective min/max radius squared */
-	rse0 = rs0;
-	rse1 = rs0;
-	if (rs1 < rse0)
-		rse0 = rs1;
-	if (rs1 > rse1)
-		rse1 = rs1;
-	if (tc >= t0 && tc <= t1) {	/* Closest point is within segment */
-		if (rsc < rse0)
-			rse0 = rsc;
-		if (rsc > rse1)
-			rse1 = rsc;
-	}
-
-	vector_isect_rec(s, s->lutree, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-	                                                  islist, 0, &lu);   
+	vector_isect_bvh(s, vb, vv, -1e6, 1e6, islist, 0, &lu);
 
 	/* If we failed to locate a requested intersection */
 	if (((omin != NULL || omnt != NULL || omntri != NULL) && islist[0].pv == 1e68)
@@ -5604,6 +5416,38 @@ gtri **omaxtri
 
 #endif /* INTERSECT_VERIFY */
 
+/* Compute the two extreme intersections of each of an array of */
+/* vectors with the gamut surface. Return the number that intersect. */
+static int vector_isect_n(
+gamut *s,
+double (*p1)[3],	/* First points (ie param value 0.0) */
+double (*p2)[3],	/* Second points (ie param value 1.0) */
+double (*omin)[3],	/* Return gamut surface points, min = closest to p1 */
+double (*omax)[3],	/* max = farthest from p1 */
+double *omnt,		/* Return parameter values for p1 and p2, 0 being at p1, */
+double *omxt,		/* and 1 being at p2 */
+int *isect,			/* Return nz for each vector that intersects */
+int n				/* Number of vectors */
+) {
+	int i, rv, nis = 0;
+
+	if (s->ne_inited == 0)
+		init_bvh(s);			/* Init BVH structure (and triangulate) */
+
+	for (i = 0; i < n; i++) {
+		rv = compute_vector_isect(s, p1[i], p2[i],
+		                          omin != NULL ? omin[i] : NULL,
+		                          omax != NULL ? omax[i] : NULL,
+		                          omnt != NULL ? &omnt[i] : NULL,
+		                          omxt != NULL ? &omxt[i] : NULL, NULL, NULL);
+		if (isect != NULL)
+			isect[i] = rv;
+		nis += rv;
+	}
+
+	return nis;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Compute all the intersection pairs of the vector p1->p2 with */
 /* the gamut surface.  lp points to an array of ll gispnt to be */
@@ -5620,19 +5464,15 @@ int     ll 		/* Size of list. */
 ) {
 	gtri *tp;
 	double vb[3], vv[3];	/* Center relative base of vector, vector of vector */
-	double tt, t0, rs0, t1, rs1, tc, rsc, vscale;	
-	double rse0, rse1;		/* Effective radius squared min & max */
+	double tt, t0, t1, vscale;	
 	int lu = 0, i, j, k, m, pdir;
 	int rv = 0;
 
 #ifdef INTERSECT_DEBUG
 	printf("compute_vector_isectns p1 %f %f %f, p2 %f %f %f\n", p1[0], p1[1], p1[2], p2[0], p2[1], p2[2]);
 #endif
-	if IS_LIST_EMPTY(s->tris)
-		triangulate(s);
-
-	if (s->lu_inited == 0)
-		init_lu(s);				/* Init BSP search tree */
+	if (s->ne_inited == 0)
+		init_bvh(s);			/* Init BVH structure (and triangulate) */
 
 	/* Convert twp points to relative base + vector direction */
 	for (tt = 0.0, j = 0; j < 3; j++) {
@@ -5654,51 +5494,8 @@ int     ll 		/* Size of list. */
 	t0 = -1e6 * vscale;		/* Set the parameter search space */
 	t1 =  1e6 * vscale;
 
-	/* Compute radius range of segment */
-	for (rs0 = rs1 = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + t0 * vv[j];
-		rs0 += tt * tt;
-		tt = vb[j] + t1 * vv[j];
-		rs1 += tt * tt;
-	}
-
-	/* Compute the point closest to the center */
-	tc = -(vv[0] * vb[0] + vv[1] * vb[1] + vv[2] * vb[2])
-	    / (vv[0] * vv[0] + vv[1] * vv[1] + vv[2] * vv[2]);
-
-#ifdef INTERSECT_DEBUG
-	/* Check that this is correct */
-	for (tt = 0.0, j = 0; j < 3; j++) {
-		double pp;
-		pp = vb[j] + tc * vv[j];
-		tt += pp * vv[j];
-	}
-	if (fabs(tt) > 1e-5)
-		error("Failed to locate closest point on vector");
-#endif	/* INTERSECT_DEBUG */
-
-	for (rsc = 0.0, j = 0; j < 3; j++) {
-		tt = vb[j] + tc * vv[j];
-		rsc += tt * tt;
-	}
-
-	/* Compute the effective min/max radius squared */
-	rse0 = rs0;
-	rse1 = rs0;
-	if (rs1 < rse0)
-		rse0 = rs1;
-	if (rs1 > rse1)
-		rse1 = rs1;
-	if (tc >= t0 && tc <= t1) {	/* Closest point is within segment */
-		if (rsc < rse0)
-			rse0 = rsc;
-		if (rsc > rse1)
-			rse1 = rsc;
-	}
-
-	/* Recursively locate all the triangle intersections using BSP */
-	vector_isect_rec(s, s->lutree, vb, vv, t0, rs0, t1, rs1, tc, rsc, rse0, rse1,
-	                                                  lp, ll, &lu);   
+	/* Locate all the triangle intersections using the BVH */
+	vector_isect_bvh(s, vb, vv, t0, t1, lp, ll, &lu);
 
 	if (lu <= 1) {
 #ifdef INTERSECT_DEBUG
@@ -6538,7 +6335,7 @@ char *filename
 		gtri *t;
 		int v0, v1, v2;
 
-		t = new_gtri();
+		t = new_gtri(s);
 		ADD_ITEM_TO_BOT(s->tris, t);	/* Append to triangulation list */
 
 		v0 = *((int *)gam->t[1].fdata[i][v0f]);
@@ -6598,7 +6395,7 @@ char *filename
 			}
 
 			/* Creat the edge structure */
-			e = new_gedge();
+			e = new_gedge(s);
 			ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
 			tp->e[en] = e;			/* This edge */
 			tp->ei[en] = 0;			/* 0th triangle in edge */
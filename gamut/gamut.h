@@ -149,8 +149,7 @@ struct _gtri {
 	int sort;			/* lookup: Plane sorting result for each try */
 	int bsort;			/* lookup: Current best tries sort */
 
-	unsigned int touch;	/* nn: Per value touch count */
-	double mix[2][3];	/* nn: Bounding box min and max */
+	double mix[2][3];	/* Bounding box min and max, set by init_bvh() */
 
 	double area;		/* Area - computed by nssverts() */
 	int    ssverts;		/* Number of stratified sampling verts needed - computed by nssverts() */
@@ -175,14 +174,25 @@ struct _gedge {
 
 /* ------------------------------------ */
 
-/* The gamut nearest neighbor search structure */
-struct _gnn {
-	struct _gamut *s;		/* Base gamut object */
-	int n;					/* Number of points stored */
-	gtri **sax[3 * 2];		/* Sorted axis pointers, one for each direction */
-	unsigned int tbase;		/* Touch base value for this pass */
-	unsigned int ttarget;	/* Touch target value for this pass */
-}; typedef struct _gnn gnn; 
+/* A bounding volume hierarchy node */
+struct _gbvhn {
+	double mn[3], mx[3];	/* Bounding box of the nodes triangles (absolute) */
+	int ix;					/* Leaf: index of first triangle, else index of second child */
+	int nt;					/* Leaf: number of triangles, 0 if not a leaf */
+}; typedef struct _gbvhn gbvhn;
+
+/* The gamut bounding volume hierarchy used by the nearest and vector */
+/* intersection lookups. The nodes are stored depth first, so the first */
+/* child of a node immediately follows it. The triangle values used by */
+/* the leaf tests are held as arrays in leaf order. */
+struct _gbvh {
+	int nn;					/* Number of nodes */
+	gbvhn *node;			/* [nn] Nodes, root is node[0] */
+	int nt;					/* Number of triangles */
+	gtri **t;				/* [nt] Triangles in leaf order */
+	double *pe[4];			/* [nt] Triangle plane equations (absolute) */
+	double *mn[3], *mx[3];	/* [nt] Triangle bounding boxes (absolute) */
+}; typedef struct _gbvh gbvh; 
 
 /* ------------------------------------ */
 
@@ -212,9 +222,13 @@ struct _gamut {
 	int nsv;			/* Number of vertices that have been set */
 	int ntv;			/* Number of vertices used in triangulation */
 	gvert **verts;		/* Pointers to allocated vertices */
+	int trisn;			/* Next triangle serial number */
+	int edgesn;			/* Next edge serial number */
+	int bspnsn;			/* Next BSP decision node serial number */
+	int bsplsn;			/* Next BSP triangle list node serial number */
 	int read_inited;	/* Flag set if gamut was initialised from a read */
 	int lu_inited;		/* Flag set if radial surface lookup is inited */
-	int ne_inited;		/* Flag set if nearest lookup is inited */
+	int ne_inited;		/* Flag set if nearest and vector intersect lookup is inited */
 	int cu_inited;		/* Flag set if cusp values inited and trustworthy */
 	int nofilter;		/* Flag, skip segmented maxima filtering */
 	int no2pass;		/* Flag, do only one pass of convex hull */
@@ -228,7 +242,9 @@ struct _gamut {
 	gedge *edges;		/* Edges between the triangles linked list */
 
 	gbsp  *lutree;		/* Lookup function BSP tree root */
-	gnn   *nns;			/* nearest neighbor acceleration structure */
+	double *rsv;		/* Cached radial surface distances for radial_isect(), NULL if none */
+	int    rsres;		/* Direction resolution of rsv[] */
+	gbvh  *bvh;			/* nearest and vector intersect bounding volume hierarchy */
 
 	int cswbset;		/* Flag to indicate that the cs white & black points are set */
 	double cs_wp[3];	/* Color spaces white point */
@@ -315,6 +331,18 @@ struct _gamut {
 								/* Initialise this gamut with the intersection of the */
 								/* the two given gamuts. */
 
+	int (*radial_isect)(struct _gamut *s, struct _gamut *s2, int res,
+	                    double *vol, double *vol2, double *ivol);
+								/* Compute the volume of this gamut, gamut s2 and */
+								/* their intersection by integrating their radial */
+								/* surface distances over res x 2 res directions. */
+								/* s2 may be NULL. The radial distances of this gamut */
+								/* are cached, so it can be cheaply compared against */
+								/* many others. Once the cache has been set up by an */
+								/* initial call, concurrent calls with different s2 */
+								/* are safe. Any of the return values may be NULL. */
+								/* Return nz if the gamuts aren't compatible. */
+
 	int (*exp_cyl)(struct _gamut *s, struct _gamut *s1, double ratio);
 								/* Initialise this gamut with the source gamut */
 								/* expanded cylindrically around the nautral axis by */ 
@@ -369,6 +397,24 @@ struct _gamut {
 							/* Return the number of intersections set in list. Will be even. */
 							/* These will all be in then out pairs in direction p1->p2. */
 
+	void (*nearest_n)(struct _gamut *s, double (*out)[3], double (*in)[3], int n);
+	                          /* return points on surface closest to n inputs */
+
+	int (*vector_isect_n)(struct _gamut *s, double (*p1)[3], double (*p2)[3],
+	                      double (*min)[3], double (*max)[3], double *mint, double *maxt,
+	                      int *isect, int n);
+							/* Compute vector_isect() for n vectors p1[]->p2[]. */
+							/* isect[] is set nz for each vector that intersects. */
+							/* min, max, mint, maxt & isect may be NULL. */
+							/* Return the number of vectors that intersect. */
+
+	void (*init_lookup)(struct _gamut *s);
+							/* Set up the radial, nearest and vector intersection lookups. */
+							/* After this, or a first call of a lookup or batch lookup, */
+							/* radial(), nradial(), nearest(), nearest_tri(), vector_isect(), */
+							/* vector_isectns() and the batch lookups don't modify the */
+							/* gamut, and so may be called from several threads at once. */
+
 	void (*setwb)(struct _gamut *s, double *wp, double *bp, double *kp);
 							/* Define the colorspaces white, black and K only black points. */
 							/* May be NULL if unknown, and will be set to a default. */
@@ -2529,7 +2529,7 @@ static ORD32 icmFBuf_done(icmFBuf *p) {
 		}
 	}
 
-	if (p->super == NULL)
+	if (p->super == NULL && !p->inplace)
 		p->icp->al->free(p->icp->al, p->buf);
 	p->icp->al->free(p->icp->al, p);
 
@@ -2576,10 +2576,24 @@ static icmFBuf *new_icmFBuf_imp(icc *icp, icmFBuf *super, icmSnOp op, icmFile *f
 			p->size = p->ep - p->buf;
 	
 		} else {
+			unsigned char *fbuf;
+			size_t flen;
+
 			p->fp = fp;
 			p->of = of;
 			p->size = size;
 
+			/* If the file is an image in memory, read it in place */
+			if (p->op == icmSnRead
+			 && p->fp->get_buf != NULL
+			 && p->fp->get_buf(p->fp, &fbuf, &flen) == 0
+			 && of <= flen && size <= (flen - of)) {
+				p->buf = p->bp = (ORD8 *)fbuf + of;
+				p->ep = p->buf + size;
+				p->inplace = 1;
+				return p;
+			}
+
 			/* Allocate the buffer. Zero it so padding is zero. */
 			if ((p->buf = (ORD8 *) icp->al->calloc(icp->al, size, sizeof(ORD8))) == NULL) {
 				icm_err(icp, ICM_ERR_MALLOC, "new_icmFBuf: malloc failed");
@@ -3541,6 +3555,43 @@ static void icmSn_d_NFix16(icmFBuf *b, double *p) {
 	icmSn_primitive(b, (void *)p, icmSnPrim_d_NFix16, 0);
 }
 
+/* double <-> Normalize 1.0-0.0 8 bit (bpv == 1) or 16 bit (bpv == 2) array. */
+/* Reads are decoded directly from the buffer, since this is used */
+/* for the bulk of large tables. */
+static void icmSn_d_NFix_array(icmFBuf *b, double *p, unsigned int n, int bpv) {
+	unsigned int i;
+
+	if (bpv != 1)
+		bpv = 2;
+
+	if (b->op == icmSnRead
+	 && b->icp->e.c == ICM_ERR_OK
+	 && b->bp >= b->buf
+	 && b->bp <= b->ep
+	 && n <= (ORD32)(b->ep - b->bp)/bpv) {
+		ORD8 *bp = b->bp;
+
+		if (bpv == 1) {
+			for (i = 0; i < n; i++)
+				p[i] = (double)(ORD32)bp[i]/255.0;
+		} else {
+			for (i = 0; i < n; i++, bp += 2)
+				p[i] = (double)(256 * (ORD32)bp[0] + (ORD32)bp[1])/65535.0;
+		}
+		b->bp += n * bpv;
+		return;
+	}
+
+	/* Otherwise a value at a time, with the usual checks */
+	if (bpv == 1) {
+		for (i = 0; i < n; i++)
+			icmSn_d_NFix8(b, &p[i]);
+	} else {
+		for (i = 0; i < n; i++)
+			icmSn_d_NFix16(b, &p[i]);
+	}
+}
+
 /* double <-> Normalize 1.0-0.0 32 bit */
 static void icmSn_d_NFix32(icmFBuf *b, double *p) {
 	icmSn_primitive(b, (void *)p, icmSnPrim_d_NFix32, 0);
@@ -630,6 +630,32 @@ icmFile *new_icmFileStd_name_a(icmErr *e, char *name, char *mode, icmAlloc *al);
 icmFile *new_icmFileStd_fp_a(icmErr *e, FILE *fp, icmAlloc *al);
 
 
+/* - - - - - - - - - - - - - - - - - - - - -  */
+/* Implementation of read only file access class based on a memory mapped file. */
+/* get_buf() returns the file image, so that tags are decoded from it in */
+/* place rather than being copied into a buffer first. */
+/* (Reads the whole file into memory if memory mapping isn't available) */
+
+struct _icmFileMMap {
+	ICM_FILE_BASE
+
+	/* Private: */
+	icmAlloc *al;		/* Heap allocator reference */
+	int      mapped;	/* NZ if start is a mapping rather than an allocation */
+	unsigned char *start, *cur, *end;
+
+}; typedef struct _icmFileMMap icmFileMMap;
+
+/* These are available if SEPARATE_STD is not defined: */
+
+/* Create given a file name (opened for reading) */
+/* Note that this will fail if e has an error already set */
+icmFile *new_icmFileMMap_name(icmErr *e, char *name);
+
+/* Create given a file name (opened for reading) and take allocator reference */
+/* Note that this will fail if e has an error already set */
+icmFile *new_icmFileMMap_name_a(icmErr *e, char *name, icmAlloc *al);
+
 /* - - - - - - - - - - - - - - - - - - - - -  */
 /* Implementation of file access class based on a memory image */
 /* The buffer is assumed to be allocated with the given heap allocator */
@@ -1029,6 +1055,7 @@ struct _icmFBuf {
 	ORD8 *buf;			/* Pointer to buffer base */
 	ORD8 *bp;			/* Pointer to next location to read/write */
 	ORD8 *ep;			/* Pointer to location one past end of buffer */
+	int inplace;		/* NZ if buf references a file image rather than being allocated */
 
 	/* buf, bp, ep are dummy pointers used to compute size if op & icmSnDumyBuf */
 
@@ -379,17 +379,8 @@ static void icmPeCurve_LUT816_serialise(icmPeCurve *p, icmFBuf *b) {
 	    UINT_MAX, 0, p->bpv, "icmLut8/16"))
 		return;
 
-	if (b->op & icmSnSerialise) {
-		unsigned int i;
-
-		if (p->bpv == 1) {
-			for (i = 0; i < p->count; i++)
-				icmSn_d_NFix8(b, &p->data[i]);
-		} else {
-			for (i = 0; i < p->count; i++)
-				icmSn_d_NFix16(b, &p->data[i]);
-		}
-	}
+	if (b->op & icmSnSerialise)
+		icmSn_d_NFix_array(b, p->data, p->count, p->bpv);
 
 	ICMSNFREEARRAY(b, p->_count, p->data)
 	// ICMRDCHECKCONSUMED(icmPeCurve)		can't because there's no directory above us
@@ -713,15 +704,8 @@ void icmPeClut_LUT816_serialise(icmPeClut *p, icmFBuf *b) {
 	    (void **)&p->clutTable, sizeof(double),
 	    UINT_MAX, 0, p->bpv, "icmLut8/16"))
 		return;
-	if (b->op & icmSnSerialise) {
-		if (p->bpv == 1) {
-			for (i = 0; i < clutsize; i++)
-				icmSn_d_NFix8(b, &p->clutTable[i]);
-		} else {
-			for (i = 0; i < clutsize; i++)
-				icmSn_d_NFix16(b, &p->clutTable[i]);
-		}
-	}
+	if (b->op & icmSnSerialise)
+		icmSn_d_NFix_array(b, p->clutTable, clutsize, p->bpv);
 	ICMSNFREEARRAY(p, p->_clutsize, p->clutTable)
 	// Can't ICMRDCHECKCONSUMED(icmPeClut) because there is no directory above us
 
@@ -223,6 +223,7 @@ typedef struct {
 							/* Offset 0 = allocated size */
 							/* Offset 1 = next free index */
 							/* Offset 2 = first fwd index */
+	unsigned int *rblock;	/* Single allocation holding all the lists */
 	unsigned int count;		/* Copy of forward table size */
 	double       *data;		/* Copy of forward table data */
 } icmRevTable;
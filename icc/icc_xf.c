@@ -316,6 +316,29 @@ static icmPe_lurv icmPeCurveSet_trace_lookup_bwd(icmPeCurveSet *p, double *out,
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Support for reverse interpolation of 1D lookup tables */
 
+/* Return the range of reverse lists that the fwd table segment i to i+1 intersects */
+static void icmTable_bwd_range(
+	icmRevTable  *rt,
+	unsigned int i,
+	unsigned int *ps,			/* Return start and end indexes (inclusive) */
+	unsigned int *pe
+) {
+	unsigned int s, e;
+
+	s = (unsigned int)((rt->data[i] - rt->rmin) * rt->qscale);
+	e = (unsigned int)((rt->data[i+1] - rt->rmin) * rt->qscale);
+	if (s >= rt->rsize)
+		s = rt->rsize-1;
+	if (e >= rt->rsize)
+		e = rt->rsize-1;
+	if (s > e) {	/* swap */
+		unsigned int t;
+		t = s; s = e; e = t;
+	}
+	*ps = s;
+	*pe = e;
+}
+
 /* Create a reverse curve lookup acceleration table */
 /* return non-zero on error, 2 = malloc error. */
 static int icmTable_setup_bwd(
@@ -324,7 +347,9 @@ static int icmTable_setup_bwd(
 	unsigned int size,			/* Size of fwd table */
 	double       *data			/* Table */
 ) {
-	unsigned int i;
+	unsigned int i, j, s, e;
+	unsigned int *cnt;			/* Number of fwd indexes in each list */
+	unsigned int tsize;			/* Total size of all the lists */
 
 	if (rt->inited) {
 		return 0;
@@ -356,49 +381,45 @@ static int icmTable_setup_bwd(
 		goto fail;
 	}
 
-	/* Assign each output value range bucket lists it intersects */
+	/* Rather than allocating each list separately, count the */
+	/* fwd indexes in each list, and lay them all out in one allocation. */
+	if ((cnt = (unsigned int *) icp->al->calloc(icp->al, rt->rsize, sizeof(unsigned int))) == NULL) {
+		icp->al->free(icp->al, rt->rlists);
+		goto fail;
+	}
 	for (i = 0; rt->count > 1 && i < (rt->count-1); i++) {
-		unsigned int s, e, j;	/* Start and end indexes (inclusive) */
-		s = (unsigned int)((rt->data[i] - rt->rmin) * rt->qscale);
-		e = (unsigned int)((rt->data[i+1] - rt->rmin) * rt->qscale);
-		if (s >= rt->rsize)
-			s = rt->rsize-1;
-		if (e >= rt->rsize)
-			e = rt->rsize-1;
-		if (s > e) {	/* swap */
-			unsigned int t;
-			t = s; s = e; e = t;
+		icmTable_bwd_range(rt, i, &s, &e);
+		for (j = s; j <= e; j++)
+			cnt[j]++;
+	}
+	for (tsize = 0, j = 0; j < rt->rsize; j++) {
+		if (cnt[j] > 0)
+			tsize = sat_addadd(tsize, 2, cnt[j]);
+	}
+	if (tsize == UINT_MAX || ovr_mul(tsize, sizeof(unsigned int))
+	 || (rt->rblock = (unsigned int *) icp->al->malloc(icp->al,
+	                        (tsize > 0 ? tsize : 1) * sizeof(unsigned int))) == NULL) {
+		icp->al->free(icp->al, cnt);
+		icp->al->free(icp->al, rt->rlists);
+		goto fail;
+	}
+	for (tsize = 0, j = 0; j < rt->rsize; j++) {
+		if (cnt[j] > 0) {
+			rt->rlists[j] = rt->rblock + tsize;
+			rt->rlists[j][0] = 2 + cnt[j];		/* Allocated size */
+			rt->rlists[j][1] = 2;				/* Next free slot */
+			tsize += 2 + cnt[j];
 		}
+	}
+	icp->al->free(icp->al, cnt);
+
+	/* Assign each output value range bucket lists it intersects */
+	for (i = 0; rt->count > 1 && i < (rt->count-1); i++) {
+		icmTable_bwd_range(rt, i, &s, &e);
 
 		/* For all buckets that may contain this output range, add index of this output */
-		for (j = s; j <= e; j++) {
-			unsigned int as;			/* Allocation size */
-			unsigned int nf;			/* Next free slot */
-			if (rt->rlists[j] == NULL) {	/* No allocation */
-				as = 5;						/* Start with space for 5 */
-				if ((rt->rlists[j] = (unsigned int *) icp->al->calloc(icp->al, as, sizeof(unsigned int))) == NULL) {
-					goto fail;
-				}
-				rt->rlists[j][0] = as;
-				nf = rt->rlists[j][1] = 2;
-			} else {
-				as = rt->rlists[j][0];	/* Allocate space for this list */
-				nf = rt->rlists[j][1];	/* Next free location in list */
-				if (nf >= as) {			/* need to expand space */
-					if ((as = sat_mul(as, 2)) == UINT_MAX
-					 || ovr_mul(as, sizeof(unsigned int))) {
-						goto fail;
-					}
-					rt->rlists[j] = (unsigned int *) icp->al->realloc(icp->al,rt->rlists[j], as * sizeof(unsigned int));
-					if (rt->rlists[j] == NULL) {
-						goto fail;
-					}
-					rt->rlists[j][0] = as;
-				}
-			}
-			rt->rlists[j][nf++] = i;
-			rt->rlists[j][1] = nf;
-		}
+		for (j = s; j <= e; j++)
+			rt->rlists[j][rt->rlists[j][1]++] = i;
 	}
 	rt->inited = 1;
 	return 0;
@@ -413,9 +434,9 @@ static void icmTable_delete_bwd(
 	icmRevTable  *rt			/* Reverse table data to setup */
 ) {
 	if (rt->inited != 0) {
-		while (rt->rsize > 0)
-			icp->al->free(icp->al, rt->rlists[--rt->rsize]);
+		icp->al->free(icp->al, rt->rblock);
 		icp->al->free(icp->al, rt->rlists);
+		rt->rsize = 0;
 		rt->count = 0;			/* Don't keep these */
 		rt->data = NULL;
 	}
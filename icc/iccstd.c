@@ -41,6 +41,12 @@
 #define fileno _fileno
 #endif
 
+#if defined(UNIX) || defined(__APPLE__)
+# include <sys/mman.h>
+# include <unistd.h>
+# define ICM_USE_MMAP			/* Memory map files for icmFileMMap */
+#endif
+
 #ifndef SIZE_MAX
 # define SIZE_MAX ((size_t)(-1))
 #endif
@@ -541,6 +547,237 @@ icmAlloc *al			/* heap allocator, NULL for default */
 	return p;
 }
 
+/* ------------------------------------------------- */
+/* Memory mapped read only icmFile compatible class */
+
+/* Get the size of the file */
+static size_t icmFileMMap_get_size(icmFile *pp) {
+	icmFileMMap *p = (icmFileMMap *)pp;
+
+	return p->end - p->start;
+}
+
+/* Set current position to offset. Return 0 on success, nz on failure. */
+static int icmFileMMap_seek(
+icmFile *pp,
+unsigned int offset
+) {
+	icmFileMMap *p = (icmFileMMap *)pp;
+
+	if (offset > (size_t)(p->end - p->start))
+		return 1;
+	p->cur = p->start + offset;
+	return 0;
+}
+
+/* Read count items of size length. Return number of items successfully read. */
+static size_t icmFileMMap_read(
+icmFile *pp,
+void *buffer,
+size_t size,
+size_t count
+) {
+	icmFileMMap *p = (icmFileMMap *)pp;
+	size_t len;
+
+	if (size == 0 || count == 0)
+		return 0;
+
+	len = (p->end - p->cur)/size;
+	if (count > len)
+		count = len;
+	len = size * count;
+	if (len > 0)
+		memmove(buffer, p->cur, len);
+	p->cur += len;
+	return count;
+}
+
+/* write count items of size length. Return number of items successfully written. */
+static size_t icmFileMMap_write(
+icmFile *pp,
+void *buffer,
+size_t size,
+size_t count
+) {
+	return 0;		/* Read only */
+}
+
+/* do a printf */
+static int icmFileMMap_printf(
+icmFile *pp,
+const char *format,
+...
+) {
+	return -1;		/* Read only */
+}
+
+/* flush all write data out to secondary storage. Return nz on failure. */
+static int icmFileMMap_flush(
+icmFile *pp
+) {
+	return 0;
+}
+
+/* Return the file image */
+static int icmFileMMap_get_buf(
+icmFile *pp,
+unsigned char **buf,
+size_t *len
+) {
+	icmFileMMap *p = (icmFileMMap *)pp;
+	if (buf != NULL)
+		*buf = p->start;
+	if (len != NULL)
+		*len = p->end - p->start;
+	return 0;
+}
+
+/* Take a reference to the icmFileMMap */
+static icmFile *icmFileMMap_reference(
+icmFile *pp
+) {
+	pp->refcount++;
+	return pp;
+}
+
+/* we're done with the file object, return nz on failure */
+static int icmFileMMap_delete(
+icmFile *pp
+) {
+	if (pp == NULL || --pp->refcount > 0)
+		return 0;
+	{
+		int rv = 0;
+		icmFileMMap *p = (icmFileMMap *)pp;
+		icmAlloc *al = p->al;
+
+#ifdef ICM_USE_MMAP
+		if (p->mapped) {
+			if (munmap((void *)p->start, p->end - p->start) != 0)
+				rv = 2;
+		} else
+#endif
+		if (p->start != NULL)
+			al->free(al, p->start);
+
+		al->free(al, p);	/* Free this object */
+		al->del(al);		/* Free allocator if this is the last reference */
+
+		return rv;
+	}
+}
+
+/* Create given a file name */
+/* Note that this will fail if e has an error already set */
+icmFile *new_icmFileMMap_name(
+icmErr *e,				/* sticky return error, may be NULL */
+char *name
+) {
+	return new_icmFileMMap_name_a(e, name, NULL);
+}
+
+/* Create given a file name and allocator */
+/* Note that this will fail if e has an error already set */
+icmFile *new_icmFileMMap_name_a(
+icmErr *e,				/* Sticky return error, may be NULL */
+char *name,
+icmAlloc *al			/* heap allocator, NULL for default */
+) {
+	icmFileMMap *p = NULL;
+	FILE *fp;
+	char nmode[50];
+	struct stat sbuf = { 0 };
+	size_t size;
+
+	if (e != NULL && e->c != ICM_ERR_OK)
+		return NULL;		/* Pre-existing error */
+
+	strcpy(nmode, "r");
+#if defined(O_BINARY) || defined(_O_BINARY)
+	strcat(nmode, "b");
+#endif
+
+	if ((fp = fopen(name,nmode)) == NULL) {
+		icm_err_e(e, ICM_ERR_FILE_OPEN, "Opening file '%s' failed",name);
+		return NULL;
+	}
+
+	if (fstat(fileno(fp), &sbuf) != 0) {
+		fclose(fp);
+		icm_err_e(e, ICM_ERR_FILE_OPEN, "Getting size of file '%s' failed",name);
+		return NULL;
+	}
+	size = (size_t)sbuf.st_size;
+	if (sbuf.st_size < 0 || size != sbuf.st_size) {		/* Doesn't fit in size_t */
+		fclose(fp);
+		icm_err_e(e, ICM_ERR_FILE_OPEN, "File '%s' is too large to map",name);
+		return NULL;
+	}
+
+	if (al == NULL) {	/* None provided, create default */
+		if ((al = new_icmAllocStd(e)) == NULL) {
+			fclose(fp);
+			return NULL;
+		}
+	} else {
+		al = al->reference(al);
+	}
+
+	if ((p = (icmFileMMap *) al->calloc(al, 1, sizeof(icmFileMMap))) == NULL) {
+		fclose(fp);
+		al->del(al);
+		icm_err_e(e, ICM_ERR_MALLOC, "Allocating Memory Mapped File object failed");
+		return NULL;
+	}
+	p->refcount  = 1;
+	p->al        = al;
+	p->get_size  = icmFileMMap_get_size;
+	p->seek      = icmFileMMap_seek;
+	p->read      = icmFileMMap_read;
+	p->write     = icmFileMMap_write;
+	p->printf    = icmFileMMap_printf;
+	p->flush     = icmFileMMap_flush;
+	p->get_buf   = icmFileMMap_get_buf;
+	p->reference = icmFileMMap_reference;
+	p->del       = icmFileMMap_delete;
+
+	if (size > 0) {
+#ifdef ICM_USE_MMAP
+		void *base;
+
+		/* (The mapping remains valid after the file is closed) */
+		if ((base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0)) != MAP_FAILED) {
+			p->start = (unsigned char *)base;
+			p->mapped = 1;
+		}
+#endif
+		if (p->start == NULL) {		/* Read it into memory */
+			if ((p->start = (unsigned char *)al->malloc(al, size)) == NULL) {
+				fclose(fp);
+				al->free(al, p);
+				al->del(al);
+				icm_err_e(e, ICM_ERR_MALLOC, "Allocating Memory File buffer failed");
+				return NULL;
+			}
+			if (fread(p->start, 1, size, fp) != size) {
+				fclose(fp);
+				al->free(al, p->start);
+				al->free(al, p);
+				al->del(al);
+				icm_err_e(e, ICM_ERR_FILE_READ, "Reading file '%s' failed",name);
+				return NULL;
+			}
+		}
+	}
+	fclose(fp);
+
+	p->cur = p->start;
+	p->end = p->start + size;
+
+	return (icmFile *)p;
+}
+
 /* ------------------------------------------------- */
 
 /* Create a memory image file access class with the std allocator */
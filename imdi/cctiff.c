@@ -96,6 +96,9 @@
 #include "icc.h"
 #include "xicc.h"
 #include "imdi.h"
+#include "conv.h"
+#include "xdg_bds.h"
+#include "tiffstrip.h"
 
 #undef DEBUG		/* Print detailed debug info */
 
@@ -105,6 +108,7 @@
 #endif
 
 #define DEFJPGQ 80		/* Default JPEG quality */
+#define CACHE_KEYL 4096	/* Maximum imdi cache key length */
 
 void usage(char *diag, ...) {
 	fprintf(stderr,"Color Correct a TIFF or JPEG file using any sequence of ICC profiles or Calibrations, V%s\n",ARGYLL_VERSION_STR);
@@ -130,6 +134,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -I              Ignore any file or profile colorspace mismatches\n");
 	fprintf(stderr," -D              Don't append or set the output TIFF or JPEG description\n");
 	fprintf(stderr," -N              Output uncompressed TIFF (default LZW)\n");
+	fprintf(stderr," -M              Cache the fast conversion table for re-use\n");
 	fprintf(stderr," -e profile.[%s | tiff | jpg]  Optionally embed a profile in the destination TIFF or JPEG file.\n",ICC_FILE_EXT_ND);
 	fprintf(stderr,"\n");
 	fprintf(stderr,"                 Then for each profile in sequence:\n");
@@ -903,6 +908,97 @@ static void output_curves(
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Check that a line of floating point device values are all in the */
+/* range 0.0 .. 1.0 that imdi and the ICC device encoding can represent. */
+/* (Larger HDR values would otherwise be silently clipped) */
+static void check_float_line(void *buf, imdi_pixrep rep, int nv, int y) {
+	int i;
+	double v;
+
+	for (i = 0; i < nv; i++) {
+		if (rep == pixflt32)
+			v = ((float *)buf)[i];
+		else
+			v = imdi_half2float(((unsigned short *)buf)[i]);
+		if (!(v >= 0.0 && v <= 1.0))
+			error("Floating point TIFF value %f on line %d is outside the range 0.0 to 1.0",v,y);
+	}
+}
+
+/* Add a string to an FNV-1a hash */
+static unsigned int str_hash(unsigned int hash, char *s) {
+	for (; *s != '\000'; s++) {
+		hash ^= (unsigned char)*s;
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+/* Add the contents of a file to an FNV-1a hash. */
+/* Return nz if the file can't be read. */
+static int file_hash(unsigned int *hash, char *name) {
+	unsigned char buf[8192];
+	size_t i, n;
+	FILE *fp;
+
+	if ((fp = fopen(name, "rb")) == NULL)
+		return 1;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		for (i = 0; i < n; i++) {
+			*hash ^= buf[i];
+			*hash *= 16777619;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* Create the imdi cache file name and key for the conversion. */
+/* The key identifies the profile/calibration chain contents and all */
+/* the options that affect the multi-dimensional table values. */
+/* Return nz if the cache can't be used. */
+static int imdi_cache_name(
+	sucntx *su,
+	int bps,			/* Bits per sample */
+	int clutres,		/* imdi resolution */
+	char **cname,		/* Return allocated cache file name */
+	char *ckey			/* Return key, CACHE_KEYL long */
+) {
+	char tbuf[MAXNAMEL+1];
+	char **paths = NULL;
+	unsigned int hash = 2166136261u;
+	int i, npaths;
+
+	sprintf(ckey, "cctiff %s ins 0x%x outs 0x%x inv %d %d id %d od %d bps %d signs 0x%x 0x%x"
+	              " comb %d %d lcurve %d %d cvt %d %d res %d",
+	              ARGYLL_VERSION_STR, su->ins, su->outs, su->iinv, su->oinv, su->id, su->od,
+	              bps, su->isign_mask, su->osign_mask, su->icombine, su->ocombine,
+	              su->ilcurve, su->olcurve, su->icvt != NULL, su->ocvt != NULL, clutres);
+
+	for (i = su->first; i <= su->last; i++) {
+		unsigned int fhash = 2166136261u;
+
+		if (file_hash(&fhash, su->profs[i].name))
+			return 1;
+		if (strlen(ckey) > (CACHE_KEYL - 100))
+			return 1;
+		sprintf(ckey + strlen(ckey), " %s 0x%08x %d %d %d", su->profs[i].c != NULL ? "icc" : "cal",
+		        fhash, su->profs[i].intent, su->profs[i].func, su->profs[i].order);
+	}
+	sprintf(ckey + strlen(ckey), " fclut %d lclut %d", su->fclut, su->lclut);
+
+	hash = str_hash(hash, ckey);
+	sprintf(tbuf, "ArgyllCMS/imdi_%08x.cache", hash);
+	if ((npaths = xdg_bds(NULL, &paths, xdg_cache, xdg_write, xdg_user, xdg_none, tbuf)) < 1)
+		return 1;
+	if (create_parent_directories(paths[0])
+	 || (*cname = strdup(paths[0])) == NULL) {
+		xdg_free(paths, npaths);
+		return 1;
+	}
+	xdg_free(paths, npaths);
+	return 0;
+}
 
 /* Check whether two colorspaces appear compatible */
 /* return NZ if they match, Z if they don't. */
@@ -997,6 +1093,7 @@ main(int argc, char *argv[]) {
 	int ignoremm = 0;		/* Ignore any colorspace mismatches */
 	int nodesc = 0;			/* Don't append or set the description */
 	int copydct = 0;		/* For jpeg->jpeg with no changes, copy DCT cooeficients */
+	int docache = 0;		/* Cache the imdi table */
 	int i, j, rv = 0;
 
 	/* TIFF file info */
@@ -1006,6 +1103,8 @@ main(int argc, char *argv[]) {
 
 	int x, y, width, height;					/* Common size of image */
 	uint16 bitspersample;						/* Bits per sample */
+	uint16 sampleformat = SAMPLEFORMAT_UINT;	/* Sample format */
+	imdi_pixrep pixrep;							/* imdi pixel representation */
 	uint16 resunits;
 	float resx, resy;
 	uint16 pconfig;								/* Planar configuration */
@@ -1019,6 +1118,7 @@ main(int argc, char *argv[]) {
 	char *wdesc = NULL;							/* Written desciption */
 
 	tdata_t *inbuf = NULL, *outbuf = NULL, *hprecbuf = NULL;
+	tiffstrip *ts = NULL;		/* TIFF output strip writer */
 	int inbpix, outbpix;				/* Number of pixels in jpeg in/out buf */
 
 	/* JPEG file info */
@@ -1221,6 +1321,9 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'N')
 				su.compr = 0;
 
+			else if (argv[fa][1] == 'M')
+				docache = 1;
+
 
 			/* Verbosity */
 			else if (argv[fa][1] == 'v' || argv[fa][1] == 'V') {
@@ -1339,7 +1442,11 @@ main(int argc, char *argv[]) {
 		TIFFGetField(rh, TIFFTAG_IMAGELENGTH, &height);
 
 		TIFFGetField(rh, TIFFTAG_BITSPERSAMPLE, &bitspersample);
-		if (bitspersample != 8 && bitspersample != 16) {
+		TIFFGetFieldDefaulted(rh, TIFFTAG_SAMPLEFORMAT, &sampleformat);
+		if (sampleformat == SAMPLEFORMAT_IEEEFP) {
+			if (bitspersample != 16 && bitspersample != 32)
+				error("TIFF Input file must be 16 or 32 bits/channel floating point");
+		} else if (bitspersample != 8 && bitspersample != 16) {
 			error("TIFF Input file must be 8 or 16 bits/channel");
 		}
 
@@ -1354,6 +1461,8 @@ main(int argc, char *argv[]) {
 		if ((su.ins = TiffPhotometric2ColorSpaceSignature(NULL, &su.icvt, &su.isign_mask, rphotometric,
 		                                     bitspersample, rsamplesperpixel, rextrasamples)) == 0)
 			error("Can't handle TIFF file photometric %s", Photometric2str(rphotometric));
+		if (sampleformat == SAMPLEFORMAT_IEEEFP && (su.icvt != NULL || su.isign_mask != 0))
+			error("Floating point TIFF file must be in a device colorspace, not photometric %s", Photometric2str(rphotometric));
 		su.iinv = 0;
 		su.id = rsamplesperpixel;
 
@@ -1380,6 +1489,8 @@ main(int argc, char *argv[]) {
 
 		if (dojpg < 0)
 			dojpg = 0;
+		if (dojpg && sampleformat == SAMPLEFORMAT_IEEEFP)
+			error("Can't write floating point TIFF input as a JPEG file");
 
 	/* See if it is a JPEG File */
 	} else {
@@ -1539,8 +1650,10 @@ main(int argc, char *argv[]) {
 			su.profs[i].cal->del(su.profs[i].cal);	/* Clean up */
 			su.profs[i].cal = NULL;
 
+			ATIMER_BEGIN("icc read")
 			if ((su.profs[i].c = read_embedded_icc(su.profs[i].name)) == NULL)
 				error ("Can't read profile or calibration from file '%s'",su.profs[i].name);
+			ATIMER_END
 
 			su.profs[i].h = su.profs[i].c->header;
 
@@ -1657,6 +1770,7 @@ main(int argc, char *argv[]) {
 		TIFFSetField(wh, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
 		TIFFSetField(wh, TIFFTAG_SAMPLESPERPIXEL, wsamplesperpixel);
 		TIFFSetField(wh, TIFFTAG_BITSPERSAMPLE, bitspersample);
+		TIFFSetField(wh, TIFFTAG_SAMPLEFORMAT, sampleformat);
 		TIFFSetField(wh, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 
 		if (su.compr)
@@ -1716,6 +1830,8 @@ main(int argc, char *argv[]) {
 		if ((su.outs = TiffPhotometric2ColorSpaceSignature(&su.ocvt, NULL, &su.osign_mask, wphotometric,
 		                                     bitspersample, wsamplesperpixel, wextrasamples)) == 0)
 			error("Can't handle TIFF file photometric %s", Photometric2str(wphotometric));
+		if (sampleformat == SAMPLEFORMAT_IEEEFP && (su.ocvt != NULL || su.osign_mask != 0))
+			error("Floating point TIFF file must be in a device colorspace, not photometric %s", Photometric2str(wphotometric));
 		TIFFSetField(wh, TIFFTAG_PHOTOMETRIC, wphotometric);
 
 		if (alpha && wextrasamples > 0) {
@@ -1979,9 +2095,16 @@ main(int argc, char *argv[]) {
 	if (check)
 		doimdi = dofloat = 1;
 
+	if (sampleformat == SAMPLEFORMAT_IEEEFP)
+		pixrep = bitspersample == 32 ? pixflt32 : pixflt16;
+	else
+		pixrep = bitspersample == 8 ? pixint8 : pixint16;
+
 	if (doimdi && su.nprofs > 0) {
 		int aclutres = 0;	/* Automatically set res */
 		imdi_options opts = opts_none;
+		char *cname = NULL;	/* imdi cache file name */
+		char ckey[CACHE_KEYL];	/* imdi cache key */
 	
 		if (rextrasamples > 0) {		/* We need to skip the alpha */
 			opts |= opts_istride;
@@ -2007,17 +2130,32 @@ main(int argc, char *argv[]) {
 
 		if (su.verb)
 			printf("Using CLUT resolution %d\n",clutres);
+
+		/* The icc lookups are re-entrant once they have been initialised */
+		/* by a first lookup, but inverse calibration lookups aren't. */
+		for (i = su.first; i <= su.last; i++) {
+			if (su.profs[i].cal != NULL && su.profs[i].func != icmFwd)
+				break;
+		}
+		if (i > su.last)
+			opts |= opts_mtfill;
+
+		if (docache) {
+			if (imdi_cache_name(&su, bitspersample, clutres, &cname, ckey) != 0)
+				warning("Unable to use the imdi table cache");
+			else if (su.verb)
+				printf("Using imdi table cache file '%s'\n",cname);
+		}
 	
-		s = new_imdi(
+		ATIMER_BEGIN("imdi table build")
+		s = new_imdi_c(
 			su.id,			/* Number of input dimensions */
 			su.od,			/* Number of output dimensions */
-							/* Input pixel representation */
-			bitspersample == 8 ? pixint8 : pixint16,
-							/* Output pixel representation */
+			pixrep,			/* Input pixel representation */
 			su.isign_mask,	/* Treat appropriate channels as signed */
 			NULL,			/* No raster to callback channel mapping */
 			prec_min,		/* Minimum of input and output precision */
-			bitspersample == 8 ? pixint8 : pixint16,
+			pixrep,			/* Output pixel representation */
 			su.osign_mask,	/* Treat appropriate channels as signed */
 			NULL,			/* No raster to callback channel mapping */
 			clutres,		/* Desired table resolution */
@@ -2027,8 +2165,14 @@ main(int argc, char *argv[]) {
 			input_curves,	/* Callback functions */
 			md_table,
 			output_curves,
-			(void *)&su		/* Context to callbacks */
+			(void *)&su,	/* Context to callbacks */
+			cname,			/* Cache file name */
+			ckey			/* Cache key */
 		);
+		ATIMER_END
+
+		if (cname != NULL)
+			free(cname);
 		
 		if (s == NULL) {
 	#ifdef NEVER
@@ -2193,6 +2337,12 @@ main(int argc, char *argv[]) {
 		/* Process colors to translate */
 		/* (Should fix this to process a group of lines at a time ?) */
 
+		/* Compress and write TIFF strips in parallel with the conversion */
+		if (wh != NULL) {
+			if ((ts = new_tiffstrip(wh)) == NULL)
+				error("Failed to create TIFF strip writer");
+		}
+
 		for (y = 0; y < height; y++) {
 			tdata_t *obuf;
 
@@ -2200,6 +2350,8 @@ main(int argc, char *argv[]) {
 			if (rh) {
 				if (TIFFReadScanline(rh, inbuf, y, 0) < 0)
 					error ("Failed to read TIFF line %d",y);
+				if (pixrep == pixflt32 || pixrep == pixflt16)
+					check_float_line(inbuf, pixrep, width * rsamplesperpixel, y);
 			} else {
 				jpeg_read_scanlines(&rj, (JSAMPARRAY)&inbuf, 1);
 				if (su.iinv) {
@@ -2211,7 +2363,10 @@ main(int argc, char *argv[]) {
 
 			if (doimdi && su.nprofs > 0) {
 				/* Do fast conversion */
+				ATIMER_BEGIN("imdi kernel")
 				s->interp(s, (void **)outp, 0, (void **)inp, su.id, width);
+				ATIMER_END
+				ACOUNT("imdi pixels", width);
 			}
 			
 			if (dofloat || su.nprofs == 0) {
@@ -2221,7 +2376,20 @@ main(int argc, char *argv[]) {
 					double in[MAX_CHAN], out[MAX_CHAN];
 					
 //printf("\n");
-					if (bitspersample == 8) {
+					if (pixrep == pixflt32 || pixrep == pixflt16) {
+						for (i = 0; i < su.id; i++) {
+							double v;
+							if (pixrep == pixflt32)
+								v = ((float *)inbuf)[x * su.id + i];
+							else
+								v = imdi_half2float(((unsigned short *)inbuf)[x * su.id + i]);
+							if (!(v > 0.0))			/* Clamp the same way imdi does */
+								v = 0.0;
+							else if (v > 1.0)
+								v = 1.0;
+							in[i] = v;
+						}
+					} else if (bitspersample == 8) {
 						for (i = 0; i < su.id; i++) {
 							int v = ((unsigned char *)inbuf)[x * su.id + i];
 //printf("~1 8 bit pixel value chan %d = %d\n",i,v);
@@ -2256,7 +2424,19 @@ main(int argc, char *argv[]) {
 							 out[i] = in[i];
 					}
 
-					if (bitspersample == 8) {
+					if (pixrep == pixflt32 || pixrep == pixflt16) {
+						for (i = 0; i < su.od; i++) {
+							double v = out[i];
+							if (!(v > 0.0))
+								v = 0.0;
+							else if (v > 1.0)
+								v = 1.0;
+							if (pixrep == pixflt32)
+								((float *)hprecbuf)[x * su.od + i] = (float)v;
+							else
+								((unsigned short *)hprecbuf)[x * su.od + i] = imdi_float2half((float)v);
+						}
+					} else if (bitspersample == 8) {
 						for (i = 0; i < su.od; i++) {
 							int v = (int)(out[i] * 255.0 + 0.5);
 //printf("~1 8 bit chan %d = %d\n",i,v);
@@ -2291,7 +2471,12 @@ main(int argc, char *argv[]) {
 					/* Compute the errors */
 					for (x = 0; x < (width * su.od); x++) {
 						int err;
-						if (bitspersample == 8)
+						if (pixrep == pixflt32)
+							err = (int)(65535.0 * (((float *)outbuf)[x] - ((float *)hprecbuf)[x]));
+						else if (pixrep == pixflt16)
+							err = (int)(65535.0 * (imdi_half2float(((unsigned short *)outbuf)[x])
+							                     - imdi_half2float(((unsigned short *)hprecbuf)[x])));
+						else if (bitspersample == 8)
 							err = ((unsigned char *)outbuf)[x] - ((unsigned char *)hprecbuf)[x];
 						else
 							err = ((unsigned short *)outbuf)[x] - ((unsigned short *)hprecbuf)[x];
@@ -2311,7 +2496,7 @@ main(int argc, char *argv[]) {
 				obuf = outbuf;
 
 			if (wh != NULL) {
-				if (TIFFWriteScanline(wh, obuf, y, 0) < 0)
+				if (ts->write(ts, obuf))
 					error ("Failed to write TIFF line %d",y);
 			} else {	
 				if (su.oinv) {
@@ -2336,6 +2521,11 @@ main(int argc, char *argv[]) {
 	}
 
 	if (wh != NULL) {
+		if (ts != NULL) {
+			if (ts->flush(ts))
+				error ("Failed to write TIFF file '%s'",out_name);
+			ts->del(ts);
+		}
 		if (outbuf != NULL)
 			_TIFFfree(outbuf);
 		if (hprecbuf != NULL)
@@ -2385,6 +2575,8 @@ main(int argc, char *argv[]) {
 	if (wdesc != NULL)
 		free(wdesc);
 
+	ATIMING_REPORT("cctiff");
+
 	return 0;
 }
 
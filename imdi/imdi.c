@@ -27,18 +27,20 @@
 #undef VERBOSE
 #undef VVERBOSE
 
+#define IMDI_FLTBLK 256		/* [256] Pixels per block converted by the floating point adapter */
+
 static unsigned int imdi_get_check(imdi *im);
 static void imdi_reset_check(imdi *im);
 static void imdi_info(imdi *s, unsigned long *size, int *gres, int *sres);
 static void imdi_del(imdi *im);
 static void interp_match(imdi *s, void **outp, int outst, void **inp, int inst,
                          unsigned int npixels);
+static void interp_float(imdi *s, void **outp, int outst, void **inp, int inst,
+                         unsigned int npixels);
 
 
 /* Create a new imdi */
 /* Return NULL if request is not supported */
-/* Note that we use the high level pixel layout description to locate */
-/* a suitable run-time. */
 imdi *new_imdi(
 	int id,				  /* Number of input dimensions */
 	int od,				  /* Number of output lookup dimensions */
@@ -62,6 +64,41 @@ imdi *new_imdi(
 	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
 	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
 	void *cntx		/* Context to callbacks */
+) {
+	return new_imdi_c(id, od, in, in_signed, inm, iprec, out, out_signed, outm,
+	                  res, oopt, checkv, opt, input_curves, md_table, output_curves,
+	                  cntx, NULL, NULL);
+}
+
+/* Create a new imdi, with an optional table cache file */
+/* Return NULL if request is not supported */
+/* Note that we use the high level pixel layout description to locate */
+/* a suitable run-time. */
+imdi *new_imdi_c(
+	int id,				  /* Number of input dimensions */
+	int od,				  /* Number of output lookup dimensions */
+	                      /* Number of output channels written = od - no. of oopt skip flags */
+	imdi_pixrep in,		  /* Input pixel representation */
+	int in_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *inm,			  /* Input raster channel to callback channel mapping, NULL for none. */
+	imdi_iprec iprec,	  /* Internal processing precision */
+	imdi_pixrep out,	  /* Output pixel representation */
+	int out_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *outm,			  /* Output raster channel to callback channel mapping, NULL for none. */
+	                      /* Mapping must include skipped channels. */
+	int res,			  /* Desired table resolution */
+	imdi_ooptions oopt,   /* Output per channel options (by callback channel) */
+	unsigned int *checkv, /* Output channel check values (by callback channel, NULL == 0) */
+	imdi_options opt,	  /* Direction and stride options */
+
+	/* Callbacks to lookup the imdi table values. */
+	/* (Skip output channels are looked up) */
+	void (*input_curves) (void *cntx, double *out_vals, double *in_vals),
+	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
+	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
+	void *cntx,		/* Context to callbacks */
+	char *cname,	/* Cache file name, NULL if none */
+	char *ckey		/* Cache key string */
 ) {
 	int i;
 	int prec;					/* Target internal precision */
@@ -74,9 +111,31 @@ imdi *new_imdi(
 	tabspec bts;				/* Best tab spec */
 	imdi_conv bcnv = conv_none;	/* Best tables conversion flags */
 	imdi_ooptions Ooopt;		/* oopt re-aranged to correspond to output channel index */
+	imdi_pixrep fin = invalid_rep;	/* Floating point input representation being adapted */
+	imdi_pixrep fout = invalid_rep;	/* Floating point output representation being adapted */
+	imdi_options copt = opt;	/* Options called with */
 	
 	imdi *im;
 
+	/* There are no floating point kernels, so we adapt a 16 bit kernel */
+	/* using interp_float(). It converts blocks of pixels into dense, */
+	/* pixel interleaved 16 bit buffers, and takes care of the float */
+	/* side stride and the processing direction. */
+	if (in == pixflt32 || in == pixflt16) {
+		fin = in;
+		in = pixint16;
+		in_signed = 0;
+		opt &= ~opts_istride;
+	}
+	if (out == pixflt32 || out == pixflt16) {
+		fout = out;
+		out = pixint16;
+		out_signed = 0;
+		opt &= ~opts_ostride;
+	}
+	if (fin != invalid_rep || fout != invalid_rep)
+		opt &= ~(opts_fwd | opts_bwd);
+
 	/* Compute the Output channel index oopt mask */
 	if (outm == NULL)
 		Ooopt = oopt;
@@ -386,7 +445,8 @@ imdi *new_imdi(
 	/* Allocate and initialise the appropriate tables */
 	im->impl = (void *)imdi_tab(&bgs, &bts, bcnv, in, out, ktable[bk].interp,
 	                            inm, outm, oopt, checkv, input_curves, md_table,
-	                            output_curves, cntx);
+	                            output_curves, cntx, (opt & opts_mtfill) ? 1 : 0,
+	                            cname, cname != NULL ? ckey : NULL);
 
 	if (im->impl == NULL) {
 #ifdef VERBOSE
@@ -405,6 +465,18 @@ imdi *new_imdi(
 		im->interp  = ktable[bk].interp;	
 	else
 		im->interp  = interp_match;
+
+	if (fin != invalid_rep || fout != invalid_rep) {	/* Adapt for floating point */
+		imdi_imp *impl = (imdi_imp *)im->impl;
+
+		impl->flirep = fin;
+		impl->florep = fout;
+		impl->flistr = (copt & opts_istride) ? 1 : 0;
+		impl->flostr = (copt & opts_ostride) ? 1 : 0;
+		impl->flbwd = (copt & opts_bwd) ? 1 : 0;
+		impl->finterp = im->interp;
+		im->interp = interp_float;
+	}
 	im->get_check   = imdi_get_check;
 	im->reset_check = imdi_reset_check;
 	im->info        = imdi_info;
@@ -533,6 +605,185 @@ unsigned int npixels		/* Number of pixels */
 	impl->interp(s, moutp, outst, minp, inst, npixels);
 }
 
+/* Convert a float to a 16 bit value, clamping to 0.0 .. 1.0 */
+/* (NaN is converted to 0) */
+#define FLT2US(vv) ((vv) > 0.0f ? ((vv) < 1.0f ? (unsigned short)((vv) * 65535.0f + 0.5f) \
+                                               : 65535) : 0)
+
+/* Advance the integer representation pointers by a number of pixels */
+static void adv_ptrs(
+void **dp,			/* Return advanced pointers */
+void **sp,			/* Pointers to advance */
+imdi_pixrep rep,	/* Representation */
+int n,				/* Number of plane pointers */
+int st,				/* Stride in components */
+unsigned int off	/* Pixel offset */
+) {
+	int j, bpc;
+
+	bpc = (rep == pixint16 || rep == planeint16) ? 2 : 1;
+	if (rep == pixint8 || rep == pixint16)
+		n = 1;
+	for (j = 0; j < n; j++)
+		dp[j] = (void *)((char *)sp[j] + (long)bpc * st * off);
+}
+
+/* Floating point adapter. */
+/* Convert blocks of floating point pixels to or from 16 bit */
+/* pixel interleaved buffers, and call the 16 bit conversion */
+/* (interp_match() or a kernel) to do the interpolation. */
+/* A non-floating point side is passed through using the callers pointers. */
+static void interp_float(
+imdi *s,
+void **outp, int outst,		/* Output pointers and stride */
+void **inp, int inst,		/* Input pointers and stride */
+unsigned int npixels		/* Number of pixels */
+) {
+	imdi_imp *impl = (imdi_imp *)s->impl;
+	int id = impl->id, wod = impl->wod;
+	unsigned short ibuf[IMDI_FLTBLK * IXDI];	/* 16 bit input block */
+	unsigned short obuf[IMDI_FLTBLK * IXDO];	/* 16 bit output block */
+	void *binp[IXDI];
+	void *boutp[IXDO];
+	int binst, boutst;
+	unsigned int nb, b, i;
+	int j;
+
+	/* Supply default strides */
+	if (!impl->flistr) {
+		if (impl->cirep == planeint8 || impl->cirep == planeint16)
+			inst = 1;
+		else
+			inst = id;
+	}
+	if (!impl->flostr) {
+		if (impl->corep == planeint8 || impl->corep == planeint16)
+			outst = 1;
+		else
+			outst = wod;
+	}
+
+	/* Process the blocks in the requested direction, so that in-place */
+	/* conversion to a larger pixel works. Each block is read before it is written. */
+	nb = (npixels + IMDI_FLTBLK - 1)/IMDI_FLTBLK;
+	for (b = 0; b < nb; b++) {
+		unsigned int off, n;
+
+		off = (impl->flbwd ? nb - 1 - b : b) * IMDI_FLTBLK;
+		n = npixels - off;
+		if (n > IMDI_FLTBLK)
+			n = IMDI_FLTBLK;
+
+		if (impl->flirep == pixflt32) {
+			float *ip = (float *)inp[0] + (long)inst * off;
+			unsigned short *op = ibuf;
+
+			for (i = 0; i < n; i++, ip += inst) {
+				for (j = 0; j < id; j++, op++)
+					*op = FLT2US(ip[j]);
+			}
+			binp[0] = (void *)ibuf;
+			binst = id;
+		} else if (impl->flirep == pixflt16) {
+			unsigned short *ip = (unsigned short *)inp[0] + (long)inst * off;
+			unsigned short *op = ibuf;
+
+			for (i = 0; i < n; i++, ip += inst) {
+				for (j = 0; j < id; j++, op++) {
+					float vv = imdi_half2float(ip[j]);
+					*op = FLT2US(vv);
+				}
+			}
+			binp[0] = (void *)ibuf;
+			binst = id;
+		} else {
+			adv_ptrs(binp, inp, impl->cirep, id, inst, off);
+			binst = inst;
+		}
+
+		if (impl->florep != invalid_rep) {
+			boutp[0] = (void *)obuf;
+			boutst = wod;
+		} else {
+			adv_ptrs(boutp, outp, impl->corep, wod, outst, off);
+			boutst = outst;
+		}
+
+		impl->finterp(s, boutp, boutst, binp, binst, n);
+
+		if (impl->florep == pixflt32) {
+			float *op = (float *)outp[0] + (long)outst * off;
+			unsigned short *ip = obuf;
+
+			for (i = 0; i < n; i++, op += outst) {
+				for (j = 0; j < wod; j++, ip++)
+					op[j] = *ip * (1.0f/65535.0f);
+			}
+		} else if (impl->florep == pixflt16) {
+			unsigned short *op = (unsigned short *)outp[0] + (long)outst * off;
+			unsigned short *ip = obuf;
+
+			for (i = 0; i < n; i++, op += outst) {
+				for (j = 0; j < wod; j++, ip++)
+					op[j] = imdi_float2half(*ip * (1.0f/65535.0f));
+			}
+		}
+	}
+}
+
+/* Convert an IEEE 754 half float to a float */
+float imdi_half2float(unsigned short h) {
+	union { float f; unsigned int u; } v;
+	unsigned int sg, ex, mn;
+
+	sg = (h & 0x8000) << 16;
+	ex = (h >> 10) & 0x1f;
+	mn = h & 0x3ff;
+
+	if (ex == 0) {				/* Zero or subnormal */
+		v.f = (float)mn * (1.0f/16777216.0f);
+		v.u |= sg;
+	} else if (ex == 0x1f) {	/* Inf or NaN */
+		v.u = sg | 0x7f800000 | (mn << 13);
+	} else {
+		v.u = sg | ((ex + 127 - 15) << 23) | (mn << 13);
+	}
+	return v.f;
+}
+
+/* Convert a float to an IEEE 754 half float, rounding to nearest even */
+unsigned short imdi_float2half(float f) {
+	union { float f; unsigned int u; } v;
+	unsigned int sg, ex, mn, rv, rm, hf;
+	int sh;
+
+	v.f = f;
+	sg = (v.u >> 16) & 0x8000;
+	ex = (v.u >> 23) & 0xff;
+	mn = v.u & 0x7fffff;
+
+	if (ex == 0xff)					/* Inf or NaN */
+		return sg | 0x7c00 | (mn != 0 ? 0x200 : 0);
+	if (ex > (127 + 15))			/* Overflow */
+		return sg | 0x7c00;
+	if (ex < (127 - 14)) {			/* Subnormal or zero */
+		if (ex < (127 - 25))
+			return sg;
+		mn |= 0x800000;
+		sh = 126 - ex;
+		rv = mn >> sh;
+		rm = mn & ((1 << sh) - 1);
+		hf = 1 << (sh - 1);
+	} else {
+		rv = ((ex - 127 + 15) << 10) | (mn >> 13);
+		rm = mn & 0x1fff;
+		hf = 0x1000;
+	}
+	if (rm > hf || (rm == hf && (rv & 1)))
+		rv++;		/* (May carry into the exponent, which is correct) */
+	return sg | rv;
+}
+
 /* Get the per output channel check flags - bit corresponds to output interpolation channel */
 static unsigned int imdi_get_check(imdi *im) {
 	imdi_imp *impl = (imdi_imp *)im->impl;
@@ -75,6 +75,9 @@ imdi *new_imdi(
 	imdi_ooptions oopt,   /* Output per channel options (by callback channel) */
 	unsigned int *checkv, /* Output channel check values (by callback channel, NULL == 0) */
 	imdi_options opt,	  /* Direction and stride options */
+	                      /* (pixflt32 and pixflt16 values are clamped to 0.0 .. 1.0, */
+	                      /*  and are converted to 16 bits for interpolation, so callers */
+	                      /*  must scale or reject values outside that range) */
 
 	/* Callbacks to lookup the imdi table values. */
 	/* (Skip output channels are looked up) */
@@ -84,6 +87,38 @@ imdi *new_imdi(
 	void *cntx		/* Context to callbacks */
 );
 
+/* Create a new imdi, using a cache file for the multi-dimensional table. */
+/* If cname is non-NULL and the file holds a table with the same layout */
+/* and key, it will be used rather than calling md_table(). Otherwise the */
+/* table is created and then written to cname. ckey should uniquely */
+/* identify the md_table() values, i.e. a hash of the profiles and options. */
+/* Return NULL if request is not supported */
+imdi *new_imdi_c(
+	int id,				  /* Number of input dimensions */
+	int od,				  /* Number of output lookup dimensions */
+	imdi_pixrep in,		  /* Input pixel representation */
+	int in_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *inm,			  /* Input raster channel to callback channel mapping, NULL for none. */
+	imdi_iprec iprec,	  /* Internal processing precision */
+	imdi_pixrep out,	  /* Output pixel representation */
+	int out_signed,		  /* Bit flag per channel, NZ if treat as signed */
+	int *outm,			  /* Output raster channel to callback channel mapping, NULL for none. */
+	int res,			  /* Desired table resolution */
+	imdi_ooptions oopt,   /* Output per channel options (by callback channel) */
+	unsigned int *checkv, /* Output channel check values (by callback channel, NULL == 0) */
+	imdi_options opt,	  /* Direction and stride options */
+	void (*input_curves) (void *cntx, double *out_vals, double *in_vals),
+	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
+	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
+	void *cntx,		/* Context to callbacks */
+	char *cname,	/* Cache file name, NULL if none */
+	char *ckey		/* Cache key string */
+);
+
+/* Convert between IEEE 754 half float values and float */
+float imdi_half2float(unsigned short h);
+unsigned short imdi_float2half(float f);
+
 #endif /* IMDI_H */
 
 
@@ -38,7 +38,13 @@ typedef enum {
 	pixint8     = 0x01,		/* 8 Bits per value, pixel interleaved, no padding */
 	planeint8   = 0x02,		/* 8 bits per value, plane interleaved */
 	pixint16    = 0x03,		/* 16 Bits per value, pixel interleaved, no padding */
-	planeint16  = 0x04		/* 16 bits per value, plane interleaved */
+	planeint16  = 0x04,		/* 16 bits per value, plane interleaved */
+
+	/* Floating point representations. There are no kernels generated for these, */
+	/* new_imdi() adapts a 16 bit kernel, converting pixels in blocks at run time. */
+	/* Values are clamped to the range 0.0 .. 1.0 */
+	pixflt32    = 0x05,		/* 32 bit IEEE float per value, pixel interleaved, no padding */
+	pixflt16    = 0x06		/* 16 bit IEEE half float per value, pixel interleaved, no padding */
 } imdi_pixrep;
 
 /* The internal processing precision */
@@ -103,7 +109,10 @@ typedef enum {
 	opts_sort_splx = 0x20,	/* Force sort algorithm, rather than simplex table (generate both)  */
 	opts_splx      = 0x40,	/* Generate simplex only (when possible), default is sort only. */
 
-	opts_end       = 0x80	/* End marker */
+	opts_end       = 0x80,	/* End marker */
+
+	/* Runtime only options, not used in kernel generation or selection */
+	opts_mtfill    = 0x100	/* Callbacks are re-entrant, so tables may be filled in parallel */
 } imdi_options;
 
 /* This sructure allows a series of related kernels to be generated */
@@ -203,6 +212,8 @@ int set_genspec(genspec *gs, gendesc *gd, int comb, mach_arch *a);
 			break;													\
 		case pixint16:												\
 		case planeint16:											\
+		case pixflt32:												\
+		case pixflt16:												\
 			_iprec = 16;											\
 			break;													\
 	}																\
@@ -214,6 +225,8 @@ int set_genspec(genspec *gs, gendesc *gd, int comb, mach_arch *a);
 			break;													\
 		case pixint16:												\
 		case planeint16:											\
+		case pixflt32:												\
+		case pixflt16:												\
 			_oprec = 16;											\
 			break;													\
 	}																\
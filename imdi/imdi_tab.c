@@ -23,15 +23,23 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include <limits.h>
+
+#include "numlib.h"
 #include "imdi.h"
 #include "imdi_tab.h"
+#include "conv.h"
 
 #undef VERBOSE
 #undef ASSERTS			/* Check asserts */
 
-#ifdef ASSERTS
-#include <numlib.h>
-#endif
+#define IMDI_MAXTHR 64			/* [64] Maximum number of table fill threads */
+#define IMDI_CHPERTHR 8			/* [8] Table fill chunks per thread */
+
+#define IMDI_CACHE_MAGIC 0x434d4449	/* Cache file magic number */
+#define IMDI_CACHE_VERS 1			/* Cache file version */
+#define IMDI_CACHE_HDRSZ (18 + IXDI + IXDO)	/* Max. cache file header ints */
+#define IMDI_CACHE_MAXKEY 1024		/* Max. cache key length */
 
 
 
@@ -124,6 +132,323 @@ double in_adj[] = {
 };
 
 
+/* Interpolation table fill context */
+typedef struct {
+	imdi_imp *it;
+	genspec *gs;
+	tabspec *ts;
+	byte *t;			/* Interp table */
+	int *ibdinc;		/* Interp table increment for each dimension in bytes */
+	int bigend;			/* NZ if big endian */
+	int vsize;			/* Fixed point storage size */
+	double vscale;		/* Value scale for fixed point */
+	void (*md_table)(void *cntx, double *out_vals, double *in_vals);
+	void *cntx;
+
+	/* Parallel fill */
+	unsigned int ix0;	/* First pseudo-hilbert index to be done by the threads */
+	unsigned int chsz;	/* Pseudo-hilbert index chunk size */
+	int nchunks;		/* Number of chunks */
+	int nthr;			/* Number of threads */
+} imfill;
+
+/* Per thread fill context */
+typedef struct {
+	imfill *fx;
+	int i0;				/* First chunk */
+} imthr;
+
+/* Fill the interpolation table entries with a pseudo-hilbert index */
+/* in the range six to eix inclusive. */
+static void im_fill_range(imfill *fx, unsigned int six, unsigned int eix) {
+	imdi_imp *it = fx->it;
+	genspec *gs = fx->gs;
+	tabspec *ts = fx->ts;
+	PHILBERT(phc)	/* Pseudo Hilbert counter */
+
+	/* Get ready to access the entries in the table, */
+	/* starting at the first valid index >= six */
+	PH_INIT(phc, it->id, gs->itres)
+	if (six > phctmask)
+		return;
+	if (six > 0) {
+		phcix = six - 1;
+		PH_INC(phc)
+		if (PH_LOOPED(phc))
+			return;
+	}
+
+	/* Create the interpolation table entry values */
+	while (phcix <= eix) {
+		int e, ee, ff;
+		double riv[IXDI];	/* Real input values */
+		double rev[IXDO];	/* Real entry values */
+		unsigned long iev; 
+		byte *p, *pp;		/* Pointer to entry, sub-entry */
+
+		for (e = 0, p = fx->t; e < it->id; e++) {
+			riv[e] = ((double)phc[e]) / (gs->itres - 1.0);
+			p += phc[e] * fx->ibdinc[e];		/* Compute pointer to entry value */
+		}
+
+		/* Lookup this vertices value */
+		{
+			double mriv[IXDI];	/* Channel mapped real input values */
+			double mrev[IXDO];	/* Channel mapped real entry values */
+			for (e = 0; e < it->id; e++)
+				mriv[it->it_map[e]] = riv[e];
+			fx->md_table(fx->cntx, mrev, mriv);
+			for (e = 0; e < it->od; e++)
+				rev[e] = mrev[it->im_map[e]];
+		}
+
+		/* Create all the output values */
+
+		/* I'm trying to avoid having to declare the actual entry sized */
+		/* variables, since it is difficult dynamically. */
+
+		/* For all the full entries */
+		ff = 0;
+		pp = p;
+		for (e = 0; e < ts->im_fn; e++, pp += ts->im_fs) {
+			/* For all channels within full entry */
+			for (ee = 0; ee < ts->im_fv; ee++, ff++) {
+				double revf = rev[ff];
+				if (revf < 0.0)						/* Guard against sillies */
+					revf = 0.0;
+				else if (revf > 1.0)
+					revf = 1.0;
+				iev = (unsigned long)(revf * fx->vscale + 0.5);
+
+				if (fx->bigend) {
+					write_entry[fx->vsize](pp + (ts->im_fs - (ee+1) * fx->vsize), iev);
+				} else {
+					write_entry[fx->vsize](pp + ee * fx->vsize, iev);
+				}
+			}
+		}
+
+		/* For all the 0 or 1 partial entry */
+		for (e = 0; e < ts->im_pn; e++) {
+			/* For all channels within partial entry */
+			for (ee = 0; ee < ts->im_pv; ee++, ff++) {
+				double revf = rev[ff];
+				if (revf < 0.0)						/* Guard against sillies */
+					revf = 0.0;
+				else if (revf > 1.0)
+					revf = 1.0;
+				iev = (unsigned long)(revf * fx->vscale + 0.5);
+
+				if (fx->bigend) {
+					write_entry[fx->vsize](pp + (ts->im_ps - (ee+1) * fx->vsize), iev);
+				} else {
+					write_entry[fx->vsize](pp + ee * fx->vsize, iev);
+				}
+			}
+		}
+#ifdef ASSERTS
+		if (ff != it->od)
+			fprintf(stderr,"imdi_tab assert: ff == it->od\n");
+#endif
+
+		PH_INC(phc)
+		if (PH_LOOPED(phc))
+			break;
+	}
+}
+
+/* Thread that fills every nthr'th chunk of the table */
+static int im_fill_thread(void *cntx) {
+	imthr *tx = (imthr *)cntx;
+	imfill *fx = tx->fx;
+	int i;
+
+	for (i = tx->i0; i < fx->nchunks; i += fx->nthr) {
+		unsigned int six, eix;
+
+		six = fx->ix0 + i * fx->chsz;
+		if (i == (fx->nchunks-1))
+			eix = UINT_MAX;
+		else
+			eix = six + fx->chsz - 1;
+		im_fill_range(fx, six, eix);
+	}
+	return 0;
+}
+
+/* Fill the whole interpolation table, using multiple threads if mtfill is set. */
+/* The first entry is always done by the calling thread, so that any lazy */
+/* initialisation in the callback happens before the other threads start. */
+/* Each entry is computed independently, so the result doesn't depend */
+/* on the number of threads. */
+static void im_fill(imfill *fx, int mtfill) {
+	imthr tx[IMDI_MAXTHR];
+	athread *ths[IMDI_MAXTHR];
+	unsigned int tmask;
+	int i, bits;
+
+	fx->nthr = 1;
+	if (mtfill) {
+		if ((fx->nthr = system_processors()) < 1)
+			fx->nthr = 1;
+		if (fx->nthr > IMDI_MAXTHR)
+			fx->nthr = IMDI_MAXTHR;
+	}
+
+	if (fx->nthr <= 1) {
+		im_fill_range(fx, 0, UINT_MAX);
+		return;
+	}
+
+	/* Primer entry */
+	im_fill_range(fx, 0, 0);
+
+	/* Divide the rest of the pseudo-hilbert index range into chunks. */
+	/* Valid entries aren't evenly distributed over the index range, */
+	/* so use several chunks per thread to balance the load. */
+	for (bits = 0; (1 << bits) < fx->gs->itres; bits++)
+		;
+	tmask = ((1u << (bits * fx->it->id))-1);
+	fx->ix0 = 1;
+	fx->nchunks = fx->nthr * IMDI_CHPERTHR;
+	fx->chsz = tmask / fx->nchunks + 1;
+
+	for (i = 0; i < fx->nthr; i++) {
+		tx[i].fx = fx;
+		tx[i].i0 = i;
+		if ((ths[i] = new_athread(im_fill_thread, (void *)&tx[i])) == NULL)
+			break;
+	}
+
+	/* Do any chunks we failed to start a thread for ourselves */
+	if (i < fx->nthr) {
+		int j;
+		for (j = i; j < fx->nthr; j++) {
+			tx[j].fx = fx;
+			tx[j].i0 = j;
+			im_fill_thread((void *)&tx[j]);
+		}
+	}
+
+	for (i--; i >= 0; i--) {
+		ths[i]->wait(ths[i]);
+		ths[i]->del(ths[i]);
+	}
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Interpolation table cache file. The file holds a header that */
+/* identifies the table layout and the callers key, the interpolation */
+/* table, and a checksum. */
+
+/* Fill in the cache header. Return the number of ints */
+static int imdi_cache_hdr(imfill *fx, int *hdr, char *ckey, unsigned int tsize) {
+	imdi_imp *it = fx->it;
+	tabspec *ts = fx->ts;
+	int e, n = 0;
+
+	hdr[n++] = IMDI_CACHE_MAGIC;
+	hdr[n++] = IMDI_CACHE_VERS;
+	hdr[n++] = fx->bigend;
+	hdr[n++] = (int)tsize;
+	hdr[n++] = it->id;
+	hdr[n++] = it->od;
+	hdr[n++] = fx->gs->itres;
+	hdr[n++] = fx->gs->prec;
+	hdr[n++] = fx->vsize;
+	hdr[n++] = ts->im_cd;
+	hdr[n++] = ts->im_ts;
+	hdr[n++] = ts->im_fs;
+	hdr[n++] = ts->im_fn;
+	hdr[n++] = ts->im_fv;
+	hdr[n++] = ts->im_ps;
+	hdr[n++] = ts->im_pn;
+	hdr[n++] = ts->im_pv;
+	for (e = 0; e < it->id; e++)
+		hdr[n++] = it->it_map[e];
+	for (e = 0; e < it->od; e++)
+		hdr[n++] = it->im_map[e];
+	hdr[n++] = (int)strlen(ckey);
+
+	return n;
+}
+
+/* Return a checksum of the table */
+static unsigned int imdi_cache_sum(byte *t, unsigned int tsize) {
+	unsigned int i, sum = 0;
+
+	for (i = 0; i < tsize; i++)
+		sum = ((sum << 5) | (sum >> 27)) ^ t[i];
+	return sum;
+}
+
+/* Read the interpolation table from the cache file. */
+/* Return nz if there is no cache file or it doesn't match */
+static int imdi_cache_read(imfill *fx, char *cname, char *ckey, unsigned int tsize) {
+	int hdr[IMDI_CACHE_HDRSZ], fhdr[IMDI_CACHE_HDRSZ];
+	char fkey[IMDI_CACHE_MAXKEY+1];
+	unsigned int sum;
+	FILE *fp;
+	int nh;
+
+	if (strlen(ckey) > IMDI_CACHE_MAXKEY)
+		return 1;
+
+	nh = imdi_cache_hdr(fx, hdr, ckey, tsize);
+
+	if ((fp = fopen(cname, "rb")) == NULL)
+		return 1;
+
+	if (fread(fhdr, sizeof(int), nh, fp) != (size_t)nh
+	 || memcmp(hdr, fhdr, nh * sizeof(int)) != 0
+	 || fread(fkey, 1, hdr[nh-1], fp) != (size_t)hdr[nh-1]
+	 || memcmp(ckey, fkey, hdr[nh-1]) != 0
+	 || fread(fx->t, 1, tsize, fp) != tsize
+	 || fread(&sum, sizeof(unsigned int), 1, fp) != 1
+	 || sum != imdi_cache_sum(fx->t, tsize)) {
+		fclose(fp);
+#ifdef VERBOSE
+		printf("imdi_tab: cache file '%s' doesn't match\n",cname);
+#endif
+		return 1;
+	}
+	fclose(fp);
+
+#ifdef VERBOSE
+	printf("imdi_tab: read interpolation table from cache file '%s'\n",cname);
+#endif
+	return 0;
+}
+
+/* Write the interpolation table to the cache file. */
+/* Failing to write the cache isn't an error. */
+static void imdi_cache_write(imfill *fx, char *cname, char *ckey, unsigned int tsize) {
+	int hdr[IMDI_CACHE_HDRSZ];
+	unsigned int sum;
+	FILE *fp;
+	int nh;
+
+	if (strlen(ckey) > IMDI_CACHE_MAXKEY)
+		return;
+
+	nh = imdi_cache_hdr(fx, hdr, ckey, tsize);
+	sum = imdi_cache_sum(fx->t, tsize);
+
+	if ((fp = fopen(cname, "wb")) == NULL)
+		return;
+
+	if (fwrite(hdr, sizeof(int), nh, fp) != (size_t)nh
+	 || fwrite(ckey, 1, hdr[nh-1], fp) != (size_t)hdr[nh-1]
+	 || fwrite(fx->t, 1, tsize, fp) != tsize
+	 || fwrite(&sum, sizeof(unsigned int), 1, fp) != 1) {
+		fclose(fp);
+		remove(cname);		/* Don't leave a partial file */
+		return;
+	}
+	if (fclose(fp) != 0)
+		remove(cname);
+}
+
 /* Table creation function */
 imdi_imp *
 imdi_tab(
@@ -145,7 +470,10 @@ imdi_tab(
 	void (*input_curves) (void *cntx, double *out_vals, double *in_vals),
 	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
 	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
-	void *cntx		/* Context to callbacks */
+	void *cntx,		/* Context to callbacks */
+	int mtfill,		/* NZ if callbacks are re-entrant, and table may be filled in parallel */
+	char *cname,	/* If non-NULL, interpolation table cache file name */
+	char *ckey		/* Key identifying the callbacks table values in the cache file */
 ) {
 	static int inited = 0;
 	static int bigend = 0;
@@ -161,6 +489,9 @@ imdi_tab(
 	printf("imdi_tab called\n");
 #endif
 
+	if (ckey == NULL)
+		ckey = "";
+
 	if (inited == 0) {
 		init_write_tab();
 		if (*((unsigned char *)&etest) == 0xff)
@@ -385,19 +716,8 @@ imdi_tab(
 
 	/* Setup the interpolation table */
 	{
-		byte *t, *p;	/* Pointer to interp table, pointer to total entry */
-		PHILBERT(phc)	/* Pseudo Hilbert counter */
-		double vscale;	/* Value scale for fixed point */
-		int vsize;		/* Fixed point storage size */
-
-		if (ts->im_cd)
-			vsize = (gs->prec * 2)/8;	/* Fixed point entry & computation size */
-		else
-			vsize = gs->prec/8;			/* Fixed point entry size */
-		vscale = (1 << gs->prec) -0.50000001;
-										/* Value scale for fixed point padding */
-										/* -0.5 is to prevent carry/rollover after accumulation */
-										/* Could get better accuracy with saturation arithmatic */
+		byte *t;		/* Pointer to interp table */
+		imfill fx;		/* Fill context */
 
 		/* Allocate the table */
 		if ((t = (byte *)malloc(ibdinc[it->id])) == NULL) {
@@ -411,86 +731,29 @@ imdi_tab(
 		printf("Allocated grid table = %u bytes, composed of %d dim of res %d entry %d\n",ibdinc[it->id], it->id, gs->itres, ts->im_ts);
 #endif /* VERBOSE */
 
-		/* Get ready to access all the entries in the table */
-		p = t;
-		PH_INIT(phc, it->id, gs->itres)
-
-		/* Create all the interpolation table entry values */
-		do {
-			int ee, ff;
-			double riv[IXDI];	/* Real input values */
-			double rev[IXDO];	/* Real entry values */
-			unsigned long iev; 
-			byte *pp;			/* Pointer to sub-entry */
-
-			for (e = 0, p = t; e < it->id; e++) {
-				riv[e] = ((double)phc[e]) / (gs->itres - 1.0);
-				p += phc[e] * ibdinc[e];		/* Compute pointer to entry value */
-			}
-
-			/* Lookup this vertices value */
-			{
-				double mriv[IXDI];	/* Channel mapped real input values */
-				double mrev[IXDO];	/* Channel mapped real entry values */
-				for (e = 0; e < it->id; e++)
-					mriv[it->it_map[e]] = riv[e];
-				md_table(cntx, mrev, mriv);
-				for (e = 0; e < it->od; e++)
-					rev[e] = mrev[it->im_map[e]];
-			}
-
-			/* Create all the output values */
-
-			/* I'm trying to avoid having to declare the actual entry sized */
-			/* variables, since it is difficult dynamically. */
-
-			/* For all the full entries */
-			ff = 0;
-			pp = p;
-			for (e = 0; e < ts->im_fn; e++, pp += ts->im_fs) {
-				/* For all channels within full entry */
-				for (ee = 0; ee < ts->im_fv; ee++, ff++) {
-					double revf = rev[ff];
-					if (revf < 0.0)						/* Guard against sillies */
-						revf = 0.0;
-					else if (revf > 1.0)
-						revf = 1.0;
-					iev = (unsigned long)(revf * vscale + 0.5);
-
-					if (bigend) {
-						write_entry[vsize](pp + (ts->im_fs - (ee+1) * vsize), iev);
-					} else {
-						write_entry[vsize](pp + ee * vsize, iev);
-					}
-				}
-			}
-
-			/* For all the 0 or 1 partial entry */
-			for (e = 0; e < ts->im_pn; e++) {
-				/* For all channels within partial entry */
-				for (ee = 0; ee < ts->im_pv; ee++, ff++) {
-					double revf = rev[ff];
-					if (revf < 0.0)						/* Guard against sillies */
-						revf = 0.0;
-					else if (revf > 1.0)
-						revf = 1.0;
-					iev = (unsigned long)(revf * vscale + 0.5);
-
-					if (bigend) {
-						write_entry[vsize](pp + (ts->im_ps - (ee+1) * vsize), iev);
-					} else {
-						write_entry[vsize](pp + ee * vsize, iev);
-					}
-				}
-			}
-#ifdef ASSERTS
-			if (f != it->od)
-				fprintf(stderr,"imdi_tab assert: f == it->od\n");
-#endif
-
-			PH_INC(phc)
-
-		} while (!PH_LOOPED(phc));
+		fx.it = it;
+		fx.gs = gs;
+		fx.ts = ts;
+		fx.t = t;
+		fx.ibdinc = ibdinc;
+		fx.bigend = bigend;
+		if (ts->im_cd)
+			fx.vsize = (gs->prec * 2)/8;	/* Fixed point entry & computation size */
+		else
+			fx.vsize = gs->prec/8;			/* Fixed point entry size */
+		fx.vscale = (1 << gs->prec) -0.50000001;
+										/* Value scale for fixed point padding */
+										/* -0.5 is to prevent carry/rollover after accumulation */
+										/* Could get better accuracy with saturation arithmatic */
+		fx.md_table = md_table;
+		fx.cntx = cntx;
+
+		/* Use the cached table values if they match, else create them */
+		if (cname == NULL || imdi_cache_read(&fx, cname, ckey, ibdinc[it->id]) != 0) {
+			im_fill(&fx, mtfill);
+			if (cname != NULL)
+				imdi_cache_write(&fx, cname, ckey, ibdinc[it->id]);
+		}
 
 		/* Put table into place */
 		it->im_table = (void *)t;
@@ -119,6 +119,14 @@ typedef struct {
 	void (*interp)(struct _imdi *s, void **outp, int outst,	/* Underlying conversion function */
 	                                void **inp, int inst,
 	                                unsigned int npixels);
+	/* Floating point pixel adapter (see interp_float() in imdi.c) */
+	imdi_pixrep flirep;			/* Float input representation called with, invalid_rep if none */
+	imdi_pixrep florep;			/* Float output representation called with, invalid_rep if none */
+	int flistr, flostr;			/* NZ if float input/output stride is supplied by caller */
+	int flbwd;					/* NZ if blocks should be processed last to first */
+	void (*finterp)(struct _imdi *s, void **outp, int outst,	/* 16 bit function adapted */
+	                                void **inp, int inst,
+	                                unsigned int npixels);
 	/* Output channel check data */
 	unsigned long checkv[IXDO];	/* Output per channel check values. Set flag if != checkv */
 	unsigned int checkf;		/* Output per channel check flags (one per bit) */
@@ -162,7 +170,10 @@ imdi_tab(
 	void (*input_curves) (void *cntx, double *out_vals, double *in_vals),
 	void (*md_table)     (void *cntx, double *out_vals, double *in_vals),
 	void (*output_curves)(void *cntx, double *out_vals, double *in_vals),
-	void *cntx		/* Context of callbacks */
+	void *cntx,		/* Context of callbacks */
+	int mtfill,		/* NZ if callbacks are re-entrant, and table may be filled in parallel */
+	char *cname,	/* If non-NULL, interpolation table cache file name */
+	char *ckey		/* Key identifying the callbacks table values in the cache file */
 );
 
 void imdi_tab_free(imdi_imp *it);
@@ -151,6 +151,7 @@
 #undef USE_APXLS			/* [und] Use least squares approximation setting cLUT */
 							/* (More accurate when on ?, but less smooth) */
 #define USE_CAM_CLIP_OPT	/* [def] Clip out of gamut in CAM space rather than XYZ or L*a*b* */
+#undef USE_INT_SEPARATE		/* [und] Invert CMYK output with an internal separation (faster) */
 #define ENKHACK				/* [def] Enable K hack code */
 #undef PRESERVE_SYNC		/* [und] Preserve video encoded sync level values */ 		
 #undef WARN_CLUT_CLIPPING	/* [und] Print warning if setting clut clips */
@@ -3027,8 +3028,10 @@ main(int argc, char *argv[]) {
 	if (!calonly) {
 
 		/* Open up the input device profile for reading, and read header etc. */
+		ATIMER_BEGIN("icc read")
 		if ((li.in.c = read_embedded_icc(in_name)) == NULL)
 			error ("Can't open file '%s'",in_name);
+		ATIMER_END
 		li.in.h = li.in.c->header;
 
 		/* Check that it is a suitable device input icc */
@@ -3078,8 +3081,10 @@ main(int argc, char *argv[]) {
 		}
 		/* - - - - - - - - - - - - - - - - - - - */
 		/* Open up the output device output profile for reading, and read header etc. */
+		ATIMER_BEGIN("icc read")
 		if ((li.out.c = read_embedded_icc(out_name)) == NULL)
 			error ("Can't open file '%s'",out_name);
+		ATIMER_END
 		li.out.h = li.out.c->header;
 
 		if (li.out.h->deviceClass != icSigInputClass
@@ -3441,6 +3446,9 @@ main(int argc, char *argv[]) {
 #endif
 #ifdef USE_CAM_CLIP_OPT
 			fl |= ICX_CAM_CLIP;
+#endif
+#ifdef USE_INT_SEPARATE
+			fl |= ICX_INT_SEPARATE;
 #endif
 			if (li.verb)
 				printf("Loading output inverse A2B table\n");
@@ -4605,6 +4613,7 @@ main(int argc, char *argv[]) {
 			for (i = 0; i < li.in.chan; i++)
 				 agres[i] = clutPoints;
 
+			ATIMER_BEGIN("clut fill link")
 			if (wr_icc->create_lut_xforms(
 				wr_icc,
 #ifdef USE_LEASTSQUARES_APROX
@@ -4627,6 +4636,7 @@ main(int argc, char *argv[]) {
 				apxls_min, apxls_max		/* Limit APXLS to inside colorspace */
 			) != ICM_ERR_OK)
 				error("Setting 16 bit Lut failed: %d, %s",wr_icc->e.c,wr_icc->e.m);
+			ATIMER_END
 
 			if (li.verb) {
 				printf("\n");
@@ -4708,8 +4718,10 @@ main(int argc, char *argv[]) {
 			printf("Writing ICC file '%s'\n",link_name);
 
 		/* Write the file out */
+		ATIMER_BEGIN("icc write")
 		if ((rv = wr_icc->write(wr_icc,wr_fp,0)) != 0)
 			error ("Write file: %d, %s",rv,wr_icc->e.m);
+		ATIMER_END
 
 		/* eeColor format */
 		if (li.tdlut == 1) {
@@ -4929,6 +4941,8 @@ main(int argc, char *argv[]) {
 	if (li.out.c != NULL)
 		li.out.c->del(li.out.c);
 
+	ATIMING_REPORT("collink");
+
 	return 0;
 }
 
@@ -73,6 +73,11 @@
 # define DEB6 6
 # define DEB4 4
 
+#define NAMEDC_MINIX 64		/* [64] Minimum number of colors to grid index */
+#define NAMEDC_IXPC 2.0		/* [2.0] Target average number of colors per index cell */
+#define NAMEDC_IXMXRES 64	/* [64] Maximum index grid resolution */
+#define NAMEDC_IXMARG 0.999	/* [0.999] Margin on DE94 & DE2000 index lower bounds */
+
 #ifdef NT       /* You'd think there might be some standards.... */
 # ifndef __BORLANDC__
 #  define stricmp _stricmp
@@ -1166,37 +1171,286 @@ static int read_nc(namedc *p, const char *filename, int options) {
 }
 
 
-/* Return the index of the best mataching color, -1 on error. */
-/* Lab[] is assumed to be D50, 2 degree standard observer based CIE value, */
-/* and the spec value should only be provided if this is a reflective or */
-/* transmissive measurement, NULL if emissive. */
-/* If named color library is expects other than D50, 2 degree, then */
-/* it will use the spectral value if not NULL, or chromatically */
-/* adapt the Lab value. */
-/* deType == 0 DE76 */
-/* deType == 1 DE94 */
-/* deType == 2 DE2000 */
-/* if de != NULL, return the delta E */
-int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deType) {
+/* Free the grid index */
+static void free_index(namedc *p) {
+	if (p->gstart != NULL)
+		free(p->gstart);
+	p->gstart = NULL;
+	if (p->gix != NULL)
+		free(p->gix);
+	p->gix = NULL;
+	p->gdata = NULL;
+	p->gcount = 0;
+}
+
+/* Return the grid cell index of a Lab value, clamped to the grid */
+static int index_cell(namedc *p, int *ci, double *Lab) {
+	int e, gix = 0;
+
+	for (e = 2; e >= 0; e--) {
+		int ix = (int)floor((Lab[e] - p->gmin[e])/p->gcw);
+		if (ix < 0)
+			ix = 0;
+		else if (ix >= p->gres[e])
+			ix = p->gres[e]-1;
+		if (ci != NULL)
+			ci[e] = ix;
+		gix = gix * p->gres[e] + ix;
+	}
+	return gix;
+}
+
+/* (Re)build the Lab grid index of the colors if needed. */
+/* Return nz on error */
+static int build_index(namedc *p) {
+	double gmax[3], vol;
+	int i, e, ncells;
+
+	if (p->gdata == p->data && p->gcount == p->count)
+		return 0;					/* Already current */
+
+	free_index(p);
+
+	if (p->count < NAMEDC_MINIX)
+		return 0;					/* Linear search is fast enough */
+
+	/* Find the Lab bounding box and chroma range */
+	for (e = 0; e < 3; e++) {
+		p->gmin[e] = 1e38;
+		gmax[e] = -1e38;
+	}
+	p->gCmax = 0.0;
+	for (i = 0; i < p->count; i++) {
+		double *Lab = p->data[i].Lab;
+		double C = sqrt(Lab[1] * Lab[1] + Lab[2] * Lab[2]);
+
+		for (e = 0; e < 3; e++) {
+			if (Lab[e] < p->gmin[e])
+				p->gmin[e] = Lab[e];
+			if (Lab[e] > gmax[e])
+				gmax[e] = Lab[e];
+		}
+		if (C > p->gCmax)
+			p->gCmax = C;
+	}
+	p->gLmin = p->gmin[0];
+	p->gLmax = gmax[0];
+
+	/* Aim for about NAMEDC_IXPC colors per cell */
+	for (vol = 1.0, e = 0; e < 3; e++)
+		vol *= (gmax[e] - p->gmin[e]) + 1.0;
+	p->gcw = pow(vol * NAMEDC_IXPC/(double)p->count, 1.0/3.0);
+	if (p->gcw < 0.5)
+		p->gcw = 0.5;
+	for (e = 0; e < 3; e++) {
+		double rr = gmax[e] - p->gmin[e];
+		if (rr/p->gcw > (NAMEDC_IXMXRES-1))
+			p->gcw = rr/(NAMEDC_IXMXRES-1);
+	}
+	for (ncells = 1, e = 0; e < 3; e++) {
+		p->gres[e] = (int)floor((gmax[e] - p->gmin[e])/p->gcw) + 1;
+		ncells *= p->gres[e];
+	}
+
+	if ((p->gstart = (int *)calloc(ncells+1, sizeof(int))) == NULL
+	 || (p->gix = (int *)malloc(p->count * sizeof(int))) == NULL) {
+		free_index(p);
+		snprintf(p->err, NAMEDC_ERRL, "malloc of grid index failed");
+		a1logd(p->log, 1, "build_index: %s\n",p->err);
+		return 1;
+	}
+
+	/* Count the colors in each cell, and convert to start indexes */
+	for (i = 0; i < p->count; i++)
+		p->gstart[index_cell(p, NULL, p->data[i].Lab) + 1]++;
+	for (i = 0; i < ncells; i++)
+		p->gstart[i+1] += p->gstart[i];
+
+	/* Place the colors, in index order within each cell */
+	for (i = 0; i < p->count; i++) {
+		int gi = index_cell(p, NULL, p->data[i].Lab);
+		p->gix[p->gstart[gi]++] = i;
+	}
+	for (i = ncells; i > 0; i--)
+		p->gstart[i] = p->gstart[i-1];
+	p->gstart[0] = 0;
+
+	p->gdata = p->data;
+	p->gcount = p->count;
+
+	a1logd(p->log, 2, "build_index: %d colors, grid res %d x %d x %d, cell width %f\n",
+	                  p->count, p->gres[0], p->gres[1], p->gres[2], p->gcw);
+	return 0;
+}
+
+/* Return the delta E squared of the given type */
+static double desq(double *Lab0, double *Lab1, int deType) {
+	if (deType == 0)
+		return icmLabDEsq(Lab0, Lab1);
+	else if (deType == 1)
+		return icmCIE94sq(Lab0, Lab1);
+	return icmCIE2Ksq(Lab0, Lab1);
+}
+
+/* Return a lower bound on the deType delta E between Lab and */
+/* any color at least DE76 distance d from it. */
+static double de_lbound(namedc *p, double *Lab, double d, int deType) {
+	double C, Cmx, SC;
+
+	if (deType == 0)
+		return d;
+
+	/* DE94 and DE2000 chroma and hue differences are scaled down */
+	/* by SC, which increases with the chroma of both colors. */
+	C = sqrt(Lab[1] * Lab[1] + Lab[2] * Lab[2]);
+	if ((Cmx = C + d) > p->gCmax)			/* Largest other color chroma */
+		Cmx = C > p->gCmax ? C : p->gCmax;
+
+	if (deType == 1) {
+		SC = 1.0 + 0.045 * sqrt(C * Cmx);
+		return NAMEDC_IXMARG * d/SC;
+
+	} else {
+		double L50, Lmx, SL, sc;
+
+		/* DE2000 a* is scaled up by at most 1.5, SL is largest */
+		/* at the L* extremes, and the RT hue rotation term */
+		/* can reduce the chroma & hue contribution by at most */
+		/* 1 - sin(60 deg). */
+		SC = 1.0 + 0.045 * 1.5 * 0.5 * (C + Cmx);
+
+		L50 = fabs(Lab[0] - 50.0) + 0.5 * d;	/* Average L* furthest from 50 */
+		Lmx = fabs(p->gLmin - 50.0);
+		if (fabs(p->gLmax - 50.0) > Lmx)
+			Lmx = fabs(p->gLmax - 50.0);
+		if (fabs(Lab[0] - 50.0) > Lmx)
+			Lmx = fabs(Lab[0] - 50.0);
+		if (L50 > Lmx)
+			L50 = Lmx;
+		L50 *= L50;
+		SL = 1.0 + (0.015 * L50)/sqrt(20.0 + L50);
+
+		sc = sqrt(1.0 - sin(M_PI/3.0))/SC;
+		if ((1.0/SL) < sc)
+			sc = 1.0/SL;
+		return NAMEDC_IXMARG * sc * d;
+	}
+}
+
+/* Return the index of the closest color to Lab (in namedc colorspace), */
+/* -1 on error. */
+static int match_nearest(namedc *p, double *pde, double *Lab, int deType) {
 	int i, bix = -1;
 	double bde = 1e99;
-	double Lab[3];
+
+	if (deType < 0 || deType > 2) {
+		snprintf(p->err, NAMEDC_ERRL, "Unnown deType %d",deType);
+		a1logd(p->log, 1, "match: %s\n",p->err);
+		return -1;
+	}
+
+	if (p->gix == NULL) {			/* Linear search */
+		for (i = 0; i < p->count; i++) {
+			double de = desq(Lab, p->data[i].Lab, deType);
+			if (de < bde) {
+				bde = de;
+				bix = i;
+			}
+		}
+
+	} else {		/* Search the grid in shells of cells around the query */
+		int ci[3], k, mxk = 0;
+
+		index_cell(p, ci, Lab);
+		for (i = 0; i < 3; i++) {
+			if (ci[i] > mxk)
+				mxk = ci[i];
+			if ((p->gres[i] - 1 - ci[i]) > mxk)
+				mxk = p->gres[i] - 1 - ci[i];
+		}
+
+		for (k = 0; k <= mxk; k++) {
+			int lo[3], hi[3], cc[3];
+
+			/* Closest any cell in this shell can be */
+			if (k > 0) {
+				double lb = de_lbound(p, Lab, (k - 1.0) * p->gcw, deType);
+				if ((lb * lb) > bde)
+					break;
+			}
+
+			for (i = 0; i < 3; i++) {
+				if ((lo[i] = ci[i] - k) < 0)
+					lo[i] = 0;
+				if ((hi[i] = ci[i] + k) >= p->gres[i])
+					hi[i] = p->gres[i] - 1;
+			}
+
+			for (cc[0] = lo[0]; cc[0] <= hi[0]; cc[0]++) {
+				for (cc[1] = lo[1]; cc[1] <= hi[1]; cc[1]++) {
+					for (cc[2] = lo[2]; cc[2] <= hi[2]; cc[2]++) {
+						int gi, j;
+
+						/* Skip cells inside the shell, done previously */
+						if (abs(cc[0] - ci[0]) != k
+						 && abs(cc[1] - ci[1]) != k
+						 && abs(cc[2] - ci[2]) != k)
+							continue;
+
+						gi = (cc[2] * p->gres[1] + cc[1]) * p->gres[0] + cc[0];
+						for (j = p->gstart[gi]; j < p->gstart[gi+1]; j++) {
+							int ix = p->gix[j];
+							double de = desq(Lab, p->data[ix].Lab, deType);
+
+							/* Same choice as linear search on a tie */
+							if (de < bde || (de == bde && ix < bix)) {
+								bde = de;
+								bix = ix;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (bix < 0) {
+		snprintf(p->err, NAMEDC_ERRL, "No colors to match against");
+		a1logd(p->log, 1, "match: %s\n",p->err);
+		return -1;
+	}
+	if (pde != NULL) {
+		*pde = sqrt(bde);
+	}
+	return bix;
+}
+
+/* Make sure the colors are loaded and indexed ready for matching. */
+/* Return nz on error */
+static int match_setup(namedc *p) {
 
 	if (p->filename == NULL) {		/* We haven't been opened */
 		snprintf(p->err, NAMEDC_ERRL, "We haven't been opened");
 		a1logd(p->log, 1, "match: %s\n",p->err);
-		return -1;
+		return 1;
 	}
 
 	/* If the colors haven't been read yet, read them now */
 	if (p->data == NULL || (p->options & NAMEDC_OP_NODATA)) {
 		if (read_nc(p, NULL, (p->options & ~NAMEDC_OP_NODATA))) {
 			a1logd(p->log, 1, "match: on demand data load failed with '%s'\n",p->err);
-			return -1;
+			return 1;
 		}
 		a1logd(p->log, 1, "match: after loading there are %d colors\n",p->count);
 	}
 
+	return build_index(p);
+}
+
+/* Convert a D50 Lab value or spectrum to the namedc colorspace. */
+/* Return nz on error */
+static int match_conv(namedc *p, double *Lab, double *pLab, xspect *rspect) {
+
 	icmCpy3(Lab, pLab);
 
 	if (p->ill != icIlluminantD50 || p->obs != icStdObs1931TwoDegrees) {
@@ -1206,7 +1460,7 @@ int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deTyp
 				if ((p->sp2cie = new_xsp2cie(p->ill, 0.0, NULL, p->obs, NULL, icSigLabData, 0)) == NULL) {
 					snprintf(p->err, NAMEDC_ERRL, "creating spectral conversion failed");
 					a1logd(p->log, 1, "match: %s\n",p->err);
-					return -1;
+					return 1;
 					
 				}
 			}
@@ -1228,12 +1482,12 @@ int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deTyp
 					if ((tt = new_xsp2cie(p->ill, 0.0, NULL, p->obs, NULL, icSigXYZData, 0)) == NULL) {
 						snprintf(p->err, NAMEDC_ERRL, "creating spectral conversion failed");
 						a1logd(p->log, 1, "match: %s\n",p->err);
-						return -1;
+						return 1;
 					}
 					if (standardIlluminant(&ts, icxIT_E, 0.0)) {
 						snprintf(p->err, NAMEDC_ERRL, "match: creating E type spectrum failed");
 						a1logd(p->log, 1, "match: %s\n",p->err);
-						return -1;
+						return 1;
 					} 
 					tt->convert(tt, wXYZ, &ts);
 					tt->del(tt);
@@ -1248,48 +1502,50 @@ int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deTyp
 			icmXYZ2Lab(&p->dXYZ, Lab, Lab);
 		}
 	}
- 
-	if (deType == 0) {
-		for (i = 0; i < p->count; i++) {
-			double de = icmLabDEsq(Lab, p->data[i].Lab);
-			if (de < bde) {
-				bde = de;
-				bix = i;
-			}
-		}
+	return 0;
+}
 
-	} else if (deType == 1) {
-		for (i = 0; i < p->count; i++) {
-			double de = icmCIE94sq(Lab, p->data[i].Lab);
-			if (de < bde) {
-				bde = de;
-				bix = i;
-			}
-		}
+/* Return the index of the best mataching color, -1 on error. */
+/* Lab[] is assumed to be D50, 2 degree standard observer based CIE value, */
+/* and the spec value should only be provided if this is a reflective or */
+/* transmissive measurement, NULL if emissive. */
+/* If named color library is expects other than D50, 2 degree, then */
+/* it will use the spectral value if not NULL, or chromatically */
+/* adapt the Lab value. */
+/* deType == 0 DE76 */
+/* deType == 1 DE94 */
+/* deType == 2 DE2000 */
+/* if de != NULL, return the delta E */
+int match(struct _namedc *p, double *de, double *pLab, xspect *rspect, int deType) {
+	double Lab[3];
 
-	} else if (deType == 2) {
-		for (i = 0; i < p->count; i++) {
-			double de = icmCIE2Ksq(Lab, p->data[i].Lab);
-			if (de < bde) {
-				bde = de;
-				bix = i;
-			}
-		}
-	} else {
-		snprintf(p->err, NAMEDC_ERRL, "Unnown deType %d",deType);
-		a1logd(p->log, 1, "match: %s\n",p->err);
+	if (match_setup(p))
 		return -1;
-	}
 
-	if (bix < 0) {
-		snprintf(p->err, NAMEDC_ERRL, "No colors to match against");
-		a1logd(p->log, 1, "match: %s\n",p->err);
+	if (match_conv(p, Lab, pLab, rspect))
 		return -1;
+ 
+	return match_nearest(p, de, Lab, deType);
+}
+
+/* Match a batch of n colors, as for match(). */
+/* Return nz on error. */
+static int match_batch(struct _namedc *p, int *ix, double *de, double (*pLab)[3],
+                       xspect *rspect, int n, int deType) {
+	double Lab[3];
+	int i;
+
+	if (match_setup(p))
+		return 1;
+
+	for (i = 0; i < n; i++) {
+		if (match_conv(p, Lab, pLab[i], rspect != NULL ? &rspect[i] : NULL))
+			return 1;
+
+		if ((ix[i] = match_nearest(p, de != NULL ? &de[i] : NULL, Lab, deType)) < 0)
+			return 1;
 	}
-	if (de != NULL) {
-		*de = sqrt(bde);
-	}
-	return bix;
+	return 0;
 }
 
 /* Free an entry */
@@ -1324,6 +1580,7 @@ static void clear_namedc(namedc *p) {
 			p->data = NULL;
 		}
 		p->count = 0;
+		free_index(p);
 	}
 }
 
@@ -1358,6 +1615,7 @@ namedc *new_namedc(a1log *log) {
 	p->read_icc   = read_icc;
 	p->read       = read_nc;
 	p->match      = match;
+	p->match_batch = match_batch;
 
 	p->chrom[0][0] = -1e38;
 
@@ -1460,6 +1718,45 @@ main(int argc, char *argv[]) {
 			error(" match failed with '%s'\n",p->err);
 		printf("Matched color '%s' with DE00 %f\n",p->data[ix].name,de);
 	}
+
+	/* Check batch matching against a linear search */
+	/* (Only for D50 libraries, where match() doesn't convert Lab) */
+	if (p->ill == icIlluminantD50 && p->obs == icStdObs1931TwoDegrees) {
+		double Lab[100][3];
+		int ix[100];
+		int i, j, t, bad = 0;
+
+		for (i = 0; i < 100; i++) {
+			Lab[i][0] = d_rand(0.0, 100.0);
+			Lab[i][1] = d_rand(-100.0, 100.0);
+			Lab[i][2] = d_rand(-100.0, 100.0);
+		}
+		for (t = 0; t < 3; t++) {
+			if (p->match_batch(p, ix, NULL, Lab, NULL, 100, t))
+				error(" batch match failed with '%s'\n",p->err);
+
+			for (i = 0; i < 100; i++) {
+				double bde = 1e99;
+				int bix = -1;
+				for (j = 0; j < p->count; j++) {
+					double de;
+					if (t == 0)
+						de = icmLabDEsq(Lab[i], p->data[j].Lab);
+					else if (t == 1)
+						de = icmCIE94sq(Lab[i], p->data[j].Lab);
+					else
+						de = icmCIE2Ksq(Lab[i], p->data[j].Lab);
+					if (de < bde) {
+						bde = de;
+						bix = j;
+					}
+				}
+				if (bix != ix[i])
+					bad++;
+			}
+		}
+		printf("Batch match check %s (%d mismatches)\n",bad == 0 ? "OK" : "FAILED", bad);
+	}
 	
 #ifdef NEVER
 	printf("Loaded %d colors\n",p->count);
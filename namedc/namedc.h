@@ -93,6 +93,14 @@ struct _namedc {
 	/* if de != NULL, return the delta E */
 	int (*match)(struct _namedc *p, double *de, double *Lab, xspect *spect, int deType);
 
+	/* Match a batch of n colors, as for match(). */
+	/* ix[] returns the index of the best matching color for each, */
+	/* and de[] the delta E if de != NULL. spect[] should be NULL, or */
+	/* point to n spectral values. */
+	/* Return nz on error. */
+	int (*match_batch)(struct _namedc *p, int *ix, double *de, double (*Lab)[3],
+	                   xspect *spect, int n, int deType);
+
 	/* Houskeeping - should switch this to a1log ? */
 #define NAMEDC_ERRL 1000
 	int errc;				/* Error code */
@@ -114,6 +122,17 @@ struct _namedc {
 	double chrom[3][3];		/* Chromatic transform to this namedc space */
 	icmXYZNumber dXYZ;		/* Named color white point */
 
+	/* Lab grid index of the colors, to speed up match() */
+	nce *gdata;				/* data[] the index was built for, NULL if none */
+	unsigned int gcount;	/* count the index was built for */
+	int gres[3];			/* Grid resolution */
+	double gmin[3];			/* Grid origin */
+	double gcw;				/* Grid cell width */
+	int *gstart;			/* Start of each cells colors in gix[], [ncells+1] */
+	int *gix;				/* Color indexes sorted by cell, [count] */
+	double gLmin, gLmax;	/* Range of color L* values */
+	double gCmax;			/* Maximum color chroma */
+
 }; typedef struct _namedc namedc;
 
 /* Create a new, uninitialised namedc */
@@ -0,0 +1,252 @@
+
+/* Levenberg-Marquardt non-linear least squares minimiser. */
+/* This is good for fitting a model to a set of measurements, */
+/* where the partial derivatives of each residual are available. */
+
+/*
+ * Author: agent
+ * Date:   18/10/2026
+ *
+ * Copyright 2026, agent
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+	Each itteration forms the normal equations Jt.J.dp = -Jt.r from the
+	Jacobian J and residuals r, adds the Marquardt damping lambda * diag(Jt.J)
+	and solves for the step dp using a Cholesky decomposition.
+	If the step reduces the error, it is taken and lambda is reduced, making
+	the next step closer to Gauss-Newton. If not, lambda is increased,
+	making the step closer to a short steepest descent step, and the
+	normal equations are re-solved without re-evaluating the Jacobian.
+
+	The Jacobian is never stored. Each row is requested from the
+	callback as a list of its non-zero entries, and its outer product
+	is added to Jt.J straight away. A row with nz non-zero entries
+	costs nz * (nz+1)/2 multiply-adds, rather than di * (di+1)/2,
+	and only di x di (not nr x di) storage is needed. Jt.J itself is
+	treated as dense, since the rows usually overlap enough to fill it.
+ */
+
+/* Note that all arrays are indexed from 0 */
+
+#include "numsup.h"
+#include "ludecomp.h"
+#include "levmarq.h"
+
+#define LM_LAMBDA0 1e-3		/* [1e-3] Initial damping factor */
+#define LM_LAMBDAF 10.0		/* [10.0] Damping factor increase/decrease multiplier */
+#define LM_LAMBDAMX 1e16	/* [1e16] Damping factor at which to give up */
+#define LM_DIAGMIN 1e-12	/* [1e-12] Minimum diagonal damping value */
+
+#undef DEBUG
+
+#ifdef DEBUG
+# define DBG(xx)	printf xx;
+#else
+# define DBG(xx)
+#endif
+
+/* Return the sum of the squares of the residuals at tp[] */
+static double sumsq(
+int nr,
+double tp[],
+double (*rjfunc)(void *fdata, int k, double jv[], int jx[], int *nz, double tp[]),
+void *fdata
+) {
+	double rv = 0.0, r;
+	int k;
+
+	for (k = 0; k < nr; k++) {
+		r = (*rjfunc)(fdata, k, NULL, NULL, NULL, tp);
+		rv += r * r;
+	}
+	return rv;
+}
+
+/* Form the upper triangle of Jt.J and -Jt.r at tp[] a row at a time, */
+/* and return the sum of the squares of the residuals. */
+static double normeq(
+int di,
+int nr,
+double **jtj,
+double *jtr,
+double *jv,				/* di scratch values */
+int *jx,				/* di scratch indexes */
+double tp[],
+double (*rjfunc)(void *fdata, int k, double jv[], int jx[], int *nz, double tp[]),
+void *fdata
+) {
+	double rv = 0.0, r;
+	int i, j, k, nz;
+
+	for (i = 0; i < di; i++) {
+		jtr[i] = 0.0;
+		for (j = i; j < di; j++)
+			jtj[i][j] = 0.0;
+	}
+	for (k = 0; k < nr; k++) {
+		nz = 0;
+		r = (*rjfunc)(fdata, k, jv, jx, &nz, tp);
+		rv += r * r;
+
+		for (i = 0; i < nz; i++) {
+			int ii = jx[i];
+			double vv = jv[i];
+
+			if (vv == 0.0)
+				continue;
+			jtr[ii] -= vv * r;
+			for (j = 0; j < nz; j++) {	/* Upper triangle */
+				if (jx[j] >= ii)
+					jtj[ii][jx[j]] += vv * jv[j];
+			}
+		}
+	}
+	return rv;
+}
+
+/* return 0 on sucess, 1 on failure due to excessive itterations */
+/* Result will be in cp */
+int levmarq(
+double *rv,				/* If not NULL, return the residual sum of squares */
+int di,					/* Dimentionality (number of parameters) */
+int nr,					/* Number of residuals */
+double cp[],			/* Initial starting point, and returned result */
+double ftol,			/* Relative tollerance of error change to stop on */
+int maxit,				/* Maximum iterations allowed */
+double (*rjfunc)(void *fdata, int k, double jv[], int jx[], int *nz, double tp[]),
+						/* Residuals & Jacobian function to evaluate */
+void *fdata,			/* Opaque data needed by rjfunc() */
+void (*prog)(void *pdata, int perc),		/* Optional progress percentage callback */
+void *pdata				/* Opaque data needed by prog() */
+) {
+	int i, j;
+	double **jtj;			/* Jt.J */
+	double **aa;			/* Damped Jt.J and its decomposition */
+	double *jtr;			/* -Jt.r */
+	double *dp;				/* Step */
+	double *tp;				/* Trial point */
+	double *jv;				/* Non-zero Jacobian row values */
+	int *jx;				/* Index of non-zero Jacobian row entries */
+	double lambda = LM_LAMBDA0;
+	int    iter;
+	double retv; 			/* Current sum of squares at cp */
+	double stopth;			/* Current stop threshold */
+	double startdel = -1.0;	/* Initial change in function value */
+	double curdel;			/* Current change in function value */
+	int pc = 0;				/* Percentage complete */
+
+	jtj = dmatrix(0, di-1, 0, di-1);
+	aa  = dmatrix(0, di-1, 0, di-1);
+	jtr = dvector(0, di-1);
+	dp  = dvector(0, di-1);
+	tp  = dvector(0, di-1);
+	jv  = dvector(0, di-1);
+	jx  = ivector(0, di-1);
+
+	if (prog != NULL)		/* Report initial progress */
+		prog(pdata, pc);
+
+	/* Initial function and normal equations evaluation */
+	retv = normeq(di, nr, jtj, jtr, jv, jx, cp, rjfunc, fdata);
+
+	DBG(("levmarq: initial retv = %f\n",retv))
+
+	/* Itterate until we converge on a solution, or give up. */
+	for (iter = 1; iter < maxit; iter++) {
+		double pretv;			/* Previous function return value */
+		double tretv = 0.0;		/* Trial function return value */
+
+		pretv = retv;
+
+		/* Find a damping factor that gives us an improvement */
+		for (;;) {
+
+			/* Damp and solve the normal equations */
+			for (i = 0; i < di; i++) {
+				for (j = i; j < di; j++)
+					aa[i][j] = jtj[i][j];
+				aa[i][i] += lambda * (jtj[i][i] > LM_DIAGMIN ? jtj[i][i] : LM_DIAGMIN);
+			}
+
+			if (llt_decomp(aa, aa, di) == 0) {
+				llt_backsub(aa, di, jtr, dp);
+
+				for (i = 0; i < di; i++)
+					tp[i] = cp[i] + dp[i];
+
+				tretv = sumsq(nr, tp, rjfunc, fdata);
+
+				DBG(("levmarq: itter %d lambda %e trial retv %f\n",iter,lambda,tretv))
+
+				if (tretv < retv)
+					break;
+			}
+
+			lambda *= LM_LAMBDAF;
+			if (lambda > LM_LAMBDAMX)
+				break;
+		}
+
+		/* Can't improve on where we are */
+		if (lambda > LM_LAMBDAMX) {
+			DBG(("levmarq: stopping on itter %d because lambda is too large\n",iter))
+			break;
+		}
+
+		/* Accept the step */
+		for (i = 0; i < di; i++)
+			cp[i] = tp[i];
+		retv = tretv;
+		lambda /= LM_LAMBDAF;
+		if (lambda < DBL_EPSILON)
+			lambda = DBL_EPSILON;
+
+		stopth = ftol * 0.5 * (fabs(pretv) + fabs(retv) + DBL_EPSILON);
+		curdel = fabs(pretv - retv);
+		if (startdel < 0.0) {
+			startdel = curdel;
+		} else {
+			int tt;
+			tt = (int)(100.0 * pow((log(curdel) - log(startdel))/(log(stopth) - log(startdel)), 4.0) + 0.5);
+			if (tt > pc && tt < 100) {
+				pc = tt;
+				if (prog != NULL)		/* Report progress */
+					prog(pdata, pc);
+			}
+		}
+
+		if (curdel <= stopth) {
+			DBG(("levmarq: stopping on itter %d because curdel %f <= stopth %f\n",iter,curdel,stopth))
+			break;
+		}
+
+		/* Normal equations for the next itteration */
+		normeq(di, nr, jtj, jtr, jv, jx, cp, rjfunc, fdata);
+	}
+
+	free_ivector(jx, 0, di-1);
+	free_dvector(jv, 0, di-1);
+	free_dvector(tp, 0, di-1);
+	free_dvector(dp, 0, di-1);
+	free_dvector(jtr, 0, di-1);
+	free_dmatrix(aa, 0, di-1, 0, di-1);
+	free_dmatrix(jtj, 0, di-1, 0, di-1);
+
+	if (prog != NULL)		/* Report final progress */
+		prog(pdata, 100);
+
+	if (rv != NULL)
+		*rv = retv;
+
+	if (iter < maxit)
+		return 0;
+
+	DBG(("levmarq: returning 1 due to excessive itterations\n"))
+	return 1;		/* Failed due to execessive itterations */
+}
+
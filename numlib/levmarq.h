@@ -0,0 +1,61 @@
+#ifndef LEVMARQ_H
+#define LEVMARQ_H
+
+/* Levenberg-Marquardt non-linear least squares minimiser */
+
+/*
+ * Author: agent
+ * Date:   18/10/2026
+ *
+ * Copyright 2026, agent
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/*
+	Minimise the sum of the squares of nr residuals r[] that are
+	a function of di parameters tp[], given the residuals and
+	their partial derivatives (the Jacobian).
+
+	rjfunc() is called for one residual at a time, for k = 0..nr-1
+	in order at each trial point tp[]. It should return residual k,
+	and if jv != NULL, also set jv[0..nz-1] to the non-zero partial
+	derivatives of that residual with respect to the parameters
+	jx[0..nz-1] (each index at most once), and set *nz. jv[] and jx[]
+	have room for di entries.
+	Each Jacobian row is folded into the normal equations as it
+	is returned, so the full Jacobian is never stored.
+
+	return values:
+
+ 	0  Success
+
+	1  Ran out of itterations
+
+ */
+
+int levmarq(
+double *rv,				/* If not NULL, return the residual sum of squares */
+int di,					/* Dimentionality (number of parameters) */
+int nr,					/* Number of residuals */
+double cp[],			/* Initial starting point, and returned result */
+double ftol,			/* Relative tollerance of error change to stop on */
+int maxit,				/* Maximum iterations allowed */
+double (*rjfunc)(void *fdata, int k, double jv[], int jx[], int *nz, double tp[]),
+						/* Residuals & Jacobian function to evaluate */
+void *fdata,			/* Opaque data needed by rjfunc() */
+void (*prog)(void *pdata, int perc),		/* Optional progress percentage callback */
+void *pdata				/* Opaque data needed by prog() */
+);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif /* LEVMARQ_H */
@@ -566,7 +566,7 @@ double *x			/* Return X[] (may be same as B[]) */
 	}
 
 	/* Solve Lt.x = y */
-	for (i = n; i >= 0; i--) {
+	for (i = n-1; i >= 0; i--) {
 		sum = x[i];
 		for (k = i+1 ; k < n; k++)
 			sum -= L[k][i] * x[k];
@@ -10,6 +10,7 @@
 #include "powell.h"		/* Powell multi dimentional minimiser */
 #include "dhsx.h"		/* Downhill simplex multi dimentional minimiser */
 #include "varmet.h"		/* Variable Metric multi dimentional minimiser */
+#include "levmarq.h"		/* Levenberg-Marquardt least squares minimiser */
 #include "ludecomp.h"	/* LU decomposition matrix solver */
 #include "svd.h"		/* Singular Value decomposition matrix solver */
 #include "zbrent.h"		/* 1 dimentional brent root search */
@@ -4232,6 +4232,151 @@ double usec_time() {
 
 #endif /* UNIX */
 
+/*******************************/
+/* Phase timing instrumentation */
+
+#ifdef ENABLE_ATIMING
+
+#define ATM_MAXPHASES 64	/* Maximum number of phases + counters */
+
+typedef struct {
+	char *name;				/* Phase or counter name */
+	int iscount;			/* nz if this is a counter */
+	double calls;			/* Number of start/stop pairs or acount_add() calls */
+	double tot;				/* Total usec, or counter total */
+} atm_phase;
+
+static int g_atm_enabled = -1;			/* -1 = not checked yet */
+static double g_atm_stime = 0.0;		/* usec_time() when first enabled */
+static atm_phase g_atm_ph[ATM_MAXPHASES];
+static int g_atm_nph = 0;
+
+#ifdef NT
+static volatile LONG g_atm_lock = 0;
+# define ATM_LOCK() while (InterlockedExchange(&g_atm_lock, 1) != 0) Sleep(0)
+# define ATM_UNLOCK() InterlockedExchange(&g_atm_lock, 0)
+#else
+static pthread_mutex_t g_atm_lock = PTHREAD_MUTEX_INITIALIZER;
+# define ATM_LOCK() pthread_mutex_lock(&g_atm_lock)
+# define ATM_UNLOCK() pthread_mutex_unlock(&g_atm_lock)
+#endif
+
+/* Return nz if timing collection is enabled */
+int atiming_enabled() {
+	if (g_atm_enabled < 0) {
+		ATM_LOCK();
+		if (g_atm_enabled < 0) {
+			g_atm_stime = usec_time();
+			g_atm_enabled = getenv("ARGYLL_TIMING") != NULL ? 1 : 0;
+		}
+		ATM_UNLOCK();
+	}
+	return g_atm_enabled;
+}
+
+/* Return the table index of the given phase. */
+/* Return -1 if the table is full. Lock must be held. */
+static int atm_lookup(char *name, int iscount) {
+	int i;
+
+	for (i = 0; i < g_atm_nph; i++) {
+		if (g_atm_ph[i].iscount == iscount
+		 && (g_atm_ph[i].name == name || strcmp(g_atm_ph[i].name, name) == 0))
+			return i;
+	}
+	if (g_atm_nph >= ATM_MAXPHASES)
+		return -1;
+	g_atm_ph[i].name = name;
+	g_atm_ph[i].iscount = iscount;
+	g_atm_ph[i].calls = 0.0;
+	g_atm_ph[i].tot = 0.0;
+	g_atm_nph++;
+	return i;
+}
+
+/* Start timing the named phase */
+void atimer_start(atimer *p, char *name) {
+	p->ix = -1;
+	if (!atiming_enabled())
+		return;
+	ATM_LOCK();
+	p->ix = atm_lookup(name, 0);
+	ATM_UNLOCK();
+	p->stime = usec_time();
+}
+
+/* Stop timing and add the elapsed time to the phase */
+void atimer_stop(atimer *p) {
+	double etime;
+
+	if (p->ix < 0)
+		return;
+	etime = usec_time() - p->stime;
+	ATM_LOCK();
+	g_atm_ph[p->ix].calls++;
+	g_atm_ph[p->ix].tot += etime;
+	ATM_UNLOCK();
+	p->ix = -1;
+}
+
+/* Add n to the named counter */
+void acount_add(char *name, double n) {
+	int ix;
+
+	if (!atiming_enabled())
+		return;
+	ATM_LOCK();
+	if ((ix = atm_lookup(name, 1)) >= 0) {
+		g_atm_ph[ix].calls++;
+		g_atm_ph[ix].tot += n;
+	}
+	ATM_UNLOCK();
+}
+
+/* Print the timing breakdown to fp, in the order the phases */
+/* were first seen. Nested phases are included in their parents */
+/* time, so the percentages of wall time needn't add up to 100. */
+void atiming_report(FILE *fp, char *title) {
+	double wall;
+	int i, nc = 0;
+
+	if (!atiming_enabled())
+		return;
+
+	ATM_LOCK();
+	wall = (usec_time() - g_atm_stime)/1000.0;
+	if (wall <= 0.0)
+		wall = 1e-6;
+
+	fprintf(fp,"%s timing breakdown, wall time %.1f msec:\n",title != NULL ? title : "",wall);
+	fprintf(fp,"  %-32s %8s %12s %12s %7s\n","Phase","Calls","Total msec","msec/call","% wall");
+	for (i = 0; i < g_atm_nph; i++) {
+		atm_phase *ph = &g_atm_ph[i];
+		double ms = ph->tot/1000.0;
+
+		if (ph->iscount) {
+			nc++;
+			continue;
+		}
+		fprintf(fp,"  %-32s %8.0f %12.2f %12.4f %6.1f%%\n",ph->name,ph->calls,ms,
+		        ph->calls > 0.0 ? ms/ph->calls : 0.0, 100.0 * ms/wall);
+	}
+	if (nc > 0) {
+		fprintf(fp,"  %-32s %8s %12s\n","Counter","Calls","Total");
+		for (i = 0; i < g_atm_nph; i++) {
+			atm_phase *ph = &g_atm_ph[i];
+
+			if (!ph->iscount)
+				continue;
+			fprintf(fp,"  %-32s %8.0f %12.0f\n",ph->name,ph->calls,ph->tot);
+		}
+	}
+	fflush(fp);
+	ATM_UNLOCK();
+}
+
+#endif /* ENABLE_ATIMING */
+
 /*******************************/
 /* Debug convenience functions */
 /*******************************/
@@ -944,6 +944,54 @@ unsigned int msec_time();
 /* (The first invokation of usec_time() returns zero) */
 double usec_time();
 
+/*******************************************/
+/* Hot-path phase timing instrumentation */
+
+/* Named phase timers and event counters accumulate into a global */
+/* table that atiming_report() prints as a per-phase breakdown. */
+/* Collection is only active if the ARGYLL_TIMING environment */
+/* variable is set, and #undef ENABLE_ATIMING compiles it all out. */
+
+#define ENABLE_ATIMING		/* [def] Compile in phase timing support */
+
+#ifdef ENABLE_ATIMING
+
+typedef struct {
+	int ix;					/* Phase table index, -1 if not active */
+	double stime;			/* usec_time() at start */
+} atimer;
+
+/* Return nz if timing collection is enabled (checks ARGYLL_TIMING once) */
+int atiming_enabled();
+
+/* Start timing the named phase. name should be a string constant. */
+void atimer_start(atimer *p, char *name);
+
+/* Stop timing and add the elapsed time to the phase */
+void atimer_stop(atimer *p);
+
+/* Add n to the named counter */
+void acount_add(char *name, double n);
+
+/* Print the timing breakdown to fp, if collection is enabled */
+void atiming_report(FILE *fp, char *title);
+
+/* Time the statements between ATIMER_BEGIN() and ATIMER_END. */
+/* (Don't return or goto out of the timed block) */
+# define ATIMER_BEGIN(name) { atimer _atimer; atimer_start(&_atimer, name);
+# define ATIMER_END atimer_stop(&_atimer); }
+# define ACOUNT(name, n) acount_add(name, (double)(n))
+# define ATIMING_REPORT(title) atiming_report(stderr, title)
+
+#else /* !ENABLE_ATIMING */
+
+# define ATIMER_BEGIN(name) {
+# define ATIMER_END }
+# define ACOUNT(name, n)
+# define ATIMING_REPORT(title)
+
+#endif /* !ENABLE_ATIMING */
+
 /*******************************************/
 /* Debug convenience functions (duplicated in icc) */
 
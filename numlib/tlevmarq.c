@@ -0,0 +1,120 @@
+
+/* Code to test the Levenberg-Marquardt minimiser */
+/*
+ * Author: agent
+ * Date:   18/10/2026
+ *
+ * Copyright 2026, agent
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#include <stdio.h>
+#include "numlib.h"
+
+/*       Final approximate solution:                                       */
+
+double expect[9] = {
+	-0.5706545E+00,
+	-0.6816283E+00,
+	-0.7017325E+00,
+	-0.7042129E+00,
+	-0.7013690E+00,
+	-0.6918656E+00,
+	-0.6657920E+00,
+	-0.5960342E+00,
+	-0.4164121E+00 };
+
+double rjfcn(		/* Return a residual and its Jacobian row */
+	void *fdata,	/* Opaque data pointer */
+	int k,			/* Residual index */
+	double jv[],	/* Returned non-zero Jacobian row values, NULL if not needed */
+	int jx[],		/* Returned Jacobian row value indexes */
+	int *nz,		/* Returned number of non-zero values */
+	double tp[]);	/* Multivriate input value */
+
+#define N 9
+
+static void progress(void *pdata, int perc) {
+	printf("%c% 3d%%",cr_char,perc);
+	if (perc == 100)
+		printf("\n");
+	fflush(stdout);
+}
+
+int main(void)
+{
+	double cp[N];		/* Function input values */
+	double err;
+	int j;
+	int rc;
+
+	error_program = "tlevmarq";	/* Set global error reporting string */
+	check_if_not_interactive();
+
+	/*	 The following starting values provide a rough solution. */
+	for (j = 0; j < N; j++) {
+		cp[j] = -1.f;
+	}
+
+	rc = levmarq(
+		&err,
+		N, 				/* Dimentionality */
+		N, 				/* Number of residuals */
+		cp,				/* Initial starting point */
+		0.00000001,		/* Tollerance of error change to stop on */
+		1000,			/* Maximum iterations allowed */
+		rjfcn, 			/* Residual & Jacobian function to evaluate */
+		NULL,			/* Opaque data needed by function */
+		progress,		/* Progress callback */
+		NULL			/* Context for callback */
+	);
+
+	fprintf(stdout,"Status = %d, final approximate solution err = %f:\n",rc,err);
+	for (j = 0; j < N; j++) {
+		fprintf(stdout,"cp[%d] = %e, expect %e\n",j,cp[j],expect[j]);
+	}
+
+	return 0;
+} /* main() */
+
+/* Function being minimized, as a set of residuals */
+double rjfcn(
+void *fdata,		/* Opaque data pointer */
+int k,				/* Residual index */
+double jv[],		/* Returned non-zero Jacobian row values, NULL if not needed */
+int jx[],			/* Returned Jacobian row value indexes */
+int *nz,			/* Returned number of non-zero values */
+double tp[]			/* Multivriate input value */
+) {
+	double temp, temp1, temp2;
+	int n = 0;
+
+	temp = (3.0 - 2.0 * tp[k]) * tp[k];
+	temp1 = 0.0;
+	if (k != 0) {
+		temp1 = tp[k-1];
+	}
+	temp2 = 0.0;
+	if (k != ((N)-1))
+		temp2 = tp[k+1];
+
+	/* Each residual only depends on its neighbours */
+	if (jv != NULL) {
+		if (k != 0) {
+			jx[n] = k-1;
+			jv[n++] = -1.0;
+		}
+		jx[n] = k;
+		jv[n++] = 3.0 - 4.0 * tp[k];
+		if (k != ((N)-1)) {
+			jx[n] = k+1;
+			jv[n++] = -2.0;
+		}
+		*nz = n;
+	}
+
+	return temp - temp1 - 2.0 * temp2 + 1.0;
+}
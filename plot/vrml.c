@@ -60,6 +60,10 @@
 # define stricmp strcasecmp
 #endif
 
+#define VRML_WBUFSZ 65536	/* [65536] Size of geometry array output buffer */
+#define VRML_DECIMALS 6		/* [6] Decimal places of geometry and color values, as %f */
+#define VRML_DSCALE 1000000	/* [1000000] 10 to the power VRML_DECIMALS */
+
 /* Convert input values to x,y, z */
 static void cs2xyz(vrml *s, double *out, double *in) {
 	if (s->ispace == vrml_rgb) {			/* RGB */
@@ -389,11 +393,223 @@ static void make_last_vertex(vrml *s, int set) {
 		s->set[set].pary[s->set[set].npoints-1].last = 1;
 }
 
-/* Turn all the vertexes into a set of points */
-static void make_points(vrml *s, int set) {
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Buffered output of the geometry arrays. Values are formatted  */
+/* directly into a buffer with VRML_DECIMALS fractional digits   */
+/* and trailing zeros dropped, rather than a fprintf("%f") per   */
+/* value, and the buffer is written each time it fills.          */
+/* Note that this is not a streamed writer - each set is held in */
+/* memory until it is written out by make_points(), make_lines() */
+/* etc., since the X3D index attributes and the VRML/X3D color   */
+/* arrays have to be written separately from the coordinates.    */
+
+/* Write out anything in the output buffer. */
+/* (Call this before using fprintf() on s->fp again) */
+static void wflush(vrml *s) {
+	if (s->wbix > 0) {
+		if (fwrite(s->wbuf, 1, s->wbix, s->fp) != s->wbix)
+			s->werr = 1;
+		s->wbix = 0;
+	}
+}
+
+/* Make sure there is room for n more characters */
+#define WROOM(s, n) if ((s)->wbix + (n) > VRML_WBUFSZ) wflush(s)
+
+/* Add a string */
+static void wstr(vrml *s, char *str) {
+	for (; *str != '\000'; str++) {
+		WROOM(s, 1);
+		s->wbuf[s->wbix++] = *str;
+	}
+}
+
+/* Add an integer */
+static void wint(vrml *s, int v) {
+	char tb[12];
+	unsigned int uv;
+	int i = 0;
+
+	WROOM(s, 12);
+	if (v < 0) {
+		s->wbuf[s->wbix++] = '-';
+		uv = -(unsigned int)v;
+	} else
+		uv = v;
+	do {
+		tb[i++] = '0' + uv % 10;
+		uv /= 10;
+	} while (uv != 0);
+	while (i > 0)
+		s->wbuf[s->wbix++] = tb[--i];
+}
+
+/* Add a real value */
+static void wdbl(vrml *s, double v) {
+	unsigned long long iv;
+	unsigned int ip, fp;
+	int i;
+
+	/* Fall back for anything out of the fast range */
+	if (!(fabs(v) < 1e9)) {
+		WROOM(s, 30);
+		s->wbix += sprintf(s->wbuf + s->wbix, "%g", v);
+		return;
+	}
+
+	iv = (unsigned long long)(fabs(v) * (double)VRML_DSCALE + 0.5);
+	ip = (unsigned int)(iv / VRML_DSCALE);
+	fp = (unsigned int)(iv % VRML_DSCALE);
+
+	if (v < 0.0 && iv != 0) {
+		WROOM(s, 1);
+		s->wbuf[s->wbix++] = '-';
+	}
+	wint(s, (int)ip);
+	if (fp != 0) {
+		char tb[VRML_DECIMALS];
+
+		for (i = VRML_DECIMALS-1; i >= 0; i--) {
+			tb[i] = '0' + fp % 10;
+			fp /= 10;
+		}
+		for (i = VRML_DECIMALS; i > 0 && tb[i-1] == '0'; i--)
+			;
+		WROOM(s, 1 + VRML_DECIMALS);
+		s->wbuf[s->wbix++] = '.';
+		memcpy(s->wbuf + s->wbix, tb, i);
+		s->wbix += i;
+	}
+}
+
+/* Add a line with a real triplet */
+static void wdbl3(vrml *s, char *indent, double v[3], char *term) {
+	wstr(s, indent);
+	wdbl(s, v[0]);
+	wstr(s, " ");
+	wdbl(s, v[1]);
+	wstr(s, " ");
+	wdbl(s, v[2]);
+	wstr(s, term);
+}
+
+/* Return a vertex position in x,y,z */
+static void vertex_xyz(vrml *s, int set, int i, double xyz[3]) {
+	double pp[3];
+	icmCpy3(pp, s->set[set].pary[i].pp);
+	cs2xyz(s, xyz, pp);
+}
+
+/* Return the natural color of a vertex */
+static void vertex_natrgb(vrml *s, int set, int i, double rgb[3]) {
+	double pp[3];
+
+	icmCpy3(pp, s->set[set].pary[i].pp);
+	if (s->ispace == vrml_rgb)			/* RGB */
+		icmCpy3(rgb, pp);
+	else if (s->ispace == vrml_xyz)		/* XYZ */
+		s->XYZ2RGB(s, rgb, pp);
+	else								/* Lab */
+		s->Lab2RGB(s, rgb, pp);	
+}
+
+/* Return the color of a vertex - the natural color if none was set */
+static void vertex_rgb(vrml *s, int set, int i, double rgb[3]) {
+	if (s->set[set].pary[i].cc[0] < 0.0)
+		vertex_natrgb(s, set, i, rgb);
+	else
+		icmCpy3(rgb, s->set[set].pary[i].cc);
+}
+
+/* Write all the vertex coordinates of a set, one per line */
+static void write_coords(vrml *s, int set, char *indent, char *term) {
 	double xyz[3];
+	int i;
+
+	for (i = 0; i < s->set[set].npoints; i++) {
+		vertex_xyz(s, set, i, xyz);
+		wdbl3(s, indent, xyz, term);
+	}
+	wflush(s);
+}
+
+/* Write all the vertex colors of a set, one per line */
+static void write_vcolors(vrml *s, int set, char *indent, char *term) {
+	double rgb[3];
+	int i;
+
+	for (i = 0; i < s->set[set].npoints; i++) {
+		vertex_rgb(s, set, i, rgb);
+		wdbl3(s, indent, rgb, term);
+	}
+	wflush(s);
+}
+
+/* Write the per line/tri/quad colors of a set, one per line. */
+/* cc is an overall color, or NULL or cc[0] < 0.0 for none */
+static void write_pcolors(vrml *s, int set, double cc[3], char *indent, char *term) {
+	double rgb[3];
+	int i;
+
+	for (i = 0; i < s->set[set].ntrqu; i++) {
+
+		/* Use line/patch overall supplied color */
+		if (cc != NULL && cc[0] >= 0.0) {
+			icmCpy3(rgb, cc);
+
+		/* Use per line/tri/quad color */
+		} else if (s->set[set].tqary[i].cc[0] >= 0.0) {
+			icmCpy3(rgb, s->set[set].tqary[i].cc);
+
+		/* Hmm. We can only have all per vertex or all per polygon - */
+		/* use natural color of first vertex. */
+		} else {
+			vertex_natrgb(s, set, s->set[set].tqary[i].ix[0], rgb);
+		}
+		wdbl3(s, indent, rgb, term);
+	}
+	wflush(s);
+}
+
+/* Write the line/tri/quad vertex indexes of a set, one per line */
+static void write_tqindexes(vrml *s, int set, char *indent, char *sep) {
 	int i, j;
 
+	for (i = 0; i < s->set[set].ntrqu; i++) {
+		wstr(s, indent);
+		for (j = 0; j < 4; j++) {
+			if (s->set[set].tqary[i].ix[j] < 0)
+				break;
+			wint(s, s->set[set].tqary[i].ix[j]);
+			wstr(s, sep);
+		}
+		wstr(s, "-1\n");
+	}
+	wflush(s);
+}
+
+/* Write the line vertex indexes for ppset vertices per line (or .last flag) */
+static void write_lindexes(vrml *s, int set, int ppset, char *indent, char *sep) {
+	int i, j;
+
+	for (i = 0; i < s->set[set].npoints;) {
+		wstr(s, indent);
+		for (j = 0; i < s->set[set].npoints  && j < ppset; j++) {
+			wint(s, i++);
+			wstr(s, sep);
+			if (s->set[set].pary[i-1].last != 0)
+				break;
+		}
+		wstr(s, "-1\n");
+	}
+	wflush(s);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Turn all the vertexes into a set of points */
+static void make_points(vrml *s, int set) {
+
 	if (set < 0 || set > 9)
 		error("vrml make_points set %d out of range",set);
 
@@ -412,13 +628,10 @@ static void make_points(vrml *s, int set) {
 		fprintf(s->fp,"        <Coordinate point ='\n");
 	}
 
-	for (i = 0; i < s->set[set].npoints; i++) {
-		cs2xyz(s, xyz, s->set[set].pary[i].pp);
-		if (s->fmt == fmt_vrml)
-			fprintf(s->fp,"            %f %f %f,\n", xyz[0], xyz[1], xyz[2]); 
-		else
-			fprintf(s->fp,"          %f %f %f\n", xyz[0], xyz[1], xyz[2]); 
-	}
+	if (s->fmt == fmt_vrml)
+		write_coords(s, set, "            ", ",\n");
+	else
+		write_coords(s, set, "          ", "\n");
 	
 	if (s->fmt == fmt_vrml) {
 		fprintf(s->fp,"          ]\n");
@@ -431,35 +644,12 @@ static void make_points(vrml *s, int set) {
 	if (s->fmt == fmt_vrml) {
 		fprintf(s->fp,"        color Color {\n");
 		fprintf(s->fp,"          color [			# RGB colors of each vertex\n");
-	} else {
-		fprintf(s->fp,"        <Color color='\n");
-	}
-
-	for (i = 0; i < s->set[set].npoints; i++) {
-		double rgb[3], Lab[3];
-
-		if (s->set[set].pary[i].cc[0] < 0.0) {
-			Lab[0] = s->set[set].pary[i].pp[0];
-			Lab[1] = s->set[set].pary[i].pp[1];
-			Lab[2] = s->set[set].pary[i].pp[2];
-			if (s->ispace == vrml_rgb)			/* RGB */
-				icmCpy3(rgb, Lab);
-			else if (s->ispace == vrml_xyz)		/* XYZ */
-				s->XYZ2RGB(s, rgb, Lab);
-			else								/* Lab */
-				s->Lab2RGB(s, rgb, Lab);	
-		} else {
-			icmCpy3(rgb, s->set[set].pary[i].cc);
-		}
-		if (s->fmt == fmt_vrml)
-			fprintf(s->fp,"            %f %f %f,\n", rgb[0], rgb[1], rgb[2]);
-		else
-			fprintf(s->fp,"          %f %f %f\n", rgb[0], rgb[1], rgb[2]);
-	}
-	if (s->fmt == fmt_vrml) {
+		write_vcolors(s, set, "            ", ",\n");
 		fprintf(s->fp,"          ] \n");
 		fprintf(s->fp,"        }\n");
 	} else {
+		fprintf(s->fp,"        <Color color='\n");
+		write_vcolors(s, set, "          ", "\n");
 		fprintf(s->fp,"        '></Color>\n");
 	}
 	/* End color */
@@ -475,8 +665,6 @@ static void make_points(vrml *s, int set) {
 
 /* Convert the vertices to lines, ppset vertices per line (or .last flag) */
 static void make_lines(vrml *s, int set, int ppset) {
-	double xyz[3];
-	int i, j;
 
 	if (set < 0 || set > 9)
 		error("vrml make_lines set %d out of range",set);
@@ -490,24 +678,14 @@ static void make_lines(vrml *s, int set, int ppset) {
 		fprintf(s->fp,"        coord Coordinate { \n");
 		fprintf(s->fp,"          point [\n");
 
-		for (i = 0; i < s->set[set].npoints; i++) {
-			cs2xyz(s, xyz, s->set[set].pary[i].pp);
-			fprintf(s->fp,"            %f %f %f,\n", xyz[0], xyz[1], xyz[2]); 
-		}
+		write_coords(s, set, "            ", ",\n");
 	
 		fprintf(s->fp,"          ]\n");
 		fprintf(s->fp,"        }\n");
 		fprintf(s->fp,"        coordIndex [\n");
 
-		for (i = 0; i < s->set[set].npoints;) {
-			fprintf(s->fp,"          ");
-			for (j = 0; i < s->set[set].npoints  && j < ppset; j++) {
-				fprintf(s->fp,"          %d, ", i++);
-				if (s->set[set].pary[i-1].last != 0)
-					break;
-			}
-			fprintf(s->fp,"          -1,\n");
-		}
+		write_lindexes(s, set, ppset, "          ", ", ");
+
 		fprintf(s->fp,"        ]\n");
 
 		/* Color */
@@ -515,24 +693,8 @@ static void make_lines(vrml *s, int set, int ppset) {
 		fprintf(s->fp,"        color Color {\n");
 		fprintf(s->fp,"          color [			# RGB colors of each vertex\n");
 
-		for (i = 0; i < s->set[set].npoints; i++) {
-			double rgb[3], Lab[3];
-
-			if (s->set[set].pary[i].cc[0] < 0.0) {
-				Lab[0] = s->set[set].pary[i].pp[0];
-				Lab[1] = s->set[set].pary[i].pp[1];
-				Lab[2] = s->set[set].pary[i].pp[2];
-				if (s->ispace == vrml_rgb)			/* RGB */
-					icmCpy3(rgb, Lab);
-				else if (s->ispace == vrml_xyz)		/* XYZ */
-					s->XYZ2RGB(s, rgb, Lab);
-				else								/* Lab */
-					s->Lab2RGB(s, rgb, Lab);	
-			} else {
-				icmCpy3(rgb, s->set[set].pary[i].cc);
-			}
-			fprintf(s->fp,"            %f %f %f,\n", rgb[0], rgb[1], rgb[2]);
-		}
+		write_vcolors(s, set, "            ", ",\n");
+
 		fprintf(s->fp,"          ] \n");
 		fprintf(s->fp,"        }\n");
 		/* End color */
@@ -551,46 +713,18 @@ static void make_lines(vrml *s, int set, int ppset) {
 
 		/* Indexes */
 		fprintf(s->fp,"        coordIndex='\n");
-		for (i = 0; i < s->set[set].npoints;) {
-			fprintf(s->fp,"          ");
-			for (j = 0; i < s->set[set].npoints  && j < ppset; j++) {
-				fprintf(s->fp,"          %d ", i++);
-				if (s->set[set].pary[i-1].last != 0)
-					break;
-			}
-			fprintf(s->fp,"          -1\n");
-		}
+		write_lindexes(s, set, ppset, "          ", " ");
 		fprintf(s->fp,"        '\n");
 		fprintf(s->fp,"        >	<!-- CoordIndex -->\n");
 
 		/* Coordinates */
 		fprintf(s->fp,"        <Coordinate point='\n");
-		for (i = 0; i < s->set[set].npoints; i++) {
-			cs2xyz(s, xyz, s->set[set].pary[i].pp);
-			fprintf(s->fp,"          %f %f %f\n", xyz[0], xyz[1], xyz[2]); 
-		}
+		write_coords(s, set, "          ", "\n");
 		fprintf(s->fp,"        '></Coordinate>\n");
 
 		/* Color */
 		fprintf(s->fp,"        <Color color='\n");
-		for (i = 0; i < s->set[set].npoints; i++) {
-			double rgb[3], Lab[3];
-	
-			if (s->set[set].pary[i].cc[0] < 0.0) {
-				Lab[0] = s->set[set].pary[i].pp[0];
-				Lab[1] = s->set[set].pary[i].pp[1];
-				Lab[2] = s->set[set].pary[i].pp[2];
-				if (s->ispace == vrml_rgb)			/* RGB */
-					icmCpy3(rgb, Lab);
-				else if (s->ispace == vrml_xyz)		/* XYZ */
-					s->XYZ2RGB(s, rgb, Lab);
-				else								/* Lab */
-					s->Lab2RGB(s, rgb, Lab);	
-			} else {
-				icmCpy3(rgb, s->set[set].pary[i].cc);
-			}
-			fprintf(s->fp,"          %f %f %f\n", rgb[0], rgb[1], rgb[2]);
-		}
+		write_vcolors(s, set, "          ", "\n");
 		fprintf(s->fp,"        '></Color>\n");
 		fprintf(s->fp,"      </IndexedLineSet>\n");
 		fprintf(s->fp,"    </Shape>\n");
@@ -605,8 +739,6 @@ double trans,	/* Transparency level */
 double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 				/* for previously set or vertex or natural color */
 ) {
-	int i, j, nverts, ix;
-	int v[3];
 	int lines = 0;
 
 	if (set < 0 || set > 9)
@@ -646,11 +778,8 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 		fprintf(s->fp,"            point [			# Verticy coordinates\n");
 	
 		/* Spit out the point values, in order. */
-		for (i = 0; i < s->set[set].npoints; i++) {
-			double xyz[3];
-			cs2xyz(s, xyz, s->set[set].pary[i].pp);
-			fprintf(s->fp,"              %f %f %f,\n", xyz[0], xyz[1], xyz[2]);
-		}
+		write_coords(s, set, "              ", ",\n");
+
 		fprintf(s->fp,"            ]\n");
 		fprintf(s->fp,"          }\n");
 		fprintf(s->fp,"\n");
@@ -658,20 +787,7 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 		                                                  lines ? "line" : "polygon");
 	
 		/* Spit out the lines/triangles/quads */
-		for (i = 0; i < s->set[set].ntrqu; i++) {
-			if (s->set[set].tqary[i].ix[2] < 0)		/* Line */
-				fprintf(s->fp,"            %d, %d, -1\n", s->set[set].tqary[i].ix[0],
-				                                            s->set[set].tqary[i].ix[1]);
-			else if (s->set[set].tqary[i].ix[3] < 0)		/* Triangle */
-				fprintf(s->fp,"            %d, %d, %d, -1\n", s->set[set].tqary[i].ix[0],
-				                                                s->set[set].tqary[i].ix[1],
-				                                                s->set[set].tqary[i].ix[2]);
-			else							/* Quad */
-				fprintf(s->fp,"            %d, %d, %d, %d, -1\n", s->set[set].tqary[i].ix[0],
-				                                                    s->set[set].tqary[i].ix[1],
-				                                                    s->set[set].tqary[i].ix[2],
-				                                                    s->set[set].tqary[i].ix[3]);
-		}
+		write_tqindexes(s, set, "            ", ", ");
 	
 		fprintf(s->fp,"          ]\n");
 		fprintf(s->fp,"\n");
@@ -682,33 +798,8 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 			fprintf(s->fp,"          color [			# RGB colors of each line/tri/quad\n");
 		
 			/* Spit out the colors for each line/tri/quad */
-			for (i = 0; i < s->set[set].ntrqu; i++) {
-				double out[3];
-				double rgb[3];
-		
-				/* Use line/patch overall supplied color */
-				if (cc != NULL && cc[0] >= 0.0) {
-					fprintf(s->fp,"            %f %f %f,\n", cc[0], cc[1], cc[2]);
-		
-				/* Use per line/tri/quad color */
-				} else if (s->set[set].tqary[i].cc[0] >= 0.0) {
-					fprintf(s->fp,"            %f %f %f,\n", s->set[set].tqary[i].cc[0],
-					                                           s->set[set].tqary[i].cc[1],
-					                                           s->set[set].tqary[i].cc[2]);
-		
-				/* Hmm. We can only have all per vertex or all per polygon - */
-				/* use natural color of first vertex. */
-				} else {
-					int vx = s->set[set].tqary[i].ix[0];
-					if (s->ispace == vrml_rgb)		/* RGB */
-						icmCpy3(rgb, s->set[set].pary[vx].pp);
-					else if (s->ispace == vrml_xyz)		/* XYZ */
-						s->XYZ2RGB(s, rgb, s->set[set].pary[vx].pp);
-					else								/* Lab */
-						s->Lab2RGB(s, rgb, s->set[set].pary[vx].pp);	
-					fprintf(s->fp,"            %f %f %f,\n", rgb[0], rgb[1], rgb[2]);
-				}
-			}
+			write_pcolors(s, set, cc, "            ", ",\n");
+
 			fprintf(s->fp,"            ] \n");
 			fprintf(s->fp,"          }\n");
 	
@@ -719,27 +810,8 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 			fprintf(s->fp,"          color [			# RGB colors of each vertex\n");
 		
 			/* Spit out the colors for each vertex */
-			for (i = 0; i < s->set[set].npoints; i++) {
-				double out[3];
-				double rgb[3];
-		
-				/* Use vertex color */
-				if (s->set[set].pary[i].cc[0] >= 0.0) {
-					fprintf(s->fp,"            %f %f %f,\n",
-						  s->set[set].pary[i].cc[0], s->set[set].pary[i].cc[1], s->set[set].pary[i].cc[2]);
-		
-				/* Use natural color of vertex */
-				} else {
-					if (s->ispace == vrml_rgb)		/* RGB */
-						icmCpy3(rgb, s->set[set].pary[i].pp);
-					else if (s->ispace == vrml_xyz)		/* XYZ */
-						s->XYZ2RGB(s, rgb, s->set[set].pary[i].pp);
-					else								/* Lab */
-						s->Lab2RGB(s, rgb, s->set[set].pary[i].pp);	
-		
-					fprintf(s->fp,"            %f %f %f,\n", rgb[0], rgb[1], rgb[2]);
-				}
-			}
+			write_vcolors(s, set, "            ", ",\n");
+
 			fprintf(s->fp,"            ] \n");
 			fprintf(s->fp,"          }\n");
 		}
@@ -783,19 +855,12 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 
 		/* Indexes */
 		fprintf(s->fp,"          coordIndex='\n");
-		for (i = 0; i < s->set[set].ntrqu; i++) {
-			fprintf(s->fp,"           ");
-			for (j = 0; j < 4; j++) {
-				if (s->set[set].tqary[i].ix[j] < 0)
-					break;
-				fprintf(s->fp," %d", s->set[set].tqary[i].ix[j]);
-			}
-			fprintf(s->fp," -1\n");
-		}
+		write_tqindexes(s, set, "            ", " ");
 		fprintf(s->fp,"          '>\n");
 
 #ifdef NEVER
 		if (s->set[set].ppoly) {
+			int i;
 			/* colorIndex field is necessary for colorPerVertex=true ? */
 			fprintf(s->fp,"          colorIndex='\n");
 			for (i = 0; i < s->set[set].ntrqu; i++) {
@@ -809,11 +874,7 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 		/* Coordinates */
 		fprintf(s->fp,"\n");
 		fprintf(s->fp,"          <Coordinate point='\n");
-		for (i = 0; i < s->set[set].npoints; i++) {
-			double xyz[3];
-			cs2xyz(s, xyz, s->set[set].pary[i].pp);
-			fprintf(s->fp,"            %f %f %f\n", xyz[0], xyz[1], xyz[2]);
-		}
+		write_coords(s, set, "            ", "\n");
 		fprintf(s->fp,"          '></Coordinate>\n");
 
 		/* Color */
@@ -822,59 +883,11 @@ double cc[3]	/* Surface color, cc == NULL or cc[0] < 0.0 */
 		
 		/* Per poligon color */
 		if (s->set[set].ppoly) {
-			/* Spit out the colors for each line/tri/quad */
-			for (i = 0; i < s->set[set].ntrqu; i++) {
-				double out[3];
-				double rgb[3];
-		
-				/* Use line/patch overall supplied color */
-				if (cc != NULL && cc[0] >= 0.0) {
-					fprintf(s->fp,"            %f %f %f\n", cc[0], cc[1], cc[2]);
-		
-				/* Use per line/tri/quad color */
-				} else if (s->set[set].tqary[i].cc[0] >= 0.0) {
-					fprintf(s->fp,"            %f %f %f\n", s->set[set].tqary[i].cc[0],
-					                                           s->set[set].tqary[i].cc[1],
-					                                           s->set[set].tqary[i].cc[2]);
-		
-				/* Hmm. We can only have all per vertex or all per polygon - */
-				/* use natural color of first vertex. */
-				} else {
-					int vx = s->set[set].tqary[i].ix[0];
-					if (s->ispace == vrml_rgb)		/* RGB */
-						icmCpy3(rgb, s->set[set].pary[vx].pp);
-					else if (s->ispace == vrml_xyz)		/* XYZ */
-						s->XYZ2RGB(s, rgb, s->set[set].pary[vx].pp);
-					else								/* Lab */
-						s->Lab2RGB(s, rgb, s->set[set].pary[vx].pp);	
-					fprintf(s->fp,"            %f %f %f\n", rgb[0], rgb[1], rgb[2]);
-				}
-			}
+			write_pcolors(s, set, cc, "            ", "\n");
 	
 		/* Per vertex color */
 		} else {
-			/* Spit out the colors for each vertex */
-			for (i = 0; i < s->set[set].npoints; i++) {
-				double out[3];
-				double rgb[3];
-		
-				/* Use vertex color */
-				if (s->set[set].pary[i].cc[0] >= 0.0) {
-					fprintf(s->fp,"            %f %f %f\n",
-						  s->set[set].pary[i].cc[0], s->set[set].pary[i].cc[1], s->set[set].pary[i].cc[2]);
-		
-				/* Use natural color of vertex */
-				} else {
-					if (s->ispace == vrml_rgb)		/* RGB */
-						icmCpy3(rgb, s->set[set].pary[i].pp);
-					else if (s->ispace == vrml_xyz)		/* XYZ */
-						s->XYZ2RGB(s, rgb, s->set[set].pary[i].pp);
-					else								/* Lab */
-						s->Lab2RGB(s, rgb, s->set[set].pary[i].pp);	
-		
-					fprintf(s->fp,"            %f %f %f\n", rgb[0], rgb[1], rgb[2]);
-				}
-			}
+			write_vcolors(s, set, "            ", "\n");
 		}
 
 		fprintf(s->fp,"          '></Color>\n");
@@ -1391,6 +1404,13 @@ double vdist
 		return NULL;
 	}
 
+	if ((s->wbuf = (char *)malloc(VRML_WBUFSZ)) == NULL) {
+		warning("Malloc of vrml output buffer failed");
+		free(s->name);
+		free(s);
+		return NULL;
+	}
+
 	s->ext                   = get_ext;
 	s->format                = get_format;
 	s->flush                 = do_flush;
@@ -1464,6 +1484,7 @@ double vdist
 
 	if ((s->fp = fopen(s->name,"w")) == NULL) {
 		warning("Opening of vrml plot file '%s' for write failed",s->name);
+		free(s->wbuf);
 		free(s);
 		return NULL;
 	}
@@ -1757,6 +1778,8 @@ static int do_flush(vrml *s) {
 	
 		fflush(s->fp);
 		rv = fclose(s->fp);
+		if (rv == 0 && s->werr)
+			rv = -1;
 
 		/* Check that there are the x3dom files with the output file */
 		if (s->fmt == fmt_x3dom) {
@@ -1855,6 +1878,8 @@ static void del_vrml(vrml *s) {
 	}
 	if (s->name != NULL)
 		free(s->name);
+	if (s->wbuf != NULL)
+		free(s->wbuf);
     free(s);
 }
 
@@ -44,15 +44,17 @@ typedef enum {
 } vrml_space;
 
 
+/* (Vertex and color values are held as float to reduce */
+/*  memory use, since they are only used for display.) */
 struct vrml_point {
-	double pp[3];			/* Vertex position */
-	double cc[3];			/* Vertex color */
+	float pp[3];			/* Vertex position */
+	float cc[3];			/* Vertex color */
 	int last;				/* Last vertex of line flag */
 };
 
 struct vrml_triquad {
 	int ix[4];
-	double cc[3];			/* Per polygon color if ppoly, natural if cc[0] < 0 */
+	float cc[3];			/* Per polygon color if ppoly, natural if cc[0] < 0 */
 };
 
 struct _vrml {
@@ -63,6 +65,10 @@ struct _vrml {
 
 	int written;		/* Set to nz when file has been written */
 
+	char *wbuf;			/* Geometry array output buffer, VRML_WBUFSZ bytes */
+	int wbix;			/* Number of characters in wbuf */
+	int werr;			/* Set to nz on a wbuf write error */
+
 	vrml_fmt fmt;		/* Format to output. Defaults to global format */
 						/* (Have to add ext() and format() methods if we change this) */ 
 	vrml_space ispace;	/* 0 if Lab, 1 if XYZ plot, (range 0..1), 2 if RGB (range 0..1) */
@@ -1026,8 +1026,10 @@ int main(int argc, char *argv[]) {
 	icg->add_other(icg, "CTI3"); 	/* our special input type is Calibration Target Information 3 */
 	icg->add_other(icg, "CAL"); 	/* our special device Calibration state */
 
+	ATIMER_BEGIN("cgats read")
 	if (icg->read_name(icg, inname))
 		error("CGATS file read error : %s",icg->e.m);
+	ATIMER_END
 
 	if (icg->ntables == 0 || icg->t[0].tt != tt_other || icg->t[0].oi != 0)
 		error ("Input file isn't a CTI3 format file");
@@ -1282,6 +1284,8 @@ int main(int argc, char *argv[]) {
 	printf("Exectution time = %f seconds\n",(double)ttime/(double)CLOCKS_PER_SEC);
 #endif /* DO_TIME */
 
+	ATIMING_REPORT("colprof");
+
 	return 0;
 }
 
@@ -38,12 +38,20 @@
 #include "icc.h"
 #include "xicc.h"
 #include "vrml.h"
+#include "conv.h"
 
 /* Resolution of the sampling modes */
 #define TRES 11
 #define HTRES 27
 #define UHTRES 61
 
+/* Sampled check mode */
+#define SMAXSAMP 100000		/* Default maximum number of samples */
+#define SBATCH 2048			/* Samples per batch, between convergence checks */
+#define SMINSAMP 4096		/* Minimum number of samples before stopping */
+#define SCONV 0.01			/* Default relative 95% confidence of average DE to stop at */
+#define SABSCONV 0.001		/* Absolute 95% confidence of average DE to stop at */
+
 /* ------------------------------------------------------- */
 /* Macros for an di or fdi dimensional counter */
 /* Declare the counter name nn, dimensions di, & count */
@@ -93,6 +101,8 @@ void usage(void) {
 	fprintf(stderr," -h           high res test (%d)\n",HTRES);
 	fprintf(stderr," -u           Ultra high res test (%d)\n",UHTRES);
 	fprintf(stderr," -R res       Specific grid resolution\n");
+	fprintf(stderr," -S [nmax]    Quasi-random sampled test rather than grid, max %d samples\n",SMAXSAMP);
+	fprintf(stderr," -T conf      Stop sampled test at relative 95%% confidence of average (def. %.2f)\n",SCONV);
 	fprintf(stderr," -I           Do bwd to fwd check\n");
 	fprintf(stderr," -c           Show CIE94 delta E values\n");
 	fprintf(stderr," -k           Show CIEDE2000 delta E values\n");
@@ -105,6 +115,78 @@ void usage(void) {
 
 static void DE2RGB(double *out, double in);
 
+/* ---------------------------------------- */
+/* Sampled check support. The samples for a batch are */
+/* generated serially, looked up by a set of threads, */
+/* and the results then accumulated in order. */
+
+typedef struct {
+	int inv;						/* PCS -> Device -> PCS */
+	int inn;						/* Number of device channels */
+	icc *icco;
+	icmLuSpace *luo1, *luo2;		/* Fwd and bwd lookups */
+	int cie94, cie2k;				/* Delta E type */
+
+	int nsamp;						/* Number of samples in batch */
+	double (*dev)[MAX_CHAN];		/* Device test values (!inv) */
+	double (*pcsin)[3];				/* PCS test values */
+	double (*devout)[MAX_CHAN];		/* Device round trip values */
+	double (*pcsout)[3];			/* PCS round trip values */
+	double *de;						/* Delta E's */
+
+	int next;						/* Next sample to do */
+	amutex lock;					/* Lock for next */
+} sctx;
+
+#define SCHUNK 64		/* Samples per thread work unit */
+
+/* Sample lookup thread */
+static int samp_thread(void *pp) {
+	sctx *cx = (sctx *)pp;
+	icc *icco = cx->icco;
+	icmLuSpace *luo1 = cx->luo1, *luo2 = cx->luo2;
+
+	for (;;) {
+		int i, ie;
+
+		amutex_lock(cx->lock);
+		i = cx->next;
+		cx->next += SCHUNK;
+		amutex_unlock(cx->lock);
+
+		if (i >= cx->nsamp)
+			break;
+		if ((ie = i + SCHUNK) > cx->nsamp)
+			ie = cx->nsamp;
+
+		for (; i < ie; i++) {
+			double *pcsin = cx->pcsin[i], *devout = cx->devout[i], *pcsout = cx->pcsout[i];
+
+			/* Device -> PCS */
+			if (!cx->inv) {
+				if (luo1->lookup_fwd(luo1, pcsin, cx->dev[i]) & icmPe_lurv_err)
+					error ("%d, %s",icco->e.c,icco->e.m);
+			}
+
+			/* PCS -> Device */
+			if (luo2->lookup_fwd(luo2, devout, pcsin) & icmPe_lurv_err)
+				error ("%d, %s",icco->e.c,icco->e.m);
+
+			/* Device to PCS */
+			if (luo1->lookup_fwd(luo1, pcsout, devout) & icmPe_lurv_err)
+				error ("%d, %s",icco->e.c,icco->e.m);
+
+			if (cx->cie2k)
+				cx->de[i] = icmCIE2K(pcsout, pcsin);
+			else if (cx->cie94)
+				cx->de[i] = icmCIE94(pcsout, pcsin);
+			else
+				cx->de[i] = icmLabDE(pcsout, pcsin);
+		}
+	}
+	return 0;
+}
+
 int
 main(
 	int argc,
@@ -125,6 +207,8 @@ main(
 	int rv = 0;
 	int inv = 0;
 	int tres = TRES;
+	int smax = 0;					/* Sampled test maximum samples, 0 if grid */
+	double sconv = SCONV;			/* Sampled test convergence */
 	double tlimit = -1.0;
 	double klimit = -1.0;
 	icRenderingIntent intent = icRelativeColorimetric;	/* Default */
@@ -185,6 +269,26 @@ main(
 				tres = res;
 			}
 
+			/* Sampled test */
+			else if (argv[fa][1] == 'S') {
+				smax = SMAXSAMP;
+				if (na != NULL && isdigit(na[0])) {
+					fa = nfa;
+					smax = atoi(na);
+					if (smax < 1)
+						usage();
+				}
+			}
+
+			/* Sampled test convergence */
+			else if (argv[fa][1] == 'T') {
+				if (na == NULL) usage();
+				fa = nfa;
+				sconv = atof(na);
+				if (sconv < 0.0)
+					usage();
+			}
+
 			/* Inverse */
 			else if (argv[fa][1] == 'I') {
 				inv = 1;
@@ -339,15 +443,162 @@ main(
 		}
 
 		if (verb) {
-			printf("Grid resolution is %d\n",tres);
+			if (smax > 0)
+				printf("Sampled test, up to %d samples\n",smax);
+			else
+				printf("Grid resolution is %d\n",tres);
 			if (tlimit >= 0.0)
 				printf("Input total ink limit assumed is %3.1f%%\n",100.0 * tlimit);
 			if (klimit >= 0.0)
 				printf("Input black ink limit assumed is %3.1f%%\n",100.0 * klimit);
 		}
 
+		/* Quasi-random sampled test of either direction */
+		if (smax > 0) {
+			sctx cx;
+			sobol *so;
+			int sdi = inv ? 3 : inn;
+			int i, n, nthr;
+			athread **ths;
+			int conv = 0;
+
+			if ((so = new_sobol(sdi)) == NULL)
+				error("new_sobol(%d) failed",sdi);
+
+			cx.inv = inv;
+			cx.inn = inn;
+			cx.icco = icco;
+			cx.luo1 = luo1;
+			cx.luo2 = luo2;
+			cx.cie94 = cie94;
+			cx.cie2k = cie2k;
+			amutex_init(cx.lock);
+
+			if ((cx.dev = (double (*)[MAX_CHAN])malloc(sizeof(double) * MAX_CHAN * SBATCH)) == NULL
+			 || (cx.pcsin = (double (*)[3])malloc(sizeof(double) * 3 * SBATCH)) == NULL
+			 || (cx.devout = (double (*)[MAX_CHAN])malloc(sizeof(double) * MAX_CHAN * SBATCH)) == NULL
+			 || (cx.pcsout = (double (*)[3])malloc(sizeof(double) * 3 * SBATCH)) == NULL
+			 || (cx.de = (double *)malloc(sizeof(double) * SBATCH)) == NULL)
+				error("Malloc of sample arrays failed");
+
+			if ((nthr = system_processors()) < 1)
+				nthr = 1;
+			if ((ths = (athread **)calloc(nthr, sizeof(athread *))) == NULL)
+				error("Malloc of threads failed");
+
+			while (nsamps < smax) {
+				int ns = smax - (int)nsamps;
+				if (ns > SBATCH)
+					ns = SBATCH;
+
+				/* Generate the next batch of test points */
+				for (cx.nsamp = 0; cx.nsamp < ns;) {
+					double v[MAX_CHAN];
+
+					if (so->next(so, v))
+						break;					/* Run out of sequence */
+
+					if (inv) {
+						double *pcsin = cx.pcsin[cx.nsamp];
+						pcsin[0] = 100.0 * v[0];
+						pcsin[1] = (127.0 * 2.0 * v[1]) - 127.0;
+						pcsin[2] = (127.0 * 2.0 * v[2]) - 127.0;
+					} else {
+						double *dev = cx.dev[cx.nsamp];
+						double cdev[MAX_CHAN], sum;
+
+						/* Reject any (possibly calibrated) device values over the limits */
+						for (sum = 0.0, n = 0; n < inn; n++) {
+							cdev[n] = dev[n] = v[n];
+							sum += cdev[n];
+						}
+						if (cal != NULL) {
+							cal->interp(cal, cdev, dev);
+							for (sum = 0, n = 0; n < inn; n++)
+								sum += cdev[n];
+						}
+						if ((tlimit > 0.0 && sum > tlimit)
+						 || (klimit > 0.0 && kch >= 0 && cdev[kch] > klimit))
+							continue;
+					}
+					cx.nsamp++;
+				}
+				if (cx.nsamp == 0)
+					break;
+
+				/* Do the lookups */
+				cx.next = 0;
+				for (i = 0; i < nthr; i++) {
+					if ((ths[i] = new_athread(samp_thread, (void *)&cx)) == NULL)
+						error("Failed to create sample thread");
+				}
+				for (i = 0; i < nthr; i++) {
+					ths[i]->wait(ths[i]);
+					ths[i]->del(ths[i]);
+				}
+
+				/* Accumulate the results */
+				for (i = 0; i < cx.nsamp; i++) {
+					double de = cx.de[i];
+
+					if (dovrml) {
+						int ix[2];
+
+						ix[0] = wrl->add_vertex(wrl, 0, cx.pcsin[i]);
+						ix[1] = wrl->add_vertex(wrl, 0, cx.pcsout[i]);
+
+						if (dodecol) {		/* Lines with color determined by length */
+							double rgb[3];
+							DE2RGB(rgb, icmNorm33(cx.pcsin[i], cx.pcsout[i]));
+							wrl->add_col_line(wrl, 0, ix, rgb);
+						} else {	/* Natural color */
+							wrl->add_line(wrl, 0, ix);
+						}
+					}
+
+					aerr += de;
+					rerr += de * de;
+					if (de > merr)
+						merr = de;
+					nsamps++;
+
+					if (verb > 1) {
+						printf("[%f] %f %f %f -> ",de, cx.pcsin[i][0], cx.pcsin[i][1], cx.pcsin[i][2]);
+						for (n = 0; n < inn; n++)
+							printf("%f ",cx.devout[i][n]);
+						printf("-> %f %f %f\n",cx.pcsout[i][0], cx.pcsout[i][1], cx.pcsout[i][2]);
+					}
+				}
+
+				/* Stop if the 95% confidence interval of the average */
+				/* is within sconv of it, or is negligible. */
+				if (nsamps >= SMINSAMP) {
+					double avg = aerr/nsamps;
+					double var = rerr/nsamps - avg * avg;
+					double ci = 1.96 * sqrt((var > 0.0 ? var : 0.0)/nsamps);
+
+					if (ci <= sconv * avg || ci <= SABSCONV) {
+						conv = 1;
+						break;
+					}
+				}
+			}
+
+			if (verb)
+				printf("Sampled test used %.0f samples, %s\n",nsamps,
+				       conv ? "average converged" : "average didn't converge");
+
+			free(ths);
+			free(cx.de);
+			free(cx.pcsout);
+			free(cx.devout);
+			free(cx.pcsin);
+			free(cx.dev);
+			amutex_del(cx.lock);
+			so->del(so);
+
 		/* Device -> PCS -> Device */
-		if (!inv) {
+		} else if (!inv) {
 			double dev[MAX_CHAN], cdev[MAX_CHAN], pcsin[3], devout[MAX_CHAN], pcsout[3];
 			DCOUNT(co, inn, 0, 0, tres);		/* Multi-D counter */
 	
@@ -52,6 +52,7 @@
 #include "xicc.h"
 #include "plot.h"
 #include "vrml.h"
+#include "conv.h"
 #include "ui.h"
 
 #define RSPLFLAGS (0 /* | RSPL_2PASSSMTH | RSPL_EXTRAFIT2 */)
@@ -69,6 +70,9 @@
 
 #define PRES 256		/* Plotting resolution (must be >= CAL_RES) */
 
+#define WARM_START		/* [def] Re-calibrate starting from the previous .cal curves */
+#define WS_MAXCELLS 16	/* [16] Grid cells to search from warm start before full inversion */
+
 void usage(char *diag, ...) {
 	int i;
 	fprintf(stderr,"Create printer calibration, Version %s\n",ARGYLL_VERSION_STR);
@@ -564,6 +568,363 @@ static double interp_cal(wval *cvals, int n_cvals, double ival) {
 	return oval;
 }
 
+/* Do an inverse lookup of a 1D rspl, starting from a device value */
+/* that is expected to be close to the solution, such as the previous */
+/* calibration curve value. The grid cells either side of the start */
+/* are searched for one that brackets the target, and if none is found */
+/* within WS_MAXCELLS, a full inverse lookup is done. Return -1.0 on error. */
+static double rspl_ilookup_ws(rspl *r, double start, double in) {
+	int res = r->g.res[0];
+	double gw = r->g.w[0], gl = r->g.l[0];
+	int k0, k, d, n;
+	co tp[2];
+
+	if (start < gl || start > r->g.h[0])
+		return rspl_ilookup(r, start, in);
+
+	k0 = (int)floor((start - gl)/gw);
+	if (k0 > (res-2))
+		k0 = res-2;
+
+	/* Search outwards from the start cell, alternating sides */
+	for (n = 0; n < (2 * WS_MAXCELLS); n++) {
+		double v0, v1;
+
+		d = (n + 1)/2;
+		k = (n & 1) ? k0 + d : k0 - d;
+		if (k < 0 || k > (res-2))
+			continue;
+
+		tp[0].p[0] = gl + k * gw;
+		tp[1].p[0] = gl + (k+1) * gw;
+		r->interp(r, &tp[0]);
+		r->interp(r, &tp[1]);
+		v0 = tp[0].v[0];
+		v1 = tp[1].v[0];
+
+		if ((in >= v0 && in <= v1) || (in <= v0 && in >= v1)) {
+			double t = 0.0;
+			if (v1 != v0)
+				t = (in - v0)/(v1 - v0);
+			return tp[0].p[0] + t * gw;
+		}
+	}
+
+	return rspl_ilookup(r, start, in);
+}
+
+/* Per channel fitting and inversion context */
+typedef struct {
+	int ch;				/* Channel index */
+
+	/* Fitting inputs */
+	wval *pvals;		/* Channel patch values, white first */
+	int n_pvals;		/* Number of patch values */
+	int n_white;		/* Number of white patches averaged into pvals[0] */
+	double smooth;		/* RSPL smoothness factor */
+	int imitate;		/* nz to create the imitation absolute delta E */
+	int verb;			/* Compute fit quality */
+
+	/* Fitting outputs */
+	rspl *raw;			/* Raw Lab values fitted to rspl */
+	rspl *ade;			/* Absolute delta E */
+	rspl *rde;			/* Relative delta E */
+	rspl *pcade;		/* Imitation absolute delta E, if imitate */
+	double avgde, maxde;	/* Raw fit quality if verb */
+
+	/* Inversion inputs */
+	int initial;		/* nz if initial calibration, else re-calibrate or imitate */
+	double ademax, ademin;	/* Initial absolute DE aims */
+	rspl *tcurve;		/* Initial tweak target curve, NULL if none */
+	wval *pcvals;		/* Previous calibration curve to warm start from, NULL if none */
+	int n_pcvals;		/* Number of previous calibration curve values */
+
+	/* Inversion outputs */
+	double rdemax, rdemin;	/* Initial relative DE aims */
+	wval *cvals;		/* Calibration curve */
+	int n_cvals;		/* Number of calibration curve values */
+} chfit;
+
+/* Fit the raw Lab values of a channel, and create */
+/* the absolute and relative delta E rspl's from them. */
+static void chfit_fit(chfit *cx) {
+	datai low,high;
+	datao olow,ohigh;
+	int gres[MXDI];
+	double avgdev[MXDO];
+	cow *dpoints;
+	co *dpoints_a;
+	co *dpoints_r;
+	double wh[3], prev[3], tot;
+	int i;
+
+	low[0] = 0.0;
+	high[0] = 1.0;
+	gres[0] = GRES;
+	olow[0] = 0.0;
+	ohigh[0] = 100.0;
+	olow[1] = olow[2] = -128.0; 
+	ohigh[1] = ohigh[2] = 128.0;
+	avgdev[0] = 0.0025;
+	avgdev[1] = 0.005;
+	avgdev[2] = 0.005;
+
+	if ((cx->raw = new_rspl(RSPL_NOFLAGS,1, 3)) == NULL)
+		error("new_rspl() failed");
+
+	if ((dpoints = (cow *)malloc(sizeof(cow) * cx->n_pvals)) == NULL)
+		error("malloc dpoints[%d] failed",cx->n_pvals);
+
+	for (i = 0; i < cx->n_pvals; i++) {
+		dpoints[i].p[0] = cx->pvals[i].dev;
+		dpoints[i].v[0] = cx->pvals[i].Lab[0];
+		dpoints[i].v[1] = cx->pvals[i].Lab[1];
+		dpoints[i].v[2] = cx->pvals[i].Lab[2];
+		if (i == 0)
+			dpoints[i].w = (double)cx->n_white;
+		else
+			dpoints[i].w = 1.0;
+	}
+
+	cx->raw->fit_rspl_w(cx->raw,
+	           RSPLFLAGS,
+	           dpoints,			/* Test points */
+	           cx->n_pvals,			/* Number of test points */
+	           low, high, gres,		/* Low, high, resolution of grid */
+	           olow, ohigh,			/* Default data scale */
+	           cx->smooth,			/* Smoothing */
+	           avgdev,				/* Average deviation */
+	           NULL);				/* iwidth */
+
+	/* Compute fit quality */
+	if (cx->verb > 0) {
+		cx->avgde = cx->maxde = 0.0;
+		for (i = 0; i < cx->n_pvals; i++) {
+			co tp;	/* Test point */
+			double de;
+			tp.p[0] = cx->pvals[i].dev;
+			cx->raw->interp(cx->raw, &tp);
+			de = icmLabDE(cx->pvals[i].Lab, tp.v);
+
+			cx->avgde += de;
+			if (de > cx->maxde)
+				cx->maxde = de;
+		}
+		cx->avgde /= (double)cx->n_pvals;
+	}
+
+	free(dpoints);
+
+	/* Create a RSPL of absolute deltaE and relative deltaE '94 */ 
+	avgdev[0] = 0.0;
+
+	if ((cx->ade = new_rspl(RSPL_NOFLAGS,1, 1)) == NULL)
+		error("new_rspl() failed");
+	if (cx->imitate) {
+		if ((cx->pcade = new_rspl(RSPL_NOFLAGS,1, 1)) == NULL)
+			error("new_rspl() failed");
+	}
+	if ((cx->rde = new_rspl(RSPL_NOFLAGS,1, 1)) == NULL)
+		error("new_rspl() failed");
+
+	if ((dpoints_a = malloc(sizeof(co) * GRES)) == NULL)
+		error("malloc dpoints[%d] failed",GRES);
+	if ((dpoints_r = malloc(sizeof(co) * GRES)) == NULL)
+		error("malloc dpoints[%d] failed",GRES);
+
+	for (i = 0; i < GRES; i++) {
+		co tp;	/* Test point */
+
+		tp.p[0] = i/(double)(GRES-1);
+		cx->raw->interp(cx->raw, &tp);
+
+		dpoints_a[i].p[0] = tp.p[0];
+		dpoints_r[i].p[0] = tp.p[0];
+		if (i == 0) {
+			tot = 0.0;
+			prev[0] = wh[0] = tp.v[0];
+			prev[1] = wh[1] = tp.v[1];
+			prev[2] = wh[2] = tp.v[2];
+			dpoints_a[i].v[0] = 0.0;
+			dpoints_r[i].v[0] = 0.0;
+		} else {
+			/* Use Euclidean for large DE: (CIE94 stuffs up here) */
+			dpoints_a[i].v[0] = icmLabDE(tp.v, wh);
+			/* And CIE94 for small: */
+			tot += icmCIE94(tp.v, prev);
+			prev[0] = tp.v[0];
+			prev[1] = tp.v[1];
+			prev[2] = tp.v[2];
+			dpoints_r[i].v[0] = tot;
+		}
+	}
+
+	cx->ade->set_rspl(cx->ade,
+	           0, 
+	           (void *)dpoints_a,	/* Test points */
+	           rsplset1,			/* Setting function */
+	           low, high, gres,		/* Low, high, resolution of grid */
+	           NULL, NULL			/* Default data scale */
+	           );
+	if (cx->imitate) {
+		cx->pcade->set_rspl(cx->pcade,
+		           0, 
+		           (void *)dpoints_a,	/* Test points */
+		           rsplset1,			/* Setting function */
+		           low, high, gres,		/* Low, high, resolution of grid */
+		           NULL, NULL			/* Default data scale */
+		           );
+	}
+	cx->rde->set_rspl(cx->rde,
+	           0, 
+	           (void *)dpoints_r,		/* Test points */
+	           rsplset1,			/* Setting function */
+	           low, high, gres,		/* Low, high, resolution of grid */
+	           NULL, NULL			/* Default data scale */
+	           );
+	free(dpoints_a);
+	free(dpoints_r);
+}
+
+/* Lookup the previous calibration curve of a channel */
+static double chfit_prev(chfit *cx, double x) {
+	double t, w;
+	int mi;
+
+	t = x * (cx->n_pcvals-1.0);
+	mi = (int)floor(t);
+	if (mi < 0)
+		mi = 0;
+	else if (mi > (cx->n_pcvals-2))
+		mi = cx->n_pcvals-2;
+	w = t - (double)mi;
+
+	return (1.0 - w) * cx->pcvals[mi].dev + w * cx->pcvals[mi+1].dev;
+}
+
+/* Create the calibration curve of a channel by inverse lookup */
+static void chfit_inv(chfit *cx) {
+	co tp;
+	int i;
+
+	if ((cx->cvals = (wval *)malloc(sizeof(wval) * cx->n_cvals)) == NULL)
+		error("Malloc of %d cvals failed",cx->n_cvals);
+
+	if (cx->initial) {
+		double rdemin, rdemax;	/* Relative DE min and max targets */
+
+		/* Convert absolute de aims to relative */
+		if ((rdemax = rspl_ilookup(cx->ade, 0.0, cx->ademax)) < 0.0)
+			error("Unexpected failure to invert curve %d for DE %f",cx->ch,cx->ademax); 
+
+		tp.p[0] = rdemax;
+		cx->rde->interp(cx->rde, &tp);
+		cx->rdemax = rdemax = tp.v[0];
+
+		if ((rdemin = rspl_ilookup(cx->ade, 1.0, cx->ademin)) < 0.0)
+			error("Unexpected failure to invert curve %d for DE %f",cx->ch,cx->ademax); 
+
+		tp.p[0] = rdemin;
+		cx->rde->interp(cx->rde, &tp);
+		cx->rdemin = rdemin = tp.v[0];
+
+		/* Convert relative delta E aim to device value */
+		for (i = 0; i < cx->n_cvals; i++) {
+			double x = i/(cx->n_cvals-1.0);
+			double inv;
+
+			cx->cvals[i].inv = x;
+
+			/* Apply any aim tweak curve */
+			if (cx->tcurve != NULL) {
+				tp.p[0] = x;
+				cx->tcurve->interp(cx->tcurve, &tp);
+				x = tp.v[0];
+			}
+
+			inv = x * (rdemax - rdemin) + rdemin;
+
+			if ((cx->cvals[i].dev = rspl_ilookup(cx->rde, 0.5, inv)) < 0.0)
+				error("Unexpected failure to invert curve %d for DE %f",cx->ch,inv); 
+		}
+
+	} else {
+
+		/* Lookup the expected ade for each input device value, and */
+		/* then translate it into the required output device value */
+		for (i = 0; i < cx->n_cvals; i++) {
+			double x = i/(cx->n_cvals-1.0);
+
+			cx->cvals[i].inv = tp.p[0] = x;
+			cx->pcade->interp(cx->pcade, &tp);
+
+			/* Start from the previous calibration, since a re-calibration */
+			/* is usually only a small correction to it. */
+			if (cx->pcvals != NULL)
+				cx->cvals[i].dev = rspl_ilookup_ws(cx->ade, chfit_prev(cx, x), tp.v[0]);
+			else
+				cx->cvals[i].dev = rspl_ilookup(cx->ade, 0.5, tp.v[0]);
+
+			if (cx->cvals[i].dev < 0.0)
+				error("Unexpected failure to invert curve %d for DE %f",cx->ch,tp.v[0]); 
+		}
+	}
+}
+
+/* Thread context for processing a subset of the channels */
+typedef struct {
+	chfit *cx;			/* All the channel contexts */
+	int nch;			/* Number of channels */
+	int i0, inc;		/* First channel and channel increment */
+	void (*func)(chfit *cx);	/* Per channel function */
+} chthr;
+
+static int chfit_thread(void *cntx) {
+	chthr *tx = (chthr *)cntx;
+	int j;
+
+	for (j = tx->i0; j < tx->nch; j += tx->inc)
+		tx->func(&tx->cx[j]);
+
+	return 0;
+}
+
+/* Call func() for each channel, spreading the channels over the processors. */
+/* The channels are independent, so the result doesn't depend on the */
+/* number of threads. */
+static void chfit_all(chfit *cx, int nch, void (*func)(chfit *cx)) {
+	chthr tx[MAX_CHAN];
+	int nthr, i;
+
+	if ((nthr = system_processors()) < 1)
+		nthr = 1;
+	if (nthr > nch)
+		nthr = nch;
+
+	for (i = 0; i < nthr; i++) {
+		tx[i].cx = cx;
+		tx[i].nch = nch;
+		tx[i].i0 = i;
+		tx[i].inc = nthr;
+		tx[i].func = func;
+	}
+
+	if (nthr <= 1) {
+		chfit_thread((void *)&tx[0]);
+	} else {
+		athread *ths[MAX_CHAN];
+
+		for (i = 0; i < nthr; i++) {
+			if ((ths[i] = new_athread(chfit_thread, (void *)&tx[i])) == NULL)
+				error("Failed to create channel fitting thread");
+		}
+		for (i = 0; i < nthr; i++) {
+			ths[i]->wait(ths[i]);
+			ths[i]->del(ths[i]);
+		}
+	}
+}
+
 int main(int argc, char *argv[]) {
 	int fa,nfa,mfa;				/* current argument we're looking at */
 	int verb = 0;
@@ -611,6 +972,9 @@ int main(int argc, char *argv[]) {
 	int n_cvals;				/* Number of calibration curve values */
 	wval *cvals[MAX_CHAN];		/* Calibration curve tables */
 	rspl *tcurves[MAX_CHAN];	/* Tweak target curves */
+	int n_pcvals = 0;			/* Number of previous calibration curve values */
+	wval *pcvals[MAX_CHAN];		/* Previous calibration curve tables for warm start */
+	chfit chf[MAX_CHAN];		/* Per channel fitting context */
 	int i, j;
 
 
@@ -624,7 +988,9 @@ int main(int argc, char *argv[]) {
 		pcade[j] = NULL;
 		cvals[j] = NULL;
 		tcurves[j] = NULL;
+		pcvals[j] = NULL;
 	}
+	memset((void *)chf, 0, sizeof(chf));
 
 	error_program = argv[0];
 	memset((void *)&xpi, 0, sizeof(profxinf));	/* Init extra profile info to defaults */
@@ -1063,6 +1429,47 @@ int main(int argc, char *argv[]) {
 			}
 			free(bident);
 		}
+
+#ifdef WARM_START
+		/* Load the previous calibration curves from the first table, */
+		/* so that the re-calibration can start from them. */
+		if (recal && tcg->t[0].nsets >= 2) {
+			char *bident;
+			int spi[1+MAX_CHAN];	/* CGATS indexes for each field */
+			char buf[100];
+
+			bident = icx_inkmask2char(pct->devmask, 0); 
+
+			sprintf(buf, "%s_I",bident);
+			if ((spi[0] = tcg->find_field(tcg, 0, buf)) < 0)
+				error("Can't find field %s in '%s'",buf,calname);
+
+			for (j = 0; j < devchan; j++) {
+				inkmask imask = icx_index2ink(pct->devmask, j);
+				sprintf(buf, "%s_%s",bident,icx_ink2char(imask));
+				if ((spi[1+j] = tcg->find_field(tcg, 0, buf)) < 0)
+					error("Can't find field %s in '%s'",buf,calname);
+			}
+
+			n_pcvals = tcg->t[0].nsets;
+			for (j = 0; j < devchan; j++) {
+				if ((pcvals[j] = (wval *)malloc(sizeof(wval) * n_pcvals)) == NULL)
+					error("Malloc of %d pcvals failed",n_pcvals);
+
+				/* Convert back to our subtractive sense */
+				for (i = 0; i < n_pcvals; i++) {
+					if (devmask & ICX_ADDITIVE) {
+						pcvals[j][i].inv = 1.0 - *((double *)tcg->t[0].fdata[n_pcvals-1-i][spi[0]]);
+						pcvals[j][i].dev = 1.0 - *((double *)tcg->t[0].fdata[n_pcvals-1-i][spi[1+j]]);
+					} else {
+						pcvals[j][i].inv = *((double *)tcg->t[0].fdata[i][spi[0]]);
+						pcvals[j][i].dev = *((double *)tcg->t[0].fdata[i][spi[1+j]]);
+					}
+				}
+			}
+			free(bident);
+		}
+#endif /* WARM_START */
 		tcg->del(tcg);
 
 	} else {	/* Must be an initial or Imitation calibration */
@@ -1352,72 +1759,29 @@ int main(int argc, char *argv[]) {
 	}
 	icg->del(icg);		/* Clean up */
 
-	/* Interpolate Lab using rspl */
+	/* Interpolate Lab using rspl, and create the absolute and */
+	/* relative delta E rspl's for each channel. */
 	for (j = 0; j < devchan; j++) {
-		datai low,high;
-		datao olow,ohigh;
-		int gres[MXDI];
-		double avgdev[MXDO];
-		cow *dpoints;
-
-		low[0] = 0.0;
-		high[0] = 1.0;
-		gres[0] = GRES;
-		olow[0] = 0.0;
-		ohigh[0] = 100.0;
-		olow[1] = olow[2] = -128.0; 
-		ohigh[1] = ohigh[2] = 128.0;
-		avgdev[0] = 0.0025;
-		avgdev[1] = 0.005;
-		avgdev[2] = 0.005;
-
-		if ((raw[j] = new_rspl(RSPL_NOFLAGS,1, 3)) == NULL)
-			error("new_rspl() failed");
-
-		if ((dpoints = (cow *)malloc(sizeof(cow) * n_pvals[j])) == NULL)
-			error("malloc dpoints[%d] failed",n_pvals[j]);
-
-		for (i = 0; i < n_pvals[j]; i++) {
-			dpoints[i].p[0] = pvals[j][i].dev;
-			dpoints[i].v[0] = pvals[j][i].Lab[0];
-			dpoints[i].v[1] = pvals[j][i].Lab[1];
-			dpoints[i].v[2] = pvals[j][i].Lab[2];
-			if (i == 0)
-				dpoints[i].w = (double)n_white;
-			else
-				dpoints[i].w = 1.0;
-		}
-
-		raw[j]->fit_rspl_w(raw[j],
-		           RSPLFLAGS,
-		           dpoints,			/* Test points */
-		           n_pvals[j],			/* Number of test points */
-		           low, high, gres,		/* Low, high, resolution of grid */
-		           olow, ohigh,			/* Default data scale */
-		           smooth,				/* Smoothing */
-		           avgdev,				/* Average deviation */
-		           NULL);				/* iwidth */
-
-
-		/* Compute & show fit quality */
-		if (verb > 0) {
-			double avgde = 0.0, maxde = 0.0;
-			for (i = 0; i < n_pvals[j]; i++) {
-				co tp;	/* Test point */
-				double de;
-				tp.p[0] = pvals[j][i].dev;
-				raw[j]->interp(raw[j], &tp);
-				de = icmLabDE(pvals[j][i].Lab, tp.v);
-
-				avgde += de;
-				if (de > maxde)
-					maxde = de;
-			}
-			avgde /= (double)n_pvals[j];
-			printf("Chan %d raw fit avg DE %f, max %f\n",j,avgde,maxde);
-		}
+		chf[j].ch = j;
+		chf[j].pvals = pvals[j];
+		chf[j].n_pvals = n_pvals[j];
+		chf[j].n_white = n_white;
+		chf[j].smooth = smooth;
+		chf[j].imitate = imitate;
+		chf[j].verb = verb;
+	}
+	chfit_all(chf, devchan, chfit_fit);
 
-		free(dpoints);
+	for (j = 0; j < devchan; j++) {
+		raw[j] = chf[j].raw;
+		ade[j] = chf[j].ade;
+		rde[j] = chf[j].rde;
+		if (imitate)
+			pcade[j] = chf[j].pcade;
+
+		/* Show fit quality */
+		if (verb > 0)
+			printf("Chan %d raw fit avg DE %f, max %f\n",j,chf[j].avgde,chf[j].maxde);
 	}
 
 	/* Plot the raw curves */
@@ -1469,92 +1833,6 @@ int main(int argc, char *argv[]) {
 		wrl->del(wrl);		/* Write file and delete */
 	}
 
-	/* Create a RSPL of absolute deltaE and relative deltaE '94 */ 
-	for (j = 0; j < devchan; j++) {
-		datai low,high;
-		int gres[MXDI];
-		double avgdev[MXDO];
-		co *dpoints_a;
-		co *dpoints_r;
-		double wh[3], prev[3], tot;
-
-		low[0] = 0.0;
-		high[0] = 1.0;
-		gres[0] = GRES;
-		avgdev[0] = 0.0;
-
-		if ((ade[j] = new_rspl(RSPL_NOFLAGS,1, 1)) == NULL)
-			error("new_rspl() failed");
-		if (imitate) {
-			if ((pcade[j] = new_rspl(RSPL_NOFLAGS,1, 1)) == NULL)
-				error("new_rspl() failed");
-		}
-		if ((rde[j] = new_rspl(RSPL_NOFLAGS,1, 1)) == NULL)
-			error("new_rspl() failed");
-
-		if ((dpoints_a = malloc(sizeof(co) * GRES)) == NULL)
-			error("malloc dpoints[%d] failed",GRES);
-		if ((dpoints_r = malloc(sizeof(co) * GRES)) == NULL)
-			error("malloc dpoints[%d] failed",GRES);
-
-//printf("~1 Chan %d:\n",j);
-		for (i = 0; i < GRES; i++) {
-			co tp;	/* Test point */
-
-			tp.p[0] = i/(double)(GRES-1);
-			raw[j]->interp(raw[j], &tp);
-
-			dpoints_a[i].p[0] = tp.p[0];
-			dpoints_r[i].p[0] = tp.p[0];
-			if (i == 0) {
-//printf("~1 wht = %f %f %f\n",tp.v[0],tp.v[1],tp.v[2]);
-				tot = 0.0;
-				prev[0] = wh[0] = tp.v[0];
-				prev[1] = wh[1] = tp.v[1];
-				prev[2] = wh[2] = tp.v[2];
-				dpoints_a[i].v[0] = 0.0;
-				dpoints_r[i].v[0] = 0.0;
-			} else {
-//printf("~1 samp %d = %f %f %f\n",i,tp.v[0],tp.v[1],tp.v[2]);
-				/* Use Euclidean for large DE: (CIE94 stuffs up here) */
-				dpoints_a[i].v[0] = icmLabDE(tp.v, wh);
-				/* And CIE94 for small: */
-				tot += icmCIE94(tp.v, prev);
-				prev[0] = tp.v[0];
-				prev[1] = tp.v[1];
-				prev[2] = tp.v[2];
-				dpoints_r[i].v[0] = tot;
-			}
-//printf("~1   %d: dev %f, ade %f, rde %f\n",i,tp.p[0],dpoints_a[i].v[0],dpoints_r[i].v[0]);
-		}
-
-		ade[j]->set_rspl(ade[j],
-		           0, 
-		           (void *)dpoints_a,	/* Test points */
-		           rsplset1,			/* Setting function */
-		           low, high, gres,		/* Low, high, resolution of grid */
-		           NULL, NULL			/* Default data scale */
-		           );
-		if (imitate) {
-			pcade[j]->set_rspl(pcade[j],
-			           0, 
-			           (void *)dpoints_a,	/* Test points */
-			           rsplset1,			/* Setting function */
-			           low, high, gres,		/* Low, high, resolution of grid */
-			           NULL, NULL			/* Default data scale */
-			           );
-		}
-		rde[j]->set_rspl(rde[j],
-		           0, 
-		           (void *)dpoints_r,		/* Test points */
-		           rsplset1,			/* Setting function */
-		           low, high, gres,		/* Low, high, resolution of grid */
-		           NULL, NULL			/* Default data scale */
-		           );
-		free(dpoints_a);
-		free(dpoints_r);
-	}
-
 	if (initial) {
 		/* Establish the ademax values */
 		pct->update_devmax(pct, -1, -1.0);		/* Make sure there is a value for each */
@@ -2066,74 +2344,40 @@ int main(int argc, char *argv[]) {
 		/* Do inverse lookup to create relative linearization curves */
 		n_cvals = CAL_RES;
 		for (j = 0; j < devchan; j++) {
-			co tp;
-			double rdemin, rdemax;	/* Relative DE min and max targets */
-
-			/* Convert absolute de aims to relative */
-			if ((rdemax = rspl_ilookup(ade[j], 0.0, pct->ademax[j])) < 0.0)
-				error("Unexpected failure to invert curve %d for DE %f",j,pct->ademax[j]); 
-
-			tp.p[0] = rdemax;
-			rde[j]->interp(rde[j], &tp);
-			rdemax = tp.v[0];
-
-			if ((rdemin = rspl_ilookup(ade[j], 1.0, pct->ademin[j])) < 0.0)
-				error("Unexpected failure to invert curve %d for DE %f",j,pct->ademax[j]); 
+			chf[j].initial = 1;
+			chf[j].ademax = pct->ademax[j];
+			chf[j].ademin = pct->ademin[j];
+			chf[j].tcurve = tcurves[j];
+			chf[j].n_cvals = n_cvals;
+		}
 
-			tp.p[0] = rdemin;
-			rde[j]->interp(rde[j], &tp);
-			rdemin = tp.v[0];
+		/* The first reverse lookup sets the global reverse cache limits, */
+		/* so do one before going multi-threaded. */
+		rspl_ilookup(ade[0], 0.0, 0.0);
+		chfit_all(chf, devchan, chfit_inv);
 
+		for (j = 0; j < devchan; j++) {
+			cvals[j] = chf[j].cvals;
 			if (verb > 0)
-				printf("Chan %d: rDE Max = %f, rDE Min = %f\n",j,rdemax,rdemin);
-
-			if ((cvals[j] = (wval *)malloc(sizeof(wval) * n_cvals)) == NULL)
-				error("Malloc of %d cvals failed",n_cvals);
-
-			/* Convert relative delta E aim to device value */
-			for (i = 0; i < n_cvals; i++) {
-				double x = i/(n_cvals-1.0);
-				double inv;
-
-				cvals[j][i].inv = x;
-
-				/* Apply any aim tweak curve */
-				if (tcurves[j] != NULL) {
-					tp.p[0] = x;
-					tcurves[j]->interp(tcurves[j], &tp);
-					x = tp.v[0];
-				}
-
-				inv = x * (rdemax - rdemin) + rdemin;
-
-				if ((cvals[j][i].dev = rspl_ilookup(rde[j], 0.5, inv)) < 0.0)
-					error("Unexpected failure to invert curve %d for DE %f",j,inv); 
-//printf("~1 chan %d, step %d, inv %f, detarg %f, got dev %f\n",j,i,x,pp[0].v[0],pp[k].p[0]);
-			}
+				printf("Chan %d: rDE Max = %f, rDE Min = %f\n",j,chf[j].rdemax,chf[j].rdemin);
 		}
 
 	} else if (recal || imitate) {
 
 		n_cvals = CAL_RES;
 		for (j = 0; j < devchan; j++) {
-			co tp;
-
-			if ((cvals[j] = (wval *)malloc(sizeof(wval) * n_cvals)) == NULL)
-				error("Malloc of %d cvals failed",n_cvals);
-
-			/* Lookup the expected ade for each input device value, and */
-			/* then translate it into the required output device value */
-			for (i = 0; i < n_cvals; i++) {
-				double x = i/(n_cvals-1.0);
+			chf[j].initial = 0;
+			chf[j].pcade = pcade[j];
+			chf[j].pcvals = pcvals[j];
+			chf[j].n_pcvals = n_pcvals;
+			chf[j].n_cvals = n_cvals;
+		}
 
-				cvals[j][i].inv = tp.p[0] = x;
-				pcade[j]->interp(pcade[j], &tp);
+		rspl_ilookup(ade[0], 0.0, 0.0);		/* Set reverse cache limits */
+		chfit_all(chf, devchan, chfit_inv);
 
-				if ((cvals[j][i].dev = rspl_ilookup(ade[j], 0.5, tp.v[0])) < 0.0)
-					error("Unexpected failure to invert curve %d for DE %f",j,tp.v[0]); 
-//printf("~1 chan %d, ix %d, inv %f, pcade %f, iade %f\n",j,i,x,tp.v[0],cvals[j][i].dev);
-			}
-		}
+		for (j = 0; j < devchan; j++)
+			cvals[j] = chf[j].cvals;
 	}
 
 	if (initial || recal || imitate) {
@@ -2460,6 +2704,8 @@ int main(int argc, char *argv[]) {
 			pcade[j]->del(pcade[j]);
 		if (cvals[j] != NULL)
 			free(cvals[j]);
+		if (pcvals[j] != NULL)
+			free(pcvals[j]);
 		if (tcurves[j] != NULL)
 			tcurves[j]->del(tcurves[j]);
 	}
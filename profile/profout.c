@@ -84,6 +84,7 @@
 #define IGNORE_DISP_ZEROS	    /* [def] Ignore points with zero value if not at dev. zero */
 #define NO_B2A_PCS_CURVES		/* [def] PCS curves seem to make B2A less accurate. Why ? */
 #define USE_CAM_CLIP_OPT		/* [def] Clip out of gamut in CAM space rather than PCS */
+#undef USE_INT_SEPARATE		/* [und] Invert CMYK B2A with an internal separation (faster) */
 #undef USE_LEASTSQUARES_APROX	/* [und] Use least squares fitting approximation in B2A */
 								/* (This improves robustness ?, but makes it less smooth) */
 //#undef USE_EXTRA_FITTING		/* [und] Turn on data point error compensation in A2B */
@@ -2283,6 +2284,9 @@ make_output_icc(
 #else
 				warning("!!!! USE_CAM_CLIP_OPT in profout.c is off !!!!");
 #endif
+#ifdef USE_INT_SEPARATE
+				flags |= ICX_INT_SEPARATE;		/* Fixed K rule inverse via a separation */
+#endif
 
 				if ((AtoB = wr_xicc->get_luobj(wr_xicc, flags, icmFwd,
 				                  !allintents ? icmDefaultIntent : icRelativeColorimetric,
@@ -2818,6 +2822,7 @@ make_output_icc(
 #else /* !DEBUG_IGM_ONE */
 
 				/* Create perceptual/saturation A2B cLuts */
+				ATIMER_BEGIN("clut fill A2B")
 				if (wr_icco->create_lut_xforms(
 					wr_icco,
 #ifdef USE_LEASTSQUARES_APROX
@@ -2840,6 +2845,7 @@ make_output_icc(
 					NULL, NULL			/* Use default APXLS range */
 				) != ICM_ERR_OK)
 					error("Setting 16 bit Device->PCS Lut failed: %d, %s",wr_icco->e.c,wr_icco->e.m);
+				ATIMER_END
 				if (cx.verb) {
 					printf("\n");
 				}
@@ -2897,6 +2903,7 @@ make_output_icc(
 				b2agres[i] = b2ares;
 
 			/* Create B2A cLut */
+			ATIMER_BEGIN("clut fill B2A")
 			if (wr_icco->create_lut_xforms(
 				wr_icco,
 #ifdef USE_LEASTSQUARES_APROX
@@ -2919,6 +2926,7 @@ make_output_icc(
 				NULL, NULL			/* Use default APXLS range */
 			) != ICM_ERR_OK)
 				error("Setting 16 bit PCS->Device Lut failed: %d, %s",wr_icco->e.c,wr_icco->e.m);
+			ATIMER_END
 			if (cx.verb) {
 				printf("\n");
 			}
@@ -3120,6 +3128,7 @@ make_output_icc(
 
 
 			/* Create Gamut table */
+			ATIMER_BEGIN("clut fill gamut")
 			if (wr_icco->create_lut_xforms(wr_icco,
 					ICM_CLUT_SET_EXACT,
 					&cx,					/* Context */
@@ -3136,6 +3145,7 @@ make_output_icc(
 					NULL, NULL	
 			) != ICM_ERR_OK)
 				error("Setting 16 bit PCS->Device Gamut Lut failed: %d, %s",wr_icco->e.c,wr_icco->e.m);
+			ATIMER_END
 			if (cx.verb) {
 				printf("\n");
 			}
@@ -3238,9 +3248,11 @@ make_output_icc(
 		cal->del(cal);
 
 	/* Write the file (including all tags) out */
+	ATIMER_BEGIN("icc write")
 	if ((rv = wr_icco->write(wr_icco,wr_fp,0)) != 0) {
 		error("Write file: %d, %s",rv,wr_icco->e.m);
 	}
+	ATIMER_END
 
 	/* Close the file */
 	wr_icco->del(wr_icco);
@@ -39,6 +39,7 @@
 #include "numlib.h"
 #ifdef RENDER_TIFF
 # include "tiffio.h"
+# include "tiffstrip.h"
 #endif	/* TIFF */
 #ifdef RENDER_PNG
 # include "png.h"
@@ -316,6 +317,7 @@ static int render2d_write(
 ) {
 #ifdef RENDER_TIFF
 	TIFF *wh = NULL;
+	tiffstrip *ts = NULL;		/* Parallel compressing strip writer */
 	uint16 samplesperpixel = 0, bitspersample = 0;
 	uint16 extrasamples = 0;	/* Extra "alpha" samples */
 	uint16 extrainfo[MXCH2D];	/* Info about extra samples */
@@ -473,6 +475,11 @@ static int render2d_write(
 
 		/* Allocate one TIFF line buffer */
 		outbuf = _TIFFmalloc(TIFFScanlineSize(wh));
+
+		if ((ts = new_tiffstrip(wh)) == NULL) {
+			a1loge(g_log, 1, "render2d: Failed to create TIFF strip writer for '%s'\n",filename);
+			return 1;
+		}
 #else
 		a1loge(g_log, 1, "render2d: TIFF format not compiled in\n");
 		return 1;
@@ -972,7 +979,7 @@ static int render2d_write(
 			if (fmt == tiff_file) {
 #ifdef RENDER_TIFF
 
-				if (TIFFWriteScanline(wh, outbuf, y, 0) < 0) {
+				if (ts->write(ts, outbuf)) {
 					a1loge(g_log, 1, "Failed to write TIFF file '%s' line %d\n",filename,y);
 					return 1;
 				}
@@ -1008,6 +1015,11 @@ static int render2d_write(
 	if (fmt == tiff_file) {
 #ifdef RENDER_TIFF
 		_TIFFfree(outbuf);
+		if (ts->flush(ts)) {
+			a1loge(g_log, 1, "Failed to write TIFF file '%s'\n",filename);
+			return 1;
+		}
+		ts->del(ts);
 		TIFFClose(wh);		/* Close Output file */
 #endif	/* TIFF */
 
@@ -0,0 +1,474 @@
+
+/*
+ * render2d
+ *
+ * Parallel compressing TIFF strip writer.
+ *
+ * Author:  agent
+ * Date:    18/10/2026
+ *
+ * Copyright 2026, agent
+ * All rights reserved.
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Strips are filled by the callers thread in a ring of buffers.
+ * A filled strip is handed to the worker threads to compress, and
+ * the strip buffer is written out when the ring wraps around to it
+ * again, so strips are written in order while later strips are
+ * being compressed. Each strip is compressed independently,
+ * as the TIFF format requires.
+ *
+ * The LZW encoder follows the libtiff one, less its
+ * compression ratio monitoring.
+ */
+
+#undef DEBUG
+
+#define TS_STRIPBYTES 262144	/* [256K] Target uncompressed strip size */
+#define TS_MAXTHR 16			/* [16] Maximum number of compression threads */
+#define TS_SLOTSPERTHR 2		/* [2] Strip buffers per compression thread */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numlib.h"
+#include "conv.h"
+#include "tiffio.h"
+#include "tiffstrip.h"
+
+#ifdef DEBUG
+# define DBG(xx)	a1logd(g_log, 0, xx );
+#else
+# define DBG(xx)
+#endif
+
+/* ------------------------------------------------------------- */
+/* TIFF LZW encoder */
+
+#define LZW_BITSMIN 9				/* Start of code width */
+#define LZW_BITSMAX 12				/* Maximum code width */
+#define LZW_MAXCODE(n) ((1 << (n)) - 1)
+#define LZW_CODEMAX LZW_MAXCODE(LZW_BITSMAX)
+#define LZW_CLEAR 256				/* Clear code */
+#define LZW_EOI 257					/* End of information code */
+#define LZW_FIRST 258				/* First free code */
+#define LZW_HSIZE 9001				/* Hash table size, 91% occupancy */
+#define LZW_HSHIFT (13 - 8)
+
+/* Encoder hash table */
+typedef struct {
+	long hash[LZW_HSIZE];			/* Prefix code + character, -1 if unused */
+	unsigned short code[LZW_HSIZE];	/* Code for hash entry */
+} lzwenc;
+
+/* Output a code MSB first */
+#define LZW_PUTCODE(op, cc) {							\
+	nextdata = (nextdata << nbits) | (cc);				\
+	nextbits += nbits;									\
+	*op++ = (unsigned char)(nextdata >> (nextbits-8));	\
+	nextbits -= 8;										\
+	if (nextbits >= 8) {								\
+		*op++ = (unsigned char)(nextdata >> (nextbits-8));	\
+		nextbits -= 8;									\
+	}													\
+}
+
+/* Worst case encoded size of n bytes */
+#define LZW_MAXSIZE(n) ((n) + (n)/2 + (n)/256 + 64)
+
+/* Clear the hash table */
+static void lzw_clear(lzwenc *e) {
+	int h;
+
+	for (h = 0; h < LZW_HSIZE; h++)
+		e->hash[h] = -1;
+}
+
+/* Encode n > 0 bytes from ip to op. Return the number of bytes output */
+static tsize_t lzw_encode(lzwenc *e, unsigned char *op, unsigned char *ip, tsize_t n) {
+	unsigned char *sop = op, *ep = ip + n;
+	unsigned long nextdata = 0;
+	int nextbits = 0;
+	int nbits = LZW_BITSMIN;
+	int maxcode = LZW_MAXCODE(LZW_BITSMIN);
+	int free_ent = LZW_FIRST;
+	int ent, c, h, disp;
+	long fcode;
+
+	lzw_clear(e);
+	LZW_PUTCODE(op, LZW_CLEAR);
+	ent = *ip++;
+
+	while (ip < ep) {
+		c = *ip++;
+		fcode = ((long)c << LZW_BITSMAX) + ent;
+		h = (c << LZW_HSHIFT) ^ ent;
+
+		if (e->hash[h] == fcode) {			/* Existing string */
+			ent = e->code[h];
+			continue;
+		}
+		if (e->hash[h] >= 0) {				/* Secondary probe */
+			disp = LZW_HSIZE - h;
+			if (h == 0)
+				disp = 1;
+			do {
+				if ((h -= disp) < 0)
+					h += LZW_HSIZE;
+				if (e->hash[h] == fcode)
+					break;
+			} while (e->hash[h] >= 0);
+			if (e->hash[h] == fcode) {
+				ent = e->code[h];
+				continue;
+			}
+		}
+
+		/* New string, output the prefix and add it to the table */
+		LZW_PUTCODE(op, ent);
+		ent = c;
+		e->code[h] = (unsigned short)free_ent++;
+		e->hash[h] = fcode;
+		if (free_ent == (LZW_CODEMAX-1)) {	/* Table is full */
+			lzw_clear(e);
+			free_ent = LZW_FIRST;
+			LZW_PUTCODE(op, LZW_CLEAR);
+			nbits = LZW_BITSMIN;
+			maxcode = LZW_MAXCODE(LZW_BITSMIN);
+		} else if (free_ent > maxcode) {
+			nbits++;
+			maxcode = LZW_MAXCODE(nbits);
+		}
+	}
+
+	/* Output the last string, allowing for the decoders table growth */
+	LZW_PUTCODE(op, ent);
+	free_ent++;
+	if (free_ent == (LZW_CODEMAX-1)) {
+		LZW_PUTCODE(op, LZW_CLEAR);
+		nbits = LZW_BITSMIN;
+	} else if (free_ent > maxcode) {
+		nbits++;
+	}
+	LZW_PUTCODE(op, LZW_EOI);
+	if (nextbits > 0)
+		*op++ = (unsigned char)(nextdata << (8 - nextbits));
+
+	return (tsize_t)(op - sop);
+}
+
+/* ------------------------------------------------------------- */
+
+/* Strip buffer states */
+#define TS_FREE   0			/* Empty or being filled by write() */
+#define TS_FILLED 1			/* Waiting to be compressed */
+#define TS_BUSY   2			/* Being compressed */
+#define TS_DONE   3			/* Ready to be written */
+
+/* A strip buffer */
+typedef struct {
+	int state;
+	uint32 strip;			/* Strip number */
+	unsigned char *rbuf;	/* Raw strip data */
+	tsize_t rlen;			/* Bytes in rbuf */
+	unsigned char *cbuf;	/* Compressed strip data */
+	tsize_t clen;			/* Bytes in cbuf */
+} tsslot;
+
+struct _tiffstrip_imp;
+
+/* Compression thread context */
+typedef struct {
+	struct _tiffstrip_imp *p;
+	lzwenc enc;
+} tsthr;
+
+typedef struct _tiffstrip_imp {
+	TIFF *wh;
+	int comp;				/* COMPRESSION_LZW or COMPRESSION_NONE, -1 for TIFFWriteScanline() */
+	int swab;				/* 0, 16 or 32 if samples need byte swapping */
+	tsize_t lsize;			/* Scanline size in bytes */
+	uint32 height;			/* Image height */
+	uint32 rps;				/* Rows per strip */
+	uint32 row;				/* Next row to write */
+
+	int nslots;				/* Number of strip buffers */
+	tsslot *slots;			/* Ring of strip buffers */
+	int cur;				/* Strip buffer being filled */
+
+	int nthr;				/* Number of compression threads, 0 to compress in write() */
+	athread *th[TS_MAXTHR];
+	tsthr *tx;				/* nthr thread contexts, or 1 for compressing in write() */
+
+	amutex lock;			/* Lock for slot states and finish */
+	acond workc;			/* Signalled when a strip is filled, or on finish */
+	acond donec;			/* Signalled when a strip has been compressed */
+	int finish;				/* Flag to tell threads to exit */
+} tiffstrip_imp;
+
+/* Compress a strip buffer */
+static void ts_compress(tiffstrip_imp *p, lzwenc *e, tsslot *sl) {
+	if (p->swab == 16)
+		TIFFSwabArrayOfShort((uint16 *)sl->rbuf, (unsigned long)sl->rlen/2);
+	else if (p->swab == 32)
+		TIFFSwabArrayOfLong((uint32 *)sl->rbuf, (unsigned long)sl->rlen/4);
+
+	if (p->comp == COMPRESSION_LZW)
+		sl->clen = lzw_encode(e, sl->cbuf, sl->rbuf, sl->rlen);
+}
+
+/* Compression thread */
+static int ts_thread(void *cntx) {
+	tsthr *t = (tsthr *)cntx;
+	tiffstrip_imp *p = t->p;
+	int i, bi;
+
+	amutex_lock(p->lock);
+	for (;;) {
+
+		/* Take the lowest numbered filled strip */
+		for (bi = -1, i = 0; i < p->nslots; i++) {
+			if (p->slots[i].state == TS_FILLED
+			 && (bi < 0 || p->slots[i].strip < p->slots[bi].strip))
+				bi = i;
+		}
+		if (bi >= 0) {
+			tsslot *sl = &p->slots[bi];
+
+			sl->state = TS_BUSY;
+			amutex_unlock(p->lock);
+			ts_compress(p, &t->enc, sl);
+			amutex_lock(p->lock);
+			sl->state = TS_DONE;
+			acond_signal(p->donec);
+			continue;
+		}
+		if (p->finish)
+			break;
+		acond_wait(p->workc, p->lock);
+	}
+	acond_signal(p->workc);		/* Pass finish on to the next thread */
+	amutex_unlock(p->lock);
+	return 0;
+}
+
+/* Wait for a submitted strip buffer to be compressed, write it */
+/* and mark it as free. Return NZ on error */
+static int ts_retire(tiffstrip_imp *p, tsslot *sl) {
+	int rv = 0;
+
+	if (sl->state == TS_FREE)
+		return 0;
+
+	if (p->nthr > 0) {
+		amutex_lock(p->lock);
+		while (sl->state != TS_DONE)
+			acond_wait(p->donec, p->lock);
+		amutex_unlock(p->lock);
+	}
+
+	if (p->comp == COMPRESSION_LZW)
+		rv = TIFFWriteRawStrip(p->wh, sl->strip, sl->cbuf, sl->clen) < 0;
+	else
+		rv = TIFFWriteRawStrip(p->wh, sl->strip, sl->rbuf, sl->rlen) < 0;
+
+	sl->state = TS_FREE;
+	sl->rlen = 0;
+	return rv;
+}
+
+/* Submit the current strip buffer for compression, and retire */
+/* the next one in the ring. Return NZ on error */
+static int ts_submit(tiffstrip_imp *p) {
+	tsslot *sl = &p->slots[p->cur];
+
+	sl->strip = (p->row-1)/p->rps;
+
+	if (p->nthr == 0) {
+		ts_compress(p, &p->tx[0].enc, sl);
+		sl->state = TS_DONE;
+		return ts_retire(p, sl);
+	}
+
+	amutex_lock(p->lock);
+	sl->state = TS_FILLED;
+	acond_signal(p->workc);
+	amutex_unlock(p->lock);
+
+	if (++p->cur >= p->nslots)
+		p->cur = 0;
+
+	return ts_retire(p, &p->slots[p->cur]);
+}
+
+static int tiffstrip_write(tiffstrip *s, void *line) {
+	tiffstrip_imp *p = (tiffstrip_imp *)s->impl;
+	tsslot *sl;
+
+	if (p->comp < 0)
+		return TIFFWriteScanline(p->wh, line, p->row++, 0) < 0;
+
+	if (p->row >= p->height)
+		return 1;
+
+	sl = &p->slots[p->cur];
+	memcpy(sl->rbuf + sl->rlen, line, p->lsize);
+	sl->rlen += p->lsize;
+	p->row++;
+
+	if ((p->row % p->rps) == 0 || p->row == p->height)
+		return ts_submit(p);
+
+	return 0;
+}
+
+static int tiffstrip_flush(tiffstrip *s) {
+	tiffstrip_imp *p = (tiffstrip_imp *)s->impl;
+	int i, rv = 0;
+
+	if (p->comp < 0)
+		return 0;
+
+	/* Partial last strip */
+	if (p->slots[p->cur].rlen > 0)
+		rv |= ts_submit(p);
+
+	/* Write the remaining strips in order */
+	for (i = 0; i < p->nslots; i++)
+		rv |= ts_retire(p, &p->slots[(p->cur + i) % p->nslots]);
+
+	return rv;
+}
+
+static void tiffstrip_del(tiffstrip *s) {
+	tiffstrip_imp *p = (tiffstrip_imp *)s->impl;
+	int i;
+
+	if (p != NULL) {
+		if (p->nthr > 0) {
+			amutex_lock(p->lock);
+			p->finish = 1;
+			acond_signal(p->workc);
+			amutex_unlock(p->lock);
+			for (i = 0; i < p->nthr; i++) {
+				if (p->th[i] != NULL)
+					p->th[i]->del(p->th[i]);
+			}
+			acond_del(p->donec);
+			acond_del(p->workc);
+			amutex_del(p->lock);
+		}
+		if (p->slots != NULL) {
+			for (i = 0; i < p->nslots; i++) {
+				free(p->slots[i].rbuf);
+				free(p->slots[i].cbuf);
+			}
+			free(p->slots);
+		}
+		free(p->tx);
+		free(p);
+	}
+	free(s);
+}
+
+/* Create a strip writer */
+/* Return NULL on error */
+tiffstrip *new_tiffstrip(TIFF *wh) {
+	tiffstrip *s;
+	tiffstrip_imp *p;
+	uint16 comp, pred, bps;
+	uint32 rows;
+	int i, ntx;
+
+	if ((s = (tiffstrip *)calloc(1, sizeof(tiffstrip))) == NULL)
+		return NULL;
+	if ((p = (tiffstrip_imp *)calloc(1, sizeof(tiffstrip_imp))) == NULL) {
+		free(s);
+		return NULL;
+	}
+	s->impl  = (void *)p;
+	s->write = tiffstrip_write;
+	s->flush = tiffstrip_flush;
+	s->del   = tiffstrip_del;
+
+	p->wh = wh;
+	p->lsize = TIFFScanlineSize(wh);
+
+	TIFFGetFieldDefaulted(wh, TIFFTAG_COMPRESSION, &comp);
+	pred = PREDICTOR_NONE;
+	if (comp == COMPRESSION_LZW)		/* (Predictor is a codec field) */
+		TIFFGetFieldDefaulted(wh, TIFFTAG_PREDICTOR, &pred);
+	TIFFGetFieldDefaulted(wh, TIFFTAG_BITSPERSAMPLE, &bps);
+	TIFFGetField(wh, TIFFTAG_IMAGELENGTH, &p->height);
+
+	/* Fall back to the libtiff codec for anything else */
+	if ((comp != COMPRESSION_LZW && comp != COMPRESSION_NONE)
+	 || pred != PREDICTOR_NONE || p->lsize <= 0 || p->height == 0) {
+		DBG(("tiffstrip: using TIFFWriteScanline()\n"))
+		p->comp = -1;
+		return s;
+	}
+	p->comp = comp;
+
+	if (TIFFIsByteSwapped(wh) && (bps == 16 || bps == 32))
+		p->swab = bps;
+
+	p->rps = (uint32)(TS_STRIPBYTES / p->lsize);
+	if (p->rps < 1)
+		p->rps = 1;
+	if (p->rps > p->height)
+		p->rps = p->height;
+	TIFFSetField(wh, TIFFTAG_ROWSPERSTRIP, p->rps);
+
+	p->nthr = system_processors();
+	if (p->nthr > TS_MAXTHR)
+		p->nthr = TS_MAXTHR;
+	if (p->nthr <= 1)
+		p->nthr = 0;
+
+	/* No point having more strip buffers than strips */
+	rows = (p->height + p->rps - 1)/p->rps;
+	p->nslots = p->nthr == 0 ? 1 : TS_SLOTSPERTHR * p->nthr;
+	if ((uint32)p->nslots > rows)
+		p->nslots = rows;
+
+	DBG(("tiffstrip: %d rows per strip, %d threads, %d buffers\n",p->rps,p->nthr,p->nslots))
+
+	if ((p->slots = (tsslot *)calloc(p->nslots, sizeof(tsslot))) == NULL) {
+		tiffstrip_del(s);
+		return NULL;
+	}
+	for (i = 0; i < p->nslots; i++) {
+		if ((p->slots[i].rbuf = (unsigned char *)malloc(p->rps * p->lsize)) == NULL
+		 || (comp == COMPRESSION_LZW
+		  && (p->slots[i].cbuf = (unsigned char *)malloc(LZW_MAXSIZE(p->rps * p->lsize))) == NULL)) {
+			tiffstrip_del(s);
+			return NULL;
+		}
+	}
+
+	ntx = p->nthr == 0 ? 1 : p->nthr;
+	if ((p->tx = (tsthr *)calloc(ntx, sizeof(tsthr))) == NULL) {
+		tiffstrip_del(s);
+		return NULL;
+	}
+
+	if (p->nthr > 0) {
+		amutex_init(p->lock);
+		acond_init(p->workc);
+		acond_init(p->donec);
+
+		for (i = 0; i < p->nthr; i++) {
+			p->tx[i].p = p;
+			if ((p->th[i] = new_athread(ts_thread, (void *)&p->tx[i])) == NULL) {
+				tiffstrip_del(s);
+				return NULL;
+			}
+		}
+	}
+	return s;
+}
@@ -0,0 +1,50 @@
+
+#ifndef TIFFSTRIP_H
+#define TIFFSTRIP_H
+
+/*
+ * render2d
+ *
+ * Parallel compressing TIFF strip writer.
+ *
+ * Author:  agent
+ * Date:    18/10/2026
+ *
+ * Copyright 2026, agent
+ * All rights reserved.
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ *
+ */
+
+/*
+ * Scanlines are assembled into strips, which are compressed
+ * by worker threads and then written in order using TIFFWriteRawStrip().
+ * LZW and no compression are handled this way, anything else falls
+ * back to TIFFWriteScanline().
+ *
+ * (Need to #include "tiffio.h" before this.)
+ */
+
+struct _tiffstrip {
+	void *impl;			/* Opaque implementation (type tiffstrip_imp *) */
+
+	/* Write the next scanline of TIFFScanlineSize() bytes. */
+	/* Return NZ on error */
+	int (*write)(struct _tiffstrip *p, void *line);
+
+	/* Write any strips still being compressed. Call before TIFFClose(). */
+	/* Return NZ on error */
+	int (*flush)(struct _tiffstrip *p);
+
+	/* Delete the object */
+	void (*del)(struct _tiffstrip *p);
+
+}; typedef struct _tiffstrip tiffstrip;
+
+/* Create a strip writer for a TIFF file that has had all its tags set, */
+/* and has no image data written yet. This sets TIFFTAG_ROWSPERSTRIP. */
+/* Return NULL on error */
+tiffstrip *new_tiffstrip(TIFF *wh);
+
+#endif /* TIFFSTRIP_H */
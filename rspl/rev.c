@@ -272,6 +272,7 @@ static void search_list(schbase *b, int *rip, unsigned int tcount);
 static void clear_limitv(rspl *s);
 
 static double get_limitv(schbase *b, int ix,	float *fcb, double *p);
+static void limit_block(rspl *s, int *lo, int *hi);
 
 #ifdef STATS
 static char *opnames[6] = { "exact", "clipv", "clipn", "auxil", "locus" };
@@ -430,6 +431,7 @@ rev_set_limit_rspl(
 		error("rspl: rev_set_limit can't handle fdi = %d",s->fdi);
 
 	b = set_search_limit(s, limit, lcntx, limitv);	/* Init and set limit info */
+	s->limitmono = 0;				/* Until told otherwise */
 
 	if (s->rev.inited) {		/* If cache and acceleration has been allocated */
 		invalidate_revaccell(s);		/* Invalidate the reverse cache */
@@ -466,6 +468,20 @@ rev_get_limit_rspl(
 	}
 }
 
+/* Declare that the ink limit function is monotonic non-decreasing */
+/* in each input, so that the reverse setup can classify whole blocks */
+/* of the fwd grid against the limit from their corner values. */
+/* This is reset by rev_set_limit(). */
+static void
+rev_set_limit_mono_rspl(
+	rspl *s,		/* this */
+	int mono		/* NZ if limit function is monotonic */
+) {
+	DBG(("rev: setting ink limit function monotonic %d\n",mono));
+
+	s->limitmono = mono;
+}
+
 /* Set the RSPL_NEARCLIP LCh weightings. */
 /* Will only work with L*a*b* like output spaces. */
 /* Calling this will clear the reverse interpolaton cache. */
@@ -1090,8 +1106,11 @@ init_search(
 
 	DBG(("Initializing search di %d fdi %d\n",s->di,s->fdi));
 
-	if (s->rev.inited == 0) 	/* Compute reverse info if it doesn't exist */
+	if (s->rev.inited == 0) { 	/* Compute reverse info if it doesn't exist */
+		ATIMER_BEGIN("rspl reverse setup")
 		make_rev(s);
+		ATIMER_END
+	}
 
 	/* If first time initialisation (Fourth section init) */
 	if ((b = s->rev.sb) == NULL)
@@ -4588,7 +4607,7 @@ double *p			/* Array of input values (can be NULL to compute) */
 	if (base == NULL)
 		base = s->g.a + ix * s->g.pss;
 	lv = base[-1];					/* Fetch existing ink limit function value */
-	if ((float)lv == L_UNINIT) {			/* Not been computed yet */
+	if ((float)lv == L_UNINIT || (float)lv == L_OVER) {	/* Not been computed yet */
 		if (p != NULL) {
 			lv = INKSCALE * s->limitf(s->lcntx, p);	/* Do it */
 			base[-1] = (float)lv;
@@ -4628,6 +4647,81 @@ rspl *s
 	}
 }
 
+/* Utility to get or calculate the ink limit value of */
+/* the fwd vertex at grid coordinate gc[]. */
+static double get_limitv_gc(
+rspl *s,
+int *gc
+) {
+	float *gp = s->g.a;
+	double iv[MXDI];
+	int e;
+
+	for (e = 0; e < s->di; e++)
+		gp += gc[e] * s->g.fci[e];
+
+	if (gp[-1] == L_UNINIT || gp[-1] == L_OVER) {	/* Not been computed yet */
+		for (e = 0; e < s->di; e++)
+			iv[e] = s->g.l[e] + gc[e] * s->g.w[e];  /* Input sample values */
+		gp[-1] = (float)(INKSCALE * s->limitf(s->lcntx, iv));
+	}
+	return gp[-1];
+}
+
+/* Classify the fwd vertices in the grid block lo[] .. hi[] (inclusive) */
+/* against the ink limit, for a limit function that is monotonic in each */
+/* input. The values at the lowest and highest corners bound the limit */
+/* function over the block, so a block that is entirely under the limit */
+/* is left L_UNINIT (which reads as being under), one that is entirely */
+/* over is marked L_OVER, and one that straddles the limit is split in */
+/* two along its longest side. get_limitv() computes any values needed later. */
+static void limit_block(
+rspl *s,
+int *lo,			/* Lowest grid coordinate of block */
+int *hi				/* Highest grid coordinate of block */
+) {
+	int e, k, di = s->di;
+	int mhi[MXDI], mlo[MXDI];
+
+	if (get_limitv_gc(s, hi) <= s->limitv)
+		return;			/* All under the limit */
+
+	if (get_limitv_gc(s, lo) > s->limitv) {	/* All over the limit */
+		FCOUNT(gc, MXDI, di);
+		float *gp;
+
+		for (e = 0; e < di; e++)
+			mhi[e] = hi[e] + 1;
+		FRECONFA(gc, lo, mhi);
+		FC_INIT(gc);
+		while (!FC_DONE(gc)) {
+			for (gp = s->g.a, e = 0; e < di; e++)
+				gp += gc[e] * s->g.fci[e];
+			if (gp[-1] == L_UNINIT)
+				gp[-1] = L_OVER;
+			FC_INC(gc);
+		}
+		return;
+	}
+
+	/* Straddles the limit, so split along the longest side */
+	for (k = 0, e = 1; e < di; e++) {
+		if ((hi[e] - lo[e]) > (hi[k] - lo[k]))
+			k = e;
+	}
+	if (hi[k] == lo[k])
+		return;			/* Single vertex, and it's been computed */
+
+	for (e = 0; e < di; e++) {
+		mhi[e] = hi[e];
+		mlo[e] = lo[e];
+	}
+	mhi[k] = (lo[k] + hi[k])/2;
+	mlo[k] = mhi[k] + 1;
+	limit_block(s, lo, mhi);
+	limit_block(s, mlo, hi);
+}
+
 /* Cell code */
 
 static void free_cell_contents(fxcell *c);
@@ -6327,6 +6421,7 @@ init_rev(rspl *s) {
 	/* Methods */
 	s->rev_set_limit   = rev_set_limit_rspl;
 	s->rev_get_limit   = rev_get_limit_rspl;
+	s->rev_set_limit_mono = rev_set_limit_mono_rspl;
 	s->rev_set_lchw    = rev_set_lchw;
 	s->rev_interp      = rev_interp_rspl;
 	s->rev_locus       = rev_locus_rspl;
@@ -9495,19 +9590,33 @@ rspl *s
 		DBG(("Looking up fwd vertex ink limit values\n"));
 //printf("Looking up fwd vertex ink limit values\n");
 //printf("s->limitv = %f\n",s->limitv);
-		/* Calling the limit function for each fwd vertex could be bad */
-		/* if the limit function is slow. Maybe an octree type algorithm */
-		/* could be used if this is a problem ? */
-		EC_INIT(gc);
-		for (i = 0, gp = s->g.a; i < s->g.no; i++, gp += s->g.pss) {
-			if (gp[-1] == L_UNINIT) {
-				for (e = 0; e < di; e++)
-					iv[e] = s->g.l[e] + gc[e] * s->g.w[e];  /* Input sample values */
-				gp[-1] = (float)(INKSCALE * s->limitf(s->lcntx, iv));
-//printf("~1 set ix %d limitv to %f\n",i,gp[-1]);
+		if (s->limitmono) {
+			int lo[MXDI], hi[MXDI];
+
+			/* Calling the limit function for each fwd vertex could be bad */
+			/* if the limit function is slow, so since it is monotonic, */
+			/* classify whole blocks of vertices from their corners, and */
+			/* only evaluate vertices near the ink limit boundary. */
+			for (e = 0; e < di; e++) {
+				lo[e] = 0;
+				hi[e] = s->g.res[e] - 1;
 			}
+			limit_block(s, lo, hi);
+
+		} else {
+			/* Calling the limit function for each fwd vertex could be bad */
+			/* if the limit function is slow. */
+			EC_INIT(gc);
+			for (i = 0, gp = s->g.a; i < s->g.no; i++, gp += s->g.pss) {
+				if (gp[-1] == L_UNINIT) {
+					for (e = 0; e < di; e++)
+						iv[e] = s->g.l[e] + gc[e] * s->g.w[e];  /* Input sample values */
+					gp[-1] = (float)(INKSCALE * s->limitf(s->lcntx, iv));
+//printf("~1 set ix %d limitv to %f\n",i,gp[-1]);
+				}
 //else printf("~1 ix %d limitv is %f\n",i,gp[-1]);
-			EC_INC(gc);
+				EC_INC(gc);
+			}
 		}
 		s->g.limitv_cached = 1;
 	}
@@ -115,8 +115,8 @@ typedef struct {
 typedef struct {
 	int niters;		/* Number of multigrid itterations needed */
 	int **ires; 	/* Resolution for each itteration and dimension */
-	void **mgtmps[MXDO]; /* Store pointers to re-usable mgtmp when incremental */
-					/* (These don't seem to be used anymore. was incremental removed ?) */
+	void *mgtmps[MXDO]; /* Final resolution mgtmp for each output retained by */
+					/* an RSPL_INCREMENTAL fit, NULL if not retained. */
 } it_info;
 
 /* Structure for final resolution multi-dimensional regularized spline data */
@@ -193,6 +193,9 @@ struct _rspl {
 		/* Uninitialised limit value */
 #define L_UNINIT ((float)-1e38)
 
+		/* Limit value not computed, but known to be over the limit */
+#define L_OVER ((float)1e38)
+
 #define FL_BITS 3	/* flag bits per dimension */
 		/* Macros to access flags. Arguments are a pointer to base grid point and  */
 		/* Flag value is distance from edge in bottom 2 bits, values 0, 1 or 2 maximum. */
@@ -231,6 +234,7 @@ struct _rspl {
 	double (*limitf)(void *cntx, double *in);	/* Optional input space qualifier function. */
 	void *lcntx;		/* Context passed to limit() */
 	double limitv;		/* Value not to be exceeded by limit() */
+	int limitmono;		/* Flag - limit() is monotonic non-decreasing in each input */
 
 	/* Hermite spline interpolation support */
 	struct {
@@ -257,6 +261,8 @@ struct _rspl {
 #define RSPL_AUTOSMOOTH   0x0001	/* Automatically determin local optimal avgdev smoothing */
 #define RSPL_SYMDOMAIN    0x0004	/* Maintain symetric smoothness with nonsym. resolution */
 #define RSPL_SET_APXLS    0x0020	/* For set_rspl, adjust samples for aproximate least squares */
+#define RSPL_INCREMENTAL  0x0002	/* For fit_rspl, retain the fit equations so that */
+									/* points can be added with add_rspl() */
 #define RSPL_FASTREVSETUP 0x0010	/* Do a fast reverse setup at the cost of subsequent speed */
 #define RSPL_VERBOSE      0x8000	/* Turn on print progress messages */
 #define RSPL_NOVERBOSE    0x4000	/* Turn off print progress messages */
@@ -377,6 +383,36 @@ struct _rspl {
 		void (*func)(void *cbntx, double *out, double *in)		/* Function to set from */
 	);
 
+	/* Add to, or replace some of the scattered data points of an rspl */
+	/* that was fitted with the RSPL_INCREMENTAL flag, and re-fit it. */
+	/* The previous solution and fit equations are re-used, so the */
+	/* re-fit time is proportional to the change. The new points must */
+	/* fall within the existing grid range. */
+	/* Return non-zero if result is non-monotonic */
+	int
+	(*add_rspl)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		co *d,			/* Array holding position and function values of data points */
+		int *ix,		/* Index of the existing point each one replaces, -1 to add it. */
+						/* NULL if all are to be added. If an index is repeated, */
+						/* the last replacement is used. */
+		int ndp			/* Number of data points */
+	);
+
+	/* Add to or replace scattered data points with weights, and re-fit */
+	/* Return non-zero if result is non-monotonic */
+	int
+	(*add_rspl_w)(
+		struct _rspl *s,	/* this */
+		int flags,		/* Combination of flags */
+		cow *d,			/* Array holding position, function and weight values of data points */
+		int *ix,		/* Index of the existing point each one replaces, -1 to add it. */
+						/* NULL if all are to be added. If an index is repeated, */
+						/* the last replacement is used. */
+		int ndp			/* Number of data points */
+	);
+
 	/* Initialize the grid from a provided function. By default the grid */
 	/* values are set to exactly the value returned by func(), unless the */
 	/* RSPL_SET_APXLS flag is set, in which case an attempt is made to have */
@@ -519,6 +555,15 @@ struct _rspl {
 		double *limitv		/* Return limit value */
 	);
 
+	/* Declare that the ink limit function is monotonic non-decreasing in */
+	/* each input. Reverse setup can then bound it over blocks of the grid */
+	/* from their corner values, and only call it for every grid vertex */
+	/* near the limit boundary. Call after rev_set_limit(), which resets it. */
+	void (*rev_set_limit_mono)(
+		struct _rspl *s,	/* this */
+		int mono			/* NZ if limit function is monotonic */
+	);
+
 	/* Set the RSPL_NEARCLIP LCh weightings. */
 	/* Will only work with L*a*b* like output spaces. */
 	/* Calling this will clear the reverse interpolaton cache. */
@@ -49,10 +49,9 @@
  *  coupling in direction of any axis that is not outside this box).
  *  [Example is "t3d -t 6 -P 0:0:0:1:1:1" where lins should not bend up at top end.]
  *  
- *  Speedup that skips recomputing all of A to add new points seems OK. (nothing uses
- *  incremental currently anyway.)
- *
- *  Is there any way of speeding up incremental recalculation ????
+ *  Incremental re-fit (add_rspl()) only re-solves at the final resolution.
+ *  If many points are added it might be better to do a coarse grid
+ *  correction pass too.
  *
  * Add optional simplex point interpolation to
  * solve setup. (No large advantage in this ??) 
@@ -177,6 +176,9 @@
 
 #endif
 
+/* add_rspl() parameters */
+#define INCR_RSCTOL 1e-9	/* [1e-9] Re-scale the smoothness if the factor differs from 1.0 by more */
+
 #undef NEVER
 #define ALWAYS
 
@@ -185,6 +187,9 @@ extern void alloc_grid(rspl *s);
 
 extern int is_mono(rspl *s);
 
+/* Implemented in rev.c: */
+extern void free_rev(rspl *s);
+
 /* Convention is to use:
    i to index grid points u.a
    n to index data points d.a
@@ -316,6 +321,11 @@ static int add_rspl_imp(rspl *s, int flags, void *d, int dtp, int dno);
 static mgtmp *new_mgtmp(rspl *s, int gres[MXDI], double smooth, double avgdev, int f, int issm);
 static void free_mgtmp(mgtmp *m);
 static void setup_solve(mgtmp *m, mgtmp *sm);
+static void set_mgdat(mgtmp *m, int n);
+static double opt_smooth(rspl *s, int di, int ndp, double ad, int f);
+static double cj_line(cj_arrays *ta, double **A, double *x, double *b, int gno, int acols,
+                      int *xcol, int sof, int nid, int inc, int max_it, double tol);
+static double dpnt_solve(mgtmp *m, int n, double sign);
 static void solve_gres(mgtmp *m, cj_arrays *ta, double tol, int final);
 static void init_soln(mgtmp  *m1, mgtmp  *m2);
 static double mgtmp_interp(mgtmp  *m, double p[MXDI]);
@@ -396,6 +406,12 @@ it_info *ii
 		free_imatrix(ii->ires, 0, ii->niters, 0, s->di);
 		ii->ires = NULL;
 	}
+	for (f = 0; f < MXDO; f++) {
+		if (ii->mgtmps[f] != NULL) {
+			free_mgtmp((mgtmp *)ii->mgtmps[f]);
+			ii->mgtmps[f] = NULL;
+		}
+	}
 }
 
 
@@ -428,6 +444,7 @@ fit_rspl_imp(
 ) {
 	int di = s->di, fdi = s->fdi;
 	int i, e, f;
+	int rv;
 
 #ifdef NEVER
 printf("~1 rspl: di %d, fdi %d\n",fdi);
@@ -613,7 +630,11 @@ printf("~1 rspl: flags = 0x%x\n",flags);
 	set_it_info(s, s->g.res, &s->ii);
 
 	/* Do the data point fitting */
-	return add_rspl_imp(s, 0, d, dtp, dno);
+	ATIMER_BEGIN("rspl fit")
+	rv = add_rspl_imp(s, flags & RSPL_INCREMENTAL, d, dtp, dno);
+	ATIMER_END
+
+	return rv;
 }
 
 /* Weighting adjustment values */
@@ -856,7 +877,14 @@ plot_mgtmp1(sm);
 		for (gp = s->g.a, i = 0; i < s->g.no; gp += s->g.pss, i++)
 			gp[f] = (float)m->q.x[i];
 
-		free_mgtmp(m);			/* Free final resolution entry */
+		if (s->ii.mgtmps[f] != NULL) {
+			free_mgtmp((mgtmp *)s->ii.mgtmps[f]);
+			s->ii.mgtmps[f] = NULL;
+		}
+		if (flags & RSPL_INCREMENTAL)
+			s->ii.mgtmps[f] = (void *)m;	/* Retain for add_rspl() */
+		else
+			free_mgtmp(m);			/* Free final resolution entry */
 
 //		if (sm != NULL)			/* Free smoothing map */
 //			free_mgtmp(sm);
@@ -996,6 +1024,246 @@ fit_rspl_w_df(
 	                    smooth, avgdev, ipos, weak, cbntx, func);
 }
 
+/* Add to or replace scattered data points, and re-fit from the */
+/* retained RSPL_INCREMENTAL fit equations and solution. */
+/* Return non-zero if non-monotonic */
+static int
+incr_rspl_imp(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	void *d,		/* Array holding position and function values of data points */
+	int dtp,		/* Flag indicating data type, 0 = (co *), 1 = (cow *) */
+	int *ix,		/* Index of point each replaces, -1 to add, NULL for all add */
+	int dno			/* Number of data points */
+) {
+	int di = s->di, fdi = s->fdi;
+	int ono = s->d.no;			/* Previous number of data points */
+	int nno;					/* New number of data points */
+	int *rix;					/* Index in s->d.a[] of each updated point, -1 to skip */
+	int *lix;					/* Last update of each existing point */
+	double rsc[MXDO];			/* Smoothness rescale factor for each output */
+	int dosc[MXDO];				/* NZ if smoothness is to be rescaled */
+	int i, n, e, f;
+	cj_arrays ta;	/* cj_line temporary arrays */
+
+	if (flags & RSPL_VERBOSE)	/* Turn on progress messages to stdout */
+		s->verbose = 1;
+	if (flags & RSPL_NOVERBOSE)	/* Turn off progress messages to stdout */
+		s->verbose = 0;
+
+	for (f = 0; f < fdi; f++) {
+		if (s->ii.mgtmps[f] == NULL)
+			error("rspl: add_rspl needs a fit done with RSPL_INCREMENTAL");
+	}
+
+	if (dno == 0)
+		return is_mono(s);
+
+	/* Figure out where each point goes */
+	if ((rix = ivector(0, dno-1)) == NULL)
+		error("rspl malloc failed - rix");
+	for (nno = ono, i = 0; i < dno; i++) {
+		if (ix == NULL || ix[i] < 0)
+			rix[i] = nno++;
+		else if (ix[i] >= ono)
+			error("rspl: add_rspl replacement index %d out of range",ix[i]);
+		else
+			rix[i] = ix[i];
+	}
+
+	/* If an existing point is replaced more than once, only the last */
+	/* replacement is used, so that its equations are only removed once. */
+	if (ono > 0) {
+		if ((lix = ivector(0, ono-1)) == NULL)
+			error("rspl malloc failed - lix");
+		for (i = 0; i < ono; i++)
+			lix[i] = -1;
+		for (i = 0; i < dno; i++) {
+			if (rix[i] < ono) {
+				if (lix[rix[i]] >= 0)
+					rix[lix[rix[i]]] = -1;
+				lix[rix[i]] = i;
+			}
+		}
+		free_ivector(lix, 0, ono-1);
+	}
+
+	/* The smoothness factor depends on the number of data points and */
+	/* the data range, so the smoothness equations may need re-scaling. */
+	for (f = 0; f < fdi; f++) {
+		rsc[f] = 1.0;
+		if (s->smooth >= 0.0)
+			rsc[f] = 1.0/opt_smooth(s, di, ono, s->avgdev[f], f);
+	}
+
+	/* Expand the data value range to cover the new points */
+	for (i = 0; i < dno; i++) {
+		double *v = dtp == 0 ? ((co *)d)[i].v : ((cow *)d)[i].v;
+
+		if (rix[i] < 0)
+			continue;
+		for (f = 0; f < fdi; f++) {
+			if (v[f] < s->d.vl[f]) {
+				s->d.vw[f] += s->d.vl[f] - v[f];
+				s->d.vl[f] = v[f];
+			}
+			if (v[f] > (s->d.vl[f] + s->d.vw[f]))
+				s->d.vw[f] = v[f] - s->d.vl[f];
+		}
+	}
+
+	for (f = 0; f < fdi; f++) {
+		if (s->smooth >= 0.0)
+			rsc[f] *= opt_smooth(s, di, nno, s->avgdev[f], f);
+		dosc[f] = fabs(rsc[f] - 1.0) > INCR_RSCTOL;
+	}
+
+	/* Remove the equations of the points that are changing. */
+	/* If the smoothness is being rescaled, remove all of them, */
+	/* as well as any weak default function, and rescale what's left. */
+	for (f = 0; f < fdi; f++) {
+		mgtmp *m = (mgtmp *)s->ii.mgtmps[f];
+
+		if (dosc[f]) {
+			double **A = m->q.A;
+			int k;
+
+			for (n = 0; n < ono; n++)
+				dpnt_solve(m, n, -1.0);
+			for (i = 0; i < m->g.no; i++) {
+				if (s->dfunc != NULL)
+					A[i][0] -= 2.0 * m->wdfw;
+				for (k = 0; k < m->q.acols; k++)
+					A[i][k] *= rsc[f];
+				if (s->dfunc != NULL)
+					A[i][0] += 2.0 * m->wdfw;
+			}
+			for (e = 0; e < di; e++)
+				m->sf.cw[e] *= rsc[f];
+		} else {
+			for (i = 0; i < dno; i++) {
+				if (rix[i] >= 0 && rix[i] < ono)
+					dpnt_solve(m, rix[i], -1.0);
+			}
+		}
+	}
+
+	/* Update the data points */
+	if (nno > ono) {
+		if ((s->d.a = (rpnts *) realloc(s->d.a, sizeof(rpnts) * nno)) == NULL)
+			error("rspl malloc failed - data points");
+	}
+	for (i = 0; i < dno; i++) {
+		rpnts *dp;
+
+		if (rix[i] < 0)
+			continue;
+		dp = &s->d.a[rix[i]];
+		if (dtp == 0) {
+			co *sp = &((co *)d)[i];
+			for (e = 0; e < di; e++)
+				dp->p[e] = sp->p[e];
+			for (f = 0; f < fdi; f++) {
+				dp->v[f] = sp->v[f];
+				dp->k[f] = 1.0;
+			}
+		} else {
+			cow *sp = &((cow *)d)[i];
+			for (e = 0; e < di; e++)
+				dp->p[e] = sp->p[e];
+			for (f = 0; f < fdi; f++) {
+				dp->v[f] = sp->v[f];
+				dp->k[f] = sp->w;
+			}
+		}
+
+	}
+	s->d.no = nno;
+
+	init_cj_arrays(&ta);		/* Zero temporary arrays */
+
+	/* Add the new equations and re-solve, starting from the previous solution */
+	for (f = 0; f < fdi; f++) {
+		mgtmp *m = (mgtmp *)s->ii.mgtmps[f];
+		double nbsum;
+		float *gp;
+
+		if (nno > ono) {
+			if ((m->d = (struct mgdat *) realloc(m->d, nno * m->sizeof_mgdat)) == NULL)
+				error("rspl: malloc failed - mgtmp");
+		}
+		for (i = 0; i < dno; i++) {
+			if (rix[i] >= 0)
+				set_mgdat(m, rix[i]);
+		}
+
+		if (dosc[f]) {
+			for (n = 0; n < nno; n++)
+				dpnt_solve(m, n, 1.0);
+		} else {
+			for (i = 0; i < dno; i++) {
+				if (rix[i] >= 0)
+					dpnt_solve(m, rix[i], 1.0);
+			}
+		}
+
+		/* Re-compute norm of b[] */
+		for (nbsum = 0.0, i = 0; i < m->g.no; i++)
+			nbsum += m->q.b[i] * m->q.b[i];
+		nbsum = sqrt(nbsum);
+		if (nbsum < 1e-4) 
+			nbsum = 1e-4;
+		m->q.normb = nbsum;
+
+		/* The previous solution is already close everywhere, so the remaining */
+		/* error is mostly local to the changed points, with a small low frequency */
+		/* component if the smoothness was rescaled. Conjugate gradient over the */
+		/* whole grid deals with both much faster than relaxation does. */
+		cj_line(&ta, m->q.A, m->q.x, m->q.b, m->g.no, m->q.acols, m->q.xcol,
+		        0, m->g.no, 1, 10 * m->g.no, TOL);
+
+		/* Transfer result in x[] to appropriate grid point value */
+		for (gp = s->g.a, i = 0; i < s->g.no; gp += s->g.pss, i++)
+			gp[f] = (float)m->q.x[i];
+	}
+
+	free_cj_arrays(&ta);
+	free_ivector(rix, 0, dno-1);
+
+	/* Invalidate things that depend on the grid values */
+	s->g.fminmax_valid = 0;
+	free_rev(s);
+
+	/* Return non-mono check */
+	return is_mono(s);
+}
+
+/* Add to or replace scattered data points, and re-fit */
+/* Return non-zero if result is non-monotonic */
+static int
+add_rspl(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	co *d,			/* Array holding position and function values of data points */
+	int *ix,		/* Index of the existing point each one replaces, -1 to add it. */
+	int dno			/* Number of data points */
+) {
+	return incr_rspl_imp(s, flags, (void *)d, 0, ix, dno);
+}
+
+/* Add to or replace scattered data points with weights, and re-fit */
+/* Return non-zero if result is non-monotonic */
+static int
+add_rspl_w(
+	rspl *s,		/* this */
+	int flags,		/* Combination of flags */
+	cow *d,			/* Array holding position, function and weight values of data points */
+	int *ix,		/* Index of the existing point each one replaces, -1 to add it. */
+	int dno			/* Number of data points */
+) {
+	return incr_rspl_imp(s, flags, (void *)d, 1, ix, dno);
+}
+
 /* Init scattered data elements in rspl */
 void
 init_data(rspl *s) {
@@ -1006,6 +1274,8 @@ init_data(rspl *s) {
 	s->fit_rspl_ww   = fit_rspl_ww;
 	s->fit_rspl_df   = fit_rspl_df;
 	s->fit_rspl_w_df = fit_rspl_w_df;
+	s->add_rspl      = add_rspl;
+	s->add_rspl_w    = add_rspl_w;
 }
 
 /* Free the scattered data allocation */
@@ -1349,6 +1619,54 @@ static double opt_smooth(
 /* - - - - - - - - - - - - - - - - - - - - - - - -*/
 /* Multi-grid temp structure (mgtmp) routines */
 
+/* Fill in the aux data point info for data point n */
+/* (We're assuming N-linear interpolation here. */
+/*  Perhaps we should try simplex too ?) */
+static void set_mgdat(mgtmp *m, int n) {
+	rspl *s = m->s;
+	int di = s->di;
+	double we[MXDI];	/* 1.0 - Weight in each dimension */
+	int ix = 0;			/* Index to base corner of surrounding cube in grid points */
+	struct mgdat *dd;
+	int e, g, i;
+
+	/* Figure out which grid cell the point falls into */
+	for (e = 0; e < di; e++) {
+		double t;
+		int mi;
+		if (s->d.a[n].p[e] < m->g.l[e] || s->d.a[n].p[e] > m->g.h[e]) {
+			error("rspl: Data point %d outside grid %e <= %e <= %e",
+			                            n,m->g.l[e],s->d.a[n].p[e],m->g.h[e]);
+		}
+		t = (s->d.a[n].p[e] - m->g.l[e])/m->g.w[e];
+		mi = (int)floor(t);			/* Grid coordinate */
+		if (mi < 0)					/* Limit to valid cube base index range */
+			mi = 0;
+		else if (mi >= (m->g.res[e]-1))	/* Make sure outer point can't be base */
+			mi = m->g.res[e]-2;
+		ix += mi * m->g.ci[e];		/* Add Index offset for grid cube base in dimen */
+		we[e] = t - (double)mi;		/* 1.0 - weight */
+	}
+	dd = MGDAT_N(m, n);
+	dd->b = ix;
+
+	/* Compute corner weights needed for interpolation */
+	dd->w[0] = 1.0;
+	for (e = 0, g = 1; e < di; g *= 2, e++) {
+		for (i = 0; i < g; i++) {
+			dd->w[g+i] = dd->w[i] * we[e];
+			dd->w[i] *= (1.0 - we[e]);
+		}
+	}
+
+#ifdef DEBUG
+	printf("Data point %d weighting factors = \n",n);
+	for (e = 0; e < (1 << di); e++) {
+		printf("%d: %f\n",e,dd->w[e]);
+	}
+#endif /* DEBUG */
+}
+
 /* Create a new mgtmp. */
 /* Solution matricies will be NULL */
 static mgtmp *new_mgtmp(
@@ -1531,51 +1849,12 @@ static mgtmp *new_mgtmp(
 		error("rspl: malloc failed - mgtmp");
 
 	/* fill in the aux data point info */
-	/* (We're assuming N-linear interpolation here. */
-	/*  Perhaps we should try simplex too ?) */
 	for (n = 0; n < dno; n++) {
-		double we[MXDI];	/* 1.0 - Weight in each dimension */
-		int ix = 0;			/* Index to base corner of surrounding cube in grid points */
-		struct mgdat *dd;
-
-		/* Figure out which grid cell the point falls into */
-		for (e = 0; e < di; e++) {
-			double t;
-			int mi;
-			if (s->d.a[n].p[e] < m->g.l[e] || s->d.a[n].p[e] > m->g.h[e]) {
-				error("rspl: Data point %d outside grid %e <= %e <= %e",
-				                            n,m->g.l[e],s->d.a[n].p[e],m->g.h[e]);
-			}
-			t = (s->d.a[n].p[e] - m->g.l[e])/m->g.w[e];
-			mi = (int)floor(t);			/* Grid coordinate */
-			if (mi < 0)					/* Limit to valid cube base index range */
-				mi = 0;
-			else if (mi >= gres_1[e])	/* Make sure outer point can't be base */
-				mi = gres_1[e]-1;
-			ix += mi * m->g.ci[e];		/* Add Index offset for grid cube base in dimen */
-			we[e] = t - (double)mi;		/* 1.0 - weight */
-		}
-		dd = MGDAT_N(m, n);
-		dd->b = ix;
-
-		/* Compute corner weights needed for interpolation */
-		dd->w[0] = 1.0;
-		for (e = 0, g = 1; e < di; g *= 2, e++) {
-			for (i = 0; i < g; i++) {
-				dd->w[g+i] = dd->w[i] * we[e];
-				dd->w[i] *= (1.0 - we[e]);
-			}
-		}
-
-#ifdef DEBUG
-		printf("Data point %d weighting factors = \n",n);
-		for (e = 0; e < (1 << di); e++) {
-			printf("%d: %f\n",e,dd->w[e]);
-		}
-#endif /* DEBUG */
+		set_mgdat(m, n);
 
 #ifdef AUTOSM
 		if (s->ausm && m->as != NULL) {
+			int ix = MGDAT_N(m, n)->b;
 			/* Add data point to per cell list */
 			if (as->vtx_dlist[ix] == -1)
 				as->dlist[as->ndcells++] = ix;
@@ -1704,6 +1983,52 @@ print_smsens(mgtmp *m) {
 
 #endif	/* NEVER */
 
+/* Add (sign = 1.0) or remove (sign = -1.0) the equations due to data */
+/* point n to/from the A[][] and b[] matricies. */
+/* Return the change in the sum of b[] squared. */
+static double dpnt_solve(
+mgtmp *m,		/* initialized grid temp structure */
+int n,			/* Data point index */
+double sign		/* 1.0 to add, -1.0 to remove */
+) {
+	rspl *s = m->s;
+	int di = s->di;
+	int f = m->f;
+	double **A  = m->q.A;
+	int *ixcol  = m->q.ixcol;
+	double *b   = m->q.b;
+	struct mgdat *dd = MGDAT_N(m, n);
+	int bp = dd->b; 		/* index to base grid point in grid points */
+	double nbsum = 0.0;
+	int j, k;
+
+	/* For each point in the cube as the base grid point, */
+	/* add in the appropriate weighting for its weighted neighbors. */
+	for (j = 0; j < (1 << di); j++) {	/* Binary sequence */
+		double d, w, tt;
+		int ai;
+
+		ai = bp + m->g.hi[j];			/* A matrix index */
+
+		w = dd->w[j];				/* Base point grid weight */
+		d = sign * 2.0 * s->d.a[n].k[f] * w;	/* (2.0, w are derivtv factors, k data pnt wgt) */
+		tt = d * s->d.a[n].v[f];		/* Change in data component */
+
+		nbsum += (2.0 * b[ai] + tt) * tt;	/* += (b[ai] + tt)^2 - b[ai]^2 */
+		b[ai] += tt;						/* New data component value */
+		A[ai][0] += d * w;					/* dui component to itself */
+
+		/* For all the other simplex points ahead of this one, */
+		/* add in linear interpolation derivative weightings */
+		for (k = j+1; k < (1 << di); k++) {	/* Binary sequence */
+			int ii;
+			ii = ixcol[m->g.hi[k] - m->g.hi[j]];	/* A matrix column index */
+			A[ai][ii] += d * dd->w[k];				/* dui component due to ui+1 */
+		}
+	}
+	return nbsum;
+}
+
 /* Initialise the A[][] and b[] matricies ready to solve, given f */
 /* (Can be used to re-initialize an mgtmp for changing curve/extra fit factors) */
 /* We are setting up the matrix equation Ax = b to solve, where the aim is */
@@ -2280,36 +2605,8 @@ mgtmp *sm		/* Optional smoothing map for ausm mode */
 	}
 
 	/* Accumulate data point dependent factors */
-	for (n = 0; n < dno; n++) {		/* Go through all the data points */
-		int j,k;
-		struct mgdat *dd = MGDAT_N(m, n);
-		int bp = dd->b; 		/* index to base grid point in grid points */
-
-		/* For each point in the cube as the base grid point, */
-		/* add in the appropriate weighting for its weighted neighbors. */
-		for (j = 0; j < (1 << di); j++) {	/* Binary sequence */
-			double d, w, tt;
-			int ai;
-
-			ai = bp + m->g.hi[j];			/* A matrix index */
-
-			w = dd->w[j];				/* Base point grid weight */
-			d = 2.0 * s->d.a[n].k[f] * w;	/* (2.0, w are derivtv factors, k data pnt wgt) */
-			tt = d * s->d.a[n].v[f];		/* Change in data component */
-
-			nbsum += (2.0 * b[ai] + tt) * tt;	/* += (b[ai] + tt)^2 - b[ai]^2 */
-			b[ai] += tt;						/* New data component value */
-			A[ai][0] += d * w;					/* dui component to itself */
-
-			/* For all the other simplex points ahead of this one, */
-			/* add in linear interpolation derivative weightings */
-			for (k = j+1; k < (1 << di); k++) {	/* Binary sequence */
-				int ii;
-				ii = ixcol[m->g.hi[k] - m->g.hi[j]];	/* A matrix column index */
-				A[ai][ii] += d * dd->w[k];				/* dui component due to ui+1 */
-			}
-		}
-	}
+	for (n = 0; n < dno; n++)		/* Go through all the data points */
+		nbsum += dpnt_solve(m, n, 1.0);
 
 	/* Compute norm of b[] from sum of squares */
 	nbsum = sqrt(nbsum);
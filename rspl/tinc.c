@@ -0,0 +1,223 @@
+
+/************************************************/
+/* Test RSPL incremental re-fitting             */
+/************************************************/
+
+/* Author: agent
+ * Date:   18/10/2026
+ * Derived from revbench.c
+ * Copyright 2026, agent
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Fit a set of scattered points, then add and replace a few more using
+ * add_rspl(), and compare the result and the time taken against
+ * a complete re-fit of the same set of points.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include "copyright.h"
+#include "aconfig.h"
+#include "rspl.h"
+#include "numlib.h"
+
+#define GRES 33			/* Default grid resolution */
+#define NPTS 1000		/* Default number of initial points */
+#define NADD 30			/* Default number of points to add */
+#define NREP 10			/* Default number of points to replace */
+#define DI 3			/* Dimensions in */
+#define FDI 3			/* Function (out) Dimensions */
+
+/* Function approximated by rspl */
+static void func(
+double *out,
+double *in) {
+	out[0] = pow(in[0], 1.8) * 0.7 + 0.2 * in[1] * in[2];
+	out[1] = 0.5 * in[1] + 0.4 * sin(2.0 * in[0] + in[2]);
+	out[2] = 1.0 - pow(1.0 - in[2], 2.2) + 0.1 * in[0] * in[1];
+}
+
+/* Make a random sample point */
+static void rand_point(co *p) {
+	int e;
+
+	for (e = 0; e < DI; e++)
+		p->p[e] = d_rand(0.0, 1.0);
+	func(p->v, p->p);
+}
+
+void usage(void) {
+	fprintf(stderr,"Test rspl incremental fit, Version %s\n",ARGYLL_VERSION_STR);
+	fprintf(stderr,"usage: tinc [-r res] [-n npts] [-a nadd]\n");
+	fprintf(stderr," -r res        Set grid res\n");
+	fprintf(stderr," -n npts       Number of initial points\n");
+	fprintf(stderr," -a nadd       Number of points to add each round\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	int fa,nfa;				/* argument we're looking at */
+	int res = GRES;
+	int npts = NPTS;
+	int nadd = NADD;
+	int nrep = NREP;
+	int gres[MXDI];
+	co *pnts, *upts;
+	int *ix;
+	int e, f, i, k;
+	int inc_msec = 0, full_msec = 0, stime;
+	double mxerr = 0.0;
+
+	rspl *irs;		/* Incrementally fitted rspl */
+	rspl *frs;		/* Fully re-fitted rspl */
+
+	error_program = argv[0];
+
+	/* Process the arguments */
+	for(fa = 1;fa < argc;fa++) {
+		nfa = fa;					/* skip to nfa if next argument is used */
+		if (argv[fa][0] == '-')	{	/* Look for any flags */
+			char *na = NULL;		/* next argument after flag, null if none */
+
+			if (argv[fa][2] != '\000')
+				na = &argv[fa][2];		/* next is directly after flag */
+			else {
+				if ((fa+1) < argc) {
+					if (argv[fa+1][0] != '-') {
+						nfa = fa + 1;
+						na = argv[nfa];		/* next is seperate non-flag argument */
+					}
+				}
+			}
+
+			if (argv[fa][1] == '?')
+				usage();
+
+			else if (argv[fa][1] == 'r' || argv[fa][1] == 'R') {
+				fa = nfa;
+				if (na == NULL) usage();
+				res = atoi(na);
+			}
+			else if (argv[fa][1] == 'n' || argv[fa][1] == 'N') {
+				fa = nfa;
+				if (na == NULL) usage();
+				npts = atoi(na);
+			}
+			else if (argv[fa][1] == 'a' || argv[fa][1] == 'A') {
+				fa = nfa;
+				if (na == NULL) usage();
+				nadd = atoi(na);
+			}
+			else
+				usage();
+		} else
+			break;
+	}
+	if (nrep > npts)
+		nrep = npts;
+
+	for (e = 0; e < DI; e++)
+		gres[e] = res;
+
+	if ((pnts = (co *)malloc(sizeof(co) * (npts + 5 * nadd))) == NULL)
+		error("malloc failed");
+	if ((upts = (co *)malloc(sizeof(co) * (nadd + nrep))) == NULL)
+		error("malloc failed");
+	if ((ix = (int *)malloc(sizeof(int) * (nadd + nrep))) == NULL)
+		error("malloc failed");
+
+	for (i = 0; i < npts; i++)
+		rand_point(&pnts[i]);
+
+	/* Initial incremental fit */
+	irs = new_rspl(RSPL_NOFLAGS, DI, FDI);
+	stime = msec_time();
+	irs->fit_rspl(irs, RSPL_INCREMENTAL, pnts, npts, NULL, NULL, gres,
+	              NULL, NULL, 1.0, NULL, NULL);
+	printf("Initial fit of %d points took %d msec\n",npts,msec_time() - stime);
+
+	/* Do some rounds of adding and replacing points */
+	for (k = 0; k < 5; k++) {
+		int nno;
+
+		/* Replace some distinct existing points with re-measured values */
+		for (i = 0; i < nrep; i++) {
+			int j;
+			do {
+				ix[i] = i_rand(0, npts-1);
+				for (j = 0; j < i; j++) {
+					if (ix[j] == ix[i])
+						break;
+				}
+			} while (j < i);
+			upts[i] = pnts[ix[i]];
+			for (f = 0; f < FDI; f++)
+				upts[i].v[f] += d_rand(-0.01, 0.01);
+		}
+		/* And add some new ones */
+		for (; i < (nrep + nadd); i++) {
+			ix[i] = -1;
+			rand_point(&upts[i]);
+		}
+
+		stime = msec_time();
+		irs->add_rspl(irs, 0, upts, ix, nrep + nadd);
+		inc_msec += msec_time() - stime;
+
+		/* Update the full list to match */
+		for (nno = npts, i = 0; i < (nrep + nadd); i++) {
+			if (ix[i] >= 0)
+				pnts[ix[i]] = upts[i];
+			else
+				pnts[nno++] = upts[i];
+		}
+		npts = nno;
+
+		/* Full re-fit for comparison */
+		frs = new_rspl(RSPL_NOFLAGS, DI, FDI);
+		stime = msec_time();
+		frs->fit_rspl(frs, 0, pnts, npts, NULL, NULL, gres,
+		              NULL, NULL, 1.0, NULL, NULL);
+		full_msec += msec_time() - stime;
+
+		/* Compare them */
+		for (i = 0; i < 2000; i++) {
+			co ip, fp;
+
+			for (e = 0; e < DI; e++)
+				ip.p[e] = fp.p[e] = d_rand(0.0, 1.0);
+			irs->interp(irs, &ip);
+			frs->interp(frs, &fp);
+			for (f = 0; f < FDI; f++) {
+				double ee = fabs(ip.v[f] - fp.v[f]);
+				if (ee > mxerr)
+					mxerr = ee;
+			}
+		}
+		frs->del(frs);
+	}
+
+	printf("Incremental re-fits took %d msec, full re-fits took %d msec\n",inc_msec,full_msec);
+	printf("Maximum difference between incremental and full re-fit = %f\n",mxerr);
+
+	irs->del(irs);
+	free(ix);
+	free(upts);
+	free(pnts);
+
+	if (mxerr > 0.01) {
+		printf("Test failed\n");
+		return 1;
+	}
+	printf("Test passed\n");
+	return 0;
+}
+
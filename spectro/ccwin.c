@@ -38,6 +38,9 @@
 						/* [def] 1 = use error diffusion dithering with ccast quant model */
 						/*       2 = use crafted 4x4 dither cell */
 
+#define CCPCACHE_SIZE 64	/* Number of encoded patch images to cache */
+#define CCPQ_SIZE 4			/* Number of patches that can be queued for pre-encoding */
+
 #define VWIDTH  1920.0	/* Video stream and display size ? */
 #define VHEIGHT 1080.0
 
@@ -72,6 +75,22 @@
 
 /* ================================================================== */
 
+/* Everything that determines the encoded image of a patch */
+typedef struct {
+	double rgb[3];				/* Patch color (r_rgb) */
+	double bg[3];				/* Background color */
+	double x, y, w, h;			/* Position and size of test square in pixels */
+	int direct;					/* Image is for direct send */
+} ccpkey;
+
+/* An encoded patch image cache entry */
+typedef struct {
+	ccpkey key;
+	unsigned char *ibuf;		/* Memory image of .png file, NULL if entry is unused */
+	size_t ilen;
+	unsigned int stamp;			/* LRU time stamp */
+} ccpent;
+
 /* Chromwin context and (possible) web server  */
 typedef struct _chws {
 	int verb;
@@ -92,6 +111,18 @@ typedef struct _chws {
 
 	ccast *cc;					/* ChromeCast */
 
+	/* Cache of encoded patch images and background pre-encoder */
+	amutex clock;				/* Lock for cache and pre-encoder state */
+	acond cwait;				/* Signals a change in pre-encoder state */
+	ccpent cache[CCPCACHE_SIZE];/* Encoded patch images */
+	unsigned int cstamp;		/* LRU time stamp counter */
+	ccpkey pq[CCPQ_SIZE];		/* Queue of patches to pre-encode */
+	int pqn;					/* Number of patches in queue */
+	int pbusy;					/* nz if pre-encoder is encoding pkey */
+	ccpkey pkey;				/* Patch being pre-encoded */
+	int pstop;					/* Signal pre-encoder to exit */
+	athread *pth;				/* Pre-encoder thread, NULL if none */
+
 	/* Set a whole screen sized png image */
 	int (*set)(struct _chws *p, unsigned char *ibuf, size_t ilen);
 
@@ -104,6 +135,17 @@ typedef struct _chws {
 } chws;
 
 static void chws_del(chws *p) {
+	int i;
+
+	/* Stop the pre-encoder */
+	if (p->pth != NULL) {
+		amutex_lock(p->clock);
+		p->pstop = 1;
+		acond_signal(p->cwait);
+		amutex_unlock(p->clock);
+		p->pth->del(p->pth);
+		p->pth = NULL;
+	}
 
 	/* delete mongoose, if we are using it */
 	if (p->mg != NULL)
@@ -119,9 +161,203 @@ static void chws_del(chws *p) {
 	if (p->ws_url != NULL)
 		free(p->ws_url);
 
+	for (i = 0; i < CCPCACHE_SIZE; i++) {
+		if (p->cache[i].ibuf != NULL)
+			free(p->cache[i].ibuf);
+	}
+	acond_del(p->cwait);
+	amutex_del(p->clock);
+
 	free(p);
 }
 
+/* ------------------------------------------------------------------ */
+/* Encoded patch image cache. */
+
+/* Return nz if the two keys will produce the same image */
+static int ccpkey_eq(ccpkey *a, ccpkey *b) {
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		if (a->rgb[j] != b->rgb[j]
+		 || a->bg[j] != b->bg[j])
+			return 0;
+	}
+	if (a->x != b->x || a->y != b->y
+	 || a->w != b->w || a->h != b->h
+	 || a->direct != b->direct)
+		return 0;
+	return 1;
+}
+
+/* Look a patch up in the cache. Cache must be locked. */
+/* Return a copy of the image that the caller should free(), */
+/* or NULL if it is not in the cache. */
+static unsigned char *ccpc_get(chws *p, ccpkey *k, size_t *pilen) {
+	unsigned char *ibuf;
+	int i;
+
+	for (i = 0; i < CCPCACHE_SIZE; i++) {
+		ccpent *e = &p->cache[i];
+		if (e->ibuf != NULL && ccpkey_eq(&e->key, k)) {
+			if ((ibuf = malloc(e->ilen)) == NULL)
+				return NULL;
+			memcpy(ibuf, e->ibuf, e->ilen);
+			*pilen = e->ilen;
+			e->stamp = ++p->cstamp;
+			return ibuf;
+		}
+	}
+	return NULL;
+}
+
+/* Return nz if the patch is in the cache. Cache must be locked. */
+static int ccpc_has(chws *p, ccpkey *k) {
+	int i;
+
+	for (i = 0; i < CCPCACHE_SIZE; i++) {
+		if (p->cache[i].ibuf != NULL && ccpkey_eq(&p->cache[i].key, k))
+			return 1;
+	}
+	return 0;
+}
+
+/* Add a copy of an image to the cache, replacing the least recently */
+/* used entry. Cache must be locked. */
+static void ccpc_put(chws *p, ccpkey *k, unsigned char *ibuf, size_t ilen) {
+	ccpent *e = &p->cache[0];
+	unsigned char *nbuf;
+	int i;
+
+	if (ccpc_has(p, k))
+		return;
+
+	for (i = 0; i < CCPCACHE_SIZE; i++) {
+		if (p->cache[i].ibuf == NULL) {
+			e = &p->cache[i];
+			break;
+		}
+		if (p->cache[i].stamp < e->stamp)
+			e = &p->cache[i];
+	}
+
+	if ((nbuf = malloc(ilen)) == NULL)
+		return;			/* Just don't cache it */
+	memcpy(nbuf, ibuf, ilen);
+
+	if (e->ibuf != NULL)
+		free(e->ibuf);
+	e->key = *k;
+	e->ibuf = nbuf;
+	e->ilen = ilen;
+	e->stamp = ++p->cstamp;
+}
+
+static int chws_render(chws *p, ccpkey *k, unsigned char **pibuf, size_t *pilen);
+
+/* Pre-encoder thread. Encodes queued patches into the cache. */
+static int ccwin_pre_encoder(void *context) {
+	chws *p = (chws *)context;
+	unsigned char *ibuf;
+	size_t ilen;
+	int rv;
+
+	amutex_lock(p->clock);
+	for (;;) {
+		while (!p->pstop && p->pqn == 0)
+			acond_wait(p->cwait, p->clock);
+		if (p->pstop)
+			break;
+
+		p->pkey = p->pq[0];
+		p->pqn--;
+		memmove(p->pq, p->pq + 1, p->pqn * sizeof(ccpkey));
+
+		if (ccpc_has(p, &p->pkey))
+			continue;
+		p->pbusy = 1;
+		amutex_unlock(p->clock);
+
+		rv = chws_render(p, &p->pkey, &ibuf, &ilen);
+
+		amutex_lock(p->clock);
+		if (rv == 0) {
+			ccpc_put(p, &p->pkey, ibuf, ilen);
+			free(ibuf);
+		}
+		p->pbusy = 0;
+		acond_signal(p->cwait);
+	}
+	amutex_unlock(p->clock);
+
+	return 0;
+}
+
+/* Queue a patch to be pre-encoded in the background */
+static void chws_prefetch(chws *p, ccpkey *k) {
+	int i;
+
+	if (p->pth == NULL)
+		return;
+
+	amutex_lock(p->clock);
+	if ((p->pbusy && ccpkey_eq(&p->pkey, k))
+	 || ccpc_has(p, k)) {
+		amutex_unlock(p->clock);
+		return;
+	}
+	for (i = 0; i < p->pqn; i++) {
+		if (ccpkey_eq(&p->pq[i], k))
+			break;
+	}
+	if (i >= p->pqn) {
+		if (p->pqn >= CCPQ_SIZE) {		/* Discard the oldest request */
+			p->pqn--;
+			memmove(p->pq, p->pq + 1, p->pqn * sizeof(ccpkey));
+		}
+		p->pq[p->pqn++] = *k;
+		acond_signal(p->cwait);
+	}
+	amutex_unlock(p->clock);
+}
+
+/* Get the encoded image of a patch, from the cache if possible. */
+/* Return nz on error */
+static int chws_get_image(chws *p, ccpkey *k, unsigned char **pibuf, size_t *pilen) {
+	int i;
+
+	amutex_lock(p->clock);
+
+	/* Don't duplicate the work of the pre-encoder */
+	while (p->pbusy && ccpkey_eq(&p->pkey, k))
+		acond_wait(p->cwait, p->clock);
+
+	if ((*pibuf = ccpc_get(p, k, pilen)) != NULL) {
+		amutex_unlock(p->clock);
+		debugr2((errout,"Using cached png size %d bytes\n",(int)*pilen));
+		return 0;
+	}
+
+	/* We need it now, so don't pre-encode it */
+	for (i = 0; i < p->pqn; i++) {
+		if (ccpkey_eq(&p->pq[i], k)) {
+			p->pqn--;
+			memmove(p->pq + i, p->pq + i + 1, (p->pqn - i) * sizeof(ccpkey));
+			break;
+		}
+	}
+	amutex_unlock(p->clock);
+
+	if (chws_render(p, k, pibuf, pilen))
+		return 1;
+
+	amutex_lock(p->clock);
+	ccpc_put(p, k, *pibuf, *pilen);
+	amutex_unlock(p->clock);
+
+	return 0;
+}
+
 /* Set a whole screen .png (size is assumed to be large enough) */
 /* Return nz on error */
 static int chws_set(chws *p, unsigned char *ibuf, size_t ilen) {
@@ -360,6 +596,9 @@ int verb, int ddebug) {
 	p->update = chws_update;
 	p->del = chws_del;
 
+	amutex_init(p->clock);
+	acond_init(p->cwait);
+
 	/* We make sure we round the test patch size and */
 	/* location to integer resolution so that we can know */
 	/* it's exact relationship to the upsampled pixel locations. */
@@ -416,6 +655,12 @@ int verb, int ddebug) {
 			printf("Created .png server at '%s'\n",p->ws_url);
 	}
 
+	/* Start the background patch pre-encoder. */
+	/* (We can manage without it if this fails) */
+	if ((p->pth = new_athread(ccwin_pre_encoder, (void *)p)) == NULL) {
+		debugr2((errout,"new_chws: failed to start pre-encoder thread\n"));
+	}
+
 	return p;
 }
 
@@ -461,219 +706,274 @@ icmFile *ccwin_get_profile(dispwin *p, char *name, int mxlen) {
 
 /* ----------------------------------------------- */
 
-/* Change the window color. */
-/* Return 1 on error, 2 on window being closed */
-/* inst_license, inst_licensenc, inst_tamper or inst_syscompat on licening problem */
-static int ccwin_set_color(
+/* Compute the patch image parameters for a given color. */
+/* Return the scaled (pre tvenc precision) color in s_rgb[] if not NULL */
+static void ccwin_get_key(
 dispwin *p,
+ccpkey *k,
+double *s_rgb,
 double r, double g, double b	/* Color values 0.0 - 1.0 */
 ) {
 	chws *ws = (chws *)p->pcntx;
+	double rgb[3];
 	int j;
-	double orgb[3];		/* Previous RGB value */
-	double kr, kf;
-	int update_delay = 0;
 
-	debugr2((errout, "ccwin_set_color called with %f %f %f\n",r,g,b));
+	rgb[0] = r;
+	rgb[1] = g;
+	rgb[2] = b;
 
-	if (p->nowin) {
-		debugr2((errout,"ccwin_set_color: nowin - give up\n"));
-		return 1;
-	}
-
-	orgb[0] = p->rgb[0]; p->rgb[0] = r;
-	orgb[1] = p->rgb[1]; p->rgb[1] = g;
-	orgb[2] = p->rgb[2]; p->rgb[2] = b;
+	memset(k, 0, sizeof(ccpkey));		/* Make any padding deterministic */
 
 	for (j = 0; j < 3; j++) {
-		if (p->rgb[j] < 0.0)
-			p->rgb[j] = 0.0;
-		else if (p->rgb[j] > 1.0)
-			p->rgb[j] = 1.0;
-		p->r_rgb[j] = p->s_rgb[j] = p->rgb[j];
+		if (rgb[j] < 0.0)
+			rgb[j] = 0.0;
+		else if (rgb[j] > 1.0)
+			rgb[j] = 1.0;
+		k->rgb[j] = rgb[j];
 		if (p->out_tvenc) {
-			p->r_rgb[j] = p->s_rgb[j] = ((235.0 - 16.0) * p->s_rgb[j] + 16.0)/255.0;
+			rgb[j] = k->rgb[j] = ((235.0 - 16.0) * rgb[j] + 16.0)/255.0;
 
 			/* For video encoding the extra bits of precision are created by bit shifting */
 			/* rather than scaling, so we need to scale the fp value to account for this. */
 			if (p->edepth > 8)
-				p->r_rgb[j] = (p->s_rgb[j] * 255 * (1 << (p->edepth - 8)))
+				k->rgb[j] = (rgb[j] * 255 * (1 << (p->edepth - 8)))
 				            /((1 << p->edepth) - 1.0); 	
 		}
+		if (s_rgb != NULL)
+			s_rgb[j] = rgb[j];
 	}
 
-	/* This is probably not actually thread safe... */
-	p->ncix++;
+	/* Full screen background: */
+	if (p->fullscreen) {
+		if (p->bge == dw_bg_grey) {
+			k->bg[0] = 0.2;
+			k->bg[1] = 0.2;
+			k->bg[2] = 0.2;
+		} else if (p->bge == dw_bg_cvideo) {
+			k->bg[0] = p->area * (1.0 - r)/(1.0 - p->area); 
+			k->bg[1] = p->area * (1.0 - g)/(1.0 - p->area); 
+			k->bg[2] = p->area * (1.0 - b)/(1.0 - p->area); 
+
+		} else if (p->bge == dw_bg_clight) {
+			double gamma = 2.3;
+			k->bg[0] = pow(p->area * (1.0 - pow(r, gamma))/(1.0 - p->area), 1.0/gamma);
+			k->bg[1] = pow(p->area * (1.0 - pow(g, gamma))/(1.0 - p->area), 1.0/gamma);
+			k->bg[2] = pow(p->area * (1.0 - pow(b, gamma))/(1.0 - p->area), 1.0/gamma); 
+
+		} else {		/* Assume dw_bg_black */
+			k->bg[0] = 0.0;
+			k->bg[1] = 0.0;
+			k->bg[2] = 0.0;
+		}
 
-#if DDITHER != 1
-# pragma message("############################# ccwin.c DDITHER != 1 ##")
-#endif
+	/* Use default dark gray background */ 
+	} else {
+		k->bg[0] = 0.2;
+		k->bg[1] = 0.2;
+		k->bg[2] = 0.2;
+	}
 
-	/* Turn the color into a png file */
-	{
-		/* We want a raster of IWIDTH x IHEIGHT pixels for web server, */
-		/* or p->w x p->h for PNG direct. */
-		render2d *rr;
-		prim2d *rct;
-		depth2d depth = bpc8_2d;
+	k->x = ws->x;
+	k->y = ws->y;
+	k->w = ws->w;
+	k->h = ws->h;
+	k->direct = ws->direct;
+}
+
+/* Turn a patch into a png file. */
+/* (May be called from the pre-encoder thread) */
+/* Return nz on error */
+static int chws_render(
+chws *ws,
+ccpkey *k,
+unsigned char **pibuf,		/* Return memory image of .png file */
+size_t *pilen
+) {
+	/* We want a raster of IWIDTH x IHEIGHT pixels for web server, */
+	/* or p->w x p->h for PNG direct. */
+	render2d *rr;
+	prim2d *rct;
+	depth2d depth = bpc8_2d;
 #if DDITHER == 1
-		int dither = 0x8002;		/* 0x8002 = error diffuse FG only */
+	int dither = 0x8002;		/* 0x8002 = error diffuse FG only */
 #elif DDITHER == 2
-		int dither = 0x4000;		/* 0x4000 = no dither but don't average pixels */
-									/* so as to allow pattern to come through. */
+	int dither = 0x4000;		/* 0x4000 = no dither but don't average pixels */
+								/* so as to allow pattern to come through. */
 #else
-		int dither = 0;				/* Don't dither in renderer */
+	int dither = 0;				/* Don't dither in renderer */
 #endif
-		double hres = 1.0;					/* Resoltion in pix/mm */
-		double vres = 1.0;					/* Resoltion in pix/mm */
-		double iw, ih;						/* Size of page in mm (pixels) */
-		color2d c;
-		unsigned char *ibuf;		/* Memory image of .png file */
-		size_t ilen;
-		int rv;
+	double hres = 1.0;					/* Resoltion in pix/mm */
+	double vres = 1.0;					/* Resoltion in pix/mm */
+	double iw, ih;						/* Size of page in mm (pixels) */
+	color2d c;
+	int rv;
 #ifdef DO_TIMING
-		int stime;
+	int stime;
 #endif
 
-		if (ws->direct) {
-			iw = ws->w;		/* Requested size */
-			ih = ws->h;
-		} else {
-			iw = IWIDTH;
-			ih = IHEIGHT;	/* Size of page in mm */
-		}
-
-		/* Full screen background: */
-		if (p->fullscreen) {
-			if (p->bge == dw_bg_grey) {
-				ws->bg[0] = 0.2;
-				ws->bg[1] = 0.2;
-				ws->bg[2] = 0.2;
-			} else if (p->bge == dw_bg_cvideo) {
-				ws->bg[0] = p->area * (1.0 - r)/(1.0 - p->area); 
-				ws->bg[1] = p->area * (1.0 - g)/(1.0 - p->area); 
-				ws->bg[2] = p->area * (1.0 - b)/(1.0 - p->area); 
- 
-			} else if (p->bge == dw_bg_clight) {
-				double gamma = 2.3;
-				ws->bg[0] = pow(p->area * (1.0 - pow(r, gamma))/(1.0 - p->area), 1.0/gamma);
-				ws->bg[1] = pow(p->area * (1.0 - pow(g, gamma))/(1.0 - p->area), 1.0/gamma);
-				ws->bg[2] = pow(p->area * (1.0 - pow(b, gamma))/(1.0 - p->area), 1.0/gamma); 
-
-			} else {		/* Assume dw_bg_black */
-				ws->bg[0] = 0.0;
-				ws->bg[1] = 0.0;
-				ws->bg[2] = 0.0;
-			}
-
-		/* Use default dark gray background */ 
-		} else {
-			ws->bg[0] = 0.2;
-			ws->bg[1] = 0.2;
-			ws->bg[2] = 0.2;
-		}
+	if (k->direct) {
+		iw = k->w;		/* Requested size */
+		ih = k->h;
+	} else {
+		iw = IWIDTH;
+		ih = IHEIGHT;	/* Size of page in mm */
+	}
 
-		debugr2((errout, "ccwin_set_color iw %f ih %f\n",iw,ih));
+	debug2((errout, "chws_render iw %f ih %f\n",iw,ih));
 
-		if ((rr = new_render2d(iw, ih, NULL, hres, vres, rgb_2d,
-		     0, depth, dither,
+	if ((rr = new_render2d(iw, ih, NULL, hres, vres, rgb_2d,
+	     0, depth, dither,
 #if DDITHER == 1
-			 ccastQuant, NULL, 3.0/255.0
+		 ccastQuant, NULL, 3.0/255.0
 #else
-			 NULL, NULL, 0.0
+		 NULL, NULL, 0.0
 #endif
-			 )) == NULL) {
-			a1loge(g_log, 1,"ccwin: new_render2d() failed\n");
-			return 1;
-		}
-	
-		/* Set the background color */
-		c[0] = ws->bg[0];
-		c[1] = ws->bg[1];
-		c[2] = ws->bg[2];
-		rr->set_defc(rr, c);
-	
-		c[0] = p->r_rgb[0];
-		c[1] = p->r_rgb[1];
-		c[2] = p->r_rgb[2];
-		if (ws->direct)
-			rr->add(rr, rct = new_rect2d(rr, 0.0, 0.0, ws->w, ws->h, c));
-		else
-			rr->add(rr, rct = new_rect2d(rr, ws->x, ws->y, ws->w, ws->h, c));
+		 )) == NULL) {
+		a1loge(g_log, 1,"ccwin: new_render2d() failed\n");
+		return 1;
+	}
+
+	/* Set the background color */
+	c[0] = k->bg[0];
+	c[1] = k->bg[1];
+	c[2] = k->bg[2];
+	rr->set_defc(rr, c);
+
+	c[0] = k->rgb[0];
+	c[1] = k->rgb[1];
+	c[2] = k->rgb[2];
+	if (k->direct)
+		rr->add(rr, rct = new_rect2d(rr, 0.0, 0.0, k->w, k->h, c));
+	else
+		rr->add(rr, rct = new_rect2d(rr, k->x, k->y, k->w, k->h, c));
 
 #if DDITHER == 2			/* Use dither pattern */
-		{
-			double rgb[3];
-			double dpat[CCDITHSIZE][CCDITHSIZE][3];
-			double (*cpat)[MXPATSIZE][MXPATSIZE][TOTC2D];
-			int i, j;
-
-			/* Get a chrome cast dither pattern to match target color */
-			for (i = 0; i < 3; i++)
-				rgb[i] = p->r_rgb[i] * 255.0;
-			get_ccast_dith(dpat, rgb);
-
-			if ((cpat = malloc(sizeof(double) * MXPATSIZE * MXPATSIZE * TOTC2D)) == NULL) {
-				a1loge(g_log, 1, "ccwin: malloc of dither pattern failed\n");
-				return 1;
-			}
-			
-			for (i = 0; i < CCDITHSIZE; i++) {
-				for (j = 0; j < CCDITHSIZE; j++) {
-					int k = (((int)IHEIGHT-2) - j) % CCDITHSIZE;	/* Flip to origin bot left */
-					(*cpat)[i][k][0] = dpat[i][j][0]/255.0;			/* (HEIGHT-2 is correct!) */
-					(*cpat)[i][k][1] = dpat[i][j][1]/255.0;
-					(*cpat)[i][k][2] = dpat[i][j][2]/255.0;
-				}
+	{
+		double rgb[3];
+		double dpat[CCDITHSIZE][CCDITHSIZE][3];
+		double (*cpat)[MXPATSIZE][MXPATSIZE][TOTC2D];
+		int i, j;
+
+		/* Get a chrome cast dither pattern to match target color */
+		for (i = 0; i < 3; i++)
+			rgb[i] = k->rgb[i] * 255.0;
+		get_ccast_dith(dpat, rgb);
+
+		if ((cpat = malloc(sizeof(double) * MXPATSIZE * MXPATSIZE * TOTC2D)) == NULL) {
+			a1loge(g_log, 1, "ccwin: malloc of dither pattern failed\n");
+			rr->del(rr);
+			return 1;
+		}
+		
+		for (i = 0; i < CCDITHSIZE; i++) {
+			for (j = 0; j < CCDITHSIZE; j++) {
+				int k = (((int)IHEIGHT-2) - j) % CCDITHSIZE;	/* Flip to origin bot left */
+				(*cpat)[i][k][0] = dpat[i][j][0]/255.0;			/* (HEIGHT-2 is correct!) */
+				(*cpat)[i][k][1] = dpat[i][j][1]/255.0;
+				(*cpat)[i][k][2] = dpat[i][j][2]/255.0;
 			}
-			
-			set_rect2d_dpat((rect2d *)rct, cpat, CCDITHSIZE, CCDITHSIZE);
 		}
+		
+		set_rect2d_dpat((rect2d *)rct, cpat, CCDITHSIZE, CCDITHSIZE);
+	}
 #endif /* DDITHER == 2 */
 
 #ifdef CCTEST_PATTERN
 #pragma message("############################# ccwin.c TEST_PATTERN defined ! ##")
-		if (getenv("ARGYLL_CCAST_TEST_PATTERN") != NULL) {
-			verbose(0, "Writing test pattern to '%s'\n","testpattern.png");
-			if (r->write(r, "testpattern.png", 1, NULL, NULL, png_file)) {
-				a1loge(g_log, 1, "ccwin: render->write failed\n");
-				return 1;
-			}
+	if (getenv("ARGYLL_CCAST_TEST_PATTERN") != NULL) {
+		verbose(0, "Writing test pattern to '%s'\n","testpattern.png");
+		if (rr->write(rr, "testpattern.png", 1, NULL, NULL, png_file)) {
+			a1loge(g_log, 1, "ccwin: render->write failed\n");
+			rr->del(rr);
+			return 1;
 		}
+	}
 #else	/* !CCTEST_PATTERN */
 # ifdef WRITE_PNG		/* Write it to a file so that we can look at it */
 #  pragma message("############################# spectro/ccwin.c WRITE_PNG is enabled ######")
-		if (r->write(rr, "ccwin.png", 1, NULL, NULL, png_file)) {
-			a1loge(g_log, 1, "ccwin: render->write failed\n");
-			return 1;
-		}
+	if (rr->write(rr, "ccwin.png", 1, NULL, NULL, png_file)) {
+		a1loge(g_log, 1, "ccwin: render->write failed\n");
+		rr->del(rr);
+		return 1;
+	}
 # endif	/* WRITE_PNG */
 #endif	/* !CCTEST_PATTERN */
 
 
 #ifdef DO_TIMING
-		stime = msec_time();
+	stime = msec_time();
 #endif
 
-		rv = rr->write(rr, "MemoryBuf", 1, &ibuf, &ilen, png_mem);
-
+	rv = rr->write(rr, "MemoryBuf", 1, pibuf, pilen, png_mem);
+	rr->del(rr);
 
-		if (rv) {
-			a1loge(g_log, 1, "ccwin: render->write failed\n");
-			return 1;
-		}
-		rr->del(rr);
+	if (rv) {
+		a1loge(g_log, 1, "ccwin: render->write failed\n");
+		return 1;
+	}
 #ifdef DO_TIMING
-		stime = msec_time() - stime;
-		printf("render->write took %d msec\n",stime);
+	stime = msec_time() - stime;
+	printf("render->write took %d msec\n",stime);
 #endif
-		if (ws->update(ws, ibuf, ilen, ws->bg)) {
-			a1loge(g_log, 1, "ccwin: color update failed\n");
-			return 1;
-		}
-		p->ccix = p->ncix;
+
+	return 0;
+}
+
+/* Change the window color. */
+/* Return 1 on error, 2 on window being closed */
+/* inst_license, inst_licensenc, inst_tamper or inst_syscompat on licening problem */
+static int ccwin_set_color(
+dispwin *p,
+double r, double g, double b	/* Color values 0.0 - 1.0 */
+) {
+	chws *ws = (chws *)p->pcntx;
+	int j;
+	double orgb[3];		/* Previous RGB value */
+	double kr, kf;
+	int update_delay = 0;
+	ccpkey key;
+	unsigned char *ibuf;		/* Memory image of .png file */
+	size_t ilen;
+
+	debugr2((errout, "ccwin_set_color called with %f %f %f\n",r,g,b));
+
+	if (p->nowin) {
+		debugr2((errout,"ccwin_set_color: nowin - give up\n"));
+		return 1;
 	}
 
+	orgb[0] = p->rgb[0]; p->rgb[0] = r;
+	orgb[1] = p->rgb[1]; p->rgb[1] = g;
+	orgb[2] = p->rgb[2]; p->rgb[2] = b;
+
+	ccwin_get_key(p, &key, p->s_rgb, r, g, b);
+
+	for (j = 0; j < 3; j++) {
+		if (p->rgb[j] < 0.0)
+			p->rgb[j] = 0.0;
+		else if (p->rgb[j] > 1.0)
+			p->rgb[j] = 1.0;
+		p->r_rgb[j] = key.rgb[j];
+		ws->bg[j] = key.bg[j];
+	}
+
+	/* This is probably not actually thread safe... */
+	p->ncix++;
+
+#if DDITHER != 1
+# pragma message("############################# ccwin.c DDITHER != 1 ##")
+#endif
+
+	/* Get the color as a png file */
+	if (chws_get_image(ws, &key, &ibuf, &ilen)) {
+		a1loge(g_log, 1, "ccwin: rendering patch failed\n");
+		return 1;
+	}
+	if (ws->update(ws, ibuf, ilen, ws->bg)) {
+		a1loge(g_log, 1, "ccwin: color update failed\n");
+		return 1;
+	}
+	p->ccix = p->ncix;
 
 	/* If update is notified asyncronously ... */
 	while(p->ncix != p->ccix) {
@@ -691,6 +991,27 @@ double r, double g, double b	/* Color values 0.0 - 1.0 */
 	return 0;
 }
 
+/* Hint the color that will be set next, so that its */
+/* image can be encoded while the current patch is measured. */
+/* Return nz on error */
+static int ccwin_set_next_color(
+dispwin *p,
+double r, double g, double b	/* Color values 0.0 - 1.0 */
+) {
+	chws *ws = (chws *)p->pcntx;
+	ccpkey key;
+
+	debugr2((errout, "ccwin_set_next_color called with %f %f %f\n",r,g,b));
+
+	if (p->nowin || ws == NULL)
+		return 1;
+
+	ccwin_get_key(p, &key, NULL, r, g, b);
+	chws_prefetch(ws, &key);
+
+	return 0;
+}
+
 /* Set/unset the full screen background color flag */
 /* Return nz on error */
 static int ccwin_set_fc(dispwin *p, int fullscreen) {
@@ -789,6 +1110,7 @@ int ddebug						/* >0 to print debug statements to stderr */
 	p->set_color           = ccwin_set_color;
 	p->set_fc              = ccwin_set_fc;
 	p->set_patch_win       = ccwin_set_patch_win;
+	p->set_next_color      = ccwin_set_next_color;
 	p->set_update_delay    = dispwin_set_update_delay;
 	p->set_settling_delay  = dispwin_set_settling_delay;
 	p->enable_update_delay = dispwin_enable_update_delay;
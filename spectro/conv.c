@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
 #include <ctype.h>
 
@@ -611,6 +612,18 @@ int create_parent_directories(char *path) {
 	return 0;
 }
 
+/* Acquire load and release store for compilers without __atomic */
+unsigned int aatomic_load_imp(volatile unsigned int *var) {
+	unsigned int rv = *var;
+	MemoryBarrier();
+	return rv;
+}
+
+void aatomic_store_imp(volatile unsigned int *var, unsigned int val) {
+	MemoryBarrier();
+	*var = val;
+}
+
 /* return the number of processors */
 int system_processors() {
 	SYSTEM_INFO sysinfo;
@@ -664,6 +677,94 @@ char *path_to_file_in_same_dir(char *inpath, char *infile) {
 	return rv;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Lock free single producer, single consumer ring buffer. */
+
+/* head and tail are free running counts, so that full and empty */
+/* can be distinguished without wasting an entry. The producer */
+/* only writes head, and the consumer only writes tail. */
+
+static int aring_put(aring *p, void *ent) {
+	unsigned int head = p->head;		/* Only we write this */
+	unsigned int ix;
+
+	if ((head - aatomic_load(p->tail)) >= p->size)
+		return 1;							/* Full */
+
+	ix = head & (p->size-1);
+	if (p->esize > 0)
+		memcpy(p->buf + ix * p->esize, ent, p->esize);
+	p->stime[ix] = usec_time();
+
+	aatomic_store(p->head, head+1);		/* Publish the entry */
+	return 0;
+}
+
+static int aring_get(aring *p, void *ent, double *lat) {
+	unsigned int tail = p->tail;		/* Only we write this */
+	unsigned int ix;
+
+	if (aatomic_load(p->head) == tail)
+		return 1;							/* Empty */
+
+	ix = tail & (p->size-1);
+	if (p->esize > 0 && ent != NULL)
+		memcpy(ent, p->buf + ix * p->esize, p->esize);
+	if (lat != NULL)
+		*lat = (usec_time() - p->stime[ix])/1000.0;
+
+	aatomic_store(p->tail, tail+1);		/* Release the entry */
+	return 0;
+}
+
+static int aring_count(aring *p) {
+	return (int)(aatomic_load(p->head) - aatomic_load(p->tail));
+}
+
+static void aring_flush(aring *p) {
+	aatomic_store(p->tail, aatomic_load(p->head));
+}
+
+static void aring_del(aring *p) {
+	if (p != NULL) {
+		free(p->buf);
+		free(p->stime);
+		free(p);
+	}
+}
+
+aring *new_aring(int size, int esize) {
+	aring *p;
+	unsigned int sz;
+
+	if (size < 1 || esize < 0)
+		return NULL;
+
+	for (sz = 1; sz < (unsigned int)size; sz <<= 1)
+		;
+
+	if ((p = (aring *)calloc(sizeof(aring), 1)) == NULL)
+		return NULL;
+
+	p->size = sz;
+	p->esize = esize;
+	if ((p->buf = (char *)calloc(sz, esize > 0 ? esize : 1)) == NULL
+	 || (p->stime = (double *)calloc(sz, sizeof(double))) == NULL) {
+		aring_del(p);
+		return NULL;
+	}
+
+	p->put   = aring_put;
+	p->get   = aring_get;
+	p->count = aring_count;
+	p->flush = aring_flush;
+	p->del   = aring_del;
+
+	usec_time();		/* Make sure the timer is initialized before use by threads */
+
+	return p;
+}
+
 
 /* ============================================================= */
 /*                          UNIX/OS X                            */
@@ -221,6 +221,59 @@ athread *new_athread_reusable(int (*function)(void *context), void *context, int
 #define new_athread(func, ctx) new_athread_reusable(func, ctx, 0)
 
 
+/* - - - - - - - - - - - - - - - - - - -- */
+/* Acquire load and release store of an unsigned int shared between threads */
+
+#if defined(__GNUC__) || defined(__clang__)
+# define aatomic_load(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+# define aatomic_store(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+#elif defined(NT)
+# define aatomic_load(var) aatomic_load_imp(&(var))
+# define aatomic_store(var, val) aatomic_store_imp(&(var), (val))
+
+unsigned int aatomic_load_imp(volatile unsigned int *var);
+void aatomic_store_imp(volatile unsigned int *var, unsigned int val);
+#endif
+
+/* - - - - - - - - - - - - - - - - - - -- */
+
+/* A lock free single producer, single consumer ring buffer. */
+/* One thread may put() entries while one other thread get()'s them, */
+/* without any locking or blocking. Each entry is time stamped */
+/* when it is put, so that the hand-off latency can be reported. */
+struct _aring {
+	unsigned int size;			/* Number of entries, power of 2 */
+	unsigned int esize;			/* Size of each entry in bytes, may be 0 */
+	char *buf;					/* size * esize bytes of entries */
+	double *stime;				/* usec_time() when each entry was put */
+	volatile unsigned int head;	/* Count of entries put, only written by producer */
+	volatile unsigned int tail;	/* Count of entries got, only written by consumer */
+
+	/* Put an entry (may be NULL if esize == 0). (Producer only) */
+	/* Return nz if the ring is full */
+	int (*put)(struct _aring *p, void *ent);
+
+	/* Get the oldest entry (may be NULL). If lat != NULL, return the */
+	/* msec it waited in the ring. (Consumer only) */
+	/* Return nz if the ring is empty */
+	int (*get)(struct _aring *p, void *ent, double *lat);
+
+	/* Return the number of entries waiting to be got */
+	int (*count)(struct _aring *p);
+
+	/* Discard all the waiting entries. (Consumer only) */
+	void (*flush)(struct _aring *p);
+
+	/* Delete the ring. Neither thread should be using it. */
+	void (*del)(struct _aring *p);
+
+}; typedef struct _aring aring;
+
+/* Create a ring with room for at least size entries of esize bytes. */
+/* Return NULL on error. */
+aring *new_aring(int size, int esize);
+
+
 /* - - - - - - - - - - - - - - - - - - -- */
 
 /* Return the login $HOME directory. */
@@ -188,6 +188,10 @@
 #define CAL_RES 256			/* Resolution of calibration table to produce. */
 #define CLIP				/* Clip RGB during refinement */
 #define RDAC_SMOOTH 0.3		/* RAMDAC curve fitting smoothness */
+#define ADAPT_INTERP_UNC 0.25	/* Adaptive refinement: uncertainty per DE of old step interpolated */
+#define ADAPT_JAC_UNC 0.5	/* Adaptive refinement: uncertainty per DE of Jacobian extrapolation */
+#define ADAPT_MEAS_UNC 0.1	/* Adaptive refinement: uncertainty of a measured point in DE */
+#define ADAPT_MEAS_NOISE 0.0002	/* Adaptive refinement: measurement noise floor as fraction of white Y */
 #define MEAS_RES			/* Measure the RAMNDAC entry size */ 
 
 #if defined(DEBUG_PLOT) || defined(DEBUG) || defined(DEBUG_MEAS_RES)
@@ -921,6 +925,9 @@ typedef struct {
 	double j[3][3];		/* Aproximate Jacobian (del RGB -> XYZ) */
 	double ij[3][3];	/* Aproximate inverse Jacobian (del XYZ-> del RGB) */
 	double fb_ij[3][3];	/* Copy of initial inverse Jacobian, used as a fallback */
+
+	double eXYZ[3];		/* Predicted XYZ at rgb without measuring (adaptive refinement) */
+	double unc;			/* Uncertainty of eXYZ in DE, 1e6 if unknown */
 } csp;
 
 
@@ -1071,6 +1078,7 @@ static void init_csamp(csamp *p, calx *x, int doupdate, int verify, int psrand,
 //printf("~1 Forcing white rgb to be 1,1,1\n");
 			p->s[i].rgb[0] = p->s[i].rgb[1] = p->s[i].rgb[2] = 1.0;
 		}
+		p->s[i].unc = 1e6;		/* Nothing known about the result yet */
 		
 //printf("~1 Inital point %d rgb %f %f %f\n",i,p->s[i].rgb[0],p->s[i].rgb[1],p->s[i].rgb[2]);
 
@@ -1125,16 +1133,57 @@ static void csamp_interp(csamp *p, double xyz[3], double v) {
 	}
 }
 
+/* Return the uncertainty in DE of a point just measured as XYZ. */
+/* This is the base uncertainty plus the DE of an absolute noise */
+/* floor in each of X, Y & Z, which dominates near black. */
+static double meas_unc(calx *x, double XYZ[3]) {
+	double nXYZ[3], de, sde = 0.0;
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		icmAry2Ary(nXYZ, XYZ);
+		nXYZ[j] += ADAPT_MEAS_NOISE * x->twh[1];
+		de = icmXYZLabDE(&x->twN, XYZ, nXYZ);
+		sde += de * de;
+	}
+	return ADAPT_MEAS_UNC + sqrt(sde);
+}
+
 /* Re-initialise a CSP with a new number of points. */
 /* Interpolate the device values and jacobian. */
 /* Set the current rgb from the current RAMDAC curves if not verifying */
+/* Predict the XYZ of each new point and the uncertainty of that prediction, */
+/* so that adaptive refinement can skip re-measuring it. */
 static void reinit_csamp(csamp *p, calx *x, int verify, int psrand, int no, int verb) {
 	csp *os;			/* Old list of samples */
 	int ono;			/* Old number of samples */
 	int i, j, k, m;
 	
-	if (no == p->no)
-		return;			/* Nothing has changed */
+	if (no == p->no) {	/* Same points, so just update the device values */
+		for (i = 0; i < no; i++) {
+			double orgb[3], drgb[3], dXYZ[3];
+
+			icmCpy3(orgb, p->s[i].rgb);
+			if (verify != 2) {	/* Lookup rgb from current calibration curves */
+				for (m = 0; m < 3; m++) {
+					p->s[i].rgb[m] = x->rdac[m]->interp(x->rdac[m], p->s[i].v);
+#ifdef CLIP
+					if (p->s[i].rgb[m] < 0.0)
+						p->s[i].rgb[m] = 0.0;
+					else if (p->s[i].rgb[m] > 1.0)
+						p->s[i].rgb[m] = 1.0;
+#endif
+				}
+			}
+
+			/* Predict the XYZ at the new rgb, and allow for the Jacobian extrapolation */
+			icmSub3(drgb, p->s[i].rgb, orgb);
+			icmMulBy3x3(dXYZ, p->s[i].j, drgb);
+			icmAdd3(p->s[i].eXYZ, p->s[i].XYZ, dXYZ);
+			p->s[i].unc += ADAPT_JAC_UNC * icmXYZLabDE(&x->twN, p->s[i].XYZ, p->s[i].eXYZ);
+		}
+		return;
+	}
 
 	os = p->s;			/* Save the existing per point information */
 	ono = p->no;
@@ -1146,6 +1195,7 @@ static void reinit_csamp(csamp *p, calx *x, int verify, int psrand, int no, int
 	/* Interpolate the current device values */
 	for (i = 0; i < no; i++) {
 		double vv, b;
+		double orgb[3];		/* Old device values interpolated */
 
 		vv = p->s[i].v;
 
@@ -1160,9 +1210,11 @@ static void reinit_csamp(csamp *p, calx *x, int verify, int psrand, int no, int
 		b = (vv - os[j].v)/(os[j+1].v - os[j].v);
 	
 		for (k = 0; k < 3; k++) {
+			orgb[k] = b * os[j+1].rgb[k] + (1.0 - b) * os[j].rgb[k];
+
 			if (verify == 2) {
 
-				p->s[i].rgb[k] = b * os[j+1].rgb[k] + (1.0 - b) * os[j].rgb[k];
+				p->s[i].rgb[k] = orgb[k];
 
 			} else {	/* Lookup rgb from current calibration curves */
 				for (m = 0; m < 3; m++) {
@@ -1196,13 +1248,14 @@ static void reinit_csamp(csamp *p, calx *x, int verify, int psrand, int no, int
 			else
 				dd = -0.02;
 			/* Matrix organization is J[XYZ][RGB] for del RGB->del XYZ*/
-			for (j = 0; j < 3; j++) {
-				p->s[i].rgb[j] += dd;
+			/* (Don't use j, it's the index of the old bracketing pair) */
+			for (m = 0; m < 3; m++) {
+				p->s[i].rgb[m] += dd;
 				fwddev(x, delXYZ, p->s[i].rgb);
-				p->s[i].j[0][j] = (delXYZ[0] - refXYZ[0]) / dd;
-				p->s[i].j[1][j] = (delXYZ[1] - refXYZ[1]) / dd;
-				p->s[i].j[2][j] = (delXYZ[2] - refXYZ[2]) / dd;
-				p->s[i].rgb[j] -= dd;
+				p->s[i].j[0][m] = (delXYZ[0] - refXYZ[0]) / dd;
+				p->s[i].j[1][m] = (delXYZ[1] - refXYZ[1]) / dd;
+				p->s[i].j[2][m] = (delXYZ[2] - refXYZ[2]) / dd;
+				p->s[i].rgb[m] -= dd;
 			}
 		}
 #endif
@@ -1217,6 +1270,24 @@ static void reinit_csamp(csamp *p, calx *x, int verify, int psrand, int no, int
 
 		p->s[i]._de = p->s[i].de = b * os[j+1].de + (1.0 - b) * os[j].de;
 		p->s[i].dc = b * os[j+1].dc + (1.0 - b) * os[j].dc;
+
+		/* Predict the XYZ at the new rgb from the interpolated XYZ, */
+		/* corrected by the Jacobian for the change in rgb. */
+		/* The uncertainty is that of the old points, plus an allowance */
+		/* for the curvature between them (greatest mid way), plus an */
+		/* allowance for the Jacobian extrapolation. */
+		{
+			double drgb[3], dXYZ[3];
+
+			icmSub3(drgb, p->s[i].rgb, orgb);
+			icmMulBy3x3(dXYZ, p->s[i].j, drgb);
+			icmAdd3(p->s[i].eXYZ, p->s[i].XYZ, dXYZ);
+
+			p->s[i].unc = b * os[j+1].unc + (1.0 - b) * os[j].unc
+			            + ADAPT_INTERP_UNC * 4.0 * b * (1.0 - b)
+			                * icmXYZLabDE(&x->twN, os[j].XYZ, os[j+1].XYZ)
+			            + ADAPT_JAC_UNC * icmXYZLabDE(&x->twN, p->s[i].XYZ, p->s[i].eXYZ);
+		}
 	}
 
 	free(os);
@@ -1637,6 +1708,7 @@ void usage(int flag, char *diag, ...) {
 	fprintf(stderr," -B blkbright         Set the target black brightness in cd/m^2\n");
 	fprintf(stderr," -e [n]               Run n verify passes on final curves\n");
 	fprintf(stderr," -z                   Run only verify pass on installed calibration curves\n");
+	fprintf(stderr," -s                   Skip re-measuring refinement points predicted to be in threshold\n");
 	fprintf(stderr," -P ho,vo,ss[,vs]     Position test window and scale it\n");
 	fprintf(stderr,"                      ho,vi: 0.0 = left/top, 0.5 = center, 1.0 = right/bottom etc.\n");
 	fprintf(stderr,"                      ss: 0.5 = half, 1.0 = normal, 2.0 = double etc.\n");
@@ -1728,6 +1800,7 @@ int main(int argc, char *argv[]) {
 	int mxits = 3;						/* maximum iterations (medium) */
 	int mxrpts = 12;					/* maximum repeats (medium) */
 	int verify = 0;						/* Do a verify after last refinement, 2 = do only verify. */
+	int adapt = 0;						/* Skip re-measuring well predicted refinement points */
 	int nver = 0;						/* Number of verify passes after refinement */
 	int webdisp = 0;					/* NZ for web display, == port number */
 	int ccdisp = 0;			 			/* NZ for ChromeCast, == list index */
@@ -2055,6 +2128,11 @@ int main(int argc, char *argv[]) {
 					nver = 1;
 				mfa = 0;
 
+			/* Adaptive refinement */
+			} else if (argv[fa][1] == 's') {
+				adapt = 1;
+				mfa = 0;
+
 #if defined(UNIX_X11)
 			} else if (argv[fa][1] == 'n') {
 				override = 0;
@@ -4618,6 +4696,8 @@ int main(int argc, char *argv[]) {
 	     it < (mxits + nver);
 	     rsteps *= 2, errthr /= (it < mxits) ? pow(2.0,THRESH_SCALE_POW) : 1.0, it++) {
 		int totmeas = 0;		/* Total number of measurements in this pass */
+		int totpred = 0;		/* Total number of points predicted rather than measured */
+		double ascale = 1.0;	/* Scale to make prediction uncertainty agree with measurement */
 		col set[3];				/* Variable to read one to three values from the display */
 
 		/* Verify pass ? */
@@ -4692,6 +4772,37 @@ int main(int argc, char *argv[]) {
 			}
 #endif /* ADJ_THRESH */
 
+			/* If adaptive refinement and the point predicted from the previous */
+			/* pass is within the threshold allowing for its uncertainty, */
+			/* use the prediction rather than re-measuring it. */
+			/* (White and black are always measured, as they may set the targets, */
+			/*  and every point is measured on the final refinement pass. Points */
+			/*  near black are always measured too, since a +ve error there is */
+			/*  weighted by up to POWERR_WEIGHT, and the uncertainty isn't.) */
+			if (adapt && it > 0 && it < (mxits-1) && i > 0 && i < (rsteps-1)
+			 && asgrey.s[i].v >= POWERR_THR && asgrey.s[i].unc < 1e5) {
+				double de, peqde, unc;
+
+				de = icmXYZLabDE(&x.twN, asgrey.s[i].tXYZ, asgrey.s[i].eXYZ);
+				peqde = icmXYZLabDE(&x.twN, peqXYZ, asgrey.s[i].eXYZ);
+				unc = ascale * asgrey.s[i].unc;
+
+				if ((de + unc) <= ierrth && (peqde + unc) < ierrth) {
+					icmAry2Ary(asgrey.s[i].XYZ, asgrey.s[i].eXYZ);
+					icmSub3(asgrey.s[i].deXYZ, asgrey.s[i].tXYZ, asgrey.s[i].XYZ);
+					asgrey.s[i]._de = icmXYZLabDE(&x.twN, asgrey.s[i].tXYZ, asgrey.s[i].XYZ);
+					asgrey.s[i].de = de;
+					asgrey.s[i].peqde = peqde;
+					asgrey.s[i].hde = 0.8 * de + 0.2 * peqde;
+					asgrey.s[i].dc = icmLabDE(asgrey.s[i].tXYZ, asgrey.s[i].XYZ);
+					totpred++;
+					if (verb > 1)
+						printf("Point %d DE %f, W.DE %f, Predicted ( < %f with uncertainty %f)\n",
+						        rsteps - i,asgrey.s[i]._de, asgrey.s[i].de, ierrth, unc);
+					continue;
+				}
+			}
+
 			/* Until we meet the necessary accuracy or give up */
 			for (rpt = 0; rpt < mxrpts; rpt++) {
 				double hlew = 1.0;	/* high L* error weight */
@@ -4714,6 +4825,17 @@ int main(int argc, char *argv[]) {
 				icmAry2Ary(asgrey.s[i].pXYZ, asgrey.s[i].XYZ);	/* Remember previous XYZ */
 				icmAry2Ary(asgrey.s[i].XYZ, set[0].XYZ);		/* Transfer current reading */
 
+				/* If adaptive, check the prediction we would have used, and grow */
+				/* the uncertainty scale for the rest of this pass if it was optimistic. */
+				if (adapt && rpt == 0 && it > 0 && it < (mxits-1) && asgrey.s[i].unc < 1e5) {
+					double perr = icmXYZLabDE(&x.twN, asgrey.s[i].eXYZ, asgrey.s[i].XYZ);
+					if (perr > (ascale * asgrey.s[i].unc)) {
+						ascale = perr / asgrey.s[i].unc;
+						if (verb >= 3)
+							printf("Prediction error %f, uncertainty scale now %f\n",perr,ascale);
+					}
+				}
+
 				/* If native white and we've just measured it, */
 				/* and we're not doing a verification, */
 				/* adjust all the other point targets txyz to track the white. */
@@ -5089,6 +5211,7 @@ int main(int argc, char *argv[]) {
 
 				prevde = asgrey.s[i].de;
 			}	/* Next repeat */
+			asgrey.s[i].unc = meas_unc(&x, asgrey.s[i].XYZ);	/* We now have a reading */
 
 			if (verb >= 3) {
 				printf("After adjustment:\n");
@@ -5179,6 +5302,8 @@ int main(int argc, char *argv[]) {
 				if (it < mxits && thrfail)
 					printf("Failed to meet target %f delta E, got worst case %f\n",errthr,failerr);
 				printf("Number of measurements taken = %d\n",totmeas);
+				if (totpred > 0)
+					printf("Number of points predicted without measuring = %d\n",totpred);
 			}
 		}
 
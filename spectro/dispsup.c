@@ -62,6 +62,9 @@
 #define DRIFT_IPERIOD	40	/* [40] Number of samples between drift interpolation measurements */
 #define DRIFT_EPERIOD	20	/* [20] Number of samples between drift extrapolation measurements */
 #define DRIFT_MAXSECS	200	/* [200] Number of seconds to time out previous drift value */
+#define DCACHE_MAXAGE	60	/* [60] Default maximum age of a cached reading in minutes */
+#define DCACHE_MAXDRIFT	0.5	/* [0.5] Default maximum white drift DE to use a cached reading */
+#define DCACHE_RGBTOL	1e-5	/* [1e-5] Test value match tolerance for a cached reading */
 //#define DRIFT_IPERIOD	6	/* Test values */
 //#define DRIFT_EPERIOD	3
 
@@ -458,6 +461,38 @@ static void do_scallout(disprd *p, double *xyz) {
 }
 #endif
 
+/* Return the RGB value to display for a test color. */
+/* If we are doing a soft cal, it is applied to the test color. */
+/* (dispwin will apply any tvenc needed) */
+static void disprd_soft_cal_col(disprd *p, double rgb[3], col *scb) {
+
+	rgb[0] = scb->r;
+	rgb[1] = scb->g;
+	rgb[2] = scb->b;
+
+	if ((p->native & 1) && p->cal[0][0] >= 0.0) {
+		int j;
+		double inputEnt_1 = (double)(p->ncal-1);
+
+		for (j = 0; j < 3; j++) {
+			unsigned int ix;
+			double val, w;
+			val = rgb[j] * inputEnt_1;
+			if (val < 0.0) {
+				val = 0.0;
+			} else if (val > inputEnt_1) {
+				val = inputEnt_1;
+			}
+			ix = (unsigned int)floor(val);		/* Coordinate */
+			if (ix > (p->ncal-2))
+				ix = (p->ncal-2);
+			w = val - (double)ix;		/* weight */
+			val = p->cal[j][ix];
+			rgb[j] = val + w * (p->cal[j][ix+1] - val);
+		}
+	}
+}
+
 /* Take a series of readings from the display - implementation */
 /* Return nz on fail/abort - see dispsup.h */
 /* Use disprd_err() to interpret it */
@@ -607,38 +642,19 @@ static int disprd_read_imp(
 		}
 		a1logd(p->log,1,"About to read patch %d\n",patch);
 
-		rgb[0] = scb->r;
-		rgb[1] = scb->g;
-		rgb[2] = scb->b;
-
-		/* If we are doing a soft cal, apply it to the test color */
-		/* (dispwin will apply any tvenc needed) */
-		if ((p->native & 1) && p->cal[0][0] >= 0.0) {
-			int j;
-			double inputEnt_1 = (double)(p->ncal-1);
-
-			for (j = 0; j < 3; j++) {
-				unsigned int ix;
-				double val, w;
-				val = rgb[j] * inputEnt_1;
-				if (val < 0.0) {
-					val = 0.0;
-				} else if (val > inputEnt_1) {
-					val = inputEnt_1;
-				}
-				ix = (unsigned int)floor(val);		/* Coordinate */
-				if (ix > (p->ncal-2))
-					ix = (p->ncal-2);
-				w = val - (double)ix;		/* weight */
-				val = p->cal[j][ix];
-				rgb[j] = val + w * (p->cal[j][ix+1] - val);
-			}
-		}
+		disprd_soft_cal_col(p, rgb, scb);
 		if ((rv = p->dw->set_color(p->dw, rgb[0], rgb[1], rgb[2])) != 0) {
 			a1logd(p->log,1,"set_color() returned %d\n",rv);
 			return 3;
 		}
 
+		/* Let the display prepare the next patch while we measure this one */
+		if (p->dw->set_next_color != NULL && (patch+1) < npat) {
+			double nrgb[3];
+			disprd_soft_cal_col(p, nrgb, &cols[patch+1]);
+			p->dw->set_next_color(p->dw, nrgb[0], nrgb[1], nrgb[2]);
+		}
+
 		/* Until we give up retrying */
 		for (;;) {
 			val.mtype = inst_mrt_none;
@@ -1221,6 +1237,502 @@ static int disprd_read(
 	return rv;
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Cross-run measurement cache.                                    */
+/*                                                                 */
+/* This is enabled by setting the ARGYLL_MEAS_CACHE environment    */
+/* variable to "filename[,maxage[,maxdrift]]", and lets readings   */
+/* of the same test values be re-used between successive runs of   */
+/* dispcal, dispread etc. on the same display and instrument.      */
+/* Readings are keyed by a hash of the instrument, display,        */
+/* instrument mode, drift compensation and calibration state,      */
+/* including the VideoLUT contents if readings go through it.      */
+/* A cached reading is only used if it is less than maxage minutes */
+/* old and the display white has not drifted by more than maxdrift */
+/* DE since it was taken, in which case it is compensated for the  */
+/* white change in the same way as white drift compensation.       */
+/* (change_drift_comp() only switches the compensation mode and    */
+/* discards the reference readings, so it can't be used to judge a */
+/* reading from a previous run. disprd_read_drift()'s white ratio  */
+/* is applied to the cached reading instead.)                      */
+/* Only readings loaded from the file are served, never ones taken */
+/* in the current run, and reads with a termination key bypass the */
+/* cache. Spectral readings are not cached.                        */
+
+struct _dcentry {
+	unsigned int key;		/* Identity hash */
+	double rgb[3];			/* Test value */
+	double XYZ[3];			/* Reading */
+	double wXYZ[3];			/* Reference white at the time of the reading */
+	int mins;				/* Time of the reading in minutes since the epoch */
+	int loaded;				/* NZ if loaded from the file, rather than read this run */
+}; typedef struct _dcentry dcentry;
+
+struct _dcache {
+	char *fname;			/* Cache file name */
+	double maxage;			/* Maximum age to use in minutes */
+	double maxdrift;		/* Maximum white drift to use in DE */
+	unsigned int key;		/* Our identity hash */
+	int no, _no;			/* Number of entries, allocation */
+	dcentry *e;				/* Entries */
+	int mod;				/* NZ if modified since loading */
+	double wXYZ[3];			/* Last white reading */
+	int w_v;				/* NZ if wXYZ is valid */
+	unsigned int w_msec;	/* msec_time() wXYZ was read at */
+	int nhit, nmeas;		/* Statistics */
+}; typedef struct _dcache dcache;
+
+/* Accumulate a FNV-1a hash */
+static unsigned int dcache_hash(unsigned int h, void *buf, size_t len) {
+	unsigned char *bp = (unsigned char *)buf;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= bp[i];
+		h *= 16777619;
+	}
+	return h;
+}
+
+static unsigned int dcache_hash_str(unsigned int h, char *s) {
+	if (s == NULL)
+		s = "";
+	return dcache_hash(h, s, strlen(s)+1);
+}
+
+static int dcache_minutes() {
+	return (int)(time(NULL)/60);
+}
+
+/* Return a cgats field as a double, whatever type it was read as */
+static double dcache_getd(cgats *icg, int i, int fi) {
+	if (icg->t[0].ftype[fi] == r_t)
+		return *((double *)icg->t[0].fdata[i][fi]);
+	if (icg->t[0].ftype[fi] == i_t)
+		return (double)*((int *)icg->t[0].fdata[i][fi]);
+	return atof((char *)icg->t[0].fdata[i][fi]);
+}
+
+/* Add an entry, replacing any existing reading of the same value. */
+/* Return NZ on malloc failure */
+static int dcache_add(dcache *dc, double rgb[3], double XYZ[3], double wXYZ[3], int mins,
+                      unsigned int key, int loaded) {
+	dcentry *e = NULL;
+	int i;
+
+	for (i = 0; i < dc->no; i++) {
+		if (dc->e[i].key == key
+		 && fabs(dc->e[i].rgb[0] - rgb[0]) <= DCACHE_RGBTOL
+		 && fabs(dc->e[i].rgb[1] - rgb[1]) <= DCACHE_RGBTOL
+		 && fabs(dc->e[i].rgb[2] - rgb[2]) <= DCACHE_RGBTOL) {
+			e = &dc->e[i];
+			break;
+		}
+	}
+	if (e == NULL) {
+		if (dc->no >= dc->_no) {
+			int _no = dc->_no ? 2 * dc->_no : 256;
+			dcentry *ne;
+			if ((ne = (dcentry *)realloc(dc->e, _no * sizeof(dcentry))) == NULL)
+				return 1;
+			dc->e = ne;
+			dc->_no = _no;
+		}
+		e = &dc->e[dc->no++];
+	}
+	e->key = key;
+	icmCpy3(e->rgb, rgb);
+	icmCpy3(e->XYZ, XYZ);
+	icmCpy3(e->wXYZ, wXYZ);
+	e->mins = mins;
+	e->loaded = loaded;
+	return 0;
+}
+
+/* Return the usable cache entry for a test value, NULL if none. */
+/* Only readings from previous runs are used. A value that is read again */
+/* during a run is being re-measured on purpose (ie. dispcal adjustment */
+/* and refinement loops), so those readings are only saved for later runs. */
+static dcentry *dcache_find(dcache *dc, double r, double g, double b) {
+	int i, now = dcache_minutes();
+
+	for (i = 0; i < dc->no; i++) {
+		if (dc->e[i].key == dc->key
+		 && fabs(dc->e[i].rgb[0] - r) <= DCACHE_RGBTOL
+		 && fabs(dc->e[i].rgb[1] - g) <= DCACHE_RGBTOL
+		 && fabs(dc->e[i].rgb[2] - b) <= DCACHE_RGBTOL) {
+			if (!dc->e[i].loaded || (now - dc->e[i].mins) > dc->maxage)
+				return NULL;
+			return &dc->e[i];
+		}
+	}
+	return NULL;
+}
+
+/* Load the cache file, dropping entries too old to be used. */
+/* A missing or unreadable file just gives an empty cache. */
+static void dcache_load(dcache *dc, a1log *log) {
+	cgats *icg;
+	int i, ki, ti, fi[9];
+	int now = dcache_minutes();
+	static char *fnames[9] = { "RGB_R", "RGB_G", "RGB_B", "XYZ_X", "XYZ_Y", "XYZ_Z",
+	                           "WHITE_X", "WHITE_Y", "WHITE_Z" };
+
+	if ((icg = new_cgats()) == NULL)
+		return;
+	icg->add_other(icg, "MCACHE");
+
+	if (icg->read_name(icg, dc->fname)) {
+		a1logd(log, 1, "dcache: no cache loaded from '%s': %s\n",dc->fname,icg->e.m);
+		icg->del(icg);
+		return;
+	}
+	if (icg->ntables < 1 || icg->t[0].tt != tt_other || icg->t[0].oi != 0
+	 || (ki = icg->find_field(icg, 0, "KEY")) < 0
+	 || (ti = icg->find_field(icg, 0, "MINUTES")) < 0) {
+		a1logd(log, 1, "dcache: '%s' isn't a measurement cache file\n",dc->fname);
+		icg->del(icg);
+		return;
+	}
+	for (i = 0; i < 9; i++) {
+		if ((fi[i] = icg->find_field(icg, 0, fnames[i])) < 0) {
+			a1logd(log, 1, "dcache: '%s' is missing field %s\n",dc->fname,fnames[i]);
+			icg->del(icg);
+			return;
+		}
+	}
+
+	for (i = 0; i < icg->t[0].nsets; i++) {
+		double v[9];
+		unsigned int key;
+		int j, mins;
+		char *kp;
+
+		if (icg->t[0].ftype[ki] != cs_t && icg->t[0].ftype[ki] != nqcs_t)
+			continue;
+		kp = (char *)icg->t[0].fdata[i][ki];
+		if (kp[0] != 'K')
+			continue;
+		key = (unsigned int)strtoul(kp+1, NULL, 16);
+		mins = (int)dcache_getd(icg, i, ti);
+		if ((now - mins) > dc->maxage)
+			continue;				/* Too old to be any use */
+		for (j = 0; j < 9; j++)
+			v[j] = dcache_getd(icg, i, fi[j]);
+		if (dcache_add(dc, v, v+3, v+6, mins, key, 1))
+			break;
+	}
+	a1logd(log, 1, "dcache: loaded %d readings from '%s'\n",dc->no,dc->fname);
+	icg->del(icg);
+}
+
+/* Write the cache file back if it has been added to */
+static void dcache_save(dcache *dc, a1log *log) {
+	cgats *ocg;
+	cgats_set_elem setel[11];
+	time_t clk = time(0);
+	struct tm *tsp = localtime(&clk);
+	char *atm = asctime(tsp);	/* Ascii time */
+	char kbuf[20];
+	int i, j;
+
+	if (!dc->mod)
+		return;
+
+	if ((ocg = new_cgats()) == NULL)
+		return;
+	ocg->add_other(ocg, "MCACHE");
+	ocg->add_table(ocg, tt_other, 0);
+	ocg->add_kword(ocg, 0, "DESCRIPTOR", "Argyll display measurement cache",NULL);
+	ocg->add_kword(ocg, 0, "ORIGINATOR", "Argyll dispsup", NULL);
+	atm[strlen(atm)-1] = '\000';	/* Remove \n from end */
+	ocg->add_kword(ocg, 0, "CREATED",atm, NULL);
+
+	ocg->add_field(ocg, 0, "KEY", nqcs_t);
+	ocg->add_field(ocg, 0, "MINUTES", i_t);
+	ocg->add_field(ocg, 0, "RGB_R", r_t);
+	ocg->add_field(ocg, 0, "RGB_G", r_t);
+	ocg->add_field(ocg, 0, "RGB_B", r_t);
+	ocg->add_field(ocg, 0, "XYZ_X", r_t);
+	ocg->add_field(ocg, 0, "XYZ_Y", r_t);
+	ocg->add_field(ocg, 0, "XYZ_Z", r_t);
+	ocg->add_field(ocg, 0, "WHITE_X", r_t);
+	ocg->add_field(ocg, 0, "WHITE_Y", r_t);
+	ocg->add_field(ocg, 0, "WHITE_Z", r_t);
+
+	for (i = 0; i < dc->no; i++) {
+		sprintf(kbuf, "K%08x", dc->e[i].key);
+		setel[0].c = kbuf;
+		setel[1].i = dc->e[i].mins;
+		for (j = 0; j < 3; j++) {
+			setel[2 + j].d = dc->e[i].rgb[j];
+			setel[5 + j].d = dc->e[i].XYZ[j];
+			setel[8 + j].d = dc->e[i].wXYZ[j];
+		}
+		ocg->add_setarr(ocg, 0, setel);
+	}
+
+	if (ocg->write_name(ocg, dc->fname))
+		a1logw(log, "Writing measurement cache '%s' failed: %s\n",dc->fname,ocg->e.m);
+	else
+		a1logd(log, 1, "dcache: saved %d readings to '%s'\n",dc->no,dc->fname);
+	ocg->del(ocg);
+}
+
+static void dcache_del(dcache *dc) {
+	if (dc->e != NULL)
+		free(dc->e);
+	free(dc->fname);
+	free(dc);
+}
+
+/* Return the white that readings are currently relative to. */
+/* This is the drift compensation target white if there is one, */
+/* else a recent white reading, taking one if needed. */
+/* Return nz on read error */
+static int dcache_white(disprd *p, double wXYZ[3], int tc, instClamping clamp) {
+	dcache *dc = p->dc;
+	int rv;
+
+	if (p->wdrift && p->targ_w_v) {
+		icmCpy3(wXYZ, p->targ_w.XYZ);
+		return 0;
+	}
+	if (!dc->w_v || (msec_time() - dc->w_msec) > (DRIFT_MAXSECS * 1000)) {
+		col wc = { 1.0, 1.0, 1.0 };
+
+		a1logd(p->log,2, "dcache: reading white for drift check\n");
+		/* Bypass any drift compensation, since it normalises white */
+		if (p->bdrift || p->wdrift)
+			rv = p->read_imp(p, &wc, 1, 0, 0, 0, tc, clamp, 0);
+		else
+			rv = p->cread(p, &wc, 1, 0, 0, 0, tc, clamp, 0);
+		if (rv != 0)
+			return rv;
+		dc->nmeas++;
+		icmCpy3(dc->wXYZ, wc.XYZ);
+		dc->w_msec = msec_time();
+		dc->w_v = 1;
+	}
+	icmCpy3(wXYZ, dc->wXYZ);
+	return 0;
+}
+
+/* Take a series of readings from the display, using cached */
+/* readings where they are valid. */
+/* Return nz on fail/abort - see dispsup.h */
+static int disprd_cache_read(
+	disprd *p,
+	col *cols,		/* Array of patch colors to be tested */
+	int npat, 		/* Number of patches to be tested */
+	int spat,		/* Start patch index for "verb", 0 if not used */
+	int tpat,		/* Total patch index for "verb", 0 if not used */
+	int acr,		/* If nz, do automatic final carriage return */
+	int tc,			/* If nz, termination key */
+	instClamping clamp,	/* NZ if clamp XYZ/Lab to be +ve */
+	int noinc		/* Ignored */
+) {
+	dcache *dc = p->dc;
+	dcentry **hits;			/* Cache entry for each patch, NULL if to be read */
+	int *mix = NULL;		/* Indexes of the patches to be read */
+	col *mcols = NULL;		/* Patches to be read */
+	int i, j, nmiss = 0;
+	double wXYZ[3];
+	int rv = 0;
+
+	/* A termination key means an interactive loop (ie. dispcal display */
+	/* adjustment) that needs live readings, so don't use or add to the cache. */
+	if (tc != 0)
+		return p->cread(p, cols, npat, spat, tpat, acr, tc, clamp, noinc);
+
+	if ((hits = (dcentry **)calloc(npat, sizeof(dcentry *))) == NULL
+	 || (mix = (int *)malloc(npat * sizeof(int))) == NULL
+	 || (mcols = (col *)malloc(npat * sizeof(col))) == NULL) {
+		free(hits);
+		free(mix);
+		a1logd(p->log,1, "disprd_cache_read: malloc failed\n");
+		return 5;
+	}
+
+	for (i = 0; i < npat; i++)
+		hits[i] = dcache_find(dc, cols[i].r, cols[i].g, cols[i].b);
+
+	/* Check the display white is close enough to that of the cached readings */
+	for (i = 0; i < npat; i++) {
+		if (hits[i] != NULL)
+			break;
+	}
+	if (i < npat) {
+		icmXYZNumber wN;
+
+		if ((rv = dcache_white(p, wXYZ, tc, clamp)) != 0)
+			goto done;
+
+		icmAry2XYZ(wN, wXYZ);
+		for (i = 0; i < npat; i++) {
+			if (hits[i] == NULL)
+				continue;
+			if (icmXYZLabDE(&wN, hits[i]->wXYZ, wXYZ) > dc->maxdrift) {
+				a1logd(p->log,2, "dcache: white drift %f DE too large to use cached reading\n",
+				                        icmXYZLabDE(&wN, hits[i]->wXYZ, wXYZ));
+				hits[i] = NULL;
+			}
+		}
+	}
+
+	/* Read the patches that aren't usefully cached */
+	for (i = 0; i < npat; i++) {
+		if (hits[i] == NULL) {
+			mix[nmiss] = i;
+			mcols[nmiss++] = cols[i];
+		}
+	}
+	if (nmiss > 0) {
+		if ((rv = p->cread(p, mcols, nmiss, spat, tpat, acr, tc, clamp, noinc)) != 0)
+			goto done;
+		dc->nmeas += nmiss;
+
+		/* A white reading can serve as the drift check white */
+		if (!p->wdrift) {
+			for (j = 0; j < nmiss; j++) {
+				if (mcols[j].r == 1.0 && mcols[j].g == 1.0 && mcols[j].b == 1.0) {
+					icmCpy3(dc->wXYZ, mcols[j].XYZ);
+					dc->w_msec = msec_time();
+					dc->w_v = 1;
+				}
+			}
+		}
+
+		/* Spectral readings aren't cached, so don't add these */
+		if (mcols[0].XYZ_v && mcols[0].sp.spec_n == 0) {
+			int now = dcache_minutes();
+
+			if ((rv = dcache_white(p, wXYZ, tc, clamp)) != 0)
+				goto done;
+			for (j = 0; j < nmiss; j++) {
+				double rgb[3];
+				rgb[0] = mcols[j].r;
+				rgb[1] = mcols[j].g;
+				rgb[2] = mcols[j].b;
+				if (dcache_add(dc, rgb, mcols[j].XYZ, wXYZ, now, dc->key, 0) == 0)
+					dc->mod = 1;
+			}
+		}
+		for (j = 0; j < nmiss; j++)
+			cols[mix[j]] = mcols[j];
+	}
+
+	/* Return the cached readings, compensated for any white change */
+	for (i = 0; i < npat; i++) {
+		int e;
+
+		if (hits[i] == NULL)
+			continue;
+		for (e = 0; e < 3; e++)
+			cols[i].XYZ[e] = hits[i]->XYZ[e] * wXYZ[e]/hits[i]->wXYZ[e];
+		if (clamp)
+			icmClamp3(cols[i].XYZ, cols[i].XYZ);
+		cols[i].XYZ_v = 1;
+		cols[i].sp.spec_n = 0;
+		cols[i].duration = 0.0;
+		cols[i].serno = p->serno;
+		dc->nhit++;
+	}
+	if (nmiss == 0 && acr && spat != 0 && tpat != 0 && (spat+npat-1) == tpat)
+		a1logv(p->log, 1, "\n");
+
+  done:;
+	free(mcols);
+	free(mix);
+	free(hits);
+	return rv;
+}
+
+/* Enable the measurement cache if ARGYLL_MEAS_CACHE is set. */
+/* Called once the display, instrument and calibration are set up. */
+static void dcache_setup(disprd *p, disppath *disp, int out_tvenc) {
+	dcache *dc;
+	char *ev, *cp;
+	unsigned int h = 2166136261u;
+	int i, j;
+
+	if ((ev = getenv("ARGYLL_MEAS_CACHE")) == NULL || ev[0] == '\000')
+		return;
+
+	if (p->spectral) {
+		a1logv(p->log, 1, "Measurement cache isn't used for spectral readings\n");
+		return;
+	}
+
+	if ((dc = (dcache *)calloc(1, sizeof(dcache))) == NULL
+	 || (dc->fname = strdup(ev)) == NULL) {
+		free(dc);
+		a1logw(p->log, "Measurement cache malloc failed - not using it\n");
+		return;
+	}
+	dc->maxage = DCACHE_MAXAGE;
+	dc->maxdrift = DCACHE_MAXDRIFT;
+	if ((cp = strchr(dc->fname, ',')) != NULL) {
+		*cp++ = '\000';
+		dc->maxage = atof(cp);
+		if ((cp = strchr(cp, ',')) != NULL)
+			dc->maxdrift = atof(cp+1);
+	}
+
+	/* Hash everything that determines what a reading of a test value will be */
+	if (p->it != NULL) {
+		h = dcache_hash_str(h, inst_name(p->it->get_itype(p->it)));
+		h = dcache_hash_str(h, p->it->get_serial_no(p->it));
+	} else {
+		h = dcache_hash_str(h, "fake");
+		h = dcache_hash_str(h, p->fake_lu != NULL ? p->fake_name : NULL);
+		h = dcache_hash_str(h, p->mcallout);
+		h = dcache_hash(h, &p->xtern, sizeof(int));
+	}
+	if (p->dw != NULL)
+		h = dcache_hash_str(h, p->dw->name);
+	else if (disp != NULL)
+		h = dcache_hash_str(h, disp->name);
+	h = dcache_hash(h, &p->ditype, sizeof(int));
+	h = dcache_hash(h, &p->cbid, sizeof(int));
+	h = dcache_hash(h, &p->tele, sizeof(int));
+	h = dcache_hash(h, &p->ambient, sizeof(int));
+	h = dcache_hash(h, &p->nadaptive, sizeof(int));
+	h = dcache_hash(h, &p->highres, sizeof(int));
+	h = dcache_hash(h, &p->refrate, sizeof(double));
+	h = dcache_hash(h, &p->bdrift, sizeof(int));
+	h = dcache_hash(h, &p->wdrift, sizeof(int));
+	h = dcache_hash(h, &p->native, sizeof(int));
+	h = dcache_hash(h, &out_tvenc, sizeof(int));
+	h = dcache_hash(h, &p->obType, sizeof(icxObserverType));
+	if (p->ccmtx != NULL)
+		h = dcache_hash(h, p->ccmtx, 9 * sizeof(double));
+	h = dcache_hash(h, &p->no_sets, sizeof(int));
+	for (i = 0; i < p->no_sets; i++)
+		h = dcache_hash(h, p->sets[i].spec, p->sets[i].spec_n * sizeof(double));
+	h = dcache_hash(h, &p->ncal, sizeof(int));
+	for (j = 0; j < 3; j++)
+		h = dcache_hash(h, p->cal[j], p->ncal * sizeof(double));
+
+	/* If readings go through the display's VideoLUT, then its contents */
+	/* matter too, whether we set it from cal[] or it was already loaded. */
+	if ((p->native & 1) == 0 && p->dw != NULL && p->dw->r != NULL) {
+		h = dcache_hash(h, &p->dw->r->nent, sizeof(int));
+		for (j = 0; j < 3; j++)
+			h = dcache_hash(h, p->dw->r->v[j], p->dw->r->nent * sizeof(double));
+	}
+	dc->key = h;
+
+	dcache_load(dc, p->log);
+
+	p->dc = dc;
+	p->cread = p->read;
+	p->read = disprd_cache_read;
+
+	a1logv(p->log, 1, "Using measurement cache '%s' (key %08x, max age %.0f minutes, max drift %.2f DE)\n",
+	                     dc->fname, dc->key, dc->maxage, dc->maxdrift);
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* Return the refresh mode and cbid */
 static void disprd_get_disptype(disprd *p, int *refrmode, int *cbid) {
@@ -2187,6 +2699,14 @@ static void disprd_del(disprd *p) {
 		a1logv(p->log, 1, "White drift was %f DE\n",de);
 	}
 
+	if (p->dc != NULL) {
+		a1logv(p->log, 1, "Measurement cache supplied %d readings, %d taken\n",
+		                                          p->dc->nhit, p->dc->nmeas);
+		dcache_save(p->dc, p->log);
+		dcache_del(p->dc);
+		p->dc = NULL;
+	}
+
 	/* The user may remove the instrument */
 	if (p->dw != NULL)
 		printf("The instrument can be removed from the screen.\n");
@@ -2629,6 +3149,7 @@ a1log *log      	/* Verb, debug & error log */
 		}
 
 		if (disp == NULL) {
+			dcache_setup(p, NULL, out_tvenc);
 			a1logd(log,1,"new_disprd returning fake device\n");
 			return p;
 		}
@@ -2945,6 +3466,8 @@ a1log *log      	/* Verb, debug & error log */
 		}
 	}
 
+	dcache_setup(p, disp, out_tvenc);
+
 	a1logd(log,1,"new_disprd succeeded\n");
 	return p;
 }
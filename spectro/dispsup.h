@@ -157,6 +157,7 @@ struct _disprd {
 	col targ_w;   		/* Target white to normalise to. last_bw[1] for batch, first white for */
 						/* non-batch, but latter can be reset. */
 	int targ_w_v;		/* target_w valid flag */
+	struct _dcache *dc;	/* Cross-run measurement cache, NULL if not used */
 
 /* public: */
 
@@ -194,6 +195,19 @@ struct _disprd {
 		int noinc       /* If nz, don't increment the count */
 	);
 
+	/* Read implementation the measurement cache reads through when it */
+	/* is in use - the original value of read. */
+	int (*cread)(struct _disprd *p,
+		col *cols,		/* Array of patch colors to be tested */
+		int npat, 		/* Number of patches to be tested */
+		int spat,		/* Start patch index for "verb", 0 if not used */
+		int tpat,		/* Total patch index for "verb", 0 if not used */
+		int acr,		/* If nz, do automatic final carriage return */
+		int tc,			/* If nz, termination key */
+		instClamping clamp,	/* NZ if clamp XYZ/Lab to be +ve */
+		int noinc       /* Ignored */
+	);
+
 	/* Return the display type information */
 	void (*get_disptype)(struct _disprd *p, int *refrmode, int *cbid);
 
@@ -246,6 +260,8 @@ struct _disprd {
 /* 15 = unknown calibration/display type */
 /* 16 = non based calibration/display type */
 /* Use disprd_err() to interpret errc */
+/* If the ARGYLL_MEAS_CACHE environment variable is set, read() will */
+/* re-use suitable readings from previous runs (see dispsup.c) */
 disprd *new_disprd(
 int *errc,			/* Error code. May be NULL */ 
 icompath *ipath,	/* Instrument path to open, &icomFakeDevice == fake */
@@ -389,6 +389,12 @@ struct _dispwin {
 	/* Return nz on error */
 	int (*set_pinfo)(struct _dispwin *p, int pno, int tno);
 
+	/* Hint the color (values 0.0 - 1.0) that will be set next, so that */
+	/* its patch can be prepared while the current one is being measured. */
+	/* Optional - may be NULL */
+	/* Return nz on error */
+	int (*set_next_color)(struct _dispwin *p, double r, double g, double b);
+
 	/* Set a patch delay and instrument reaction time values. */
 	/* The overall delay between patch change and triggering */
 	/* the instrument is (patch_delay + display_settle - inst_reaction) */
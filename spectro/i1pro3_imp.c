@@ -147,6 +147,8 @@
 
 #define MAXSCANTIME 30.0	/* [30] Maximum scan time in seconds */
 #define SW_THREAD_TIMEOUT	(10 * 60.0) 	/* [10 Min] Switch read thread timeout */
+#define SW_POLL_MSEC 10		/* [10] Switch press poll interval while waiting for trigger */
+#define SW_RING_SIZE 16		/* [16] Switch press ring buffer size */
 
 #undef D_PLOT			/* [und] Use plots to show EE info for -D7 or higher */
 #undef D_STRAYPLOT		/* [und] Use plots to show EE info for -D7 or higher */
@@ -438,6 +440,8 @@ void del_i1pro3imp(i1pro3 *p) {
 			usb_uninit_cancel(&m->sw_cancel);		/* Don't need cancel token now */
 			a1logd(p->log,5,"i1pro3 event thread terminated\n");
 		}
+		if (m->swring != NULL)
+			m->swring->del(m->swring);
 
 		if (m->trig_thread != NULL) {
 			m->trig_thread->del(m->trig_thread);
@@ -928,6 +932,10 @@ i1pro3_code i1pro3_imp_init(i1pro3 *p) {
 		                                  m->capabilities & I1PRO3_CAP_POL ? "Yes" : "No");
 	}
 
+	/* Ring to hand switch presses from the event thread */
+	if ((m->swring = new_aring(SW_RING_SIZE, 0)) == NULL)
+		return I1PRO3_INT_MALLOC;
+
 #ifdef USE_THREAD
 	/* Setup the event monitoring thread */
 	/* (If we start this too early, it wrecks instrument initialization, */
@@ -1802,14 +1810,22 @@ i1pro3_code i1pro3_imp_measure(
 
 #ifdef USE_THREAD
 		{
-			int currcount = m->switch_count;		/* Variable set by thread */
-			while (currcount == m->switch_count) {
+			int i;
+			double lat;
+
+			m->swring->flush(m->swring);		/* Ignore any earlier presses */
+			for (i = 0;; i++) {
 				inst_code rc;
 				int cerr;
 
+				if (m->swring->get(m->swring, NULL, &lat) == 0) {
+					a1logd(p->log,4,"i1pro3_imp_measure: switch hand-off took %.3f msec\n",lat);
+					break;
+				}
+
 				/* Don't trigger on user key if scan, only trigger */
 				/* on instrument event */
-				if (p->uicallback != NULL
+				if ((i % (100/SW_POLL_MSEC)) == 0 && p->uicallback != NULL
 				 && (rc = p->uicallback(p->uic_cntx, inst_armed)) != inst_ok) {
 					if (rc == inst_user_abort) {
 						ev = I1PRO3_USER_ABORT;
@@ -1821,7 +1837,7 @@ i1pro3_code i1pro3_imp_measure(
 						break;						/* Trigger */
 					}
 				}
-				msec_sleep(100);
+				msec_sleep(SW_POLL_MSEC);
 			}
 		}
 #else
@@ -4927,7 +4943,7 @@ int i1pro3_event_thread(void *pp) {
 			continue;
 		}
 		if (ecode == i1pro3_eve_switch_press) {
-			m->switch_count++;
+			m->swring->put(m->swring, NULL);		/* Ignored if full */
 			if (!m->hide_event && p->eventcallback != NULL) {
 				p->eventcallback(p->event_cntx, inst_event_switch);
 			}
@@ -209,7 +209,7 @@ struct _i1pro3imp {
 	/* Misc. and top level */
 	amutex lock;                /* USB control port access lock */
 	athread *th;				/* Switch monitoring thread (NULL if not used) */
-	volatile int switch_count;	/* Switch down count, incremented in thread */
+	aring *swring;				/* Switch presses from thread */
 	volatile int hide_event;	/* Set to supress event event during read */
 	usb_cancelt sw_cancel;		/* Token to allow cancelling event I/O */
 	volatile int th_term;		/* Terminate thread on next return */
@@ -118,12 +118,17 @@
 
 #define MAXSCANTIME 30.0	/* [30] Maximum scan time in seconds */
 #define SW_THREAD_TIMEOUT	(10 * 60.0) 	/* [10 Min] Switch read thread timeout */
+#define SW_POLL_MSEC 10		/* [10] Switch press poll interval while waiting for trigger */
+#define SW_RING_SIZE 16		/* [16] Switch press ring buffer size */
 
 #define SINGLE_READ		/* [Def] Use a single USB read for scan to eliminate latency issues. */
 #define HIGH_RES		/* [Def] Enable high resolution spectral mode code. Disable */
 						/* to break dependency on rspl library. */
 # undef FAST_HIGH_RES_SETUP	/* Slightly better accuracy ? */
 
+#define ABSWAV_BLK 4		/* [4] Readings converted together from raw to wav (loops are unrolled by 4) */
+#define ABSWAV_MINBATCH 2	/* [2] Minimum number of readings to use block conversion for */
+
 /* Debug [Und] */
 #undef DEBUG			/* Turn on debug printfs */
 #undef PLOT_DEBUG		/* Use plot to show readings & processing */
@@ -143,6 +148,7 @@
 #undef HIGH_RES_PLOT_STRAYL
 #undef ANALIZE_EXISTING		/* Analize the manufacturers existing filter shape */
 #undef PLOT_BLACK_SUBTRACT	/* Plot temperature corrected black subtraction */
+#undef CHECK_BATCHWAV		/* Check block raw to wav conversion against per reading conversion */
 #undef FAKE_AMBIENT		/* Fake the ambient mode for a Rev A */
 #undef FAKE_EEPROM				/* Get EEPROM data from i1pro_fake_eeprom.h */
 
@@ -405,6 +411,8 @@ void del_i1proimp(i1pro *p) {
 			usb_uninit_cancel(&m->rd_sync);			/* Don't need sync token now */
 			a1logd(p->log,5,"i1pro switch thread terminated\n");
 		}
+		if (m->swring != NULL)
+			m->swring->del(m->swring);
 
 		if (m->trig_thread != NULL) {
 			m->trig_thread->del(m->trig_thread);
@@ -520,6 +528,10 @@ i1pro_code i1pro_imp_init(i1pro *p) {
 	usb_init_cancel(&m->sw_cancel);			/* Init switch cancel token */
 	usb_init_cancel(&m->rd_sync);			/* Init reading sync token */
 
+	/* Ring to hand switch presses from the switch thread */
+	if ((m->swring = new_aring(SW_RING_SIZE, 0)) == NULL)
+		return I1PRO_INT_MALLOC;
+
 #ifdef USE_THREAD
 	/* Setup the switch monitoring thread */
 	if ((m->th = new_athread(i1pro_switch_thread, (void *)p)) == NULL)
@@ -2963,14 +2975,22 @@ i1pro_code i1pro_imp_measure(
 
 #ifdef USE_THREAD
 		{
-			int currcount = m->switch_count;		/* Variable set by thread */
-			while (currcount == m->switch_count) {
+			int i;
+			double lat;
+
+			m->swring->flush(m->swring);		/* Ignore any earlier presses */
+			for (i = 0;; i++) {
 				inst_code rc;
 				int cerr;
 
+				if (m->swring->get(m->swring, NULL, &lat) == 0) {
+					a1logd(p->log,4,"i1pro_imp_measure: switch hand-off took %.3f msec\n",lat);
+					break;
+				}
+
 				/* Don't trigger on user key if scan, only trigger */
 				/* on instrument switch */
-				if (p->uicallback != NULL
+				if ((i % (100/SW_POLL_MSEC)) == 0 && p->uicallback != NULL
 				 && (rc = p->uicallback(p->uic_cntx, inst_armed)) != inst_ok) {
 					if (rc == inst_user_abort) {
 						ev = I1PRO_USER_ABORT;
@@ -2982,7 +3002,7 @@ i1pro_code i1pro_imp_measure(
 						break;						/* Trigger */
 					}
 				}
-				msec_sleep(100);
+				msec_sleep(SW_POLL_MSEC);
 			}
 		}
 #else
@@ -6219,6 +6239,7 @@ i1pro_code i1pro_sens_to_absraw(
 	double scale;		/* Absolute scale value */
 	int sskip = 0;		/* Bytes to skip at start */
 	int eskip = 0;		/* Bytes to skip at end */
+	int pdeb = (p->log->debug >= 9);	/* Log every sensor value */
 
 	if (gainmode) {
 		gain = m->highgain;
@@ -6270,14 +6291,13 @@ i1pro_code i1pro_sens_to_absraw(
 		
 			for (bp += sskip, j = 0; j < m->nraw; j++, bp += 2) {
 				rval = buf2ushort(bp);
-				a1logd(p->log,9,"% 3d:rval 0x%x, ",j, rval);
-				a1logd(p->log,9,"srval 0x%x, ",rval);
 				fval = (double)(int)rval;
-				a1logd(p->log,9,"fval %.0f, ",fval);
 
 				/* And scale to be an absolute sensor reading */
 				absraw[i][j] = fval * scale;
-				a1logd(p->log,9,"absval %.1f\n",fval * scale);
+				if (pdeb)
+					a1logd(p->log,9,"% 3d:rval 0x%x, fval %.0f, absval %.1f\n",
+					                                      j, rval, fval, fval * scale);
 			}
 		}
 		darkthresh /= ndarkthresh;
@@ -6318,14 +6338,12 @@ i1pro_code i1pro_sens_to_absraw(
 				double fval, lval;
 
 				rval = buf2ushort(bp);
-				a1logd(p->log,9,"% 3d:rval 0x%x, ",j, rval);
+				if (pdeb)
+					a1logd(p->log,9,"% 3d:rval 0x%x, ",j, rval);
 				if (rval >= maxpve)
 					rval -= 0x00010000;	/* Convert to -ve */
-				a1logd(p->log,9,"srval 0x%x, ",rval);
 				fval = (double)(int)rval;
-				a1logd(p->log,9,"fval %.0f, ",fval);
 				fval -= avlastv;
-				a1logd(p->log,9,"fval-av %.0f, ",fval);
 
 #ifdef ENABLE_NONLINCOR	
 				/* Linearise */
@@ -6334,11 +6352,11 @@ i1pro_code i1pro_sens_to_absraw(
 #else
 				lval = fval;
 #endif
-				a1logd(p->log,9,"lval %.1f, ",lval);
-
 				/* And scale to be an absolute sensor reading */
 				absraw[i][j] = lval * scale;
-				a1logd(p->log,9,"absval %.1f\n",lval * scale);
+				if (pdeb)
+					a1logd(p->log,9,"srval 0x%x, fval-av %.0f, lval %.1f, absval %.1f\n",
+					                                        rval, fval, lval, lval * scale);
 				// a1logd(p->log,3,"Meas %d band %d raw = %f\n",i,j,fval);
 			}
 
@@ -7575,9 +7593,9 @@ void i1pro_sub_absraw(
 	}
 }
 
-/* Convert an absraw array from raw wavelengths to output wavelenths */
-/* for a given [std res, high res] and [emis/tras, reflective] mode */
-void i1pro_absraw_to_abswav(
+/* Convert an absraw array from raw wavelengths to output wavelenths, */
+/* one reading at a time. */
+static void i1pro_absraw_to_abswav_1(
 	i1pro *p,
 	int highres,			/* 0 for std res, 1 for high res */ 
 	int refl,				/* 0 for emis/trans, 1 for reflective */ 
@@ -7626,6 +7644,142 @@ void i1pro_absraw_to_abswav(
 	free_dvector(tm, 0, m->nwav[highres]-1);
 }
 
+/* Convert a block of up to ABSWAV_BLK readings from raw wavelengths */
+/* to output wavelengths. The readings are transposed into [band][reading] */
+/* order, so that the inner loops run over a fixed number of contiguous */
+/* readings, and each resampling and stray light matrix value is loaded */
+/* once per block rather than once per reading. The summation order */
+/* for each reading is the same as i1pro_absraw_to_abswav_1(). */
+static void i1pro_absraw_to_abswav_blk(
+	i1pro *p,
+	int highres,			/* 0 for std res, 1 for high res */ 
+	int refl,				/* 0 for emis/trans, 1 for reflective */ 
+	int nb,					/* Number of readings in block, <= ABSWAV_BLK */
+	double **abswav,		/* Desination array [nb][nwav] */
+	double **absraw,		/* Source array [nb][-1 nraw] */
+	double *rt,				/* Temporary [nraw * ABSWAV_BLK] */
+	double *tm				/* Temporary [nwav * ABSWAV_BLK] */
+) {
+	i1proimp *m = (i1proimp *)p->m;
+	i1pro_r2wtab *mtx = &m->mtx[highres][refl];
+	int nwav = m->nwav[highres];
+	int b, j, k, cx, sx;
+
+	/* Transpose the raw values, padding out the block with zero readings */
+	for (b = 0; b < nb; b++) {
+		double *ar = absraw[b];
+		for (j = 0; j < m->nraw; j++)
+			rt[j * ABSWAV_BLK + b] = ar[j];
+	}
+	for (; b < ABSWAV_BLK; b++) {
+		for (j = 0; j < m->nraw; j++)
+			rt[j * ABSWAV_BLK + b] = 0.0;
+	}
+
+	/* For each output wavelength */
+	for (cx = j = 0; j < nwav; j++) {
+		double o0 = 0.0, o1 = 0.0, o2 = 0.0, o3 = 0.0;
+
+		/* For each matrix value */
+		sx = mtx->index[j];		/* Starting index */
+		for (k = 0; k < mtx->nocoef[j]; k++, cx++, sx++) {
+			double cv = mtx->coef[cx];
+			double *iv = rt + sx * ABSWAV_BLK;
+
+			o0 += cv * iv[0];
+			o1 += cv * iv[1];
+			o2 += cv * iv[2];
+			o3 += cv * iv[3];
+		}
+		tm[j * ABSWAV_BLK + 0] = o0;
+		tm[j * ABSWAV_BLK + 1] = o1;
+		tm[j * ABSWAV_BLK + 2] = o2;
+		tm[j * ABSWAV_BLK + 3] = o3;
+	}
+
+	if (p->dtype == instI1Pro2) {
+		/* Now apply stray light compensation */ 
+		/* For each output wavelength */
+		for (j = 0; j < nwav; j++) {
+			double *slj = m->straylight[highres][j];
+			double o0 = 0.0, o1 = 0.0, o2 = 0.0, o3 = 0.0;
+
+			/* For each matrix value */
+			for (k = 0; k < nwav; k++) {
+				double sv = slj[k];
+				double *iv = tm + k * ABSWAV_BLK;
+
+				o0 += sv * iv[0];
+				o1 += sv * iv[1];
+				o2 += sv * iv[2];
+				o3 += sv * iv[3];
+			}
+			abswav[0][j] = o0;
+			if (nb > 1) abswav[1][j] = o1;
+			if (nb > 2) abswav[2][j] = o2;
+			if (nb > 3) abswav[3][j] = o3;
+		}
+	} else {
+		for (j = 0; j < nwav; j++) {
+			for (b = 0; b < nb; b++)
+				abswav[b][j] = tm[j * ABSWAV_BLK + b];
+		}
+	}
+}
+
+/* Convert an absraw array from raw wavelengths to output wavelenths */
+/* for a given [std res, high res] and [emis/tras, reflective] mode */
+/* (A scan returns many readings, so these are converted in blocks.) */
+void i1pro_absraw_to_abswav(
+	i1pro *p,
+	int highres,			/* 0 for std res, 1 for high res */ 
+	int refl,				/* 0 for emis/trans, 1 for reflective */ 
+	int nummeas,			/* Return number of readings measured */
+	double **abswav,		/* Desination array [nwav] */
+	double **absraw			/* Source array [-1 nraw] */
+) {
+	i1proimp *m = (i1proimp *)p->m;
+	double *rt, *tm;	/* Temporary block arrays */
+	int i;
+
+	if (nummeas < ABSWAV_MINBATCH) {
+		i1pro_absraw_to_abswav_1(p, highres, refl, nummeas, abswav, absraw);
+		return;
+	}
+
+	rt = dvector(0, m->nraw * ABSWAV_BLK-1);
+	tm = dvector(0, m->nwav[highres] * ABSWAV_BLK-1);
+
+	for (i = 0; i < nummeas; i += ABSWAV_BLK) {
+		int nb = nummeas - i;
+		if (nb > ABSWAV_BLK)
+			nb = ABSWAV_BLK;
+		i1pro_absraw_to_abswav_blk(p, highres, refl, nb, abswav + i, absraw + i, rt, tm);
+	}
+
+	free_dvector(tm, 0, m->nwav[highres] * ABSWAV_BLK-1);
+	free_dvector(rt, 0, m->nraw * ABSWAV_BLK-1);
+
+#ifdef CHECK_BATCHWAV
+	{
+		double **chwav, mxd = 0.0;
+		int j;
+
+		chwav = dmatrix(0, nummeas-1, 0, m->nwav[highres]-1);
+		i1pro_absraw_to_abswav_1(p, highres, refl, nummeas, chwav, absraw);
+		for (i = 0; i < nummeas; i++) {
+			for (j = 0; j < m->nwav[highres]; j++) {
+				double tt = fabs(chwav[i][j] - abswav[i][j]);
+				if (tt > mxd)
+					mxd = tt;
+			}
+		}
+		free_dmatrix(chwav, 0, nummeas-1, 0, m->nwav[highres]-1);
+		a1logd(p->log,1,"i1pro_absraw_to_abswav: %d readings, max block difference %e\n",nummeas,mxd);
+	}
+#endif /* CHECK_BATCHWAV */
+}
+
 /* Convert an abswav array of output wavelengths to scaled output readings. */
 void i1pro_scale_specrd(
 	i1pro *p,
@@ -10969,7 +11123,7 @@ int i1pro_switch_thread(void *pp) {
 			a1logd(p->log,3,"Switch thread failed with 0x%x\n",rv);
 			continue;
 		}
-		m->switch_count++;
+		m->swring->put(m->swring, NULL);		/* Ignored if full */
 		if (!m->hide_switch && p->eventcallback != NULL) {
 			p->eventcallback(p->event_cntx, inst_event_switch);
 		}
@@ -13340,3 +13494,123 @@ static i1data *new_i1data(i1proimp *m) {
 }
 
 /* ----------------------------------------------------------------- */
+
+#ifdef STANDALONE_TEST
+/* Test the block raw to wav conversion against the per reading */
+/* conversion, using synthetic filter, stray light and absraw values. */
+
+/* Convert nummeas readings both ways, and return the largest difference */
+static double check_abswav(i1pro *p, int highres, int refl, int nummeas, double **absraw) {
+	i1proimp *m = (i1proimp *)p->m;
+	double **w1, **wb, mxd = 0.0;
+	int i, j;
+
+	w1 = dmatrix(0, nummeas-1, 0, m->nwav[highres]-1);
+	wb = dmatrix(0, nummeas-1, 0, m->nwav[highres]-1);
+
+	i1pro_absraw_to_abswav_1(p, highres, refl, nummeas, w1, absraw);
+	i1pro_absraw_to_abswav(p, highres, refl, nummeas, wb, absraw);
+
+	for (i = 0; i < nummeas; i++) {
+		for (j = 0; j < m->nwav[highres]; j++) {
+			double tt = fabs(w1[i][j] - wb[i][j]);
+			if (tt > mxd)
+				mxd = tt;
+		}
+	}
+	free_dmatrix(wb, 0, nummeas-1, 0, m->nwav[highres]-1);
+	free_dmatrix(w1, 0, nummeas-1, 0, m->nwav[highres]-1);
+
+	return mxd;
+}
+
+int main(int argc, char *argv[]) {
+	i1pro _p, *p = &_p;
+	i1proimp _m, *m = &_m;
+	int ncoef = 6;			/* Maximum coefficients per wavelength */
+	int maxmeas = 1003;		/* Largest number of readings tested */
+	double **absraw;
+	double mxd = 0.0;
+	int dt, hr, rf, nm, i, j, k;
+
+	memset(p, 0, sizeof(i1pro));
+	memset(m, 0, sizeof(i1proimp));
+	p->m = (void *)m;
+	p->log = new_a1log(NULL, 0, 0, NULL, NULL, NULL, NULL);
+
+	m->nraw = 128;
+	m->nwav[0] = 36;
+	m->nwav[1] = 107;
+
+	/* Synthetic filter and stray light tables */
+	for (hr = 0; hr < 2; hr++) {
+		int nwav = m->nwav[hr];
+
+		for (rf = 0; rf < 2; rf++) {
+			i1pro_r2wtab *mtx = &m->mtx[hr][rf];
+
+			mtx->index = ivector(0, nwav-1);
+			mtx->nocoef = ivector(0, nwav-1);
+			mtx->coef = dvector(0, nwav * ncoef-1);
+			for (j = 0; j < nwav; j++) {
+				mtx->index[j] = (int)(j * (m->nraw - ncoef)/(double)nwav);
+				mtx->nocoef[j] = ncoef - (j + rf) % 3;
+			}
+			for (j = 0; j < nwav * ncoef; j++)
+				mtx->coef[j] = d_rand(-0.2, 1.0);
+		}
+		m->straylight[hr] = dmatrix(0, nwav-1, 0, nwav-1);
+		for (j = 0; j < nwav; j++) {
+			for (k = 0; k < nwav; k++)
+				m->straylight[hr][j][k] = (j == k ? 1.0 : 0.0) + d_rand(-0.01, 0.01);
+		}
+	}
+
+	absraw = dmatrix(0, maxmeas-1, -1, m->nraw-1);
+	for (i = 0; i < maxmeas; i++) {
+		for (j = -1; j < m->nraw; j++)
+			absraw[i][j] = d_rand(-10.0, 1000.0);
+	}
+
+	/* Check every partial block size, and a long scan */
+	for (dt = 0; dt < 2; dt++) {
+		p->dtype = dt ? instI1Pro2 : instI1Pro;
+		for (hr = 0; hr < 2; hr++) {
+			for (rf = 0; rf < 2; rf++) {
+				for (nm = 1; nm <= maxmeas; nm++) {
+					double tt;
+
+					if (nm > (2 * ABSWAV_BLK + 3))
+						nm = maxmeas;
+					tt = check_abswav(p, hr, rf, nm, absraw);
+					if (tt > mxd)
+						mxd = tt;
+					if (tt > 1e-9) {
+						printf("%s highres %d refl %d nummeas %d: max difference %e\n",
+						       dt ? "i1pro2" : "i1pro", hr, rf, nm, tt);
+					}
+				}
+			}
+		}
+	}
+
+	free_dmatrix(absraw, 0, maxmeas-1, -1, m->nraw-1);
+	for (hr = 0; hr < 2; hr++) {
+		for (rf = 0; rf < 2; rf++) {
+			free_ivector(m->mtx[hr][rf].index, 0, m->nwav[hr]-1);
+			free_ivector(m->mtx[hr][rf].nocoef, 0, m->nwav[hr]-1);
+			free_dvector(m->mtx[hr][rf].coef, 0, m->nwav[hr] * ncoef-1);
+		}
+		free_dmatrix(m->straylight[hr], 0, m->nwav[hr]-1, 0, m->nwav[hr]-1);
+	}
+	p->log = del_a1log(p->log);
+
+	if (mxd > 1e-9) {
+		printf("Block raw to wav conversion FAILED, max difference %e\n",mxd);
+		return 1;
+	}
+	printf("Block raw to wav conversion OK, max difference %e\n",mxd);
+	return 0;
+}
+
+#endif /* STANDALONE_TEST */
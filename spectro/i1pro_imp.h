@@ -172,7 +172,7 @@ struct _i1proimp {
 	/* Misc. and top level */
 	struct _i1data *data;		/* EEProm data container */
 	athread *th;				/* Switch monitoring thread (NULL if not used) */
-	volatile int switch_count;	/* Incremented in thread */
+	aring *swring;				/* Switch presses from thread */
 	volatile int hide_switch;	/* Set to supress switch event during read */
 	usb_cancelt sw_cancel;		/* Token to allow cancelling switch I/O */
 	volatile int th_term;		/* Terminate thread on next return */
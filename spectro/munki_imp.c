@@ -88,6 +88,8 @@
 #define WCALTOUT (24 * 60 * 60)		/* [24 Hrs] White Calibration timeout in seconds */
 #define MAXSCANTIME 20.0	/* [20 Sec] Maximum scan time in seconds */
 #define SW_THREAD_TIMEOUT (10 * 60.0) 	/* [10 Min] Switch read thread timeout */
+#define SW_POLL_MSEC 10		/* [10] Switch press poll interval while waiting for trigger */
+#define SW_RING_SIZE 16		/* [16] Switch and spos event ring buffer size */
 
 #define SINGLE_READ		/* [Def] Use a single USB read for scan to eliminate latency issues. */
 #define HIGH_RES		/* [Def] Enable high resolution spectral mode code. Disable */
@@ -115,6 +117,7 @@
 #undef HIGH_RES_PLOT
 #undef HIGH_RES_PLOT_STRAYL		/* Plot stray light upsample */
 #undef FAKE_EEPROM				/* Get [und] EEPROM data from munki_fake_eeprom.h */
+#undef CHECK_BATCHWAV			/* Check block raw to wav conversion against per reading conversion */
 
 #define DISP_INTT 0.7			/* Seconds per reading in display spot mode */
 								/* More improves repeatability in dark colors, but limits */
@@ -136,6 +139,9 @@
 
 #define NSEN_MAX 140            /* Maximum nsen/raw value we can cope with */
 
+#define ABSWAV_BLK 4			/* [4] Readings converted together from raw to wav (loops are unrolled by 4) */
+#define ABSWAV_MINBATCH 2		/* [2] Minimum number of readings to use block conversion for */
+
 /* Wavelength to start duplicating values below, because it is too noisy */
 #define WL_REF_MIN 420.0
 #define WL_EMIS_MIN 400.0
@@ -336,6 +342,10 @@ void del_munkiimp(munki *p) {
 			m->spos_th->del(m->spos_th);
 		}
 #endif
+		if (m->swring != NULL)
+			m->swring->del(m->swring);
+		if (m->sposring != NULL)
+			m->sposring->del(m->sposring);
 
 		/* Free any per mode data */
 		for (i = 0; i < mk_no_modes; i++) {
@@ -594,6 +604,11 @@ munki_code munki_imp_init(munki *p) {
 	free(calbuf);
 	calbuf = NULL;
 
+	/* Rings to hand switch and spos events from the switch thread */
+	if ((m->swring = new_aring(SW_RING_SIZE, 0)) == NULL
+	 || (m->sposring = new_aring(SW_RING_SIZE, sizeof(unsigned int))) == NULL)
+		return MUNKI_INT_MALLOC;
+
 #ifdef USE_THREAD
 	/* Setup the switch monitoring thread */
 	usb_init_cancel(&m->sw_cancel);			/* Get cancel token ready */
@@ -2056,14 +2071,22 @@ munki_code munki_imp_measure(
 
 #ifdef USE_THREAD
 		{
-			int currcount = m->switch_count;		/* Variable set by thread */
-			while (currcount == m->switch_count) {
+			int i;
+			double lat;
+
+			m->swring->flush(m->swring);		/* Ignore any earlier presses */
+			for (i = 0;; i++) {
 				inst_code rc;
 				int cerr;
+
+				if (m->swring->get(m->swring, NULL, &lat) == 0) {
+					a1logd(p->log,4,"munki_imp_measure: switch hand-off took %.3f msec\n",lat);
+					break;
+				}
 	
 				/* Don't trigger on user key if scan, only trigger */
 				/* on instrument switch */
-				if (p->uicallback != NULL
+				if ((i % (100/SW_POLL_MSEC)) == 0 && p->uicallback != NULL
 				 && (rc = p->uicallback(p->uic_cntx, inst_armed)) != inst_ok) {
 					if (rc == inst_user_abort) {
 						ev = MUNKI_USER_ABORT;
@@ -2075,7 +2098,7 @@ munki_code munki_imp_measure(
 						break;						/* Trigger */
 					}
 				}
-				msec_sleep(100);
+				msec_sleep(SW_POLL_MSEC);
 			}
 		}
 #else
@@ -6114,101 +6137,200 @@ munki_code munki_extract_patches_flash(
 }
 
 /* Convert an absraw array from raw wavelengths to output wavelenths */
-/* for the current resolution. Apply stray light compensation too. */
-void munki_absraw_to_abswav(
-	munki *p,
+/* using the given filter and stray light tables, one reading at a time. */
+static void munki_absraw_to_abswav_1(
+	int nwav,				/* Number of output wavelengths */
+	int *mtx_index,			/* [nwav] Matrix CCD sample starting index */
+	int *mtx_nocoef,		/* [nwav] Number of matrix cooeficients */
+	double *mtx_coef,		/* Matrix cooeficients */
+	double **straylight,	/* [nwav][nwav] Stray light convolution matrix */
 	int nummeas,			/* Return number of readings measured */
 	double **abswav,		/* Desination array [nwav] */
 	double **absraw			/* Source array [-1 nraw] */
 ) {
-	munkiimp *m = (munkiimp *)p->m;
-	munki_state *s = &m->ms[m->mmode];
 	double *tm;			/* Temporary array */
 	int i, j, k, cx, sx;
 	
-	tm = dvector(0, m->nwav-1);
+	tm = dvector(0, nwav-1);
 
 	/* For each measurement */
 	for (i = 0; i < nummeas; i++) {
 
 		/* For each output wavelength */
-		for (cx = j = 0; j < m->nwav; j++) {
+		for (cx = j = 0; j < nwav; j++) {
 			double oval = 0.0;
 	
 			/* For each matrix value */
-			if (s->reflective) {
-				sx = m->rmtx_index[j];		/* Starting index */
-				for (k = 0; k < m->rmtx_nocoef[j]; k++, cx++, sx++)
-					oval += m->rmtx_coef[cx] * absraw[i][sx];
-			} else {
-				sx = m->emtx_index[j];		/* Starting index */
-				for (k = 0; k < m->emtx_nocoef[j]; k++, cx++, sx++)
-					oval += m->emtx_coef[cx] * absraw[i][sx];
-			}
+			sx = mtx_index[j];		/* Starting index */
+			for (k = 0; k < mtx_nocoef[j]; k++, cx++, sx++)
+				oval += mtx_coef[cx] * absraw[i][sx];
 			tm[j] = oval;
 		}
 
 		/* Now apply stray light compensation */ 
 		/* For each output wavelength */
-		for (j = 0; j < m->nwav; j++) {
+		for (j = 0; j < nwav; j++) {
 			double oval = 0.0;
 	
 			/* For each matrix value */
-			for (k = 0; k < m->nwav; k++)
-				oval += m->straylight[j][k] * tm[k];
+			for (k = 0; k < nwav; k++)
+				oval += straylight[j][k] * tm[k];
 			abswav[i][j] = oval;
 		}
 	}
-	free_dvector(tm, 0, m->nwav-1);
+	free_dvector(tm, 0, nwav-1);
 }
 
 /* Convert an absraw array from raw wavelengths to output wavelenths */
-/* for the standard resolution. Apply stray light compensation too. */
-void munki_absraw_to_abswav1(
+/* using the given filter and stray light tables. */
+/* Readings are converted in blocks of ABSWAV_BLK, transposed into */
+/* [band][reading] order so that the inner loops run over a fixed number */
+/* of contiguous readings, and each matrix value is loaded once per block. */
+/* The summation order for each reading is the same as munki_absraw_to_abswav_1(). */
+static void munki_absraw_to_abswav_x(
 	munki *p,
+	int nwav,				/* Number of output wavelengths */
+	int *mtx_index,			/* [nwav] Matrix CCD sample starting index */
+	int *mtx_nocoef,		/* [nwav] Number of matrix cooeficients */
+	double *mtx_coef,		/* Matrix cooeficients */
+	double **straylight,	/* [nwav][nwav] Stray light convolution matrix */
 	int nummeas,			/* Return number of readings measured */
-	double **abswav,		/* Desination array [nwav1] */
-	double **absraw		/* Source array [-1 nraw] */
+	double **abswav,		/* Desination array [nwav] */
+	double **absraw			/* Source array [-1 nraw] */
 ) {
 	munkiimp *m = (munkiimp *)p->m;
-	munki_state *s = &m->ms[m->mmode];
-	double *tm;			/* Temporary array */
-	int i, j, k, cx, sx;
-	
-	tm = dvector(0, m->nwav1-1);
+	double *rt;			/* Transposed raw block [nraw][ABSWAV_BLK] */
+	double *tm;			/* Transposed wav block [nwav][ABSWAV_BLK] */
+	int i, b, j, k, cx, sx;
 
-	/* For each measurement */
-	for (i = 0; i < nummeas; i++) {
+	if (nummeas < ABSWAV_MINBATCH) {
+		munki_absraw_to_abswav_1(nwav, mtx_index, mtx_nocoef, mtx_coef, straylight,
+		                         nummeas, abswav, absraw);
+		return;
+	}
+
+	rt = dvector(0, m->nraw * ABSWAV_BLK-1);
+	tm = dvector(0, nwav * ABSWAV_BLK-1);
+
+	for (i = 0; i < nummeas; i += ABSWAV_BLK) {
+		int nb = nummeas - i;
+		if (nb > ABSWAV_BLK)
+			nb = ABSWAV_BLK;
+
+		/* Transpose the raw values, padding out the block with zero readings */
+		for (b = 0; b < nb; b++) {
+			double *ar = absraw[i + b];
+			for (j = 0; j < m->nraw; j++)
+				rt[j * ABSWAV_BLK + b] = ar[j];
+		}
+		for (; b < ABSWAV_BLK; b++) {
+			for (j = 0; j < m->nraw; j++)
+				rt[j * ABSWAV_BLK + b] = 0.0;
+		}
 
 		/* For each output wavelength */
-		for (cx = j = 0; j < m->nwav1; j++) {
-			double oval = 0.0;
+		for (cx = j = 0; j < nwav; j++) {
+			double o0 = 0.0, o1 = 0.0, o2 = 0.0, o3 = 0.0;
 	
 			/* For each matrix value */
-			if (s->reflective) {
-				sx = m->rmtx_index1[j];		/* Starting index */
-				for (k = 0; k < m->rmtx_nocoef1[j]; k++, cx++, sx++)
-					oval += m->rmtx_coef1[cx] * absraw[i][sx];
-			} else {
-				sx = m->emtx_index1[j];		/* Starting index */
-				for (k = 0; k < m->emtx_nocoef1[j]; k++, cx++, sx++)
-					oval += m->emtx_coef1[cx] * absraw[i][sx];
+			sx = mtx_index[j];		/* Starting index */
+			for (k = 0; k < mtx_nocoef[j]; k++, cx++, sx++) {
+				double cv = mtx_coef[cx];
+				double *iv = rt + sx * ABSWAV_BLK;
+
+				o0 += cv * iv[0];
+				o1 += cv * iv[1];
+				o2 += cv * iv[2];
+				o3 += cv * iv[3];
 			}
-			tm[j] = oval;
+			tm[j * ABSWAV_BLK + 0] = o0;
+			tm[j * ABSWAV_BLK + 1] = o1;
+			tm[j * ABSWAV_BLK + 2] = o2;
+			tm[j * ABSWAV_BLK + 3] = o3;
 		}
 
 		/* Now apply stray light compensation */ 
 		/* For each output wavelength */
-		for (j = 0; j < m->nwav1; j++) {
-			double oval = 0.0;
+		for (j = 0; j < nwav; j++) {
+			double *slj = straylight[j];
+			double o0 = 0.0, o1 = 0.0, o2 = 0.0, o3 = 0.0;
 	
 			/* For each matrix value */
-			for (k = 0; k < m->nwav1; k++)
-				oval += m->straylight1[j][k] * tm[k];
-			abswav[i][j] = oval;
+			for (k = 0; k < nwav; k++) {
+				double sv = slj[k];
+				double *iv = tm + k * ABSWAV_BLK;
+
+				o0 += sv * iv[0];
+				o1 += sv * iv[1];
+				o2 += sv * iv[2];
+				o3 += sv * iv[3];
+			}
+			abswav[i][j] = o0;
+			if (nb > 1) abswav[i + 1][j] = o1;
+			if (nb > 2) abswav[i + 2][j] = o2;
+			if (nb > 3) abswav[i + 3][j] = o3;
 		}
 	}
-	free_dvector(tm, 0, m->nwav1-1);
+
+	free_dvector(tm, 0, nwav * ABSWAV_BLK-1);
+	free_dvector(rt, 0, m->nraw * ABSWAV_BLK-1);
+
+#ifdef CHECK_BATCHWAV
+	{
+		double **chwav, mxd = 0.0;
+
+		chwav = dmatrix(0, nummeas-1, 0, nwav-1);
+		munki_absraw_to_abswav_1(nwav, mtx_index, mtx_nocoef, mtx_coef, straylight,
+		                         nummeas, chwav, absraw);
+		for (i = 0; i < nummeas; i++) {
+			for (j = 0; j < nwav; j++) {
+				double tt = fabs(chwav[i][j] - abswav[i][j]);
+				if (tt > mxd)
+					mxd = tt;
+			}
+		}
+		free_dmatrix(chwav, 0, nummeas-1, 0, nwav-1);
+		a1logd(p->log,1,"munki_absraw_to_abswav: %d readings, max block difference %e\n",nummeas,mxd);
+	}
+#endif /* CHECK_BATCHWAV */
+}
+
+/* Convert an absraw array from raw wavelengths to output wavelenths */
+/* for the current resolution. Apply stray light compensation too. */
+void munki_absraw_to_abswav(
+	munki *p,
+	int nummeas,			/* Return number of readings measured */
+	double **abswav,		/* Desination array [nwav] */
+	double **absraw			/* Source array [-1 nraw] */
+) {
+	munkiimp *m = (munkiimp *)p->m;
+	munki_state *s = &m->ms[m->mmode];
+
+	if (s->reflective)
+		munki_absraw_to_abswav_x(p, m->nwav, m->rmtx_index, m->rmtx_nocoef, m->rmtx_coef,
+		                         m->straylight, nummeas, abswav, absraw);
+	else
+		munki_absraw_to_abswav_x(p, m->nwav, m->emtx_index, m->emtx_nocoef, m->emtx_coef,
+		                         m->straylight, nummeas, abswav, absraw);
+}
+
+/* Convert an absraw array from raw wavelengths to output wavelenths */
+/* for the standard resolution. Apply stray light compensation too. */
+void munki_absraw_to_abswav1(
+	munki *p,
+	int nummeas,			/* Return number of readings measured */
+	double **abswav,		/* Desination array [nwav1] */
+	double **absraw		/* Source array [-1 nraw] */
+) {
+	munkiimp *m = (munkiimp *)p->m;
+	munki_state *s = &m->ms[m->mmode];
+
+	if (s->reflective)
+		munki_absraw_to_abswav_x(p, m->nwav1, m->rmtx_index1, m->rmtx_nocoef1, m->rmtx_coef1,
+		                         m->straylight1, nummeas, abswav, absraw);
+	else
+		munki_absraw_to_abswav_x(p, m->nwav1, m->emtx_index1, m->emtx_nocoef1, m->emtx_coef1,
+		                         m->straylight1, nummeas, abswav, absraw);
 }
 
 /* Convert an absraw array from raw wavelengths to output wavelenths */
@@ -6221,43 +6343,13 @@ void munki_absraw_to_abswav2(
 ) {
 	munkiimp *m = (munkiimp *)p->m;
 	munki_state *s = &m->ms[m->mmode];
-	double *tm;			/* Temporary array */
-	int i, j, k, cx, sx;
-	
-	tm = dvector(0, m->nwav2-1);
-
-	/* For each measurement */
-	for (i = 0; i < nummeas; i++) {
-
-		/* For each output wavelength */
-		for (cx = j = 0; j < m->nwav2; j++) {
-			double oval = 0.0;
-	
-			/* For each matrix value */
-			if (s->reflective) {
-				sx = m->rmtx_index2[j];		/* Starting index */
-				for (k = 0; k < m->rmtx_nocoef2[j]; k++, cx++, sx++)
-					oval += m->rmtx_coef2[cx] * absraw[i][sx];
-			} else {
-				sx = m->emtx_index2[j];		/* Starting index */
-				for (k = 0; k < m->emtx_nocoef2[j]; k++, cx++, sx++)
-					oval += m->emtx_coef2[cx] * absraw[i][sx];
-			}
-			tm[j] = oval;
-		}
 
-		/* Now apply stray light compensation */ 
-		/* For each output wavelength */
-		for (j = 0; j < m->nwav2; j++) {
-			double oval = 0.0;
-	
-			/* For each matrix value */
-			for (k = 0; k < m->nwav2; k++)
-				oval += m->straylight2[j][k] * tm[k];
-			abswav[i][j] = oval;
-		}
-	}
-	free_dvector(tm, 0, m->nwav2-1);
+	if (s->reflective)
+		munki_absraw_to_abswav_x(p, m->nwav2, m->rmtx_index2, m->rmtx_nocoef2, m->rmtx_coef2,
+		                         m->straylight2, nummeas, abswav, absraw);
+	else
+		munki_absraw_to_abswav_x(p, m->nwav2, m->emtx_index2, m->emtx_nocoef2, m->emtx_coef2,
+		                         m->straylight2, nummeas, abswav, absraw);
 }
 
 /* Convert an abswav array of output wavelengths to scaled output readings. */
@@ -8325,15 +8417,15 @@ static int munki_switch_thread(void *pp) {
 			continue;
 		}
 		if (ecode == mk_eve_switch_press) {
-			m->switch_count++;
+			m->swring->put(m->swring, NULL);		/* Ignored if full */
 			if (!m->hide_switch && p->eventcallback != NULL) {
 				p->eventcallback(p->event_cntx, inst_event_switch);
 			}
 		} else if (ecode == mk_eve_spos_change) {
 #ifdef FILTER_SPOS_EVENTS
 			/* Signal change to filer thread */
-			m->spos_msec = msec_time();
-			m->spos_change++;
+			unsigned int msec = msec_time();
+			m->sposring->put(m->sposring, &msec);
 #else
 			if (p->eventcallback != NULL) {
 				p->eventcallback(p->event_cntx, inst_event_mconf);
@@ -8349,7 +8441,10 @@ static int munki_switch_thread(void *pp) {
 static int munki_spos_thread(void *pp) {
 	munki *p = (munki *)pp;
 	munkiimp *m = (munkiimp *)p->m;
-	int change = m->spos_change;		/* Current count */
+	int change = 0;						/* nz if there is an unreported change */
+	unsigned int spos_msec = 0;			/* Time of the last change */
+	unsigned int msec;
+	double lat;
 
 	a1logd(p->log,3,"spos thread started\n");
 
@@ -8360,10 +8455,17 @@ static int munki_spos_thread(void *pp) {
 			break;
 		}
 
-		/* Do callback if change has persisted for 1 second */
-		if (change != m->spos_change
-		 && (msec_time() - m->spos_msec) >= FILTER_TIME) {
-			change = m->spos_change;
+		/* Get the time of the latest change */
+		while (m->sposring->get(m->sposring, &msec, &lat) == 0) {
+			a1logd(p->log,4,"munki_spos_thread: spos hand-off took %.3f msec\n",lat);
+			spos_msec = msec;
+			change = 1;
+		}
+
+		/* Do callback if change has persisted for FILTER_TIME */
+		if (change
+		 && (msec_time() - spos_msec) >= FILTER_TIME) {
+			change = 0;
 			if (p->eventcallback != NULL) {
 				p->eventcallback(p->event_cntx, inst_event_mconf);
 			}
@@ -9781,3 +9883,99 @@ mkdata *new_mkdata(munki *p, unsigned char *buf, int len) {
 }
 
 /* ----------------------------------------------------------------- */
+
+#ifdef STANDALONE_TEST
+/* Test the block raw to wav conversion against the per reading */
+/* conversion, using synthetic filter, stray light and absraw values. */
+
+int main(int argc, char *argv[]) {
+	munki _p, *p = &_p;
+	munkiimp _m, *m = &_m;
+	int ncoef = 6;			/* Maximum coefficients per wavelength */
+	int maxmeas = 1003;		/* Largest number of readings tested */
+	int nwavs[2] = { 36, 107 };
+	int *index, *nocoef;
+	double *coef, **straylight;
+	double **absraw, **w1, **wb;
+	double mxd = 0.0;
+	int hr, nwav, nm, i, j, k;
+
+	memset(p, 0, sizeof(munki));
+	memset(m, 0, sizeof(munkiimp));
+	p->m = (void *)m;
+	p->log = new_a1log(NULL, 0, 0, NULL, NULL, NULL, NULL);
+
+	m->nraw = 128;
+
+	absraw = dmatrix(0, maxmeas-1, -1, m->nraw-1);
+	for (i = 0; i < maxmeas; i++) {
+		for (j = -1; j < m->nraw; j++)
+			absraw[i][j] = d_rand(-10.0, 1000.0);
+	}
+
+	for (hr = 0; hr < 2; hr++) {
+		nwav = nwavs[hr];
+
+		/* Synthetic filter and stray light tables */
+		index = ivector(0, nwav-1);
+		nocoef = ivector(0, nwav-1);
+		coef = dvector(0, nwav * ncoef-1);
+		for (j = 0; j < nwav; j++) {
+			index[j] = (int)(j * (m->nraw - ncoef)/(double)nwav);
+			nocoef[j] = ncoef - j % 3;
+		}
+		for (j = 0; j < nwav * ncoef; j++)
+			coef[j] = d_rand(-0.2, 1.0);
+		straylight = dmatrix(0, nwav-1, 0, nwav-1);
+		for (j = 0; j < nwav; j++) {
+			for (k = 0; k < nwav; k++)
+				straylight[j][k] = (j == k ? 1.0 : 0.0) + d_rand(-0.01, 0.01);
+		}
+
+		w1 = dmatrix(0, maxmeas-1, 0, nwav-1);
+		wb = dmatrix(0, maxmeas-1, 0, nwav-1);
+
+		/* Check every partial block size, and a long scan */
+		for (nm = 1; nm <= maxmeas; nm++) {
+			double tt = 0.0;
+
+			if (nm > (2 * ABSWAV_BLK + 3))
+				nm = maxmeas;
+
+			munki_absraw_to_abswav_1(nwav, index, nocoef, coef, straylight,
+			                         nm, w1, absraw);
+			munki_absraw_to_abswav_x(p, nwav, index, nocoef, coef, straylight,
+			                         nm, wb, absraw);
+			for (i = 0; i < nm; i++) {
+				for (j = 0; j < nwav; j++) {
+					double dd = fabs(w1[i][j] - wb[i][j]);
+					if (dd > tt)
+						tt = dd;
+				}
+			}
+			if (tt > mxd)
+				mxd = tt;
+			if (tt > 1e-9)
+				printf("nwav %d nummeas %d: max difference %e\n", nwav, nm, tt);
+		}
+
+		free_dmatrix(wb, 0, maxmeas-1, 0, nwav-1);
+		free_dmatrix(w1, 0, maxmeas-1, 0, nwav-1);
+		free_dmatrix(straylight, 0, nwav-1, 0, nwav-1);
+		free_dvector(coef, 0, nwav * ncoef-1);
+		free_ivector(nocoef, 0, nwav-1);
+		free_ivector(index, 0, nwav-1);
+	}
+
+	free_dmatrix(absraw, 0, maxmeas-1, -1, m->nraw-1);
+	p->log = del_a1log(p->log);
+
+	if (mxd > 1e-9) {
+		printf("Block raw to wav conversion FAILED, max difference %e\n",mxd);
+		return 1;
+	}
+	printf("Block raw to wav conversion OK, max difference %e\n",mxd);
+	return 0;
+}
+
+#endif /* STANDALONE_TEST */
@@ -156,7 +156,7 @@ struct _munkiimp {
 
 	/* Misc. and top level */
 	athread *th;				/* Switch monitoring thread (NULL if not used) */
-	volatile int switch_count;	/* Incremented in thread */
+	aring *swring;				/* Switch presses from thread */
 	volatile int hide_switch;	/* Set to supress switch event during read */
 	usb_cancelt sw_cancel;		/* Token to allow cancelling switch I/O */
 	volatile int th_term;		/* Thread terminate on error rather than retry */
@@ -296,8 +296,7 @@ struct _munkiimp {
 	athread *spos_th;				/* Position change filter thread */
 	volatile int spos_th_term;		/* nz to terminate thread */
 	volatile int spos_th_termed;	/* nz when terminated */
-	volatile int spos_change;		/* counter that increments on an spos event change */
-	unsigned int spos_msec;			/* Time when spos last changes */
+	aring *sposring;				/* msec_time() of spos event changes from switch thread */
 
 	volatile double whitestamp;		/* meas_delay() white timestamp */
 	volatile double trigstamp;		/* meas_delay() trigger timestamp */
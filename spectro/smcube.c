@@ -91,6 +91,9 @@
 
 #define DEFTO 1.0		/* [1.0] Default command timeout */
 
+#define SW_POLL_MSEC 10		/* [10] Switch press poll interval while waiting for trigger */
+#define SW_RING_SIZE 16		/* [16] Switch press ring buffer size */
+
 /* Cube white reference RGB reflectivity as measured by cube */
 //static double cwref[3] = { 0.646601, 0.668981, 0.703421 };
 static double cwref[3] = { 0.795893, 0.818593, 0.855143 };
@@ -315,7 +318,7 @@ int smcube_mon_thread(void *pp) {
 		rv1 = smcube_poll_measure(p, 0.1, 1);
 		if ((rv1 & inst_mask) == inst_user_trig) {
 			a1logd(p->log,3,"Found user trigger\n");
-			p->switch_count++;
+			p->swring->put(p->swring, NULL);		/* Ignored if full */
 			if (!p->hide_switch && p->eventcallback != NULL) {
 				p->eventcallback(p->event_cntx, inst_event_switch);
 			}
@@ -350,7 +353,7 @@ int smcube_utrig_thread(void *pp) {
 	/* See if there is a button generated measure */
 	rv = smcube_poll_measure(p, 0.1, 1);
 	if ((rv & inst_mask) == inst_user_trig) {
-		p->switch_count++;
+		p->swring->put(p->swring, NULL);		/* Ignored if full */
 		if (!p->hide_switch && p->eventcallback != NULL) {
 			a1logd(p->log,3,"Found user trigger\n");
 			p->eventcallback(p->event_cntx, inst_event_switch);
@@ -402,6 +405,12 @@ smcube_init_inst(inst *pp) {
 		/* Hmm. There is nothing to report */
 	}
 
+	/* Ring to hand switch presses from the polling or trigger thread */
+	if ((p->swring = new_aring(SW_RING_SIZE, 0)) == NULL) {
+		amutex_unlock(p->lock);
+		return smcube_interp_code((inst *)p, SMCUBE_INT_MALLOC);
+	}
+
 	if (!p->bt) {
 		/* Start the polling loop thread */
 		if ((p->th = new_athread(smcube_mon_thread, (void *)p)) == NULL) {
@@ -464,17 +473,24 @@ instClamping clamp) {		/* NZ if clamp XYZ/Lab to be +ve */
 	}
 
 	if (p->trig == inst_opt_trig_user_switch) {
-		int currcount = p->switch_count;		/* Variable set by thread */
+		int i;
+		double lat;
 
 		p->hide_switch = 1;						/* Supress switch events */
 
-		currcount = p->switch_count;			/* Variable set by thread */
-		while (currcount == p->switch_count) {
+		p->swring->flush(p->swring);			/* Ignore any earlier presses */
+		for (i = 0;; i++) {
 			int cerr;
 
+			if (p->swring->get(p->swring, NULL, &lat) == 0) {
+				a1logd(p->log,4,"smcube_read_sample: switch hand-off took %.3f msec\n",lat);
+				switch_trig = 1;
+				break;
+			}
+
 			/* Don't trigger on user key if scan, only trigger */
 			/* on instrument switch */
-			if (p->uicallback != NULL
+			if ((i % (100/SW_POLL_MSEC)) == 0 && p->uicallback != NULL
 			 && (rv = p->uicallback(p->uic_cntx, inst_armed)) != inst_ok) {
 				if (rv == inst_user_abort) {
 					return rv;				/* Abort */
@@ -484,10 +500,8 @@ instClamping clamp) {		/* NZ if clamp XYZ/Lab to be +ve */
 					break;						/* Trigger */
 				}
 			}
-			msec_sleep(100);
+			msec_sleep(SW_POLL_MSEC);
 		}
-		if (currcount != p->switch_count)
-			switch_trig = 1;
 
 		a1logd(p->log,3,"############# triggered ##############\n");
 		if (p->uicallback)	/* Notify of trigger */
@@ -782,6 +796,8 @@ smcube_interp_error(inst *pp, int ec) {
 			return "Restoring calibration file failed";
 		case SMCUBE_INT_CAL_TOUCH:
 			return "Touching calibration file failed";
+		case SMCUBE_INT_MALLOC:
+			return "Memory allocation failed";
 
 		case SMCUBE_WHITE_CALIB_ERR:
 			return "White calibration is outside expected range";
@@ -815,6 +831,7 @@ smcube_interp_code(inst *pp, int ec) {
 		case SMCUBE_INT_CAL_SAVE:
 		case SMCUBE_INT_CAL_RESTORE:
 		case SMCUBE_INT_CAL_TOUCH:
+		case SMCUBE_INT_MALLOC:
 			return inst_internal_error | ec;
 
 		case SMCUBE_TIMEOUT:
@@ -863,6 +880,8 @@ smcube_del(inst *pp) {
 		}
 		if (p->icom != NULL)
 			p->icom->del(p->icom);
+		if (p->swring != NULL)
+			p->swring->del(p->swring);
 		amutex_del(p->lock);
 		p->vdel(pp);
 		free(p);
@@ -61,6 +61,7 @@
 #define SMCUBE_INT_CAL_SAVE          	0x1005		/* Saving calibration to file failed */
 #define SMCUBE_INT_CAL_RESTORE        	0x1006		/* Restoring calibration to file failed */
 #define SMCUBE_INT_CAL_TOUCH          	0x1007		/* Touching calibration to file failed */
+#define SMCUBE_INT_MALLOC          	0x1008		/* Memory allocation failed */
 
 /* Other errors */
 #define SMCUBE_WHITE_CALIB_ERR        	0x2000		/* White calibration isn't reasonable */
@@ -109,7 +110,7 @@ struct _smcube {
 	volatile int th_term;		/* nz to terminate thread */
 	volatile int th_termed;		/* nz when thread terminated */
 
-	volatile int switch_count;	/* Incremented in thread */
+	aring *swring;				/* Switch presses from monitor or trigger thread */
 	volatile int hide_switch;	/* Set to supress switch event during read */
 	double XYZ[3];				/* Button triggered XYZ in factory mode */
 
@@ -1317,6 +1317,7 @@ int main(int argc, char *argv[]) {
 	ident = icx_inkmask2char(xmask, 1); 
 	di = icx_noofinks(nmask);	/* Lookup number of dimensions */
 	stime = clock();
+	ATIMER_BEGIN("targen point generation")
 
 	/* Implement some defaults */
 	if (esteps < 0)
@@ -2839,6 +2840,7 @@ int main(int argc, char *argv[]) {
 			ftarg->del(ftarg);
 	}
 
+	ATIMER_END
 	ttime = clock() - stime;
 	if (verb) {
 		printf("Total number of patches = %d\n",pp->t[0].nsets);
@@ -2847,8 +2849,10 @@ int main(int argc, char *argv[]) {
 		printf("Execution time = %f seconds\n",ttime/(double)CLOCKS_PER_SEC);
 	}
 
+	ATIMER_BEGIN("cgats write")
 	if (pp->write_name(pp, fname))
 		error("Write error : %s",pp->e.m);
+	ATIMER_END
 
 #ifdef VRML_DIAG		/* Dump a VRML/X3D of the resulting points */
 	if (dumpvrml & 1) {	/* Lab space */
@@ -2925,6 +2929,8 @@ int main(int argc, char *argv[]) {
 	if (fxlist != NULL)
 		free(fxlist);
 
+	ATIMING_REPORT("targen");
+
 	return 0;
 }
 
@@ -28,6 +28,8 @@
 #define RGBRES 33	/* 33 */
 #define CMYKRES 17	/* 17 */
 
+#define CMPRES 200	/* Comparison direction resolution, gives 2 x CMPRES^2 directions */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -42,7 +44,47 @@
 #include "gamut.h"
 #include "counters.h"
 #include "vrml.h"
+#include "conv.h"
+
+/* Profile lookup and gamut creation parameters */
+typedef struct {
+	icmLookupFunc     func;
+	icRenderingIntent intent;
+	icColorSpaceSignature pcsor;
+	icmLookupOrder    order;
+	int fl;						/* luobj flags */
+	int tlimit;					/* Total ink limit as a % */
+	int klimit;					/* Black ink limit as a % */
+	double gamres;				/* Surface resolution */
+	double expand;				/* Expand gamut cylindrically */
+	int vc_e;					/* Enumerated viewing condition */
+	int vc_s;					/* Surround override */
+	double vc_wXYZ[3];			/* Adapted white override in XYZ */
+	double vc_wxy[2];			/* Adapted white override in x,y */
+	double vc_a;				/* Adapted luminance */
+	double vc_b;				/* Background % overide */
+	double vc_l;				/* Scene luminance override */
+	double vc_f;				/* Flare % overide */
+	double vc_g;				/* Glare % overide */
+	double vc_gXYZ[3];			/* Glare color override in XYZ */
+	double vc_gxy[2];			/* Glare color override in x,y */
+	double vc_hkscale;			/* HK scaling factor */
+	double vc_mtaf;				/* Mid tone partial adapation factor from Wxyz to Wxyz2 */ 
+	double vc_Wxyz2[3];			/* Adapted white override in XYZ */
+} gparams;
+
+/* Objects opened for a profile */
+typedef struct {
+	icmFile *fp;
+	icc *icco;
+	xicc *xicco;
+	icxLuBase *luo;
+} profobjs;
 
+static profobjs open_luo(gparams *gp, char *prof_name, int verb);
+static gamut *luo_gamut(gparams *gp, profobjs *po, int verb);
+static void close_luo(profobjs *po);
+static void compare_gamuts(gparams *gp, char *ref_name, int nprofs, char *profs[], int verb);
 static void diag_gamut(icxLuBase *p, double detail, int doaxes,
                        double tlimit, double klimit, char *outname);
 
@@ -51,6 +93,7 @@ void usage(char *diag) {
 	fprintf(stderr,"Create ICC profile Lab/Jab gamut & plot Version %s\n",ARGYLL_VERSION_STR);
 	fprintf(stderr,"Author: Graeme W. Gill, licensed under the AGPL Version 3\n");
 	fprintf(stderr,"usage: iccgamut [options] profile\n");
+	fprintf(stderr,"       iccgamut [options] -R reference profile1 [profile2 ...]\n");
 	if (diag != NULL)
 		fprintf(stderr,"Diagnostic: %s\n",diag);
 	fprintf(stderr," -v            Verbose\n");
@@ -94,6 +137,8 @@ void usage(char *diag) {
 	fprintf(stderr,"         m:x:y         Mid-tone Adaptation white as x, y\n");
     fprintf(stderr," -x pcent      Expand/compress gamut cylindrically by percent\n");
     fprintf(stderr," -s            Create special cube surface topology plot\n");
+	fprintf(stderr," -R reference  Compare the gamut volume of each profile against reference\n");
+	fprintf(stderr,"               profile or .gam file, rather than creating gamut files\n");
 	fprintf(stderr,"\n");
 	exit(1);
 }
@@ -103,47 +148,43 @@ main(int argc, char *argv[]) {
 	int fa,nfa;				/* argument we're looking at */
 	char prof_name[MAXNAMEL+1];
 	char *xl, out_name[MAXNAMEL+4+1];
-	icmFile *fp;
-	icc *icco;
-	icmErr err = { 0, { '\000'} };
 	xicc *xicco;
 	gamut *gam;
 	int verb = 0;
-	int rv = 0;
 	int vrml = 0;
 	int doaxes = 1;
 	int docusps = 0;
-	double gamres = GAMRES;		/* Surface resolution */
 	int special = 0;			/* Special surface plot */
-	int fl = 0;					/* luobj flags */
-	icxInk ink;					/* Ink parameters */
-	int tlimit = -1;			/* Total ink limit as a % */
-	int klimit = -1;			/* Black ink limit as a % */
-	icxViewCond vc;				/* Viewing Condition for CIECAM */
-	int vc_e = -1;				/* Enumerated viewing condition */
-	int vc_s = -1;				/* Surround override */
-	double vc_wXYZ[3] = {-1.0, -1.0, -1.0};	/* Adapted white override in XYZ */
-	double vc_wxy[2] = {-1.0, -1.0};		/* Adapted white override in x,y */
-	double vc_a = -1.0;			/* Adapted luminance */
-	double vc_b = -1.0;			/* Background % overide */
-	double vc_l = -1.0;			/* Scene luminance override */
-	double vc_f = -1.0;			/* Flare % overide */
-	double vc_g = -1.0;			/* Glare % overide */
-	double vc_gXYZ[3] = {-1.0, -1.0, -1.0};	/* Glare color override in XYZ */
-	double vc_gxy[2] = {-1.0, -1.0};		/* Glare color override in x,y */
-	double vc_hkscale = -1.0;			/* HK scaling factor */
-	double vc_mtaf = -1.0;		/* Mid tone partial adapation factor from Wxyz to Wxyz2 */ 
-	double vc_Wxyz2[3] = {-1.0, -1.0, -1.0};	/* Adapted white override in XYZ */
-	double expand = 1.0;		/* Expand gamut cylindrically */
+	char ref_name[MAXNAMEL+1] = "\000";	/* Reference for batch comparison */
+	gparams gp;					/* Profile lookup & gamut parameters */
+	profobjs po;				/* Profile objects */
 
 	icxLuBase *luo;
 
 	/* Lookup parameters */
-	icmLookupFunc     func   = icmFwd;				/* Default */
-	icRenderingIntent intent = -1;					/* Default */
-	icColorSpaceSignature pcsor = icSigLabData;		/* Default */
-	icmLookupOrder    order  = icmLuOrdNorm;		/* Default */
-	
+	gp.func   = icmFwd;				/* Default */
+	gp.intent = -1;					/* Default */
+	gp.pcsor  = icSigLabData;		/* Default */
+	gp.order  = icmLuOrdNorm;		/* Default */
+	gp.fl = 0;
+	gp.tlimit = -1;
+	gp.klimit = -1;
+	gp.gamres = GAMRES;
+	gp.expand = 1.0;
+	gp.vc_e = -1;
+	gp.vc_s = -1;
+	gp.vc_wXYZ[0] = gp.vc_wXYZ[1] = gp.vc_wXYZ[2] = -1.0;
+	gp.vc_wxy[0] = gp.vc_wxy[1] = -1.0;
+	gp.vc_a = -1.0;
+	gp.vc_b = -1.0;
+	gp.vc_l = -1.0;
+	gp.vc_f = -1.0;
+	gp.vc_g = -1.0;
+	gp.vc_gXYZ[0] = gp.vc_gXYZ[1] = gp.vc_gXYZ[2] = -1.0;
+	gp.vc_gxy[0] = gp.vc_gxy[1] = -1.0;
+	gp.vc_hkscale = -1.0;
+	gp.vc_mtaf = -1.0;
+	gp.vc_Wxyz2[0] = gp.vc_Wxyz2[1] = gp.vc_Wxyz2[2] = -1.0;
 
 	error_program = argv[0];
 
@@ -177,11 +218,11 @@ main(int argc, char *argv[]) {
     			switch (na[0]) {
 					case 'f':
 					case 'F':
-						func = icmFwd;
+						gp.func = icmFwd;
 						break;
 					case 'b':
 					case 'B':
-						func = icmBwd;
+						gp.func = icmBwd;
 						break;
 					default:
 						usage("Unrecognised parameter after flag -f");
@@ -194,27 +235,27 @@ main(int argc, char *argv[]) {
 				if (na == NULL) usage("No parameter after flag -i");
     			switch (na[0]) {
 					case 'd':
-						intent = icmDefaultIntent;
+						gp.intent = icmDefaultIntent;
 						break;
 					case 'a':
-						intent = icAbsoluteColorimetric;
+						gp.intent = icAbsoluteColorimetric;
 						break;
 					case 'p':
-						intent = icPerceptual;
+						gp.intent = icPerceptual;
 						break;
 					case 'r':
-						intent = icRelativeColorimetric;
+						gp.intent = icRelativeColorimetric;
 						break;
 					case 's':
-						intent = icSaturation;
+						gp.intent = icSaturation;
 						break;
 					/* Argyll special intents to check spaces underlying */
 					/* icxPerceptualAppearance & icxSaturationAppearance */
 					case 'P':
-						intent = icmAbsolutePerceptual;
+						gp.intent = icmAbsolutePerceptual;
 						break;
 					case 'S':
-						intent = icmAbsoluteSaturation;
+						gp.intent = icmAbsoluteSaturation;
 						break;
 					default:
 						usage("Unrecognised parameter after flag -i");
@@ -228,11 +269,11 @@ main(int argc, char *argv[]) {
     			switch (na[0]) {
 					case 'n':
 					case 'N':
-						order = icmLuOrdNorm;
+						gp.order = icmLuOrdNorm;
 						break;
 					case 'r':
 					case 'R':
-						order = icmLuOrdRev;
+						gp.order = icmLuOrdRev;
 						break;
 					default:
 						usage("Unrecognised parameter after flag -o");
@@ -245,10 +286,10 @@ main(int argc, char *argv[]) {
 				if (na == NULL) usage("No parameter after flag -p");
     			switch (na[0]) {
 					case 'l':
-						pcsor = icSigLabData;
+						gp.pcsor = icSigLabData;
 						break;
 					case 'j':
-						pcsor = icxSigJabData;
+						gp.pcsor = icxSigJabData;
 						break;
 					default:
 						usage("Unrecognised parameter after flag -p");
@@ -275,17 +316,23 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 's' || argv[fa][1] == 'S') {
 				special = 1;
 			}
+			/* Reference to compare against */
+			else if (argv[fa][1] == 'R') {
+				fa = nfa;
+				if (na == NULL) usage("No parameter after flag -R");
+				strncpy(ref_name, na, MAXNAMEL); ref_name[MAXNAMEL] = '\000';
+			}
 			/* Ink limit */
 			else if (argv[fa][1] == 'l') {
 				fa = nfa;
 				if (na == NULL) usage("No parameter after flag -l");
-				tlimit = atoi(na);
+				gp.tlimit = atoi(na);
 			}
 
 			else if (argv[fa][1] == 'L') {
 				fa = nfa;
 				if (na == NULL) usage("No parameter after flag -L");
-				klimit = atoi(na);
+				gp.klimit = atoi(na);
 			}
 
 
@@ -293,8 +340,8 @@ main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'd' || argv[fa][1] == 'D') {
 				fa = nfa;
 				if (na == NULL) usage("No parameter after flag -d");
-				gamres = atof(na);
-				if (gamres < 0.1 || gamres > 50.0)
+				gp.gamres = atof(na);
+				if (gp.gamres < 0.1 || gp.gamres > 50.0)
 					usage("Parameter after flag -d seems out of range");
 			}
 
@@ -307,7 +354,7 @@ main(int argc, char *argv[]) {
 
 				if (rr < 0.01 || rr > 100.0)
 					usage("-x ratio is out of range");
-				expand = rr;
+				gp.expand = rr;
 			}
 
 			/* Viewing conditions */
@@ -316,80 +363,80 @@ main(int argc, char *argv[]) {
 				if (na == NULL) usage("No parameter after flag -c");
 #ifdef NEVER
 				if (na[0] >= '0' && na[0] <= '9') {
-					vc_e = atoi(na);
+					gp.vc_e = atoi(na);
 				} else
 #endif
 				if (na[1] != ':') {
-					if ((vc_e = xicc_enum_viewcond(NULL, NULL, -2, na, 1, NULL)) == -999)
+					if ((gp.vc_e = xicc_enum_viewcond(NULL, NULL, -2, na, 1, NULL)) == -999)
 						usage("Urecognised Enumerated Viewing conditions");
 				} else if (na[0] == 's' || na[0] == 'S') {
 					if (na[1] != ':')
 						usage("Unrecognised parameters after -cs");
 					if (na[2] == 'n' || na[2] == 'N') {
-						vc_s = vc_none;		/* Automatic from Lv */
+						gp.vc_s = vc_none;		/* Automatic from Lv */
 					} else if (na[2] == 'a' || na[2] == 'A') {
-						vc_s = vc_average;
+						gp.vc_s = vc_average;
 					} else if (na[2] == 'm' || na[2] == 'M') {
-						vc_s = vc_dim;
+						gp.vc_s = vc_dim;
 					} else if (na[2] == 'd' || na[2] == 'D') {
-						vc_s = vc_dark;
+						gp.vc_s = vc_dark;
 					} else if (na[2] == 'c' || na[2] == 'C') {
-						vc_s = vc_cut_sheet;
+						gp.vc_s = vc_cut_sheet;
 					} else
 						usage("Unrecognised parameters after -cs:");
 				} else if (na[0] == 'w' || na[0] == 'W') {
 					double x, y, z;
 					if (sscanf(na+1,":%lf:%lf:%lf",&x,&y,&z) == 3) {
-						vc_wXYZ[0] = x; vc_wXYZ[1] = y; vc_wXYZ[2] = z;
+						gp.vc_wXYZ[0] = x; gp.vc_wXYZ[1] = y; gp.vc_wXYZ[2] = z;
 					} else if (sscanf(na+1,":%lf:%lf",&x,&y) == 2) {
-						vc_wxy[0] = x; vc_wxy[1] = y;
+						gp.vc_wxy[0] = x; gp.vc_wxy[1] = y;
 					} else
 						usage("Unrecognised parameters after -cw");
 				} else if (na[0] == 'a' || na[0] == 'A') {
 					if (na[1] != ':')
 						usage("Unrecognised parameters after -ca");
-					vc_a = atof(na+2);
+					gp.vc_a = atof(na+2);
 				} else if (na[0] == 'b' || na[0] == 'B') {
 					if (na[1] != ':')
 						usage("Unrecognised parameters after -cb");
-					vc_b = atof(na+2);
+					gp.vc_b = atof(na+2);
 				} else if (na[0] == 'l' || na[0] == 'L') {
 					if (na[1] != ':')
 						usage("Viewing conditions (-cl) missing ':'");
-					vc_l = atof(na+2);
+					gp.vc_l = atof(na+2);
 				} else if (na[0] == 'f' || na[0] == 'F') {
 					if (na[1] != ':')
 						usage("Viewing conditions (-cf) missing ':'");
-					vc_f = atof(na+2);
+					gp.vc_f = atof(na+2);
 				} else if (na[0] == 'g' || na[0] == 'G') {
 					double x, y, z;
 					if (sscanf(na+1,":%lf:%lf:%lf",&x,&y,&z) == 3) {
-						vc_gXYZ[0] = x; vc_gXYZ[1] = y; vc_gXYZ[2] = z;
+						gp.vc_gXYZ[0] = x; gp.vc_gXYZ[1] = y; gp.vc_gXYZ[2] = z;
 					} else if (sscanf(na+1,":%lf:%lf",&x,&y) == 2) {
-						vc_gxy[0] = x; vc_gxy[1] = y;
+						gp.vc_gxy[0] = x; gp.vc_gxy[1] = y;
 					} else if (sscanf(na+1,":%lf",&x) == 1) {
-						vc_g = x;
+						gp.vc_g = x;
 					} else
 						usage("Unrecognised parameters after -cg");
 				} else if (na[0] == 'h' || na[0] == 'H') {
 					if (na[1] != ':')
 						usage("Unrecognised parameters after -ch");
-					vc_hkscale = atof(na+2);
+					gp.vc_hkscale = atof(na+2);
 				} else if (na[0] == 'm' || na[0] == 'M') {
 					double x, y, z;
 					if (sscanf(na+1,":%lf:%lf:%lf",&x,&y,&z) == 3) {
-						vc_Wxyz2[0] = x; vc_Wxyz2[1] = y; vc_Wxyz2[2] = z;
+						gp.vc_Wxyz2[0] = x; gp.vc_Wxyz2[1] = y; gp.vc_Wxyz2[2] = z;
 					} else if (sscanf(na+1,":%lf:%lf",&x,&y) == 2) {
-						vc_Wxyz2[0] = x; vc_Wxyz2[1] = y; vc_Wxyz2[2] = -1;
+						gp.vc_Wxyz2[0] = x; gp.vc_Wxyz2[1] = y; gp.vc_Wxyz2[2] = -1;
 					} else if (sscanf(na+1,":%lf",&x) == 1) {
-						vc_mtaf = x;
+						gp.vc_mtaf = x;
 					} else
 						usage("Unrecognised parameters after -cm");
 				} else
 					usage("Unrecognised parameters after -c");
 
 				/* Make sure we output perceptual space */
-				pcsor = icxSigJabData;
+				gp.pcsor = icxSigJabData;
 			}
 			else 
 				usage("Unknown flag");
@@ -398,40 +445,105 @@ main(int argc, char *argv[]) {
 	}
 
 
-	if (intent == -1) {
-		if (pcsor == icxSigJabData)
-			intent = icRelativeColorimetric;	/* Default to icxAppearance */
+	if (gp.intent == -1) {
+		if (gp.pcsor == icxSigJabData)
+			gp.intent = icRelativeColorimetric;	/* Default to icxAppearance */
 		else
-			intent = icAbsoluteColorimetric;	/* Default to icAbsoluteColorimetric */
+			gp.intent = icAbsoluteColorimetric;	/* Default to icAbsoluteColorimetric */
+	}
+
+	/* Compare a list of profiles against the reference gamut */
+	if (ref_name[0] != '\000') {
+		if (fa >= argc || argv[fa][0] == '-')
+			usage("Expected one or more profiles to compare against the reference");
+		if (special)
+			usage("Can't do special plot in comparison mode");
+		compare_gamuts(&gp, ref_name, argc - fa, argv + fa, verb);
+		return 0;
 	}
 
 	if (fa >= argc || argv[fa][0] == '-') usage("Expected profile name");
+
 	strncpy(prof_name, argv[fa],MAXNAMEL); prof_name[MAXNAMEL] = '\000';
 
+	strcpy(out_name, prof_name);
+	if ((xl = strrchr(out_name, '.')) == NULL)	/* Figure where extention is */
+		xl = out_name + strlen(out_name);
+
+	strcpy(xl,".gam");
+
+	/* Get a expanded color conversion object */
+	po = open_luo(&gp, prof_name, verb);
+	luo = po.luo;
+
+	if (special) {
+		if (gp.func != icmFwd)
+			error("Must be forward direction for special plot");
+		xl[0] = '\000';			/* remove extension */
+		diag_gamut(luo, gp.gamres, doaxes, gp.tlimit/100.0, gp.klimit/100.0, out_name); 
+	} else {
+		/* Creat a gamut surface */
+		gam = luo_gamut(&gp, &po, verb);
+
+		if (gam->write_gam(gam, out_name))
+			error ("write gamut failed on '%s'",out_name);
+
+		if (vrml) {
+			xl[0] = '\000';			/* remove extension */
+			if (gam->write_vrml(gam,out_name, doaxes, docusps))
+				error ("write vrml failed on '%s%s'",out_name, vrml_ext());
+		}
+
+		if (verb) {
+			printf("Total volume of gamut is %f cubic colorspace units\n",gam->volume(gam));
+		}
+		gam->del(gam);
+	}
+
+	close_luo(&po);
+
+	return 0;
+}
+
+/* -------------------------------------------- */
+
+/* Open a profile and create the lookup object for it. */
+static profobjs open_luo(
+gparams *gp,
+char *prof_name,
+int verb
+) {
+	profobjs po;
+	icmErr err = { 0, { '\000'} };
+	icxInk ink;					/* Ink parameters */
+	icxViewCond vc;				/* Viewing Condition for CIECAM */
+	int fl = gp->fl;
+	int rv = 0;
+
 	/* Open up the profile for reading */
-	if ((fp = new_icmFileStd_name(&err, prof_name,"r")) == NULL)
+	if ((po.fp = new_icmFileStd_name(&err, prof_name,"r")) == NULL)
 		error ("Can't open file '%s' (0x%x, '%s')",prof_name,err.c,err.m);
 
-	if ((icco = new_icc(&err)) == NULL)
+	if ((po.icco = new_icc(&err)) == NULL)
 		error ("Creation of ICC object failed (0x%x, '%s')",err.c,err.m);
 
-	if ((rv = icco->read(icco,fp,0)) != 0)
-		error ("%d, %s",rv,icco->e.m);
+	if ((rv = po.icco->read(po.icco,po.fp,0)) != 0)
+		error ("%d, %s",rv,po.icco->e.m);
 
 	if (verb) {
 		icmFile *op;
 		if ((op = new_icmFileStd_fp(&err, stdout)) == NULL)
 			error ("Can't open stdout (0x%x, '%s')",err.c,err.m);
-		icco->header->dump(icco->header, op, 1);
+		po.icco->header->dump(po.icco->header, op, 1);
 		op->del(op);
 	}
 
 	/* Wrap with an expanded icc */
-	if ((xicco = new_xicc(icco)) == NULL)
+	if ((po.xicco = new_xicc(po.icco)) == NULL)
 		error ("Creation of xicc failed");
 
 	/* Set the ink limits */
-	icxDefaultLimits(xicco, &ink.tlimit, tlimit/100.0, &ink.klimit, klimit/100.0);
+	icxDefaultLimits(po.xicco, &ink.tlimit, gp->tlimit/100.0, &ink.klimit, gp->klimit/100.0);
 
 	if (verb) {
 		if (ink.tlimit >= 0.0)
@@ -452,61 +564,61 @@ main(int argc, char *argv[]) {
 	ink.c.Kshap = 1.0;		/* Linear transition */
 
 	/* Setup the default viewing conditions */
-	if (xicc_enum_viewcond(xicco, &vc, -1, NULL, 0, NULL) == -2)
-		error ("%d, %s",xicco->e.c, xicco->e.m);
-
-	if (vc_e != -1)
-		if (xicc_enum_viewcond(xicco, &vc, vc_e, NULL, 0, NULL) == -2)
-			error ("%d, %s",xicco->e.c, xicco->e.m);
-	if (vc_s >= 0)
-		vc.Ev = vc_s;
-	if (vc_wXYZ[1] > 0.0) {
+	if (xicc_enum_viewcond(po.xicco, &vc, -1, NULL, 0, NULL) == -2)
+		error ("%d, %s",po.xicco->e.c, po.xicco->e.m);
+
+	if (gp->vc_e != -1)
+		if (xicc_enum_viewcond(po.xicco, &vc, gp->vc_e, NULL, 0, NULL) == -2)
+			error ("%d, %s",po.xicco->e.c, po.xicco->e.m);
+	if (gp->vc_s >= 0)
+		vc.Ev = gp->vc_s;
+	if (gp->vc_wXYZ[1] > 0.0) {
 		/* Normalise it to current media white */
-		vc.Wxyz[0] = vc_wXYZ[0]/vc_wXYZ[1] * vc.Wxyz[1];
-		vc.Wxyz[2] = vc_wXYZ[2]/vc_wXYZ[1] * vc.Wxyz[1];
+		vc.Wxyz[0] = gp->vc_wXYZ[0]/gp->vc_wXYZ[1] * vc.Wxyz[1];
+		vc.Wxyz[2] = gp->vc_wXYZ[2]/gp->vc_wXYZ[1] * vc.Wxyz[1];
 	} 
-	if (vc_wxy[0] >= 0.0) {
-		double x = vc_wxy[0];
-		double y = vc_wxy[1];	/* If Y == 1.0, then X+Y+Z = 1/y */
+	if (gp->vc_wxy[0] >= 0.0) {
+		double x = gp->vc_wxy[0];
+		double y = gp->vc_wxy[1];	/* If Y == 1.0, then X+Y+Z = 1/y */
 		double z = 1.0 - x - y;
 		vc.Wxyz[0] = x/y * vc.Wxyz[1];
 		vc.Wxyz[2] = z/y * vc.Wxyz[1];
 	}
-	if (vc_a >= 0.0)
-		vc.La = vc_a;
-	if (vc_b >= 0.0)
-		vc.Yb = vc_b/100.0;
-	if (vc_l >= 0.0)
-		vc.Lv = vc_l;
-	if (vc_f >= 0.0)
-		vc.Yf = vc_f/100.0;
-	if (vc_g >= 0.0)
-		vc.Yg = vc_g/100.0;
-	if (vc_gXYZ[1] > 0.0) {
+	if (gp->vc_a >= 0.0)
+		vc.La = gp->vc_a;
+	if (gp->vc_b >= 0.0)
+		vc.Yb = gp->vc_b/100.0;
+	if (gp->vc_l >= 0.0)
+		vc.Lv = gp->vc_l;
+	if (gp->vc_f >= 0.0)
+		vc.Yf = gp->vc_f/100.0;
+	if (gp->vc_g >= 0.0)
+		vc.Yg = gp->vc_g/100.0;
+	if (gp->vc_gXYZ[1] > 0.0) {
 		/* Normalise it to current media white */
-		vc.Gxyz[0] = vc_gXYZ[0]/vc_gXYZ[1] * vc.Gxyz[1];
-		vc.Gxyz[2] = vc_gXYZ[2]/vc_gXYZ[1] * vc.Gxyz[1];
+		vc.Gxyz[0] = gp->vc_gXYZ[0]/gp->vc_gXYZ[1] * vc.Gxyz[1];
+		vc.Gxyz[2] = gp->vc_gXYZ[2]/gp->vc_gXYZ[1] * vc.Gxyz[1];
 	}
-	if (vc_gxy[0] >= 0.0) {
-		double x = vc_gxy[0];
-		double y = vc_gxy[1];	/* If Y == 1.0, then X+Y+Z = 1/y */
+	if (gp->vc_gxy[0] >= 0.0) {
+		double x = gp->vc_gxy[0];
+		double y = gp->vc_gxy[1];	/* If Y == 1.0, then X+Y+Z = 1/y */
 		double z = 1.0 - x - y;
 		vc.Gxyz[0] = x/y * vc.Gxyz[1];
 		vc.Gxyz[2] = z/y * vc.Gxyz[1];
 	}
-	if (vc_hkscale >= 0.0)
-		vc.hkscale = vc_hkscale;
-	if (vc_mtaf >= 0.0)
-		vc.mtaf = vc_mtaf;
-	if (vc_Wxyz2[0] >= 0.0 && vc_Wxyz2[1] > 0.0 && vc_Wxyz2[2] >= 0.0) {
+	if (gp->vc_hkscale >= 0.0)
+		vc.hkscale = gp->vc_hkscale;
+	if (gp->vc_mtaf >= 0.0)
+		vc.mtaf = gp->vc_mtaf;
+	if (gp->vc_Wxyz2[0] >= 0.0 && gp->vc_Wxyz2[1] > 0.0 && gp->vc_Wxyz2[2] >= 0.0) {
 		/* Normalise XYZ */
-		vc.Wxyz2[0] = vc_Wxyz2[0]/vc_Wxyz2[1] * vc.Wxyz2[1];
-		vc.Wxyz2[2] = vc_Wxyz2[2]/vc_Wxyz2[1] * vc.Wxyz2[1];
+		vc.Wxyz2[0] = gp->vc_Wxyz2[0]/gp->vc_Wxyz2[1] * vc.Wxyz2[1];
+		vc.Wxyz2[2] = gp->vc_Wxyz2[2]/gp->vc_Wxyz2[1] * vc.Wxyz2[1];
 	}
-	if (vc_Wxyz2[0] >= 0.0 && vc_Wxyz2[1] >= 0.0 && vc_Wxyz2[2] < 0.0) {
+	if (gp->vc_Wxyz2[0] >= 0.0 && gp->vc_Wxyz2[1] >= 0.0 && gp->vc_Wxyz2[2] < 0.0) {
 		/* Convert Yxy to XYZ */
-		double x = vc_Wxyz2[0];
-		double y = vc_Wxyz2[1];	/* If Y == 1.0, then X+Y+Z = 1/y */
+		double x = gp->vc_Wxyz2[0];
+		double y = gp->vc_Wxyz2[1];	/* If Y == 1.0, then X+Y+Z = 1/y */
 		double z = 1.0 - x - y;
 		vc.Wxyz2[0] = x/y * vc.Wxyz2[1];
 		vc.Wxyz2[2] = z/y * vc.Wxyz2[1];
@@ -520,86 +632,190 @@ main(int argc, char *argv[]) {
 
 #ifdef NEVER
 	printf("~1 output space flags = 0x%x\n",fl);
-	printf("~1 output space intent = %s\n",icx2str(icmRenderingIntent,intent));
-	printf("~1 output space pcs = %s\n",icx2str(icmColorSpaceSig,pcsor));
+	printf("~1 output space intent = %s\n",icx2str(icmRenderingIntent,gp->intent));
+	printf("~1 output space pcs = %s\n",icx2str(icmColorSpaceSig,gp->pcsor));
 	printf("~1 output space viewing conditions =\n"); xicc_dump_viewcond(&vc);
 	printf("~1 output space inking =\n"); xicc_dump_inking(&ink);
 #endif
 
-	strcpy(out_name, prof_name);
-	if ((xl = strrchr(out_name, '.')) == NULL)	/* Figure where extention is */
-		xl = out_name + strlen(out_name);
-
-	strcpy(xl,".gam");
-
 	/* Get a expanded color conversion object */
-	if ((luo = xicco->get_luobj(xicco, fl, func, intent, pcsor, order, &vc, &ink)) == NULL)
-		error ("%d, %s",xicco->e.c, xicco->e.m);
+	if ((po.luo = po.xicco->get_luobj(po.xicco, fl, gp->func, gp->intent, gp->pcsor,
+	                                  gp->order, &vc, &ink)) == NULL)
+		error ("%d, %s",po.xicco->e.c, po.xicco->e.m);
 
+	return po;
+}
 
-	if (special) {
-		if (func != icmFwd)
-			error("Must be forward direction for special plot");
-		xl[0] = '\000';			/* remove extension */
-		diag_gamut(luo, gamres, doaxes, tlimit/100.0, klimit/100.0, out_name); 
-	} else {
-		/* Creat a gamut surface */
-		if ((gam = luo->get_gamut(luo, gamres)) == NULL)
-			error ("%d, %s",xicco->e.c, xicco->e.m);
+/* Create the gamut surface of a profile's lookup object */
+static gamut *luo_gamut(
+gparams *gp,
+profobjs *po,
+int verb
+) {
+	gamut *gam;
 
-		if (verb) {
-			double cs_wp[3], cs_bp[3];
-			double ga_wp[3], ga_bp[3];
-
-			if (gam->getwb(gam, cs_wp, cs_bp, NULL, ga_wp, ga_bp, NULL)) {
-				fprintf(stderr,"gamut map: Unable to read gamut white and black points\n");
-			} else {
-				printf(" Colorspace white/black are %f %f %f, %f %f %f\n",
-				cs_wp[0], cs_wp[1], cs_wp[2], cs_bp[0], cs_bp[1], cs_bp[2]);
-	
-				printf(" Gamut white/black are      %f %f %f, %f %f %f\n\n",
-				ga_wp[0], ga_wp[1], ga_wp[2], ga_bp[0], ga_bp[1], ga_bp[2]);
-			}
-		}
+	if ((gam = po->luo->get_gamut(po->luo, gp->gamres)) == NULL)
+		error ("%d, %s",po->xicco->e.c, po->xicco->e.m);
 
-		/* Expand gamut cylindrically */
-		if (expand != 1.0) {
-			gamut *xgam;
+	if (verb) {
+		double cs_wp[3], cs_bp[3];
+		double ga_wp[3], ga_bp[3];
 
-			if ((xgam = new_gamut(1.0, 0, 0)) == NULL
-			 || xgam->exp_cyl(xgam, gam, expand)) {
-				error ("Creating expanded gamut failed");
-			}
+		if (gam->getwb(gam, cs_wp, cs_bp, NULL, ga_wp, ga_bp, NULL)) {
+			fprintf(stderr,"gamut map: Unable to read gamut white and black points\n");
+		} else {
+			printf(" Colorspace white/black are %f %f %f, %f %f %f\n",
+			cs_wp[0], cs_wp[1], cs_wp[2], cs_bp[0], cs_bp[1], cs_bp[2]);
 
-			gam->del(gam);
-			gam = xgam;
+			printf(" Gamut white/black are      %f %f %f, %f %f %f\n\n",
+			ga_wp[0], ga_wp[1], ga_wp[2], ga_bp[0], ga_bp[1], ga_bp[2]);
 		}
+	}
 
-		if (gam->write_gam(gam, out_name))
-			error ("write gamut failed on '%s'",out_name);
+	/* Expand gamut cylindrically */
+	if (gp->expand != 1.0) {
+		gamut *xgam;
 
-		if (vrml) {
-			xl[0] = '\000';			/* remove extension */
-			if (gam->write_vrml(gam,out_name, doaxes, docusps))
-				error ("write vrml failed on '%s%s'",out_name, vrml_ext());
+		if ((xgam = new_gamut(1.0, 0, 0)) == NULL
+		 || xgam->exp_cyl(xgam, gam, gp->expand)) {
+			error ("Creating expanded gamut failed");
 		}
 
-		if (verb) {
-			printf("Total volume of gamut is %f cubic colorspace units\n",gam->volume(gam));
-		}
 		gam->del(gam);
+		gam = xgam;
 	}
+	return gam;
+}
 
-	luo->del(luo);			/* Done with lookup object */
+/* Free the profile objects */
+static void close_luo(profobjs *po) {
+	po->luo->del(po->luo);			/* Done with lookup object */
+	po->xicco->del(po->xicco);		/* Expansion wrapper */
+	po->icco->del(po->icco);		/* Icc */
+	po->fp->del(po->fp);
+}
+
+/* -------------------------------------------- */
+/* Compare a list of profiles against a reference gamut. */
+/* The reference gamut and its radial lookup are created once, */
+/* and then the profiles are processed by a set of threads, */
+/* each creating a gamut, comparing it and then discarding it. */
+
+typedef struct {
+	gparams *gp;
+	gamut *ref;				/* Reference gamut */
+	double rvol;			/* Reference volume */
+	int nprofs;				/* Number of profiles to compare */
+	char **profs;			/* Profile names */
+	int next;				/* Index of next profile to do */
+	amutex lock;			/* Lock for next and output */
+} cmpctx;
+
+/* Comparison thread */
+static int cmp_thread(void *pp) {
+	cmpctx *cx = (cmpctx *)pp;
+
+	for (;;) {
+		int ix;
+		profobjs po;
+		gamut *gam;
+		double vol, ivol;
+
+		amutex_lock(cx->lock);
+		ix = cx->next++;
+		amutex_unlock(cx->lock);
+
+		if (ix >= cx->nprofs)
+			break;
 
-	xicco->del(xicco);		/* Expansion wrapper */
-	icco->del(icco);		/* Icc */
-	fp->del(fp);
+		po = open_luo(cx->gp, cx->profs[ix], 0);
+		gam = luo_gamut(cx->gp, &po, 0);
+		close_luo(&po);
 
+		if (cx->ref->radial_isect(cx->ref, gam, CMPRES, NULL, &vol, &ivol))
+			error("Gamut of '%s' isn't compatible with the reference",cx->profs[ix]);
+		gam->del(gam);
 
+		amutex_lock(cx->lock);
+		if (vol <= 0.0)
+			printf("%s: volume %.1f, gamut is empty\n", cx->profs[ix], vol);
+		else
+			printf("%s: volume %.1f, intersection %.1f, %.2f%% of reference, %.2f%% of profile\n",
+			       cx->profs[ix], vol, ivol, 100.0 * ivol/cx->rvol, 100.0 * ivol/vol);
+		fflush(stdout);
+		amutex_unlock(cx->lock);
+	}
 	return 0;
 }
 
+static void compare_gamuts(
+gparams *gp,
+char *ref_name,		/* Reference profile or .gam file */
+int nprofs,			/* Number of profiles to compare */
+char *profs[],		/* Profile names */
+int verb
+) {
+	cmpctx cx;
+	char *xl;
+	int i, nthr;
+	athread **ths;
+
+	if (nprofs < 1)
+		error("No profiles to compare against the reference");
+
+	/* Create the reference gamut */
+	if ((xl = strrchr(ref_name, '.')) != NULL && stricmp(xl, ".gam") == 0) {
+		if ((cx.ref = new_gamut(0.0, 0, 0)) == NULL)
+			error("Creation of reference gamut failed");
+		if (cx.ref->read_gam(cx.ref, ref_name))
+			error("Reading reference gamut '%s' failed",ref_name);
+	} else {
+		profobjs po;
+
+		po = open_luo(gp, ref_name, 0);
+		cx.ref = luo_gamut(gp, &po, 0);
+		close_luo(&po);
+	}
+
+	/* Setup the reference radial lookup before any threads use it */
+	cx.ref->radial_isect(cx.ref, NULL, CMPRES, &cx.rvol, NULL, NULL);
+	if (cx.rvol <= 0.0)
+		error("Reference gamut '%s' has no volume",ref_name);
+
+	if (verb)
+		printf("Reference '%s' volume %.1f cubic colorspace units\n",ref_name,cx.rvol);
+
+	cx.gp = gp;
+	cx.nprofs = nprofs;
+	cx.profs = profs;
+	cx.next = 0;
+	amutex_init(cx.lock);
+
+	if ((nthr = system_processors()) < 1)
+		nthr = 1;
+	if (nthr > nprofs)
+		nthr = nprofs;
+
+	if (verb)
+		printf("Comparing %d profiles using %d threads\n",nprofs,nthr);
+
+	if ((ths = (athread **)calloc(nthr, sizeof(athread *))) == NULL)
+		error("malloc failed");
+
+	for (i = 0; i < nthr; i++) {
+		if ((ths[i] = new_athread(cmp_thread, (void *)&cx)) == NULL)
+			error("Failed to create comparison thread");
+	}
+	for (i = 0; i < nthr; i++) {
+		ths[i]->wait(ths[i]);
+		ths[i]->del(ths[i]);
+	}
+	free(ths);
+
+	amutex_del(cx.lock);
+	cx.ref->del(cx.ref);
+}
+
 /* -------------------------------------------- */
 /* Code for special gamut surface plot */
 
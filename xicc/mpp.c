@@ -79,6 +79,7 @@
 #undef DEBUG
 #undef TESTDFUNC		/* Check delta functions */
 #undef NODDV			/* Use (very slow) non d/dv powell */
+#define USELEVMARQ		/* Use Levenberg-Marquardt rather than conjgrad for MULTIPASS */
 #undef DOPLOT			/* Plot the device curves */
 
 #undef NOPROCESS		/* Define to skip all fitting */
@@ -102,6 +103,7 @@
 //#define SHAPE_PMW 0.2	/* Shape parameter (wiggle) minimisation weight */
 #define SHAPE_PMW 10.0	/* Shape parameter (wiggle) minimisation weight */
 #define COMB_PMW 0.008	/* Primary combination anchor point distance weight */
+#define COMB_NRW 100.0	/* Primary combination non-real value residual weight (levmarq) */
 
 #define verbo stdout
 
@@ -2767,6 +2769,380 @@ double *pv
 }
 #endif /* TESTDFUNC */
 
+#ifdef USELEVMARQ
+/* ---------------------------------------------------- */
+/* Levenberg-Marquardt residual & Jacobian callbacks for the */
+/* MULTIPASS fits. These express the same error functions as */
+/* efunc2, efunc3 and efunc4 as a sum of squared residuals. */
+
+/* Transfer curve harmonic "wiggle" weight for efunc2 */
+static double trans_hw(int k) {
+	double w;
+
+	if (k <= 1) {						/* Use TRANS_HW01 */
+		w = TRANS_HW01;
+	} else if (k <= TRANS_HBREAK) {	/* Blend from TRANS_HW01 to TRANS_HWBR */
+		double bl = (k - 1.0)/(TRANS_HBREAK - 1.0);
+		w = (1.0 - bl) * TRANS_HW01 + bl * TRANS_HWBR;
+	} else {				/* Use TRANS_HWBR */
+		w = TRANS_HWBR + (k-TRANS_HBREAK) * TRANS_HWINC;
+	}
+	return w;
+}
+
+/* Return the band error of one test point for the efunc2 parameters, */
+/* and its partial derivatives in jr[] if jr != NULL */
+static double rjpatch2(mpp *p, double *jr, double pv[], mppcol *c) {
+	double tt;
+	double dtcnv_dpv[MPP_MXINKS][MPP_MXTCORD];	/* Del in tcnv[m] due to del in parameter */
+	double dww_dtcnv[MPP_MXINKS][MPP_MXINKS];	/* Del in ww[m] due to del in tcnv[m] */
+	double dtcnv_tc[MPP_MXINKS];				/* Del in tcnv'[m] due to del in tcnv[m] */
+	double dtcnv_ww[MPP_MXINKS];				/* Del in tcnv'[m] due to del in ww[m] */
+	double dov[MPP_MXINKS];						/* Del of ov due to del in tcnv'[m] */
+	double ddov; 								/* Del in final ov due to del in raw ov */
+	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
+	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
+	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double ov;
+	int j = p->oba;			/* Band being optimised */
+	int m, mo, k;
+
+	/* Compute the tranfer corrected device values */
+	/* and del in these values due to del in input parameters */
+	for (m = 0; m < p->n; m++) {
+		tcnv[m] = icxdpTransFunc(&pv[m * p->cord], dtcnv_dpv[m], p->cord, c->nv[m]);
+		tcnv1[m] = 1.0 - tcnv[m];
+		ww[m] = 0.0;
+		for (mo = 0; mo < p->n; mo++)
+			dww_dtcnv[mo][m] = 0.0;
+	}
+
+	if (p->useshape) {
+
+		/* Lookup the shape values */
+		for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
+			double vv;
+	 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
+				if (k & (1 << m))
+					vv *= tcnv[m];
+				else
+					vv *= tcnv1[m];
+			}
+			for (m = 0; m < p->n; m++) {
+				ww[m] += p->shape[m][k & ~(1<<m)][j] * vv;
+									/* Apply weighting to shape vertex value */
+			}
+		}
+
+		/* Compute del ww[m][m] for del tcnv[m] */
+		for (m = 0; m < p->n; m++) {			/* For each input channel were doing del of */
+			for (k = 0; k < p->nn; k++) {
+				int mm;
+				double vv = 1.0;
+				for (mm = 0; mm < p->n; mm++) {	/* Compute weight for node k */
+					if (m == mm)
+						continue;
+					if (k & (1 << mm))
+						vv *= tcnv[mm];
+					else
+						vv *= tcnv1[mm];
+				}
+				for (mo = 0; mo < p->n; mo++) {				/* For each output channel */
+					double vvv = vv * p->shape[mo][k & ~(1<<mo)][j];
+					if (k & (1 << m))
+						dww_dtcnv[mo][m] += vvv;
+					else
+						dww_dtcnv[mo][m] -= vvv;
+				}
+			}
+		}
+	}
+
+	/* Apply the shape values to adjust the primaries */
+	for (m = 0; m < p->n; m++) {
+		double gg = ww[m];				/* Curve adjustment */
+		double sv, dsv, vv = tcnv[m];		/* Input value to be tweaked */
+		if (gg >= 0.0) {
+			tt = gg - gg * vv + 1.0;
+			sv = vv/tt;
+			dsv = (gg + 1.0)/(tt * tt);
+		} else {
+			tt = 1.0 - gg * vv;
+			sv = (vv - gg * vv)/tt;
+			dsv = (1.0 - gg)/(tt * tt);
+		}
+		tcnv[m] = sv;
+		tcnv1[m] = 1.0 - sv;
+		dtcnv_tc[m] = dsv;						/* del in tcnv[m] due to del in tcnv[m] */
+		dtcnv_ww[m] = (vv * vv - vv)/(tt * tt);	/* del in tcnv[m] due to del in ww[m] */
+	}
+
+	/* Compute the primary combination values */
+	for (ov = 0.0, k = 0; k < p->nn; k++) {
+		double vv = p->pc[k][j];
+ 		for (m = 0; m < p->n; m++) {
+			if (k & (1 << m))
+				vv *= tcnv[m];
+			else
+				vv *= tcnv1[m];
+		}
+		ov += vv;
+	}
+
+	if (jr != NULL) {
+
+		/* Compute del ov for del tcnv[m] */
+		for (m = 0; m < p->n; m++) {
+			for (dov[m] = 0.0, k = 0; k < p->nn; k++) {
+				int mm;
+				double vv = p->pc[k][j];
+				for (mm = 0; mm < p->n; mm++) {
+					if (m == mm)
+						continue;
+					if (k & (1 << mm))
+						vv *= tcnv[mm];
+					else
+						vv *= tcnv1[mm];
+				}
+				if (k & (1 << m))
+					dov[m] += vv;
+				else
+					dov[m] -= vv;
+			}
+		}
+
+		/* Delta from input params to output */
+		ddov = dDE(ov);
+		for (m = 0;  m < p->n; m++) {
+			for (k = 0; k < p->cord; k++) {
+				double ttt;
+				int mm;
+	
+				/* delta via dww */
+				for (ttt = 0.0, mm = 0; mm < p->n; mm++)
+					ttt += dov[mm] * dtcnv_ww[mm] * dww_dtcnv[mm][m] * dtcnv_dpv[m][k];
+	
+				/* delta direct */
+				jr[m * p->cord + k] = ddov * (ttt + dov[m] * dtcnv_tc[m] * dtcnv_dpv[m][k]);
+			}
+		}
+	}
+
+	/* Return the band value error */
+	return lDE(ov) - c->lband[j];
+}
+
+/* Return the band error of one test point for the efunc3 parameters, */
+/* and its partial derivatives in jr[] if jr != NULL */
+/* Assume test point tcnv and fcnv are setup by sfunc3() */
+static double rjpatch3(mpp *p, double *jr, double pv[], mppcol *c) {
+	double tt;
+	double dtcnv[MPP_MXINKS];	/* Derivative of transfer curve corrected device values */
+	double dov[MPP_MXINKS];		/* Derivative of output interpolation device values */
+	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
+	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
+	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double ov, ddov;
+	int j = p->oba;			/* Band being optimised */
+	int n1 = p->n - 1;
+	int m, k;
+
+	for (m = 0; m < p->n; m++)
+		ww[m] = 0.0;
+
+	/* Interpolate the per ink shape values for this set of input values */
+	for (k = 0; k < p->nnn2; k++) {
+		m = k >> n1; 					/* Corresponding ink channel */
+		ww[m] += pv[k] * c->fcnv[k]; /* Apply weighting to shape vertex value */
+	}
+
+	/* Apply the shape values to adjust the primaries */
+	for (m = 0; m < p->n; m++) {
+		double gg = ww[m];				/* Curve adjustment */
+		double sv, vv = c->tcnv[m];		/* Input value to be tweaked */
+		if (gg >= 0.0) {
+			tt = gg - gg * vv + 1.0;
+			sv = vv/tt;
+		} else {
+			tt = 1.0 - gg * vv;
+			sv = (vv - gg * vv)/tt;
+		}
+		tcnv[m] = sv;
+		tcnv1[m] = 1.0 - sv;
+		dtcnv[m] = (vv * vv - vv)/(tt * tt);	/* del in tcnv[m] due to del in ww[m] */
+	}
+
+	/* Compute the primary combination values */
+	for (ov = 0.0, k = 0; k < p->nn; k++) {
+		double vv = p->pc[k][j];
+		for (m = 0; m < p->n; m++) {
+			if (k & (1 << m))
+				vv *= tcnv[m];
+			else
+				vv *= tcnv1[m];
+		}
+		ov += vv;
+	}
+
+	if (jr != NULL) {
+
+		/* Compute del ov[m] for del tcnv[m] */
+		for (m = 0; m < p->n; m++) {
+			for (dov[m] = 0.0, k = 0; k < p->nn; k++) {
+				int mm;
+				double vv = p->pc[k][j];
+				for (mm = 0; mm < p->n; mm++) {
+					if (m == mm)
+						continue;
+					if (k & (1 << mm))
+						vv *= tcnv[mm];
+					else
+						vv *= tcnv1[mm];
+				}
+				if (k & (1 << m))
+					dov[m] += vv;
+				else
+					dov[m] -= vv;
+			}
+			dov[m] *= dtcnv[m];		/* del ov[m] due to del in ww[m] */
+		}
+
+		ddov = dDE(ov);
+		for (k = 0; k < p->nnn2; k++) {
+			m = k >> n1; 					/* Corresponding ink channel */
+			jr[k] = ddov * dov[m] * c->fcnv[k];
+		}
+	}
+
+	/* Return the band value error */
+	return lDE(ov) - c->lband[j];
+}
+
+/* Return the band error of one test point for the efunc4 parameters, */
+/* and its partial derivatives in jr[] if jr != NULL */
+/* Assume test point pcnv are setup by sfunc4() */
+static double rjpatch4(mpp *p, double *jr, double pv[], mppcol *c) {
+	double ov, ddov;
+	int j = p->oba;			/* Band being optimised */
+	int k;
+
+	for (ov = 0.0, k = 0; k < p->nn; k++)
+		ov += c->pcnv[k] * pv[k];
+
+	if (jr != NULL) {
+		ddov = dDE(ov);
+		for (k = 0; k < p->nn; k++)
+			jr[k] = ddov * c->pcnv[k];
+	}
+
+	/* Return the band value error */
+	return lDE(ov) - c->lband[j];
+}
+
+/* Return the residual of test point i, scaled by 1/sqrt(nodp) to match */
+/* efuncN, and its non-zero Jacobian row entries if jv != NULL */
+static double rjpatches(
+mpp *p,
+double (*rjpatch)(mpp *p, double *jr, double pv[], mppcol *c),
+int np,
+int i,
+double jv[],
+int jx[],
+int *nz,
+double *pv
+) {
+	double sc = 1.0/sqrt((double)p->nodp);
+	double rv;
+	int k, n;
+
+	rv = sc * rjpatch(p, jv, pv, &p->cols[i]);
+
+	/* Compact the row down to its non-zero entries */
+	if (jv != NULL) {
+		for (n = k = 0; k < np; k++) {
+			if (jv[k] != 0.0) {
+				jv[n] = sc * jv[k];
+				jx[n++] = k;
+			}
+		}
+		*nz = n;
+	}
+	return rv;
+}
+
+/* Transfer curve residuals for levmarq(). */
+/* There are nodp test point + n * cord wiggle residuals */
+static double rjfunc2(void *adata, int i, double jv[], int jx[], int *nz, double pv[]) {
+	mpp *p = (mpp *)adata;
+	double sw;
+
+	if (i < p->nodp)
+		return rjpatches(p, rjpatch2, p->n * p->cord, i, jv, jx, nz, pv);
+
+	/* Weighted magnitude of shaper parameters */
+	/* to minimise unconstrained "wiggles" */
+	i -= p->nodp;
+	sw = sqrt(trans_hw(i % p->cord)/(double)p->n);
+	if (jv != NULL) {
+		jv[0] = sw;
+		jx[0] = i;
+		*nz = 1;
+	}
+	return sw * pv[i];
+}
+
+/* Shape parameter residuals for levmarq(). */
+/* There are nodp test point + nnn2 wiggle residuals */
+static double rjfunc3(void *adata, int i, double jv[], int jx[], int *nz, double pv[]) {
+	mpp *p = (mpp *)adata;
+	double sw = sqrt(SHAPE_PMW/(double)p->nnn2);
+
+	if (i < p->nodp)
+		return rjpatches(p, rjpatch3, p->nnn2, i, jv, jx, nz, pv);
+
+	/* Magnitude of shaper parameters to minimise unconstrained "wiggles" */
+	i -= p->nodp;
+	if (jv != NULL) {
+		jv[0] = sw;
+		jx[0] = i;
+		*nz = 1;
+	}
+	return sw * pv[i];
+}
+
+/* Vertex value residuals for levmarq(). */
+/* There are nodp test point + nn anchor + nn non-real value residuals */
+static double rjfunc4(void *adata, int i, double jv[], int jx[], int *nz, double pv[]) {
+	mpp *p = (mpp *)adata;
+	double sw = sqrt(COMB_PMW/(double)p->nn);
+	int j = p->oba;				/* Band being optimised */
+
+	if (i < p->nodp)
+		return rjpatches(p, rjpatch4, p->nn, i, jv, jx, nz, pv);
+	i -= p->nodp;
+
+	/* Anchor point error */
+	if (i < p->nn) {
+		if (jv != NULL) {
+			jv[0] = sw * dDE(pv[i]);
+			jx[0] = i;
+			*nz = 1;
+		}
+		return sw * (lDE(pv[i]) - p->lpca[i][j]);
+	}
+	i -= p->nn;
+
+	/* Stop non-real values */
+	if (jv != NULL) {
+		jv[0] = pv[i] < 0.0 ? COMB_NRW : 0.0;
+		jx[0] = i;
+		*nz = 1;
+	}
+	return pv[i] < 0.0 ? COMB_NRW * pv[i] : 0.0;
+}
+
+#endif /* USELEVMARQ */
+
 /* ---------------------------------------------------- */
 /* Optimise whole model in one go */
 
@@ -4151,9 +4527,15 @@ static int create(
 			                          efunc2, (void *)p, mppprog, (void *)p) != 0)
 				error ("Powell failed");
 #else /* !NODDV */
+# ifdef USELEVMARQ
+			if (levmarq(&resid, p->n * p->cord, p->nodp + p->n * p->cord, pv, thr * 0.01, 200,
+			                   rjfunc2, (void *)p, mppprog, (void *)p) != 0)
+				error ("Levenberg-Marquardt failed");
+# else /* !USELEVMARQ */
 			if (conjgrad(&resid, p->n * p->cord, pv, sr, thr * 0.01, 200,
 			                   efunc2, dfunc2, (void *)p, mppprog, (void *)p)!= 0)
 				error ("ConjGrad failed");
+# endif /* !USELEVMARQ */
 #endif /* !NODDV */
 
 			/* Put results back into place */
@@ -4198,9 +4580,15 @@ static int create(
 					error ("Powell failed");
 
 #else /* !NODDV */
+# ifdef USELEVMARQ
+				if (levmarq(&resid, p->nnn2, p->nodp + p->nnn2, pv, thr * 0.05, 2000,
+				          rjfunc3, (void *)p, mppprog, (void *)p) != 0)
+					error ("Levenberg-Marquardt failed");
+# else /* !USELEVMARQ */
 				if (conjgrad(&resid, p->nnn2, pv, sr, thr * 0.05, 2000,
 				          efunc3, dfunc3, (void *)p, mppprog, (void *)p) != 0.0)
 					error ("ConjGrad failed");
+# endif /* !USELEVMARQ */
 #endif /* !NODDV */
 
 				/* Put results back into place */
@@ -4247,9 +4635,15 @@ static int create(
 			                 efunc4, (void *)p, mppprog, (void *)p) != 0)
 				error ("Powell failed");
 #else /* !NODDV */
+# ifdef USELEVMARQ
+			if (levmarq(&resid, p->nn, p->nodp + 2 * p->nn, pv, thr * 0.01, 500,
+			          rjfunc4, (void *)p, mppprog, (void *)p) != 0)
+				error ("Levenberg-Marquardt failed");
+# else /* !USELEVMARQ */
 			if (conjgrad(&resid, p->nn, pv, sr, thr * 0.01, 500,
 			          efunc4, dfunc4, (void *)p, mppprog, (void *)p) != 0)
 				error ("ConjGrad failed");
+# endif /* !USELEVMARQ */
 #endif /* !NODDV */
 
 			/* Put results back into place */
@@ -64,7 +64,7 @@ void usage(void) {
 	fprintf(stderr," -l tlimit      set total ink limit, 0 - 400%% (estimate by default)\n");
 	fprintf(stderr," -L klimit      set black ink limit, 0 - 100%% (estimate by default)\n");
 	fprintf(stderr," -p absprof     Include abstract profile in output tables\n");
-//	fprintf(stderr," -s             Use internal optimized separation for CMYK\n");
+	fprintf(stderr," -s             Use internal optimized separation for CMYK\n");
 	exit(1);
 }
 
@@ -302,7 +302,7 @@ main(int argc, char *argv[]) {
 	double Kstle = 0.0, Kstpo = 0.0, Kenle = 0.0, Kenpo = 0.0, Kshap = 0.0;
 	double tlimit = -1.0;	/* Total ink limit */
 	double klimit = -1.0;	/* Black ink limit */
-	int intsep = 0;			/* Not implemented in xicc yet ??? */
+	int intsep = 0;			/* Use internal separation */
 	int rv = 0;
 
 
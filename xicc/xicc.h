@@ -259,11 +259,13 @@ struct _xicc {
 #define ICX_CAM_CLIP     0x0100		/* Use CAM space during invfwd clipping lookup, */
 									/* irrespective of the native or effective PCS. */
 									/* Ignored if MERGE_CLUT is set or vector clip is used. */
-									/* May halve the inverse lookup performance! */ 
+									/* Values well out of gamut are clipped to a CAM gamut */
+									/* surface created at setup (USECAMCLIPSURF in xlut.c). */
 #define ICX_INT_SEPARATE 0x0400		/* Handle 4 dimensional devices with fixed inking rules */
 									/* with an optimised internal separation pass, rather */
 									/* than a point by point inverse locus lookup . */
-									/* NOT IMPLEMENTED YET */
+									/* Only used for icxKluma5 and icxKluma5k rules, and */
+									/* falls back to the locus lookup on clipping. */
 #define ICX_FAST_SETUP   0x0800		/* Improve initial setup speed at the cost of throughput */
 #define ICX_VERBOSE      0x8000		/* Turn on verboseness during creation */
 
@@ -552,6 +554,9 @@ struct _icxLuLut {
 	/* private: */
 	rspl	        *clutTable;				/* The multi dimension lookup */
 	rspl	        *cclutTable;			/* Alternate multi dimension lookup in CAM space */
+	struct _icxCamSurf *camsurf;			/* Cached CAM space gamut surface for clipping */
+	rspl	        *sepTable;				/* Internal separation output' -> input' */
+	int             sepch[MXDI];			/* Separation CMY input' chanels, K chanel last */
 	/* Inverted RSPLs used to speed ink limit calculation */
 	/* input' -> input */
 	rspl *revinputTable[MXDI];
@@ -104,7 +104,7 @@ void usage(char *diag) {
 	fprintf(stderr," -u             warn if output PCS is outside the spectrum locus\n");
 	fprintf(stderr," -m             merge output processing into clut\n");
 	fprintf(stderr," -b             use CAM Jab for clipping\n");
-//	fprintf(stderr," -S             Use internal optimised separation for inverse 4d [NOT IMPLEMENTED]\n");
+	fprintf(stderr," -S             Use internal optimised separation for inverse 4d\n");
 
 #ifdef SPTEST
 	fprintf(stderr," -w             special gamut surface test PCS space\n");
@@ -761,7 +761,7 @@ main(int argc, char *argv[]) {
 	}
 
 	/* Open up the profile for reading */
-	if ((fp = new_icmFileStd_name(&err, prof_name,"r")) == NULL)
+	if ((fp = new_icmFileMMap_name(&err, prof_name)) == NULL)
 		error ("Can't open file '%s' (0x%x, '%s')",prof_name,err.c,err.m);
 
 	if ((icco = new_icc(&err)) == NULL)
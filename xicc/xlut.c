@@ -104,6 +104,14 @@
 #define CAMCLIPTRANS 1.0		/* [1.0] Cam clipping transition region Delta E */
 								/* Should this be smaller ? */
 #undef USECAMCLIPSPLINE			/* [Und] use spline blend between PCS and Jab */
+#define USECAMCLIPSURF			/* [Def] Use cached Jab gamut surface to clip well out of gamut */
+								/* (Much faster, but changes the clip result) */
+#define CAMSURFRES 5.0			/* [5.0] Jab gamut surface resolution */
+#define CAMSURFNP 40000			/* [40000] Number of Jab gamut surface sample points */
+#define CAMSURFBRES 16			/* [16] Jab surface point bucket grid resolution */
+#define CAMSURFMIN 3.0			/* [3.0] Minimum Jab clip distance to use the surface for */
+#define CAMSURFIN 0.05			/* [0.05] Distance to put surface clip point inside the gamut */
+#define CAMSURFITS 4			/* [4] Number of times to move it further in if needed */
 
 #define USELCHWEIGHT			/* [def] Use LCh weighting for nn clip if possible */
 #define JCCWEIGHT	2.0			/* [2.0] Amount to emphasize J delta E in in computing clip */
@@ -113,6 +121,9 @@
 #define KLOCUS2BLACKONLY		/* [def] Make K locus inking rules from zero to max */
 								/*       rather than min to max of locus */
 
+#define LIMMONORES 256			/* [256] Curve samples to check the ink limit is monotonic */
+#define LIMMONOTOL 1e-9			/* [1e-9] Curve decrease tollerated as monotonic */
+
 /*
  * TTBD:
  *
@@ -129,6 +140,14 @@ static double icxLimitD(icxLuLut *p, double *in);		/* For input' */
 #define icxLimitD_void ((double (*)(void *, double *))icxLimitD)	/* Cast with void 1st arg */
 static double icxLimit(icxLuLut *p, double *in);		/* For input */
 static int icxLuLut_init_clut_camclip(icxLuLut *p);
+#ifdef USECAMCLIPSURF
+static int icxLuLut_init_camclip_surf(icxLuLut *p);
+static int icxLuLut_camclip_surf(icxLuLut *p, double *cin, double *cdist, double *in);
+#endif
+static void icxLuLut_free_camclip_surf(icxLuLut *p);
+static int icxLuLut_init_intsep(icxLuLut *p);
+static int icxLuLut_inv_clut_intsep(icxLuLut *p, double *out, double *auxv, double *clipd, double *in);
+static void icxLuLut_free_intsep(icxLuLut *p);
 
 /* Debug overall lookup */
 #ifdef DEBUG_OLUT
@@ -656,6 +675,41 @@ double *ind
 	return icxLimit(p, in);
 }
 
+/* Return nz if icxLimitD() is monotonic non-decreasing in each input', */
+/* so that the rspl reverse setup can bound it over blocks of grid points. */
+/* It is if each reverse input curve and any calibration curve never */
+/* decreases, and the device values don't go below 0.0, which we check */
+/* by sampling the curves. */
+static int icxLimitD_mono(
+icxLuLut *p
+) {
+	double pv = 0.0;
+	int e, i;
+	co tc;
+
+	for (e = 0; e < p->inputChan; e++) {
+		for (i = 0; i < LIMMONORES; i++) {
+			tc.p[0] = p->ninmin[e] + i/(LIMMONORES-1.0) * (p->ninmax[e] - p->ninmin[e]);
+			p->revinputTable[e]->interp(p->revinputTable[e], &tc);
+			if (tc.v[0] < -LIMMONOTOL || (i > 0 && tc.v[0] < (pv - LIMMONOTOL)))
+				return 0;
+			pv = tc.v[0];
+		}
+	}
+
+	if (p->pp->cal != NULL) {
+		for (e = 0; e < p->pp->cal->devchan; e++) {
+			for (i = 0; i < LIMMONORES; i++) {
+				double v = p->pp->cal->interp_ch(p->pp->cal, e, i/(LIMMONORES-1.0));
+				if (i > 0 && v < (pv - LIMMONOTOL))
+					return 0;
+				pv = v;
+			}
+		}
+	}
+	return 1;
+}
+
 /* Ink limit+gamut limit clipping function for xLuLut (CMYK). */
 /* Return nz if there was clipping */
 static int icxDoLimit(
@@ -956,12 +1010,36 @@ double *in		/* Function input values to invert (== clut output' values) */
 	double tin[MXDO];	/* PCS value to be inverted */
 	double cdist = 0.0;	/* clip DE */
 	int crv = 0;		/* Return value - set to 1 if clipped */
+#ifdef USECAMCLIPSURF
+	double stin[MXDO];	/* CAM surface clipped PCS value */
+	double scdist = 0.0;	/* CAM surface clip DE */
+	int sclip = 0;		/* Set to 1 if clipped to CAM surface */
+#endif
 
 	if (p->nearclip != 0)
 		flags |= RSPL_NEARCLIP;			/* Use nearest clipping rather than clip vector */
 
 	DBR(("inv_clut_aux input is %f %f %f\n",in[0], in[1], in[2]))
 
+	/* Use the internal separation if we can. This only handles */
+	/* in gamut values, so fall through to the locus lookup otherwise. */
+	if (p->sepTable != NULL && auxr == NULL && auxt == NULL) {
+		if (icxLuLut_inv_clut_intsep(p, out, auxv, clipd, in) == 0)
+			return 0;
+	}
+
+#ifdef USECAMCLIPSURF
+	/* If we are doing CAM clipping, use the cached Jab gamut surface to */
+	/* clip values that are well out of gamut, so that they only need an */
+	/* in gamut inverse, rather than a PCS and then a CAM nearest clip search. */
+	if (p->camclip && p->nearclip && auxr == NULL
+	 && icxLuLut_camclip_surf(p, stin, &scdist, in) != 0) {
+		DBR(("inv_clut_aux CAM surface clipped to %f %f %f\n",stin[0], stin[1], stin[2]))
+		in = stin;
+		sclip = 1;
+	}
+#endif
+
 	if (auxr != NULL) {		/* Set a default locus range */
 		int ee = 0;
 		for (e = 0; e < p->clutTable->di; e++) {
@@ -1537,6 +1615,13 @@ if (p->ink.tlimit >= 0.0 || p->ink.klimit >= 0.0) {
 }
 #endif
 
+#ifdef USECAMCLIPSURF
+	if (sclip) {		/* We clipped to the CAM surface */
+		crv = 1;
+		cdist += scdist;
+	}
+#endif
+
 	if (clipd != NULL) {
 		*clipd = cdist;
 		DBR(("inv_clut_aux returning clip DE %f\n",cdist))
@@ -1761,6 +1846,8 @@ icxLuBase *pp
 	if (p->cclutTable != NULL)
 		p->cclutTable->del(p->cclutTable);
 
+	icxLuLut_free_camclip_surf(p);
+	icxLuLut_free_intsep(p);
 
 	if (p->plu != NULL)
 		p->plu->del(p->plu);
@@ -1883,6 +1970,7 @@ icxInk   *ink,			/* inking details (NULL for default) */
 int       setLminmax	/* Figure the L locus for inking rule */
 ) {
 	int devchan = p->func == icmFwd ? p->inputChan : p->outputChan;
+	int limmono;			/* NZ if ink limit function is monotonic */
 
 	if (ink) {
 		p->ink = *ink;	/* Copy the structure */
@@ -1918,6 +2006,14 @@ int       setLminmax	/* Figure the L locus for inking rule */
 		0.0					/* Value that limit() is not to exceed */
 	);
 
+	/* If the total and black ink limits only increase with each device value, */
+	/* the reverse setup need not evaluate them at every grid vertex. */
+	limmono = icxLimitD_mono(p);
+	p->clutTable->rev_set_limit_mono(p->clutTable, limmono);
+
+	/* Any internal separation will need re-creating */
+	icxLuLut_free_intsep(p);
+
 	/* Duplicate in the CAM clip rspl if it exists */
 	if (p->cclutTable != NULL) {
 		p->cclutTable->rev_set_limit(
@@ -1929,8 +2025,12 @@ int       setLminmax	/* Figure the L locus for inking rule */
 			(void *)p,			/* Context passed to limit() */
 			0.0					/* Value that limit() is not to exceed */
 		);
+		p->cclutTable->rev_set_limit_mono(p->cclutTable, limmono);
 	}
 
+	/* The CAM clip surface will need re-creating with the new limits */
+	icxLuLut_free_camclip_surf(p);
+
 	/* Figure Lmin and Lmax for icxKluma5 curve basis */
 	if (setLminmax
 	 && p->clutTable->di > p->clutTable->fdi) {	/* If K generation makes sense */
@@ -2173,10 +2273,9 @@ icxInk                *ink			/* inking details (NULL for default) */
 	 && !(p->mergeclut != 0 && pcsor == icxSigJabData))		/* Don't need camclip if merged Jab */
 		p->camclip = 1;
 
-	if (flags & ICX_INT_SEPARATE) {
-fprintf(stderr,"~1 Internal optimised 4D separations not yet implemented!\n");
+	/* Internal separation is created at the end of setup */
+	if (flags & ICX_INT_SEPARATE)
 		p->intsep = 1;
-	}
 
 	/* Init the CAM model if it will be used */
 	if (pcsor == icxSigJabData || p->camclip) {
@@ -2374,6 +2473,19 @@ fprintf(stderr,"~1 Internal optimised 4D separations not yet implemented!\n");
 			p->del((icxLuBase *)p);
 			return NULL;
 		}
+
+		/* Create any internal separation now rather than on first use, */
+		/* so that lookups from several threads don't race to create it. */
+		/* If it isn't applicable, the locus inverse is used. */
+		if (p->intsep)
+			icxLuLut_init_intsep(p);
+
+#ifdef USECAMCLIPSURF
+		/* Likewise create the CAM clip surface. If it can't be */
+		/* created, the blended PCS/CAM clip is used instead. */
+		if (p->camclip && p->nearclip && icxLuLut_init_camclip_surf(p) != 0)
+			icxLuLut_free_camclip_surf(p);
+#endif
 	}
 
 	return (icxLuBase *)p;
@@ -2466,9 +2578,219 @@ icxLuLut *p) {
 		(void *)p,			/* Context passed to limit() */
 		0.0					/* Value that limit() is not to exceed */
 	);
+	p->cclutTable->rev_set_limit_mono(p->cclutTable, icxLimitD_mono(p));
 	return 0;
 }
 
+/* ========================================================== */
+/* Internal separation support for ICX_INT_SEPARATE.          */
+/* ========================================================== */
+
+/* For a 4 input device with a fixed inking rule (i.e. K depends only */
+/* on the target PCS), the inverse solutions form a 3 dimensional */
+/* separation. We sample it once using the full locus inverse, and fit */
+/* a PCS' -> device' rspl to the samples. An in gamut inverse lookup is */
+/* then the separation lookup, followed by a 3D -> 3D Newton refinement */
+/* of the CMY' against the clut with K' held fixed, which is much */
+/* faster than a locus + auxiliary inverse of the 4D clut. */
+/* All values are in input' and output' space. */
+
+#define ISEPRES 7		/* Device' sampling grid resolution for the separation */
+#define ISEPGRES 17		/* Separation rspl grid resolution */
+#define ISEPITERS 10	/* Maximum refinement iterations */
+#define ISEPTOL 1e-4	/* Refinement output' tolerance */
+#define ISEPKTOL 0.02	/* Maximum K' departure from the separation, as fraction of range */
+
+/* Create the internal separation. */
+/* Return nz if it isn't applicable or fails. */
+static int
+icxLuLut_init_intsep(
+icxLuLut *p) {
+	int e, f, nsp, k;
+	int gres[MXDI];
+	double vlow[MXDI], vhigh[MXDI];
+	co *sp;
+	DCOUNT(gc, MXDI, 4, 0, 0, ISEPRES);
+
+	/* Only for 4 -> 3 with a K rule that is a fixed function of the PCS */
+	if (p->clutTable->di != 4 || p->clutTable->fdi != 3
+	 || (p->ink.k_rule != icxKluma5 && p->ink.k_rule != icxKluma5k))
+		return 1;
+
+	for (k = e = 0; e < 4; e++) {
+		if (p->auxm[e] == 0) {
+			if (k >= 3)
+				return 1;
+			p->sepch[k++] = e;
+		} else
+			p->sepch[3] = e;
+	}
+	if (k != 3)
+		return 1;
+
+	if ((sp = (co *)malloc(sizeof(co) * ISEPRES * ISEPRES * ISEPRES * ISEPRES)) == NULL)
+		return 1;
+
+	/* Sample the separation by looking up the PCS' of a grid */
+	/* of device' values using the locus inverse. */
+	/* (sepTable is still NULL, so this won't recurse) */
+	nsp = 0;
+	DC_INIT(gc);
+	while (!DC_DONE(gc)) {
+		co tc;
+		double cd;
+
+		for (e = 0; e < 4; e++)
+			tc.p[e] = p->ninmin[e] + gc[e]/(ISEPRES - 1.0) * (p->ninmax[e] - p->ninmin[e]);
+
+		if ((p->ink.tlimit < 0.0 && p->ink.klimit < 0.0) || icxLimitD(p, tc.p) <= 0.0) {
+			p->clutTable->interp(p->clutTable, &tc);
+
+			if (icxLuLut_inv_clut_aux(p, sp[nsp].v, NULL, NULL, NULL, &cd, tc.v) == 0) {
+				for (f = 0; f < 3; f++)
+					sp[nsp].p[f] = tc.v[f];
+				nsp++;
+			}
+		}
+		DC_INC(gc);
+	}
+	if (nsp < 20) {					/* Hmm. Not enough to go on */
+		free(sp);
+		return 1;
+	}
+
+	/* Fit the separation */
+	if ((p->sepTable = new_rspl(RSPL_NOFLAGS, 3, 4)) == NULL) {
+		free(sp);
+		return 1;
+	}
+	for (f = 0; f < 3; f++)
+		gres[f] = ISEPGRES;
+	for (e = 0; e < 4; e++) {
+		vlow[e] = p->ninmin[e];
+		vhigh[e] = p->ninmax[e];
+	}
+	p->sepTable->fit_rspl(p->sepTable, RSPL_NOFLAGS, sp, nsp, p->noutmin, p->noutmax, gres,
+	                  vlow, vhigh, 1.0, NULL, NULL);
+	free(sp);
+
+	return 0;
+}
+
+/* Do an output'->input' lookup using the internal separation. */
+/* Return nz if it wasn't an in gamut lookup, and */
+/* the locus inverse should be used instead. */
+static int
+icxLuLut_inv_clut_intsep(
+icxLuLut *p,
+double *out,		/* Function return values */
+double *auxv,		/* If not NULL, return aux value used */
+double *clipd,		/* If not NULL, return DE to gamut on clipi, 0 for not clip */
+double *in			/* Function input values to invert (== clut output' values) */
+) {
+	co tc;
+	double dev[MXDI], sepk;
+	int var[3];			/* Chanels being refined */
+	int swapped = 0;
+	int e, f, it;
+
+	/* Separation gives the starting point and K' */
+	icmCpy3(tc.p, in);
+	p->sepTable->interp(p->sepTable, &tc);
+	for (e = 0; e < 4; e++) {
+		dev[e] = tc.v[e];
+		if (dev[e] < p->ninmin[e])
+			dev[e] = p->ninmin[e];
+		else if (dev[e] > p->ninmax[e])
+			dev[e] = p->ninmax[e];
+	}
+	sepk = dev[p->sepch[3]];
+
+	/* Refine the CMY' with the K' fixed so that the clut value matches */
+	/* the target. If a CMY' chanel hits its limit (i.e. we're at the */
+	/* edge of the K' locus), then refine K' in its place. */
+	for (e = 0; e < 3; e++)
+		var[e] = p->sepch[e];
+
+	for (it = 0;; it++) {
+		double err[3], jac[3][3], ijac[3][3], dc[3], de;
+
+		icmCpyN(tc.p, dev, 4);
+		p->clutTable->interp(p->clutTable, &tc);
+		for (de = 0.0, f = 0; f < 3; f++) {
+			err[f] = in[f] - tc.v[f];
+			de += err[f] * err[f];
+		}
+		if (de <= (ISEPTOL * ISEPTOL))
+			break;
+		if (it >= ISEPITERS)
+			return 1;			/* Didn't converge, probably out of gamut */
+
+		/* Numerical Jacobian */
+		for (e = 0; e < 3; e++) {
+			int ch = var[e];
+			double del = 1e-4 * (p->ninmax[ch] - p->ninmin[ch]);
+			co tc2;
+
+			icmCpyN(tc2.p, dev, 4);
+			if ((tc2.p[ch] + del) > p->ninmax[ch])
+				del = -del;
+			tc2.p[ch] += del;
+			p->clutTable->interp(p->clutTable, &tc2);
+			for (f = 0; f < 3; f++)
+				jac[f][e] = (tc2.v[f] - tc.v[f])/del;
+		}
+		if (icmInverse3x3(ijac, jac))
+			return 1;
+		icmMulBy3x3(dc, ijac, err);
+		for (e = 0; e < 3; e++) {
+			int ch = var[e];
+			dev[ch] += dc[e];
+			if (dev[ch] < p->ninmin[ch] || dev[ch] > p->ninmax[ch]) {
+				if (dev[ch] < p->ninmin[ch])
+					dev[ch] = p->ninmin[ch];
+				else
+					dev[ch] = p->ninmax[ch];
+				if (!swapped) {
+					var[e] = p->sepch[3];
+					swapped = 1;
+				}
+			}
+		}
+	}
+
+	/* If we had to move along the edge of the K' locus, make sure we */
+	/* haven't wandered too far from the separation K' */
+	if (swapped) {
+		int ch = p->sepch[3];
+		if (fabs(dev[ch] - sepk) > (ISEPKTOL * (p->ninmax[ch] - p->ninmin[ch])))
+			return 1;
+	}
+
+	/* Make sure the result is within the ink limits */
+	if ((p->ink.tlimit >= 0.0 || p->ink.klimit >= 0.0) && icxLimitD(p, dev) > 0.0)
+		return 1;
+	for (e = 0; e < 4; e++)
+		p->licent[e] = out[e] = dev[e];
+
+	if (auxv != NULL)
+		auxv[0] = dev[p->sepch[3]];
+
+	if (clipd != NULL)
+		*clipd = 0.0;
+
+	DBR(("inv_clut_intsep returning %f %f %f %f\n",out[0],out[1],out[2],out[3]))
+	return 0;
+}
+
+/* Free any internal separation */
+static void icxLuLut_free_intsep(icxLuLut *p) {
+	if (p->sepTable != NULL) {
+		p->sepTable->del(p->sepTable);
+		p->sepTable = NULL;
+	}
+}
+
 /* ========================================================== */
 /* xicc creation code                                         */
 /* ========================================================== */
@@ -2871,6 +3193,7 @@ int	               ores				/* Num of out-table entries */
 	int rsplflags = RSPL_NOFLAGS;		/* Flags for scattered data rspl */
 	int singleintent = 0;				/* nz if only a single intent (i.e. 0 tag rather than 1) */
 	int e, f, i, j;
+	int rv;
 	double dwhite[MXDI], dblack[MXDI];	/* Device white and black values */
 	double wp[3];			/* Absolute White point in XYZ */
 	double bp[3];			/* Absolute Black point in XYZ */
@@ -3701,7 +4024,8 @@ int	               ores				/* Num of out-table entries */
 
 		/* Use our xfit to set the icc Lut AtoB table values. */
 		/* Use icc helper function to do the hard work. */
-		if (icco->create_lut_xforms(icco, ICM_CLUT_SET_EXACT, (void *)cntx, 
+		ATIMER_BEGIN("clut fill A2B")
+		rv = icco->create_lut_xforms(icco, ICM_CLUT_SET_EXACT, (void *)cntx, 
 			nsigs, sigs,				/* No. of tables + signatures */
 			2,							/* Bytes per value of CLUT, 1 or 2 */
 			(unsigned int)ires, (unsigned int *)gres, (unsigned int)ores, 
@@ -3713,7 +4037,9 @@ int	               ores				/* Num of out-table entries */
 			NULL, NULL,					/* Use default Maximum range of PCS' values */
 			set_output,					/* Linear output transform PCS'->PCS */
 			NULL, NULL					/* No APXLS */
-		)) {
+		);
+		ATIMER_END
+		if (rv != 0) {
 			xf->del(xf);
 //			printf("Setting %s->%s Lut failed: %d, %s",
 //			     icm2str(icmColorSpaceSig, h->colorSpace),
@@ -3839,6 +4165,337 @@ lutbwdgam_func(
 	/* Leave out[] unchanged */
 }
 
+/* Function to pass to rspl to create the CAM clip gamut surface from */
+/* the CAM clut grid points. */
+static void
+camclipgam_func(
+	void *pp,			/* lutgamctx structure */
+	double *out,		/* output' value at clut grid point (ie. Jab value) */
+	double *in			/* input' value at clut grid point (ie. device' value) */
+) {
+	lutgamctx *p    = (lutgamctx *)pp;
+
+	/* Figure if we are over the ink limit. */
+	if (   (p->x->ink.tlimit >= 0.0 || p->x->ink.klimit >= 0.0)
+	    && icxLimitD(p->x, in) > 0.0) {
+		int i;
+		double sf;
+		co tc;
+
+		/* We are, so use the bracket search to discover a scale */
+		/* for the clut input' value that will put us on the ink limit. */
+		for (i = 0; i < p->x->inputChan; i++)
+			p->in[i] = in[i];
+
+		if (zbrent(&sf, 0.0, 1.0, 1e-4, icxLimitFind, pp) != 0) {
+			return;		/* Give up */
+		}
+
+		/* Compute the CAM clut output for the ink limit value */
+		for (i = 0; i < p->x->inputChan; i++)
+			tc.p[i] = sf * in[i];
+		p->x->cclutTable->interp(p->x->cclutTable, &tc);
+		p->g->expand(p->g, tc.v);
+	} else {
+		p->g->expand(p->g, out);
+	}
+
+	/* Leave out[] unchanged */
+}
+
+/* Cached CAM space gamut surface, used to speed up CAM clipping. */
+/* Sample points on the surface are bucketed in a grid, so that */
+/* the LCh weighted nearest point can be found quickly. */
+typedef struct _icxCamSurf {
+	gamut *g;				/* Jab gamut surface, for in gamut test */
+	int np;					/* Number of surface sample points */
+	double (*pts)[3];		/* Jab surface sample points, in bucket order */
+	int res;				/* Bucket grid resolution */
+	double min[3], cw;		/* Bucket grid origin and cell width */
+	int *bst;				/* res^3+1 start index of each bucket's points in pts[] */
+	double lchw_sq[3];		/* LCh weighting squared */
+	double mw_sq;			/* Minimum LCh weighting squared */
+} icxCamSurf;
+
+/* Free the cached CAM clip surface */
+static void icxLuLut_free_camclip_surf(
+icxLuLut *p) {
+	icxCamSurf *cs = p->camsurf;
+
+	if (cs != NULL) {
+		if (cs->g != NULL)
+			cs->g->del(cs->g);
+		free(cs->pts);
+		free(cs->bst);
+		free(cs);
+		p->camsurf = NULL;
+	}
+}
+
+#ifdef USECAMCLIPSURF
+
+/* Return the bucket index of a Jab value, clamped to the grid */
+static void camsurf_bix(icxCamSurf *cs, int *ix, double *jab) {
+	int f;
+
+	for (f = 0; f < 3; f++) {
+		ix[f] = (int)floor((jab[f] - cs->min[f])/cs->cw);
+		if (ix[f] < 0)
+			ix[f] = 0;
+		else if (ix[f] >= cs->res)
+			ix[f] = cs->res-1;
+	}
+}
+
+/* Weighted distance squared between target and surface point, */
+/* as per the rspl LCh weighted nearest clip. */
+static double camsurf_lchw_sq(icxCamSurf *cs, double *in1, double *in2) {
+	double dl, da, db, c1, c2, dlsq, dcsq, dhsq;
+
+	dl = in1[0] - in2[0];
+	da = in1[1] - in2[1];
+	db = in1[2] - in2[2];
+	dlsq = dl * dl;
+	c1 = sqrt(in1[1] * in1[1] + in1[2] * in1[2]);
+	c2 = sqrt(in2[1] * in2[1] + in2[2] * in2[2]);
+	dcsq = (c1 - c2) * (c1 - c2);
+	if ((dhsq = da * da + db * db - dcsq) < 0.0)
+		dhsq = 0.0;
+
+	return cs->lchw_sq[0] * dlsq + cs->lchw_sq[1] * dcsq + cs->lchw_sq[2] * dhsq;
+}
+
+/* Create the cached Jab gamut surface used to speed up CAM clipping. */
+/* This is done at setup, so that lookups only read it. */
+/* Return nz on error */
+static int icxLuLut_init_camclip_surf(
+icxLuLut *p) {
+	icxCamSurf *cs;
+	lutgamctx cx;
+	double lchw[3] = { 1.0, 1.0, 1.0 };
+	double max[3], (*tpts)[3];
+	int *tbix = NULL, nb, np, i, f, ix[3];
+
+#ifdef USELCHWEIGHT
+	lchw[0] = JCCWEIGHT;
+	lchw[1] = CCCWEIGHT;
+	lchw[2] = HCCWEIGHT;
+#endif
+
+	if (p->cclutTable == NULL && icxLuLut_init_clut_camclip(p) != 0)
+		return 1;
+
+	if ((cs = p->camsurf = (icxCamSurf *)calloc(1, sizeof(icxCamSurf))) == NULL)
+		return 1;
+
+	if ((cs->g = new_gamut(CAMSURFRES, 1, 0)) == NULL)
+		return 1;
+
+	cx.g = cs->g;
+	cx.x = p;
+	cx.flu = NULL;
+
+	p->cclutTable->scan_rspl(
+		p->cclutTable,		/* this */
+		RSPL_NOFLAGS,		/* Combination of flags */
+		(void *)&cx,		/* Opaque function context */
+		camclipgam_func		/* Function to set from */
+	);
+
+	/* Stratified sample the gamut surface */
+	np = cs->g->nverts(cs->g);
+	if (np <= 0)
+		return 1;
+	np = cs->g->nssverts(cs->g, CAMSURFNP/(double)np);
+	if ((tpts = (double (*)[3])malloc(sizeof(double) * 3 * np)) == NULL)
+		return 1;
+	for (i = 0, ix[0] = 0; i < np; i++) {
+		if ((ix[0] = cs->g->getssvert(cs->g, NULL, tpts[i], NULL, ix[0])) < 0)
+			break;
+	}
+	np = i;
+
+	/* Setup the bucket grid to cover the points */
+	for (f = 0; f < 3; f++) {
+		cs->min[f] = 1e300;
+		max[f] = -1e300;
+	}
+	for (i = 0; i < np; i++) {
+		for (f = 0; f < 3; f++) {
+			if (tpts[i][f] < cs->min[f])
+				cs->min[f] = tpts[i][f];
+			if (tpts[i][f] > max[f])
+				max[f] = tpts[i][f];
+		}
+	}
+	cs->res = CAMSURFBRES;
+	for (cs->cw = 0.0, f = 0; f < 3; f++) {
+		if ((max[f] - cs->min[f]) > cs->cw)
+			cs->cw = max[f] - cs->min[f];
+	}
+	cs->cw = (cs->cw + 1e-6)/cs->res;
+
+	/* Sort the points into buckets */
+	nb = cs->res * cs->res * cs->res;
+	if ((cs->bst = (int *)calloc(nb+1, sizeof(int))) == NULL
+	 || (tbix = (int *)malloc(sizeof(int) * np)) == NULL
+	 || (cs->pts = (double (*)[3])malloc(sizeof(double) * 3 * np)) == NULL) {
+		free(tbix);
+		free(tpts);
+		return 1;
+	}
+	for (i = 0; i < np; i++) {
+		camsurf_bix(cs, ix, tpts[i]);
+		tbix[i] = (ix[0] * cs->res + ix[1]) * cs->res + ix[2];
+		cs->bst[tbix[i]+1]++;
+	}
+	for (i = 0; i < nb; i++)
+		cs->bst[i+1] += cs->bst[i];
+	for (i = 0; i < np; i++) {
+		int j = cs->bst[tbix[i]]++;
+		icmCpy3(cs->pts[j], tpts[i]);
+	}
+	for (i = nb; i > 0; i--)		/* Restore bucket start indexes */
+		cs->bst[i] = cs->bst[i-1];
+	cs->bst[0] = 0;
+	cs->np = np;
+	free(tbix);
+	free(tpts);
+
+	for (cs->mw_sq = 1e300, f = 0; f < 3; f++) {
+		cs->lchw_sq[f] = lchw[f] * lchw[f];
+		if (cs->lchw_sq[f] < cs->mw_sq)
+			cs->mw_sq = cs->lchw_sq[f];
+	}
+
+	/* Do a radial lookup now, so that the gamut creates its */
+	/* lookup acceleration structure before any lookups are made. */
+	cs->g->getcent(cs->g, max);
+	cs->g->nradial(cs->g, NULL, max);
+
+	return 0;
+}
+
+/* If the output' target value is well outside the CAM gamut surface, */
+/* return in cin[] the output' value of the nearest point on the */
+/* surface, moved slightly inside it, set the Jab clip distance */
+/* in cdist, and return nz. Return 0 if the target is in gamut or */
+/* close to the surface, and should be handled by the normal lookup. */
+static int icxLuLut_camclip_surf(
+icxLuLut *p,
+double *cin,		/* Return clipped output' value */
+double *cdist,		/* Return Jab clip distance */
+double *in			/* Target output' value */
+) {
+	icxCamSurf *cs;
+	double jab[3], cjab[3], cent[3], best, dist, ll, sf;
+	int ix[3], k, f;
+
+	if ((cs = p->camsurf) == NULL)	/* Not created, so use the normal clip */
+		return 0;
+
+	/* Convert from PCS' to Jab, as per the CAM clip */
+	p->absxyzlu->output_pch_fwd(p->absxyzlu, jab, in);
+	p->absxyzlu->output_fmt_fwd(p->absxyzlu, jab, jab);
+	p->cam->XYZ_to_cam(p->cam, jab, jab);
+
+	if (cs->g->nradial(cs->g, NULL, jab) <= 1.0)
+		return 0;				/* Within gamut */
+
+	/* Search shells of buckets outwards from the target's bucket for */
+	/* the nearest weighted point, until the rest must be further away. */
+	camsurf_bix(cs, ix, jab);
+	best = 1e300;
+	for (k = 0; k < cs->res; k++) {
+		int i0, i1, i2;
+		double lb = (k - 1) * cs->cw;	/* Lower bound on shell distance */
+
+		if (k > 1 && (cs->mw_sq * lb * lb) > best)
+			break;
+
+		for (i0 = ix[0] - k; i0 <= ix[0] + k; i0++) {
+			if (i0 < 0 || i0 >= cs->res)
+				continue;
+			for (i1 = ix[1] - k; i1 <= ix[1] + k; i1++) {
+				int st;
+				if (i1 < 0 || i1 >= cs->res)
+					continue;
+				/* Only visit the shell faces */
+				if (k == 0 || abs(i0 - ix[0]) == k || abs(i1 - ix[1]) == k)
+					st = 1;
+				else
+					st = 2 * k;
+				for (i2 = ix[2] - k; i2 <= ix[2] + k; i2 += st) {
+					int bi, i;
+					if (i2 < 0 || i2 >= cs->res)
+						continue;
+					bi = (i0 * cs->res + i1) * cs->res + i2;
+					for (i = cs->bst[bi]; i < cs->bst[bi+1]; i++) {
+						double rr = camsurf_lchw_sq(cs, jab, cs->pts[i]);
+						if (rr < best) {
+							best = rr;
+							icmCpy3(cjab, cs->pts[i]);
+						}
+					}
+				}
+			}
+		}
+	}
+	if (best >= 1e300)
+		return 0;				/* Hmm. */
+
+	for (dist = 0.0, f = 0; f < 3; f++) {
+		double tt = jab[f] - cjab[f];
+		dist += tt * tt;
+	}
+	dist = sqrt(dist);
+
+	/* Leave values close to the surface to the blended PCS/CAM clip */
+	if (dist < CAMSURFMIN)
+		return 0;
+
+	/* Move the clip point just inside the surface, so that it will */
+	/* have an exact inverse. The surface is only approximate, so */
+	/* move further in if it doesn't. */
+	cs->g->getcent(cs->g, cent);
+	ll = icmNorm33(cent, cjab);
+	for (k = 0, sf = CAMSURFIN; k < CAMSURFITS; k++, sf *= 4.0) {
+		double tjab[3];
+		co pp;
+
+		if (sf > ll)
+			sf = ll;
+		for (f = 0; f < 3; f++)
+			tjab[f] = cjab[f] + (cent[f] - cjab[f]) * sf/ll;
+
+		/* Convert from Jab back to PCS' */
+		p->cam->cam_to_XYZ(p->cam, cin, tjab);
+		p->absxyzlu->output_fmt_bwd(p->absxyzlu, cin, cin);
+		p->absxyzlu->output_pch_bwd(p->absxyzlu, cin, cin);
+
+		/* See if there is an exact inverse */
+		icmCpy3(pp.v, cin);
+		if (p->clutTable->di > p->clutTable->fdi) {
+			double min[MXDI], max[MXDI];
+			if (p->clutTable->rev_locus(p->clutTable, p->auxm, &pp, min, max) != 0)
+				break;
+		} else {
+			if ((p->clutTable->rev_interp(p->clutTable, 0, 1, NULL, NULL, &pp)
+			                                              & RSPL_NOSOLNS) != 0)
+				break;
+		}
+	}
+
+	if (k >= CAMSURFITS)
+		return 0;				/* No exact inverse, so use the normal clip */
+
+	*cdist = dist;
+
+	return 1;
+}
+
+#endif /* USECAMCLIPSURF */
+
 /* Given an xicc lookup object, return a gamut object. */
 /* Note that the PCS must be Lab or Jab */
 /* An icxLuLut type must be icmFwd or icmBwd, */
@@ -27,7 +27,7 @@
  *
  *		Should allow for offset in curves - this will greatly improve
  *		profile quality on non-calibrated displays. See spectro/dispcal.c
- *		spectro/moncurve.c. Use conjgrad() instead of powell() to speed things up.
+ *		spectro/moncurve.c.
  *      Note that if curves have scale, the scale will have to be
  *      normalized back to zero by scaling the matrix before storing
  *      the result in the ICC profile.
@@ -54,6 +54,10 @@
 
 #define XSHAPE_GAMTHR	   0.01		/* Input threshold for linear slope below gamma power */
 
+#define USELEVMARQ				/* Use Levenberg-Marquardt rather than powell */
+#define MXLM_DEL		   1e-6		/* Parameter delta for Jacobian */
+#define MXLM_CLIPW		   1000.0	/* White/black and primary clip residual weight */
+
 #undef DEBUG			/* [und] Extra printfs */
 #undef DEBUG_PLOT		/* [und] Plot curves */
 #undef DEBUG_SPEC 		/* [und] Debug some specific cases */
@@ -473,6 +477,7 @@ typedef struct {
 } mxinctx;
 
 #define NPARMS (9 + 6 + 3 * MXNORDERS)
+#define MXLM_NREG (6 + 3 * MXNORDERS + 4 + 9)	/* Maximum shaper & clip residuals */
 
 /* Context for optimising matrix */
 typedef struct {
@@ -506,6 +511,10 @@ typedef struct {
 	icmXYZNumber wp;		/* Assumed white point for Lab conversion */
 	cow *points;			/* List of test points as dev->Lab */
 	int nodp;				/* Number of data points */
+#ifdef USELEVMARQ
+	double *lmr;			/* levmarq() residuals of the current test point or block */
+	double **lmj;			/* and their Jacobian rows */
+#endif
 } mxopt;
 
 /* Per chanel function being optimised */
@@ -806,6 +815,208 @@ static void mxprogfunc(void *pdata, int perc) {
 	}
 }
 
+#ifdef USELEVMARQ
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Levenberg-Marquardt residuals & Jacobian. These are the same */
+/* error terms as mxoptfunc(), expressed as a sum of squares. */
+
+/* Compute the three weighted delta E component residuals of a test point */
+static void mxpatchres(mxopt *p, double *v, double *r, cow *pt) {
+	double xyz[3], lab[3];
+	double sw = sqrt(pt->w/(double)p->nodp);
+
+	mxmfunc(p, v, xyz, pt->p);
+	icmXYZ2Lab(&p->wp, lab, xyz);
+
+#ifdef USE_CIE94_DE
+	{
+		double dl, dc, dhsq, c1, c2, c12;
+
+		dl = lab[0] - pt->v[0];
+		c1 = sqrt(lab[1] * lab[1] + lab[2] * lab[2]);
+		c2 = sqrt(pt->v[1] * pt->v[1] + pt->v[2] * pt->v[2]);
+		c12 = sqrt(c1 * c2);		/* Symetric chromanance */
+		dc = c1 - c2;
+		dhsq = (lab[1] - pt->v[1]) * (lab[1] - pt->v[1])
+		     + (lab[2] - pt->v[2]) * (lab[2] - pt->v[2]) - dc * dc;
+		if (dhsq < 0.0)
+			dhsq = 0.0;
+
+		r[0] = sw * dl;
+		r[1] = sw * dc/(1.0 + 0.045 * c12);
+		r[2] = sw * sqrt(dhsq)/(1.0 + 0.015 * c12);
+
+		/* Give delta hue the sign of the hue angle difference */
+		if ((lab[1] * pt->v[2] - lab[2] * pt->v[1]) < 0.0)
+			r[2] = -r[2];
+	}
+#else
+	r[0] = sw * (lab[0] - pt->v[0]);
+	r[1] = sw * (lab[1] - pt->v[1]);
+	r[2] = sw * (lab[2] - pt->v[2]);
+#endif
+}
+
+/* Compute the shaper parameter and clip penalty residuals. */
+/* Return the number of residuals. (r may be NULL to just get the count) */
+static int mxregres(mxopt *p, double *v, double *r) {
+	double w, xyz[3], tp[3];
+	int f, g, nr = 0;
+
+	if (!p->isGamma) {
+		int nch = p->isShTRC ? 1 : 3;		/* Number of channels */
+		double sc = p->isShTRC ? XSHAPE_MAG : XSHAPE_MAG/3.0;
+
+		/* Input & output offset values */
+		if (p->shape0gam)
+			w = XSHAPE_OFFG;
+		else
+			w = XSHAPE_OFFS;
+		for (g = 0; g < (2 * nch); g++, nr++) {
+			if (r != NULL)
+				r[nr] = sqrt(sc * w) * v[9 + g];
+		}
+
+		/* Shaper values */
+		for (f = 0; f < p->norders; f++) {
+			/* Weigh to suppress ripples */
+			if (f <= 1) {
+				w = XSHAPE_HW01;
+			} else if (f <= XSHAPE_HBREAK) {
+				double bl = (f - 1.0)/(XSHAPE_HBREAK - 1.0);
+				w = (1.0 - bl) * XSHAPE_HW01 + bl * XSHAPE_HWBR * p->smooth;
+			} else {
+				w = XSHAPE_HWBR + (f-XSHAPE_HBREAK) * XSHAPE_HWINC * p->smooth;
+			}
+			for (g = 0; g < nch; g++, nr++) {
+				if (r != NULL) {
+					double tt = v[9 + 2 * nch + nch * f + g];
+					if (f == 0 && p->shape0gam)
+						tt -= 1.0;			/* default is linear */
+					r[nr] = sqrt(sc * w) * tt;
+				}
+			}
+		}
+	}
+
+	/* Penalize if we have white > 1 or -ve black */ 
+	if (p->clipbw) {
+		if (r != NULL) {
+			tp[0] = tp[1] = tp[2] = 1.0;
+			mxmfunc(p, v, xyz, tp);
+			r[nr] = xyz[1] > 1.0 ? MXLM_CLIPW * (xyz[1] - 1.0) : 0.0;
+		}
+		nr++;
+		if (r != NULL) {
+			tp[0] = tp[1] = tp[2] = 0.0;
+			mxmfunc(p, v, xyz, tp);
+		}
+		for (g = 0; g < 3; g++, nr++) {
+			if (r != NULL)
+				r[nr] = xyz[g] < 0.0 ? -MXLM_CLIPW * xyz[g] : 0.0;
+		}
+	}
+
+	/* Penalize if we have -ve primaries */
+	if (p->clipprims) {
+		for (g = 0; g < 9; g++, nr++) {
+			if (r != NULL)
+				r[nr] = v[g] < 0.0 ? -MXLM_CLIPW * v[g] : 0.0;
+		}
+	}
+
+	return nr;
+}
+
+/* Compact a forward differenced Jacobian row into its non-zero entries */
+static int mxjrow(mxopt *p, double *jr, double jv[], int jx[]) {
+	int j, n;
+
+	for (n = j = 0; j < p->optdim; j++) {
+		if (jr[j] != 0.0) {
+			jv[n] = jr[j];
+			jx[n++] = j;
+		}
+	}
+	return n;
+}
+
+/* Matrix residual and Jacobian row function handed to levmarq(). */
+/* Rows come in order, so the three residuals of each test point */
+/* and the block of shaper & clip residuals are computed on their first */
+/* row and served from p->lmr[] and p->lmj[] for the rest. */
+static double mxrjfunc(void *edata, int k, double jv[], int jx[], int *nz, double *v) {
+	mxopt *p = (mxopt *)edata;
+	double tv[NPARMS], tr[MXLM_NREG];
+	int i, j, nreg;
+
+	if (k < 3 * p->nodp) {		/* Test point residuals */
+		cow *pt = &p->points[k/3];
+
+		if ((k % 3) == 0) {
+			mxpatchres(p, v, p->lmr, pt);
+
+			if (jv != NULL) {	/* Forward difference Jacobian rows */
+				for (j = 0; j < p->optdim; j++)
+					tv[j] = v[j];
+				for (j = 0; j < p->optdim; j++) {
+					tv[j] += MXLM_DEL;
+					mxpatchres(p, tv, tr, pt);
+					tv[j] = v[j];
+					for (i = 0; i < 3; i++)
+						p->lmj[i][j] = (tr[i] - p->lmr[i])/MXLM_DEL;
+				}
+			}
+		}
+		k %= 3;
+
+	} else {					/* Shaper and clip residuals */
+		k -= 3 * p->nodp;
+
+		if (k == 0) {
+			nreg = mxregres(p, v, p->lmr);
+
+			if (jv != NULL) {
+				for (j = 0; j < p->optdim; j++)
+					tv[j] = v[j];
+				for (j = 0; j < p->optdim; j++) {
+					tv[j] += MXLM_DEL;
+					mxregres(p, tv, tr);
+					tv[j] = v[j];
+					for (i = 0; i < nreg; i++)
+						p->lmj[i][j] = (tr[i] - p->lmr[i])/MXLM_DEL;
+				}
+			}
+		}
+	}
+
+	if (jv != NULL)
+		*nz = mxjrow(p, p->lmj[k], jv, jx);
+	return p->lmr[k];
+}
+#endif /* USELEVMARQ */
+
+/* Optimise the current os->optdim parameters. */
+/* Return nz if it failed to converge. */
+static int mxfit(mxopt *os, double *rerr, double stopon, int maxits) {
+#ifdef USELEVMARQ
+	int rv;
+
+	os->lmr = dvector(0, MXLM_NREG-1);
+	os->lmj = dmatrix(0, MXLM_NREG-1, 0, NPARMS-1);
+
+	rv = levmarq(rerr, os->optdim, 3 * os->nodp + mxregres(os, os->v, NULL), os->v,
+	               stopon, maxits, mxrjfunc, (void *)os, mxprogfunc, (void *)os);
+
+	free_dmatrix(os->lmj, 0, MXLM_NREG-1, 0, NPARMS-1);
+	free_dvector(os->lmr, 0, MXLM_NREG-1);
+	return rv;
+#else
+	return powell(rerr, os->optdim, os->v, os->sa, stopon, maxits,
+	              mxoptfunc, (void *)os, mxprogfunc, (void *)os);
+#endif
+}
+
 
 /* Given a correction matrix, transform the matrix values */
 static void mxtransform(mxopt *os, double mat[3][3]) { 
@@ -1008,9 +1219,8 @@ double scale		/* Scale device values */
 	if (os->verb)
 		printf("Creating matrix...\n"); 
 
-	if (powell(&rerr, os->optdim, os->v, os->sa, stopon, maxits,
-	           mxoptfunc, (void *)os, mxprogfunc, (void *)os) != 0)
-		warning("Powell failed to converge, residual error = %f",rerr);
+	if (mxfit(os, &rerr, stopon, maxits) != 0)
+		warning("Matrix fit failed to converge, residual error = %f",rerr);
 
 #ifndef NEVER
 	if (os->verb) {
@@ -1039,9 +1249,8 @@ double scale		/* Scale device values */
 		if (os->verb)
 			printf("Creating matrix and single gamma curve...\n"); 
 
-		if (powell(&rerr, os->optdim, os->v, os->sa, stopon, maxits,
-		           mxoptfunc, (void *)os, mxprogfunc, (void *)os) != 0)
-			warning("Powell failed to converge, residual error = %f",rerr);
+		if (mxfit(os, &rerr, stopon, maxits) != 0)
+			warning("Matrix fit failed to converge, residual error = %f",rerr);
 
 		scgamma = os->v[9];
 		if (isShTRC && !isGamma) {
@@ -1077,9 +1286,8 @@ double scale		/* Scale device values */
 			if (os->verb)
 				printf("Creating matrix and single shaper curve...\n"); 
 
-			if (powell(&rerr, os->optdim, os->v, os->sa, stopon, maxits,
-			           mxoptfunc, (void *)os, mxprogfunc, (void *)os) != 0)
-				warning("Powell failed to converge, residual error = %f",rerr);
+			if (mxfit(os, &rerr, stopon, maxits) != 0)
+				warning("Matrix fit failed to converge, residual error = %f",rerr);
 
 			scgamma = os->v[9];
 
@@ -1112,9 +1320,8 @@ double scale		/* Scale device values */
 			if (os->verb)
 				printf("Creating matrix and gamma curves...\n"); 
 	
-			if (powell(&rerr, os->optdim, os->v, os->sa, stopon, maxits,
-			           mxoptfunc, (void *)os, mxprogfunc, (void *)os) != 0)
-				warning("Powell failed to converge, residual error = %f",rerr);
+			if (mxfit(os, &rerr, stopon, maxits) != 0)
+				warning("Matrix fit failed to converge, residual error = %f",rerr);
 
 		
 			mcgamma[0] = os->v[9];
@@ -1156,9 +1363,8 @@ double scale		/* Scale device values */
 					printf("Creating matrix and curves...\n"); 
 		
 //g_deb = 1;
-				if (powell(&rerr, os->optdim, os->v, os->sa, stopon, maxits,
-				           mxoptfunc, (void *)os, mxprogfunc, (void *)os) != 0)
-					warning("Powell failed to converge, residual error = %f",rerr);
+				if (mxfit(os, &rerr, stopon, maxits) != 0)
+					warning("Matrix fit failed to converge, residual error = %f",rerr);
 			}
 		}
 	}
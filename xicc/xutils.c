@@ -101,6 +101,21 @@ static void jpeg_error(j_common_ptr cinfo) {
 
 /* ------------------------------------------------------ */
 
+/* Return nz if the file has the ICC profile header magic number */
+static int is_icc_file(char *file_name) {
+	FILE *fp;
+	unsigned char hdr[40];
+	int rv = 0;
+
+	if ((fp = fopen(file_name, "rb")) == NULL)
+		return 0;
+	if (fread(hdr, 1, 40, fp) == 40
+	 && hdr[36] == 'a' && hdr[37] == 'c' && hdr[38] == 's' && hdr[39] == 'p')
+		rv = 1;
+	fclose(fp);
+	return rv;
+}
+
 /* Open an ICC file or a TIFF or JPEG  file with an embedded ICC profile for reading. */
 /* Return NULL on error */
 icc *read_embedded_icc(char *file_name) {
@@ -115,8 +130,13 @@ icc *read_embedded_icc(char *file_name) {
 	TIFFErrorHandlerExt olderrhx, oldwarnhx;
 	int rv;
 
-	/* First see if the file can be opened as an ICC profile */
-	if ((fp = new_icmFileStd_name(&err, file_name,"r")) == NULL) {
+	/* First see if the file can be opened as an ICC profile. */
+	/* Only map it if it looks like one, rather than a whole TIFF or JPEG. */
+	if (is_icc_file(file_name))
+		fp = new_icmFileMMap_name(&err, file_name);
+	else
+		fp = new_icmFileStd_name(&err, file_name, "r");
+	if (fp == NULL) {
 		debug2((errout,"Can't open file '%s' (0x%x, '%s')\n",file_name,err.c,err.m));
 		return NULL;
 	}